@@ -0,0 +1,231 @@
+/**
+ * @file alamak_top.cpp
+ * @brief Module alamak_top
+ *
+ * This program displays live metrics of running cars published by -metrics option
+ * of demo_car_runner or demo_car_gamepad (\ref metrics.h), like top displays processes.
+ * It maps the shared memory read only, so it never slows down or blocks the control loops,
+ * and it can be started and stopped at any time. The rates are computed from differences
+ * of counters between two refreshes divided by the difference of publish times, so they do not
+ * depend on the refresh period of this program. The percentiles are taken from the last window of publisher.
+ * When the publisher exits or it is restarted, the program waits for the new page.
+ *
+ * The values can be exported to CSV file, one line per car and refresh.
+ *
+ * For more information see header files or use doxygen.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/param.h>
+#include <vector>
+
+#include "metrics.h"
+
+#define HELP                                                                \
+    "Usage: %s [-h] [-interval ms] [-count N] [-csv file] [name]\n"         \
+    "  -h               this help\n"                                        \
+    "  -interval ms     refresh interval (default 1000 ms)\n"               \
+    "  -count N         number of refreshes, 0 unlimited (default 0)\n"     \
+    "  -csv file        append values to CSV file, - for stdout (without table)\n" \
+    "  name             name of shared memory (default " METRICS_DEFAULT_NAME ")\n\n"
+
+/// The car is marked as stale, when it did not publish for this time
+#define TOP_STALE_NS            2000000000LL
+
+/// The state of one car between two refreshes
+struct TopCar
+{
+    bool valid;                         ///< The previous values are known
+    MetricsCarData data;                ///< The values of the previous publish
+    double fps;                         ///< The last computed frame rate
+};
+
+
+/// Current wall time in seconds
+static double topWallTime()
+{
+    timespec l_ts;
+    clock_gettime( CLOCK_REALTIME, &l_ts );
+    return l_ts.tv_sec + l_ts.tv_nsec * 1e-9;
+}
+
+
+/// Print header of CSV file
+static void topCsvHeader( FILE *t_file )
+{
+    fprintf( t_file, "time_s,pid,car,age_ms,frames,frames_per_s,image_errors,timeouts,remote_errors,resets,sim_time_s,"
+             "servo,l_pwm,r_pwm,loop_hz,cycle_p50_us,cycle_p99_us,cycle_p999_us,cycle_max_us,"
+             "wait_p50_us,wait_p99_us,wait_p999_us,wait_max_us,control_p50_us,control_p99_us,control_p999_us,control_max_us\n" );
+}
+
+
+/// Print one line of CSV file
+static void topCsvLine( FILE *t_file, double t_time, long t_pid, int t_car, double t_age_ms, double t_fps, const MetricsCarData &t_data )
+{
+    fprintf( t_file, "%.3f,%ld,%d,%.1f,%llu,%.1f,%llu,%llu,%llu,%llu,%.3f,%.3f,%.3f,%.3f,%.1f",
+             t_time, t_pid, t_car, t_age_ms, ( unsigned long long ) t_data.frames, t_fps,
+             ( unsigned long long ) t_data.image_errors, ( unsigned long long ) t_data.timeouts,
+             ( unsigned long long ) t_data.remote_errors, ( unsigned long long ) t_data.resets,
+             t_data.sim_time, t_data.servo, t_data.l_pwm, t_data.r_pwm, t_data.loop_hz );
+    const MetricsLatency *l_latencies[] = { &t_data.cycle, &t_data.wait, &t_data.control };
+    for ( const MetricsLatency *l_lat : l_latencies )
+        fprintf( t_file, ",%.1f,%.1f,%.1f,%.1f", l_lat->p50_us, l_lat->p99_us, l_lat->p999_us, l_lat->max_us );
+    fprintf( t_file, "\n" );
+}
+
+
+int main( int argc, char* argv[] )
+{
+    int l_interval_ms = 1000;
+    long l_count = 0;
+    const char *l_csv_name = nullptr;
+    const char *l_name = METRICS_DEFAULT_NAME;
+
+    for ( int i = 1; i < argc; i++ )
+    {
+        if ( i + 1 < argc && !strcmp( argv[ i ], "-interval" ) )
+            l_interval_ms = atoi( argv[ ++i ] );
+        else if ( i + 1 < argc && !strcmp( argv[ i ], "-count" ) )
+            l_count = atol( argv[ ++i ] );
+        else if ( i + 1 < argc && !strcmp( argv[ i ], "-csv" ) )
+            l_csv_name = argv[ ++i ];
+        else if ( *argv[ i ] != '-' )
+            l_name = argv[ i ];
+        else
+        {
+            printf( HELP, argv[ 0 ] );
+            exit( 0 );
+        }
+    }
+
+    if ( l_interval_ms < 1 || l_count < 0 )
+    {
+        printf( HELP, argv[ 0 ] );
+        exit( 0 );
+    }
+
+    // the table is not printed, when CSV goes to stdout
+    FILE *l_csv = nullptr;
+    bool l_table = true;
+    if ( l_csv_name && !strcmp( l_csv_name, "-" ) )
+    {
+        l_csv = stdout;
+        l_table = false;
+    }
+    else if ( l_csv_name )
+    {
+        l_csv = fopen( l_csv_name, "a" );
+        if ( !l_csv )
+        {
+            fprintf( stderr, "Unable to open file '%s'!\n", l_csv_name );
+            exit( 1 );
+        }
+    }
+    // the header is written only to a new file
+    if ( l_csv && ( fseek( l_csv, 0, SEEK_END ) < 0 || ftell( l_csv ) <= 0 ) ) topCsvHeader( l_csv );
+    bool l_tty = l_table && isatty( STDOUT_FILENO );
+
+    MetricsReader l_reader;
+    std::vector< TopCar > l_cars( METRICS_MAX_CARS );
+
+    for ( long l_refresh = 0; !l_count || l_refresh < l_count; l_refresh++ )
+    {
+        if ( l_refresh ) usleep( l_interval_ms * 1000 );
+
+        // the page of exited publisher is left, the new publisher creates a new page
+        if ( l_reader.getPage() && !l_reader.isAlive() ) l_reader.close();
+        if ( !l_reader.getPage() )
+        {
+            if ( l_reader.open( l_name ) < 0 || !l_reader.isAlive() )
+            {
+                l_reader.close();
+                if ( l_table )
+                {
+                    if ( l_tty ) printf( "\033[H\033[2J" );
+                    printf( "Waiting for metrics '%s'...\n", l_name );
+                    fflush( stdout );
+                }
+                continue;
+            }
+            for ( TopCar &l_car : l_cars ) l_car.valid = false;
+        }
+
+        const MetricsPage *l_page = l_reader.getPage();
+        long long l_now = latencyNow();
+        double l_wall = topWallTime();
+
+        if ( l_table )
+        {
+            if ( l_tty ) printf( "\033[H\033[2J" );
+            printf( "Metrics '%s', pid %ld, up %.0f s, %u cars\n\n", l_name, ( long ) l_page->pid,
+                    ( l_now - l_page->start_ns ) * 1e-9, l_page->cars );
+            printf( "%4s %8s %8s %6s %6s %6s %6s %6s %6s %6s "
+                    "%8s %8s %8s %8s %8s %8s %8s\n",
+                    "car", "frames/s", "loop_hz", "imgerr", "tmout", "remerr", "resets",
+                    "servo", "l_pwm", "r_pwm",
+                    "cyc_p50", "cyc_p99", "cyc_p999", "cyc_max", "wait_p99", "ctl_p99", "ctl_max" );
+        }
+
+        for ( int i = 0; i < ( int ) l_page->cars; i++ )
+        {
+            MetricsCarData l_data;
+            if ( metricsRead( &l_page->slots[ i ], l_data ) < 0 )
+            {
+                if ( l_table ) printf( "%4d busy\n", i );
+                continue;
+            }
+
+            // the time is taken after the read, the publisher cannot be newer
+            long long l_read_ns = latencyNow();
+
+            // the rate is related to publish times, the counters were written together with them,
+            // the last rate is kept until the car publishes again
+            TopCar &l_car = l_cars[ i ];
+            long long l_dt_ns = l_car.valid && l_car.data.update_ns ? l_data.update_ns - l_car.data.update_ns : 0;
+            if ( !l_car.valid ) l_car.fps = 0;
+            if ( !l_car.valid || l_dt_ns > 0 )
+            {
+                if ( l_dt_ns > 0 ) l_car.fps = ( l_data.frames - l_car.data.frames ) * 1e9 / l_dt_ns;
+                l_car.valid = true;
+                l_car.data = l_data;
+            }
+            double l_fps = l_car.fps;
+
+            bool l_started = l_data.update_ns != 0;
+            double l_age_ms = l_started ? ( l_read_ns - l_data.update_ns ) * 1e-6 : -1;
+
+            if ( l_csv && l_started ) topCsvLine( l_csv, l_wall, ( long ) l_page->pid, i, l_age_ms, l_fps, l_data );
+
+            if ( !l_table ) continue;
+            if ( !l_started )
+            {
+                printf( "%4d not started\n", i );
+                continue;
+            }
+            printf( "%4d %8.1f %8.1f %6llu %6llu %6llu %6llu %6.2f %6.2f %6.2f "
+                    "%8.0f %8.0f %8.0f %8.0f %8.0f %8.0f %8.0f%s\n",
+                    i, l_fps, l_data.loop_hz, ( unsigned long long ) l_data.image_errors,
+                    ( unsigned long long ) l_data.timeouts, ( unsigned long long ) l_data.remote_errors,
+                    ( unsigned long long ) l_data.resets, l_data.servo, l_data.l_pwm, l_data.r_pwm,
+                    l_data.cycle.p50_us, l_data.cycle.p99_us, l_data.cycle.p999_us, l_data.cycle.max_us,
+                    l_data.wait.p99_us, l_data.control.p99_us, l_data.control.max_us,
+                    l_age_ms * 1e6 > TOP_STALE_NS ? " stale" : "" );
+        }
+
+        if ( l_table )
+        {
+            printf( "\nLatencies in microseconds, percentiles of the last %.0f s window.\n", METRICS_WINDOW_NS * 1e-9 );
+            fflush( stdout );
+        }
+        if ( l_csv ) fflush( l_csv );
+    }
+
+    if ( l_csv && l_csv != stdout ) fclose( l_csv );
+
+    return 0;
+}
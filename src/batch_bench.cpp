@@ -0,0 +1,268 @@
+/**
+ * @file batch_bench.cpp
+ * @brief Module batch_bench
+ *
+ * This program measures the throughput of \ref HeadlessBatchT in car steps per second.
+ * At first it verifies that all implementations of step kernel give the same results
+ * and that the batch drives the same trajectories as \ref HeadlessCar.
+ * Then it measures the step kernel alone for every implementation, and the whole control loop
+ * (step, rendering of images and \ref LineController) of all cars split to batches, one batch per thread.
+ *
+ * For more information see header files or use doxygen.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/param.h>
+#include <vector>
+
+#include "headless_batch.h"
+#include "track_map.h"
+#include "latency.h"
+
+#define HELP                                                                \
+    "Usage: %s [-h] [-cars N] [-threads N] [-steps N] [-track string]\n"    \
+    "  -h               this help\n"                                        \
+    "  -cars N          number of cars (default 1024)\n"                    \
+    "  -threads N       number of threads (default CPU cores)\n"            \
+    "  -steps N         simulation steps of every car (default 2000)\n"     \
+    "  -track string    track definition (default \"S R S L S R S R S S S O R S S O S R\")\n\n"
+
+/// The number of cars compared with HeadlessCar
+#define BENCH_CHECK_CARS        64
+/// The number of steps compared with HeadlessCar
+#define BENCH_CHECK_STEPS       2000
+/// The allowed distance between positions of HeadlessBatch and HeadlessCar
+#define BENCH_CHECK_TOLERANCE_M 0.001
+
+/// The work of one thread
+struct BenchThread
+{
+    pthread_t thread_id;                ///< The thread
+    const TrackMap *track;              ///< The track
+    int cars;                           ///< The number of cars of batch
+    int steps;                          ///< The number of steps
+    long long sim_ns;                   ///< Time of step and rendering
+    long long control_ns;               ///< Time of controllers
+    int on_track;                       ///< The number of cars on track after the last step
+};
+
+
+/// Open loop commands of car in step, they cover steering, acceleration, braking and rolling
+static CarCommands benchCommand( int t_car, int t_step )
+{
+    CarCommands l_cmd;
+    l_cmd.servo = sinf( t_step * 0.01f + t_car );
+    l_cmd.l_pwm = ( t_step / 300 + t_car ) % 4 == 3 ? 0 : 0.2f + 0.8f * sinf( t_step * 0.003f + t_car );
+    l_cmd.r_pwm = l_cmd.l_pwm * ( 1 - 0.2f * l_cmd.servo );
+    return l_cmd;
+}
+
+
+/** @brief Compare all implementations with the scalar one and the batch with HeadlessCar.
+ *
+ * @return The number of errors.
+ */
+static int benchCheck( const TrackMap &t_track )
+{
+    const HeadlessBatchImpl l_impls[] = { HEADLESS_BATCH_SCALAR, HEADLESS_BATCH_SSE2, HEADLESS_BATCH_AVX2 };
+    std::vector< CarCommands > l_cmds( BENCH_CHECK_CARS );
+    HeadlessBatchState l_reference;
+    int l_errors = 0;
+
+    for ( HeadlessBatchImpl l_impl : l_impls )
+    {
+        if ( headlessBatchSetImpl( l_impl ) < 0 ) continue;
+
+        HeadlessBatch l_batch( BENCH_CHECK_CARS, &t_track );
+        std::vector< HeadlessCar > l_cars( BENCH_CHECK_CARS, HeadlessCar( &t_track ) );
+        for ( int k = 0; k < BENCH_CHECK_STEPS; k++ )
+        {
+            for ( int i = 0; i < BENCH_CHECK_CARS; i++ )
+            {
+                l_cmds[ i ] = benchCommand( i, k );
+                l_cars[ i ].setServo( l_cmds[ i ].servo );
+                l_cars[ i ].setMotorPWM( l_cmds[ i ].l_pwm, l_cmds[ i ].r_pwm );
+                l_cars[ i ].getImage( nullptr );
+            }
+            l_batch.setCommands( l_cmds.data() );
+            l_batch.getImages( nullptr );
+        }
+
+        float l_max_dist = 0;
+        for ( int i = 0; i < BENCH_CHECK_CARS; i++ )
+        {
+            CarPose l_pose;
+            l_batch.getPose( i, l_pose );
+            const HeadlessCarState &l_state = l_cars[ i ].getState();
+            l_max_dist = MAX( l_max_dist, hypotf( l_pose.x - l_state.x, l_pose.y - l_state.y ) );
+        }
+
+        // all implementations must give exactly the same state
+        int l_mismatch = 0;
+        if ( l_impl == HEADLESS_BATCH_SCALAR )
+            l_reference = l_batch.getState();
+        else
+            for ( int i = 0; i < BENCH_CHECK_CARS; i++ )
+                if ( l_batch.getState().x[ i ] != l_reference.x[ i ] || l_batch.getState().y[ i ] != l_reference.y[ i ]
+                        || l_batch.getState().hx[ i ] != l_reference.hx[ i ] || l_batch.getState().hy[ i ] != l_reference.hy[ i ]
+                        || l_batch.getState().l_wheel[ i ] != l_reference.l_wheel[ i ] )
+                    l_mismatch++;
+
+        printf( "Check %-8s distance from HeadlessCar %.6f m, mismatches %d\n",
+                headlessBatchImplName( l_impl ), l_max_dist, l_mismatch );
+        l_errors += l_mismatch + ( l_max_dist > BENCH_CHECK_TOLERANCE_M );
+    }
+
+    return l_errors;
+}
+
+
+/// Measure the step kernel alone
+static void benchStep( int t_cars, int t_steps )
+{
+    const HeadlessBatchImpl l_impls[] = { HEADLESS_BATCH_SCALAR, HEADLESS_BATCH_SSE2, HEADLESS_BATCH_AVX2 };
+    std::vector< CarCommands > l_cmds( t_cars );
+    for ( int i = 0; i < t_cars; i++ )
+        l_cmds[ i ] = benchCommand( i, 0 );
+
+    for ( HeadlessBatchImpl l_impl : l_impls )
+    {
+        if ( headlessBatchSetImpl( l_impl ) < 0 )
+        {
+            printf( "Step  %-8s not supported\n", headlessBatchImplName( l_impl ) );
+            continue;
+        }
+
+        HeadlessBatch l_batch( t_cars );
+        l_batch.setCommands( l_cmds.data() );
+
+        long long l_start = latencyNow();
+        for ( int k = 0; k < t_steps; k++ )
+            l_batch.step();
+        long long l_ns = latencyNow() - l_start;
+
+        printf( "Step  %-8s %8.2f ns/car, %8.1f M car steps/s\n", headlessBatchImplName( l_impl ),
+                ( double ) l_ns / ( ( double ) t_cars * t_steps ), ( double ) t_cars * t_steps / l_ns * 1000 );
+    }
+}
+
+
+/// Thread driving one batch of cars
+static void *benchThread( void *t_arg )
+{
+    BenchThread *l_work = ( BenchThread * ) t_arg;
+
+    HeadlessBatch l_batch( l_work->cars, l_work->track );
+    std::vector< LineController > l_controllers( l_work->cars );
+    std::vector< CarCommands > l_cmds( l_work->cars );
+    std::vector< unsigned char > l_imgs( l_work->cars * CAR_CAM_RESOLUTION );
+
+    l_work->sim_ns = 0;
+    l_work->control_ns = 0;
+    for ( int k = 0; k < l_work->steps; k++ )
+    {
+        long long l_start = latencyNow();
+        l_batch.getImages( l_imgs.data() );
+        long long l_rendered = latencyNow();
+
+        for ( int i = 0; i < l_work->cars; i++ )
+            l_controllers[ i ].control( l_imgs.data() + i * CAR_CAM_RESOLUTION, l_cmds[ i ] );
+        l_batch.setCommands( l_cmds.data() );
+
+        l_work->sim_ns += l_rendered - l_start;
+        l_work->control_ns += latencyNow() - l_rendered;
+    }
+
+    l_work->on_track = 0;
+    for ( int i = 0; i < l_work->cars; i++ )
+    {
+        CarPose l_pose;
+        TrackLocation l_loc;
+        l_batch.getPose( i, l_pose );
+        if ( !l_work->track->locate( l_pose.x, l_pose.y, l_loc ) ) l_work->on_track++;
+    }
+
+    return nullptr;
+}
+
+
+/// Measure the whole control loop of all cars in parallel threads
+static void benchLoop( const TrackMap &t_track, int t_cars, int t_threads, int t_steps )
+{
+    t_threads = MIN( t_threads, t_cars );
+    std::vector< BenchThread > l_work( t_threads );
+
+    long long l_start = latencyNow();
+    for ( int t = 0; t < t_threads; t++ )
+    {
+        l_work[ t ].track = &t_track;
+        l_work[ t ].cars = t_cars / t_threads + ( t < t_cars % t_threads );
+        l_work[ t ].steps = t_steps;
+        pthread_create( &l_work[ t ].thread_id, nullptr, benchThread, &l_work[ t ] );
+    }
+
+    long long l_sim_ns = 0, l_control_ns = 0;
+    int l_on_track = 0;
+    for ( int t = 0; t < t_threads; t++ )
+    {
+        pthread_join( l_work[ t ].thread_id, nullptr );
+        l_sim_ns += l_work[ t ].sim_ns;
+        l_control_ns += l_work[ t ].control_ns;
+        l_on_track += l_work[ t ].on_track;
+    }
+    long long l_ns = latencyNow() - l_start;
+
+    double l_car_steps = ( double ) t_cars * t_steps;
+    printf( "Step+render %8.1f ns/car, control %8.1f ns/car\n", l_sim_ns / l_car_steps, l_control_ns / l_car_steps );
+    printf( "Control loop %8.2f M car steps/s, cars on track %d/%d\n", l_car_steps / l_ns * 1000, l_on_track, t_cars );
+}
+
+
+int main( int argc, char* argv[] )
+{
+    int l_cars = 1024;
+    int l_threads = sysconf( _SC_NPROCESSORS_ONLN );
+    int l_steps = 2000;
+    const char *l_track_def = "S R S L S R S R S S S O R S S O S R";
+
+    for ( int i = 1; i < argc; i++ )
+    {
+        if ( i + 1 < argc && !strcmp( argv[ i ], "-cars" ) )
+            l_cars = atoi( argv[ ++i ] );
+        else if ( i + 1 < argc && !strcmp( argv[ i ], "-threads" ) )
+            l_threads = atoi( argv[ ++i ] );
+        else if ( i + 1 < argc && !strcmp( argv[ i ], "-steps" ) )
+            l_steps = atoi( argv[ ++i ] );
+        else if ( i + 1 < argc && !strcmp( argv[ i ], "-track" ) )
+            l_track_def = argv[ ++i ];
+        else
+        {
+            printf( HELP, argv[ 0 ] );
+            exit( 0 );
+        }
+    }
+
+    if ( l_cars < 1 || l_threads < 1 || l_steps < 1 )
+    {
+        printf( HELP, argv[ 0 ] );
+        exit( 0 );
+    }
+
+    TrackMap l_track;
+    if ( l_track.compile( l_track_def ) < 0 ) exit( 1 );
+
+    int l_errors = benchCheck( l_track );
+    benchStep( l_cars, l_steps );
+
+    headlessBatchSetImpl( HEADLESS_BATCH_AUTO );
+    printf( "Selected implementation: %s, %d cars, %d threads\n",
+            headlessBatchImplName( headlessBatchGetImpl() ), l_cars, l_threads );
+    benchLoop( l_track, l_cars, l_threads, l_steps );
+
+    return l_errors ? 1 : 0;
+}
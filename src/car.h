@@ -0,0 +1,246 @@
+#pragma once
+
+/**
+ * @file car.h
+ * @brief Module car
+ *
+ * This module car defines the common interface of all car backends and the parameters of the Alamak model.
+ */
+
+#include <math.h>
+#include <array>
+
+/**
+ * @brief Compile-time geometry of line camera (vision sensor).
+ *
+ * The car backends and the vision code are templates over this geometry, so the buffers
+ * are statically sized and the loops over pixels have constant bounds for every camera.
+ * The lines of multi-line camera are stored one after another, the line 0 is the nearest one.
+ *
+ * @tparam t_resolution The number of pixels of one line, multiple of 32 (see \ref linedetect.h).
+ * @tparam t_lines The number of lines captured at once.
+ */
+template< int t_resolution, int t_lines = 1 >
+struct CarCamera
+{
+    static_assert( t_resolution > 0 && t_resolution % 32 == 0, "Camera resolution must be multiple of 32" );
+    static_assert( t_lines > 0, "Camera must have at least one line" );
+
+    static constexpr int resolution = t_resolution;     ///< Pixels of one line
+    static constexpr int lines = t_lines;               ///< Number of lines
+    static constexpr int pixels = t_resolution * t_lines; ///< Size of image
+
+    /// Buffer for the whole image
+    typedef std::array< unsigned char, pixels > Image;
+
+    /// The first pixel of line in image
+    static unsigned char *line( unsigned char *t_img, int t_line ) { return t_img + t_line * t_resolution; }
+    /// The first pixel of line in image
+    static const unsigned char *line( const unsigned char *t_img, int t_line ) { return t_img + t_line * t_resolution; }
+};
+
+/// The supported cameras, the car backends are compiled for all of them
+/// @name
+/// @{
+typedef CarCamera< 128 >                CarCameraLine128;
+typedef CarCamera< 256 >                CarCameraLine256;
+typedef CarCamera< 128, 2 >             CarCameraDual128;
+/// @}
+
+/// The camera of \ref Car used by all programs; telemetry, replay and remote server use its geometry.
+typedef CarCameraLine128                CarDefaultCamera;
+static_assert( CarDefaultCamera::lines == 1, "The default camera must have one line" );
+
+/// Line camera (vision sensor) resolution of the default camera.
+#define CAR_CAM_RESOLUTION              ( CarDefaultCamera::resolution )
+
+/// Rotation of 5th (a virtual front) steering wheel in degrees
+#define CAR_5TH_WHEEL_ANGLE_DEG         30
+/// Rotation of 5th wheel in RAD
+#define CAR_5TH_WHEEL_ANGLE_RAD         ( CAR_5TH_WHEEL_ANGLE_DEG * M_PI / 180 )
+
+/// The Alamak wheel diameter
+#define CAR_WHEEL_DIAMETER_M           0.064
+/// The limit of car speed in meters per seconds
+#define CAR_MAX_SPEED_M_S               1.2
+/// The car speed recalculated to rotation speed
+#define CAR_MAX_SPEED_DEG_S             ( ( CAR_MAX_SPEED_M_S / ( CAR_WHEEL_DIAMETER_M * M_PI ) ) * 360 )
+
+/// The real torque on a rear wheels.
+#define CAR_MAX_REAL_TORQUE_N_M         0.1
+/// Reduced torque for model, the real torque is too high
+#define CAR_MAX_TORQUE_N_M              ( CAR_MAX_REAL_TORQUE_N_M / 3 )
+
+/// The distance between front and rear axle of the Alamak
+#define CAR_WHEELBASE_M                 0.175
+/// The weight of the Alamak including battery
+#define CAR_MASS_KG                     1.0
+
+/// The return value of \ref CarT::restoreSnapshot, when the backend does not restore the velocity of car
+#define CAR_SNAPSHOT_NO_VELOCITY        1
+
+/**
+ * @brief The pose and odometry of car body.
+ *
+ * The position is in the coordinates of the backend: the scene of CoppeliaSim
+ * or the track of headless model (see \ref HeadlessTrack::startPose).
+ * The wheel angles are wrapped to <-PI, PI>, the rotation between two poses
+ * is recovered by \ref carWheelDelta.
+ */
+struct CarPose
+{
+    double time;                        ///< Simulation time of pose in seconds.
+    float x;                            ///< Position of car body.
+    float y;                            ///< Position of car body.
+    float z;                            ///< Position of car body (height).
+    float roll;                         ///< Orientation of car body in RAD.
+    float pitch;                        ///< Orientation of car body in RAD.
+    float yaw;                          ///< Heading of car in RAD.
+    float vx;                           ///< Velocity of car body in m/s.
+    float vy;                           ///< Velocity of car body in m/s.
+    float vz;                           ///< Velocity of car body in m/s.
+    float yaw_rate;                     ///< Angular velocity around vertical axis in RAD/s.
+    float l_wheel;                      ///< Angle of left rear wheel in RAD, positive forward.
+    float r_wheel;                      ///< Angle of right rear wheel in RAD, positive forward.
+};
+
+/**
+ * @brief The state of car saved by \ref CarT::saveSnapshot and restored by \ref CarT::restoreSnapshot.
+ *
+ * The snapshot belongs to the backend which saved it, the poses of different backends are not compatible.
+ * The simulation time (pose.time) is informational only, the time is never moved back by restore.
+ */
+struct CarSnapshot
+{
+    CarPose pose;                       ///< Pose, velocity and angles of rear wheels.
+    float steer;                        ///< Current angle of the 5th wheel in RAD.
+    float l_speed;                      ///< Speed of left rear wheel on ground in m/s.
+    float r_speed;                      ///< Speed of right rear wheel on ground in m/s.
+    float servo_angle;                  ///< Requested angle of the 5th wheel in RAD, see \ref CarT::setServo.
+    float l_torque;                     ///< Requested torque of left motor in N.m, see \ref CarT::setMotorPWM.
+    float r_torque;                     ///< Requested torque of right motor in N.m, see \ref CarT::setMotorPWM.
+};
+
+/**
+ * @brief Counters of failures of car backend, see \ref CarT::getFaults.
+ *
+ * The counters only grow, they are not cleared by \ref CarT::resetCar.
+ */
+struct CarFaults
+{
+    unsigned long timeouts;             ///< Images not delivered by \ref CarT::getImage in time.
+    unsigned long remote_errors;        ///< Failed calls of backend (e.g. Remote API of CoppeliaSim).
+};
+
+/** @brief Rotation of wheel between two wrapped angles.
+ *
+ * The wheel must turn less than a half of revolution between two poses.
+ */
+inline float carWheelDelta( float t_from, float t_to )
+{
+    return remainderf( t_to - t_from, 2 * M_PI );
+}
+
+/**
+ * @brief The common interface of car backends.
+ *
+ * The interface offers the same functions as can be expected in microcomputer of a real car:
+ * power control of DC motors, set position of steering servo and capture image from line camera.
+ * The control program written against this interface can drive the car model in CoppeliaSim
+ * (\ref CoppeliaSimCar) or the headless model (\ref HeadlessCar) without any change.
+ *
+ * @tparam t_camera The geometry of line camera, see \ref CarCamera.
+ */
+template< class t_camera >
+class CarT
+{
+public:
+
+    typedef t_camera Camera;            ///< Geometry of line camera
+    typedef typename t_camera::Image Image; ///< Buffer for the whole image
+
+    /** Destructor */
+    virtual ~CarT() {}
+
+    /** @brief Capture single image from line camera.
+     *
+     * @param t_img Buffer for 8bit B&W image from line camera of length t_camera::pixels (see \ref Image).
+     * It can be nullptr when the image is used only for synchronization.
+     * @return When an image is captured correctly, it returns 0. Otherwise -1.
+     */
+    virtual int getImage( unsigned char *t_img ) = 0;
+
+    /** @brief Set servo position.
+     *
+     * @param t_position The position of servo is represented by value of range <-1.0, 1.0>.
+     * According to right-hand rule the value 1.0 is turning to the left and -1.0 to the right.
+     */
+    virtual void setServo( float t_position ) = 0;
+
+    /** @brief Set power of motors.
+     *
+     * The power is represented by values of range <-1.0, 1.0>.
+     * The positive value is to move forward and negative value to move backward.
+     */
+    virtual void setMotorPWM( float t_l_pwm, float t_r_pwm ) = 0;
+
+    /** @brief Move car back to starting position.
+     */
+    virtual void resetCar() = 0;
+
+    /** @brief Start a batch of commands, see \ref commit.
+     */
+    virtual void beginCommands() {}
+
+    /** @brief Apply all commands since \ref beginCommands together.
+     *
+     * @return When the commands were applied correctly, it returns 0. Otherwise -1.
+     */
+    virtual int commit() { return 0; }
+
+    /** @brief Get file descriptor for an event loop, readable when \ref getImage would not wait.
+     *
+     * @return The file descriptor owned by the car, or -1 when \ref getImage does not wait
+     * for any external event (e.g. the headless model or the synchronous mode).
+     */
+    virtual int getFrameFd() { return -1; }
+
+    /** @brief Get simulation time of the last image in seconds.
+     *
+     * @return The simulation time, 0 when it is not known.
+     */
+    virtual double getSimTime() { return 0; }
+
+    /** @brief Get the last known pose of car body, see \ref CarPose.
+     *
+     * The pose is never waited for, the backend returns the last received values.
+     * @return When the pose is available, it returns 0. Otherwise (or when the backend has no pose) -1.
+     */
+    virtual int getPose( CarPose &t_pose ) { return -1; }
+
+    /** @brief Save the current state of car, see \ref CarSnapshot.
+     *
+     * The snapshot is taken from the last known values, it never waits for the backend.
+     * @return When the state is available, it returns 0. Otherwise (or when the backend has no snapshots) -1.
+     */
+    virtual int saveSnapshot( CarSnapshot &t_snapshot ) { return -1; }
+
+    /** @brief Move car to the state saved by \ref saveSnapshot.
+     *
+     * Unlike \ref resetCar the restore does not wait for the backend, the state is applied
+     * before the next simulation step. A part of state which the backend can not set is noted by the backend.
+     * @return When the restore was issued, it returns 0. When it was issued, but the velocity of car
+     * is not restored, it returns \ref CAR_SNAPSHOT_NO_VELOCITY. Otherwise (or when the backend has no snapshots) -1.
+     */
+    virtual int restoreSnapshot( const CarSnapshot &t_snapshot ) { return -1; }
+
+    /** @brief Get counters of failures of backend, see \ref CarFaults.
+     *
+     * The backend without remote calls (e.g. the headless model) has no failures.
+     */
+    virtual void getFaults( CarFaults &t_faults ) { t_faults.timeouts = 0; t_faults.remote_errors = 0; }
+};
+
+/// The car with the default camera.
+typedef CarT< CarDefaultCamera > Car;
+
@@ -0,0 +1,271 @@
+/**
+ * @file car_bench.cpp
+ * @brief Module car_bench
+ *
+ * This program measures the hot paths of \ref Car interface against CoppeliaSim, \ref headless_server.cpp
+ * or directly the headless model:
+ *   - sustained rate of images from \ref Car::getImage,
+ *   - throughput of actuator commands \ref Car::setServo and \ref Car::setMotorPWM with the command cache disabled,
+ *   - command to effect latency, the number of images until a command changes the camera image,
+ *   - duration of \ref Car::resetCar,
+ *   - duration of \ref Car::restoreSnapshot and the number of images until the restored pose is streamed.
+ *
+ * The results are written in JSON format, so they can be compared between versions.
+ *
+ * For more information see header files or use doxygen.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+
+#include "copsim_car.h"
+#include "headless_car.h"
+#include "latency.h"
+
+#define HELP                                                        \
+    "Usage: %s [-h] [-sync] [-frames N] [-commands N] [-trials N] [-o file] port_number|-headless\n" \
+    "  -h               this help\n"                                \
+    "  -sync            synchronous (lockstep) simulation mode\n"   \
+    "  -frames N        number of images (default 1000)\n"          \
+    "  -commands N      number of command cycles (default 10000)\n" \
+    "  -trials N        number of latency and reset trials (default 10)\n" \
+    "  -o file          output JSON file (default stdout)\n"        \
+    "  port_number      localhost port number for Remote API\n"     \
+    "  -headless        use headless car model instead of CoppeliaSim\n\n"
+
+/// Images with zero commands before command to effect trial
+#define BENCH_SETTLE_FRAMES     20
+/// Maximal number of images waiting for effect of command
+#define BENCH_EFFECT_FRAMES     200
+/// Images driven forward before the snapshot is saved and before every restore
+#define BENCH_DRIVE_FRAMES      50
+/// The pose closer to the snapshot is considered as restored
+#define BENCH_RESTORE_DISTANCE_M 0.02
+
+int main( int argc, char* argv[] )
+{
+    int l_port_num = -1;
+    int l_headless = 0;
+    int l_sync = 0;
+    int l_frames = 1000;
+    int l_commands = 10000;
+    int l_trials = 10;
+    const char *l_output = nullptr;
+
+    for ( int i = 1; i < argc; i++ )
+    {
+        if ( !strcmp( argv[ i ], "-sync" ) ) l_sync = 1;
+        else if ( !strcmp( argv[ i ], "-headless" ) ) l_headless = 1;
+        else if ( !strcmp( argv[ i ], "-frames" ) && i + 1 < argc ) l_frames = atoi( argv[ ++i ] );
+        else if ( !strcmp( argv[ i ], "-commands" ) && i + 1 < argc ) l_commands = atoi( argv[ ++i ] );
+        else if ( !strcmp( argv[ i ], "-trials" ) && i + 1 < argc ) l_trials = atoi( argv[ ++i ] );
+        else if ( !strcmp( argv[ i ], "-o" ) && i + 1 < argc ) l_output = argv[ ++i ];
+        else if ( *argv[ i ] != '-' ) l_port_num = atoi( argv[ i ] );
+        else
+        {
+            l_port_num = -1;
+            l_headless = 0;
+            break;
+        }
+    }
+    if ( ( l_port_num < 0 && !l_headless ) || l_frames < 1 || l_commands < 1 || l_trials < 1 )
+    {
+        printf( HELP, argv[ 0 ] );
+        exit( 0 );
+    }
+
+    CoppeliaSimCar l_coppsim_car;
+    HeadlessCar l_headless_car;
+    Car &l_car = l_headless ? ( Car & ) l_headless_car : ( Car & ) l_coppsim_car;
+
+    if ( !l_headless && l_coppsim_car.init( l_port_num, l_sync ) < 0 )
+    {
+        fprintf( stderr, "CoppeliaSim not connected!\n" );
+        exit( 1 );
+    }
+
+    unsigned char l_img[ CAR_CAM_RESOLUTION ];
+
+    // sustained rate of images
+    fprintf( stderr, "Images...\n" );
+    LatencyHistogram l_frame_hist;
+    l_car.resetCar();
+    if ( l_car.getImage( l_img ) < 0 )
+    {
+        fprintf( stderr, "Unable to get image!\n" );
+        exit( 1 );
+    }
+    long long l_start_ns = latencyNow();
+    for ( int i = 0; i < l_frames; i++ )
+    {
+        long long l_frame_ns = latencyNow();
+        if ( l_car.getImage( l_img ) < 0 )
+        {
+            fprintf( stderr, "Unable to get image!\n" );
+            exit( 1 );
+        }
+        l_frame_hist.record( latencyNow() - l_frame_ns );
+    }
+    double l_frames_s = ( latencyNow() - l_start_ns ) / 1e9;
+
+    // throughput of commands, batched and single writes,
+    // the command cache is disabled and the values change, so every command is really sent
+    fprintf( stderr, "Commands...\n" );
+    if ( !l_headless ) l_coppsim_car.setCommandCache( -1, 0 );
+    unsigned long l_suppressed = l_headless ? 0 : l_coppsim_car.getCommandSuppressed();
+    l_start_ns = latencyNow();
+    for ( int i = 0; i < l_commands; i++ )
+    {
+        l_car.beginCommands();
+        l_car.setServo( ( i & 1 ) ? 0.1 : -0.1 );
+        l_car.setMotorPWM( ( i & 1 ) ? 0.01 : -0.01, ( i & 1 ) ? -0.01 : 0.01 );
+        l_car.commit();
+    }
+    double l_batched_s = ( latencyNow() - l_start_ns ) / 1e9;
+
+    l_start_ns = latencyNow();
+    for ( int i = 0; i < l_commands; i++ )
+    {
+        l_car.setServo( ( i & 1 ) ? 0.1 : -0.1 );
+        l_car.setMotorPWM( ( i & 1 ) ? 0.01 : -0.01, ( i & 1 ) ? -0.01 : 0.01 );
+    }
+    double l_single_s = ( latencyNow() - l_start_ns ) / 1e9;
+    if ( !l_headless )
+    {
+        l_suppressed = l_coppsim_car.getCommandSuppressed() - l_suppressed;
+        l_coppsim_car.setCommandCache( COPPSIM_CMD_EPSILON, COPPSIM_CMD_REFRESH_FRAMES );
+    }
+    l_car.setMotorPWM( 0, 0 );
+
+    // command to effect latency and duration of reset
+    fprintf( stderr, "Latency and reset...\n" );
+    LatencyHistogram l_reset_hist;
+    int l_effect_sum = 0, l_effect_min = BENCH_EFFECT_FRAMES, l_effect_max = 0, l_effect_lost = 0;
+    double l_effect_ms_sum = 0;
+    for ( int t = 0; t < l_trials; t++ )
+    {
+        long long l_reset_ns = latencyNow();
+        l_car.resetCar();
+        l_reset_hist.record( latencyNow() - l_reset_ns );
+
+        // the stopped car gives the same image
+        unsigned char l_settled[ CAR_CAM_RESOLUTION ];
+        for ( int i = 0; i < BENCH_SETTLE_FRAMES; i++ )
+            l_car.getImage( l_settled );
+
+        l_car.beginCommands();
+        l_car.setServo( 1.0 );
+        l_car.setMotorPWM( 1.0, 1.0 );
+        l_car.commit();
+        long long l_command_ns = latencyNow();
+
+        // a failed image is not an effect, the trial is lost
+        int l_effect = 0;
+        bool l_changed = false;
+        while ( !l_changed && l_effect < BENCH_EFFECT_FRAMES )
+        {
+            l_effect++;
+            if ( l_car.getImage( l_img ) < 0 ) break;
+            l_changed = memcmp( l_img, l_settled, CAR_CAM_RESOLUTION ) != 0;
+        }
+        if ( !l_changed )
+        {
+            l_effect_lost++;
+            continue;
+        }
+        l_effect_ms_sum += ( latencyNow() - l_command_ns ) / 1e6;
+        l_effect_sum += l_effect;
+        l_effect_min = MIN( l_effect_min, l_effect );
+        l_effect_max = MAX( l_effect_max, l_effect );
+    }
+    l_car.resetCar();
+
+    // restore of snapshot saved while driving
+    fprintf( stderr, "Snapshots...\n" );
+    LatencyHistogram l_restore_hist;
+    int l_restore_sum = 0, l_restore_max = 0, l_restore_lost = 0;
+    bool l_restore_velocity = true;
+    l_car.setServo( 0 );
+    l_car.setMotorPWM( 0.5, 0.5 );
+    for ( int i = 0; i < BENCH_DRIVE_FRAMES; i++ )
+        l_car.getImage( l_img );
+
+    CarSnapshot l_snapshot;
+    bool l_snapshots = l_car.saveSnapshot( l_snapshot ) == 0;
+    if ( !l_snapshots ) fprintf( stderr, "Snapshots are not supported!\n" );
+    for ( int t = 0; l_snapshots && t < l_trials; t++ )
+    {
+        // the car moves away from the saved pose
+        for ( int i = 0; i < BENCH_DRIVE_FRAMES; i++ )
+            l_car.getImage( l_img );
+
+        long long l_restore_ns = latencyNow();
+        int l_ret = l_car.restoreSnapshot( l_snapshot );
+        if ( l_ret < 0 )
+        {
+            fprintf( stderr, "Unable to restore snapshot!\n" );
+            l_snapshots = false;
+            break;
+        }
+        l_restore_hist.record( latencyNow() - l_restore_ns );
+        if ( l_ret == CAR_SNAPSHOT_NO_VELOCITY ) l_restore_velocity = false;
+
+        // a failed image is not a restored pose, the trial is lost
+        int l_restored = 0;
+        bool l_back = false;
+        CarPose l_pose;
+        while ( !l_back && l_restored < BENCH_EFFECT_FRAMES )
+        {
+            l_restored++;
+            if ( l_car.getImage( l_img ) < 0 ) break;
+            l_back = l_car.getPose( l_pose ) == 0 &&
+                    hypotf( l_pose.x - l_snapshot.pose.x, l_pose.y - l_snapshot.pose.y ) < BENCH_RESTORE_DISTANCE_M;
+        }
+        if ( !l_back )
+        {
+            l_restore_lost++;
+            continue;
+        }
+        l_restore_sum += l_restored;
+        l_restore_max = MAX( l_restore_max, l_restored );
+    }
+    l_car.resetCar();
+
+    int l_effect_count = l_trials - l_effect_lost;
+    int l_restore_count = l_snapshots ? l_trials - l_restore_lost : 0;
+
+    FILE *l_file = l_output ? fopen( l_output, "w" ) : stdout;
+    if ( !l_file )
+    {
+        fprintf( stderr, "Unable to open output file %s!\n", l_output );
+        exit( 1 );
+    }
+
+    fprintf( l_file, "{\n" );
+    fprintf( l_file, "  \"target\": \"%s\",\n", l_headless ? "headless" : "remote" );
+    fprintf( l_file, "  \"port\": %d,\n", l_headless ? -1 : l_port_num );
+    fprintf( l_file, "  \"synchronous\": %s,\n", l_sync ? "true" : "false" );
+    fprintf( l_file, "  \"frames\": { \"count\": %d, \"per_s\": %.1f, \"avg_us\": %.1f, \"p50_us\": %.1f, \"p99_us\": %.1f, \"max_us\": %.1f },\n",
+            l_frames, l_frames / l_frames_s, l_frame_hist.getMean() / 1e3, l_frame_hist.getPercentile( 50 ) / 1e3,
+            l_frame_hist.getPercentile( 99 ) / 1e3, l_frame_hist.getMax() / 1e3 );
+    fprintf( l_file, "  \"commands\": { \"count\": %d, \"batched_per_s\": %.1f, \"single_per_s\": %.1f, \"suppressed\": %lu },\n",
+            l_commands, l_commands / l_batched_s, l_commands / l_single_s, l_suppressed );
+    fprintf( l_file, "  \"effect\": { \"trials\": %d, \"lost\": %d, \"avg_frames\": %.2f, \"min_frames\": %d, \"max_frames\": %d, \"avg_ms\": %.3f },\n",
+            l_trials, l_effect_lost, l_effect_count ? ( double ) l_effect_sum / l_effect_count : 0,
+            l_effect_count ? l_effect_min : 0, l_effect_max, l_effect_count ? l_effect_ms_sum / l_effect_count : 0 );
+    fprintf( l_file, "  \"reset\": { \"count\": %d, \"avg_ms\": %.3f, \"p99_ms\": %.3f, \"max_ms\": %.3f },\n",
+            l_trials, l_reset_hist.getMean() / 1e6, l_reset_hist.getPercentile( 99 ) / 1e6, l_reset_hist.getMax() / 1e6 );
+    fprintf( l_file, "  \"restore\": { \"supported\": %s, \"velocity\": %s, \"count\": %d, \"lost\": %d, \"avg_frames\": %.2f, \"max_frames\": %d, \"avg_ms\": %.3f, \"max_ms\": %.3f }\n",
+            l_snapshots ? "true" : "false", l_snapshots && l_restore_velocity ? "true" : "false", l_restore_count, l_restore_lost,
+            l_restore_count ? ( double ) l_restore_sum / l_restore_count : 0, l_restore_max,
+            l_restore_hist.getMean() / 1e6, l_restore_hist.getMax() / 1e6 );
+    fprintf( l_file, "}\n" );
+
+    if ( l_output ) fclose( l_file );
+
+    return 0;
+}
+
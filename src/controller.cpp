@@ -0,0 +1,160 @@
+/**
+ * @file controller.cpp
+ * @brief Module controller
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <sys/param.h>
+
+#include "controller.h"
+
+const LineControllerParams g_line_controller_default =
+{
+    2.5,                                // steer_p
+    1.0,                                // steer_d
+    0.6,                                // speed
+    0.5,                                // curve_slowdown
+    0.8,                                // inner_wheel_reduction
+    LINEDETECT_DEFAULT_MIN_CONTRAST,    // min_contrast
+    100                                 // track_width_px
+};
+
+
+/// The names of members of \ref LineControllerParams
+static const struct
+{
+    const char *name;                   ///< Name of member
+    size_t offset;                      ///< Offset of member
+    bool integer;                       ///< The member is int, otherwise float
+} g_line_controller_params[] =
+{
+    { "steer_p",                offsetof( LineControllerParams, steer_p ),                  false },
+    { "steer_d",                offsetof( LineControllerParams, steer_d ),                  false },
+    { "speed",                  offsetof( LineControllerParams, speed ),                    false },
+    { "curve_slowdown",         offsetof( LineControllerParams, curve_slowdown ),           false },
+    { "inner_wheel_reduction",  offsetof( LineControllerParams, inner_wheel_reduction ),    false },
+    { "min_contrast",           offsetof( LineControllerParams, min_contrast ),             true },
+    { "track_width_px",         offsetof( LineControllerParams, track_width_px ),           true },
+};
+
+
+/// Index of parameter in g_line_controller_params, -1 when it does not exist
+static int lineControllerFind( const char *t_name, size_t t_len )
+{
+    for ( int i = 0; i < ( int ) ( sizeof( g_line_controller_params ) / sizeof( g_line_controller_params[ 0 ] ) ); i++ )
+        if ( strlen( g_line_controller_params[ i ].name ) == t_len && !strncmp( g_line_controller_params[ i ].name, t_name, t_len ) )
+            return i;
+
+    return -1;
+}
+
+
+int lineControllerSetParam( LineControllerParams &t_params, const char *t_assignment )
+{
+    const char *l_value = strchr( t_assignment, '=' );
+    if ( !l_value ) return -1;
+
+    int l_index = lineControllerFind( t_assignment, l_value - t_assignment );
+    if ( l_index < 0 ) return -1;
+
+    char *l_end;
+    char *l_member = ( char * ) &t_params + g_line_controller_params[ l_index ].offset;
+    if ( g_line_controller_params[ l_index ].integer )
+        *( int * ) l_member = strtol( l_value + 1, &l_end, 10 );
+    else
+        *( float * ) l_member = strtof( l_value + 1, &l_end );
+
+    return ( l_end == l_value + 1 || *l_end ) ? -1 : 0;
+}
+
+
+int lineControllerSetValue( LineControllerParams &t_params, const char *t_name, float t_value )
+{
+    int l_index = lineControllerFind( t_name, strlen( t_name ) );
+    if ( l_index < 0 ) return -1;
+
+    char *l_member = ( char * ) &t_params + g_line_controller_params[ l_index ].offset;
+    if ( g_line_controller_params[ l_index ].integer )
+        *( int * ) l_member = lroundf( t_value );
+    else
+        *( float * ) l_member = t_value;
+
+    return 0;
+}
+
+
+int lineControllerGetValue( const LineControllerParams &t_params, const char *t_name, float &t_value )
+{
+    int l_index = lineControllerFind( t_name, strlen( t_name ) );
+    if ( l_index < 0 ) return -1;
+
+    const char *l_member = ( const char * ) &t_params + g_line_controller_params[ l_index ].offset;
+    if ( g_line_controller_params[ l_index ].integer )
+        t_value = *( const int * ) l_member;
+    else
+        t_value = *( const float * ) l_member;
+
+    return 0;
+}
+
+
+void lineControllerPrintParams( FILE *t_file, const LineControllerParams &t_params )
+{
+    const char *l_sep = "";
+    for ( auto &l_param : g_line_controller_params )
+    {
+        const char *l_member = ( const char * ) &t_params + l_param.offset;
+        if ( l_param.integer )
+            fprintf( t_file, "%s%s=%d", l_sep, l_param.name, *( const int * ) l_member );
+        else
+            fprintf( t_file, "%s%s=%g", l_sep, l_param.name, *( const float * ) l_member );
+        l_sep = " ";
+    }
+    fprintf( t_file, "\n" );
+}
+
+
+LineController::LineController( const LineControllerParams &t_params )
+{
+    m_params = t_params;
+    reset();
+}
+
+
+void LineController::reset()
+{
+    m_last_error = 0;
+    m_last_centre = CAR_CAM_RESOLUTION / 2;
+    memset( &m_lines, 0, sizeof( m_lines ) );
+}
+
+
+void LineController::control( const unsigned char *t_img, CarCommands &t_cmd )
+{
+    // border lines are searched from the last centre of track to the both sides
+    linedetectFind( t_img, m_last_centre, m_params.min_contrast, m_params.track_width_px, m_lines );
+    float l_centre = m_lines.centre;
+
+    m_last_centre = MIN( MAX( ( int ) l_centre, 0 ), CAR_CAM_RESOLUTION - 1 );
+
+    // positive error, the track centre is on the right side
+    float l_error = ( l_centre - ( CAR_CAM_RESOLUTION - 1 ) / 2.0 ) / ( CAR_CAM_RESOLUTION / 2 );
+    float l_servo = - m_params.steer_p * l_error - m_params.steer_d * ( l_error - m_last_error );
+    m_last_error = l_error;
+
+    l_servo = MIN( MAX( l_servo, -1.0 ), 1.0 );
+
+    // slow down in curve and reduce power on an inner wheel
+    float l_pwm = m_params.speed * ( 1.0 - fabs( l_servo ) * m_params.curve_slowdown );
+    t_cmd.servo = l_servo;
+    t_cmd.l_pwm = l_pwm;
+    t_cmd.r_pwm = l_pwm;
+    if ( l_servo > 0 )
+        t_cmd.l_pwm = l_pwm * ( 1.0 - fabs( l_servo ) * m_params.inner_wheel_reduction );
+    if ( l_servo < 0 )
+        t_cmd.r_pwm = l_pwm * ( 1.0 - fabs( l_servo ) * m_params.inner_wheel_reduction );
+}
+
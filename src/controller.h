@@ -0,0 +1,119 @@
+#pragma once
+
+/**
+ * @file controller.h
+ * @brief Module controller
+ *
+ * This module controller contains the interface of autonomous car controllers and a simple line following controller.
+ */
+
+#include <stdio.h>
+
+#include "car.h"
+#include "linedetect.h"
+
+/// The commands computed by controller for single control cycle.
+struct CarCommands
+{
+    float servo;                        ///< Servo position, see \ref Car::setServo.
+    float l_pwm;                        ///< Power of left motor, see \ref Car::setMotorPWM.
+    float r_pwm;                        ///< Power of right motor, see \ref Car::setMotorPWM.
+};
+
+/**
+ * @brief The interface of autonomous car controller.
+ *
+ * The controller computes commands from single image of line camera in every control cycle.
+ */
+class CarController
+{
+public:
+
+    /** Destructor */
+    virtual ~CarController() {}
+
+    /** @brief Reset internal state of controller, e.g. after \ref Car::resetCar. */
+    virtual void reset() {}
+
+    /** @brief Compute commands for the image from line camera.
+     *
+     * @param t_img Image from line camera of length \ref CAR_CAM_RESOLUTION.
+     * @param t_cmd Computed commands.
+     */
+    virtual void control( const unsigned char *t_img, CarCommands &t_cmd ) = 0;
+};
+
+/// Parameters of \ref LineController.
+struct LineControllerParams
+{
+    float steer_p;                      ///< Proportional gain of steering.
+    float steer_d;                      ///< Derivative gain of steering.
+    float speed;                        ///< Power of motors on straight track.
+    float curve_slowdown;               ///< Reduction of power proportional to servo position.
+    float inner_wheel_reduction;        ///< Reduction of power on an inner wheel proportional to servo position.
+    int min_contrast;                   ///< Minimal contrast of image to detect border lines, see \ref linedetectFind.
+    int track_width_px;                 ///< Width of track in pixels, used when only one border line is visible.
+};
+
+/// Default parameters of \ref LineController.
+extern const LineControllerParams g_line_controller_default;
+
+/** @brief Set single parameter of \ref LineController.
+ *
+ * @param t_params The parameters.
+ * @param t_assignment The assignment "name=value", the name is the member of \ref LineControllerParams.
+ * @return When the parameter was set, it returns 0. Otherwise -1.
+ */
+int lineControllerSetParam( LineControllerParams &t_params, const char *t_assignment );
+
+/** @brief Set single parameter of \ref LineController by name, e.g. for an optimizer.
+ *
+ * @param t_params The parameters.
+ * @param t_name The name of member of \ref LineControllerParams.
+ * @param t_value The new value, it is rounded for integer members.
+ * @return When the parameter was set, it returns 0. Otherwise -1.
+ */
+int lineControllerSetValue( LineControllerParams &t_params, const char *t_name, float t_value );
+
+/** @brief Get single parameter of \ref LineController by name.
+ *
+ * @param t_params The parameters.
+ * @param t_name The name of member of \ref LineControllerParams.
+ * @param t_value The value of parameter.
+ * @return When the parameter exists, it returns 0. Otherwise -1.
+ */
+int lineControllerGetValue( const LineControllerParams &t_params, const char *t_name, float &t_value );
+
+/** @brief Print all parameters as assignments accepted by \ref lineControllerSetParam, separated by spaces. */
+void lineControllerPrintParams( FILE *t_file, const LineControllerParams &t_params );
+
+/**
+ * @brief The simple controller following the centre between track border lines.
+ *
+ * The border lines are found by \ref linedetectFind from the track centre of the last cycle.
+ */
+class LineController : public CarController
+{
+public:
+
+    /** @brief Constructor sets parameters of controller. */
+    LineController( const LineControllerParams &t_params = g_line_controller_default );
+
+    void reset() override;
+    void control( const unsigned char *t_img, CarCommands &t_cmd ) override;
+
+    /** @brief The parameters of controller. */
+    LineControllerParams &params() { return m_params; }
+
+    /** @brief Border lines found in the last cycle. */
+    const LinedetectResult &getLines() const { return m_lines; }
+
+protected:
+
+    LineControllerParams m_params;      ///< Parameters
+    float m_last_error;                 ///< Error of the last cycle
+    int m_last_centre;                  ///< The track centre in the last cycle
+    LinedetectResult m_lines;           ///< Border lines of the last cycle
+
+};
+
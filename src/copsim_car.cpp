@@ -12,27 +12,88 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>
 #include <sys/param.h>
+#include <sys/eventfd.h>
 
 #include "copsim_car.h"
 
+/// The return code of non-blocking Remote API call (oneshot or streaming mode) is an error,
+/// simx_return_novalue_flag only means that the reply was not received yet
+static inline bool copsimNonBlockingFailed( int t_retval )
+{
+    return ( t_retval & ~simx_return_novalue_flag ) != 0;
+}
 
-CoppeliaSimCar::CoppeliaSimCar() 
+
+template< class t_camera >
+CoppeliaSimCarT< t_camera >::CoppeliaSimCarT() 
 {
     m_copsim_initialized = false;
+    m_synchronous = false;
+    m_step_pending = false;
+
+    m_cmd_batch = false;
+    m_cmd_flushes = 0;
+    m_cmd_writes = 0;
+    m_cmd_suppressed = 0;
+    m_cmd_batch_writes = 0;
+    m_servo_angle = 0;
+    m_l_torque = 0;
+    m_r_torque = 0;
+    memset( &m_faults, 0, sizeof( m_faults ) );
+
+    m_cache_epsilon = COPPSIM_CMD_EPSILON;
+    m_cache_refresh_frames = COPPSIM_CMD_REFRESH_FRAMES;
+    copsimCacheInvalidate();
 
     m_client_id = -1;
+    m_body_handle = -1;
+
+    m_frame_thread_running = false;
+    m_frame_thread_stop = false;
+    m_frame_error = false;
+    m_frame_seq = 0;
+    m_frame_read_seq = 0;
+    m_frame_arrival_ns = 0;
+    m_frame_fd = -1;
+    memset( &m_frame_stats, 0, sizeof( m_frame_stats ) );
+
+    pthread_mutex_init( &m_frame_mutex, nullptr );
+
+    // timeouts of waiting are measured by monotonic clock
+    pthread_condattr_t l_cond_attr;
+    pthread_condattr_init( &l_cond_attr );
+    pthread_condattr_setclock( &l_cond_attr, CLOCK_MONOTONIC );
+    pthread_cond_init( &m_frame_cond, &l_cond_attr );
+    pthread_condattr_destroy( &l_cond_attr );
 }
 
 
-CoppeliaSimCar::~CoppeliaSimCar() 
+template< class t_camera >
+CoppeliaSimCarT< t_camera >::~CoppeliaSimCarT() 
 {
+    copsimStopReceiver();
+
     if ( m_client_id >= 0 )
+    {
+        // let the simulation run again in real time
+        if ( m_synchronous )
+            simxSynchronous( m_client_id, false );
         simxFinish( m_client_id );
+    }
+
+    if ( m_frame_fd >= 0 ) close( m_frame_fd );
+
+    pthread_cond_destroy( &m_frame_cond );
+    pthread_mutex_destroy( &m_frame_mutex );
 }
 
 
-int CoppeliaSimCar::init( int t_port_number )
+template< class t_camera >
+int CoppeliaSimCarT< t_camera >::init( int t_port_number, bool t_synchronous )
 {
     m_client_id = simxStart( ( simxChar * ) "127.0.0.1", t_port_number, true, true, 2000, 5 );
     if ( m_client_id < 0 ) 
@@ -66,62 +127,222 @@ int CoppeliaSimCar::init( int t_port_number )
         fprintf( stderr, "Unable to get handle for %s\n", COPPSIM_OBJNAME_VISION_SENSOR );
         return -1;
     }
+    // the car can be driven without pose
+    l_simx_ret = simxGetObjectHandle( m_client_id, COPPSIM_OBJNAME_BODY, &m_body_handle, simx_opmode_blocking );
+    if ( l_simx_ret != simx_return_ok )
+    {
+        fprintf( stderr, "Unable to get handle for %s, pose is not available\n", COPPSIM_OBJNAME_BODY );
+        m_body_handle = -1;
+    }
+
+    if ( t_synchronous )
+    {
+        if ( simxSynchronous( m_client_id, true ) != simx_return_ok )
+        {
+            fprintf( stderr, "Unable to enable synchronous mode!\n" );
+            return -1;
+        }
+        m_synchronous = true;
+        m_step_pending = false;
+    }
 
     return 0;
 }
 
 
-int CoppeliaSimCar::getImage( unsigned char *t_image )
+template< class t_camera >
+int CoppeliaSimCarT< t_camera >::step()
+{
+    if ( !m_synchronous ) return -1;
+
+    // current connection is valid?
+    if ( simxGetConnectionId( m_client_id ) < 0  ) return -1;
+
+    // the streaming must be started before the first step 
+    if ( !m_copsim_initialized && copsimStartStreaming() < 0 ) return -1;
+
+    long long l_start_ns = latencyNow();
+
+    if ( simxSynchronousTrigger( m_client_id ) != simx_return_ok )
+    {
+        m_faults.remote_errors++;
+        fprintf( stderr, "Method %s failed!\n", __FUNCTION__ );
+        return -1;
+    }
+
+    // the blocking round trip guarantees that the step is finished and its data are received
+    int l_ping_time;
+    if ( simxGetPingTime( m_client_id, &l_ping_time ) != simx_return_ok )
+    {
+        m_faults.remote_errors++;
+        fprintf( stderr, "Method %s failed!\n", __FUNCTION__ );
+        return -1;
+    }
+
+    m_step_pending = true;
+    m_latency[ COPPSIM_LATENCY_STEP ].record( latencyNow() - l_start_ns );
+
+    return 0;
+}
+
+
+template< class t_camera >
+int CoppeliaSimCarT< t_camera >::getImage( unsigned char *t_image )
 {
     int l_retval;
     simxUChar* l_image_camera;
-    int l_cam_resolution[ 2 ] = { CAR_CAM_RESOLUTION, 1 };  //resolution of vision sensor
+    int l_cam_resolution[ 2 ] = { t_camera::resolution, t_camera::lines };  //resolution of vision sensor
 
     // current connection is valid?
     if ( simxGetConnectionId( m_client_id ) < 0  ) return -1;
 
     // start visual sensor streaming
-    if ( !m_copsim_initialized )
+    if ( !m_copsim_initialized && copsimStartStreaming() < 0 ) return -1;
+
+    long long l_start_ns = latencyNow();
+
+    // synchronous mode, image of the last step is already received
+    if ( m_synchronous )
     {
+        // no step since the last image, move simulation forward
+        if ( !m_step_pending && step() < 0 ) return -1;
+        m_step_pending = false;
 
         l_retval = simxGetVisionSensorImage( m_client_id, m_vision_sensor_handle, 
-                l_cam_resolution, &l_image_camera, 1, simx_opmode_streaming );
-        if ( l_retval != simx_return_novalue_flag && l_retval != simx_return_ok ) return -1;
+                l_cam_resolution, &l_image_camera, 1, simx_opmode_buffer );
+        // the image of finished step was not delivered
+        if ( l_retval != simx_return_ok )
+        {
+            m_faults.timeouts++;
+            return -1;
+        }
+
+        if ( t_image )
+            memcpy( t_image, l_image_camera, sizeof( simxUChar ) * t_camera::pixels );
+
+        m_latency[ COPPSIM_LATENCY_WAIT ].record( latencyNow() - l_start_ns );
 
-        m_copsim_initialized = true; 
+        // all joints are written again from time to time
+        if ( m_cache_refresh_frames && ++m_cache_age_frames >= m_cache_refresh_frames ) copsimCacheInvalidate();
+
+        return 0;
     }
     
+    // images are received by the standalone thread
+    if ( !m_frame_thread_running && copsimStartReceiver() < 0 ) return -1;
+
     // 5s timeout should be enough even on slow computer
-    int l_time_limit = CAR_GETIMAGE_TIMEOUT_MS;
+    long long l_deadline_ns = latencyNow() + CAR_GETIMAGE_TIMEOUT_MS * 1000000LL;
+    timespec l_deadline = { ( time_t ) ( l_deadline_ns / 1000000000LL ), ( long ) ( l_deadline_ns % 1000000000LL ) };
+
+    pthread_mutex_lock( &m_frame_mutex );
 
     // wait for next image
-    while ( l_time_limit-- &&
-           ( ( l_retval = simxGetVisionSensorImage( m_client_id, m_vision_sensor_handle, 
-                            l_cam_resolution, &l_image_camera, 1, simx_opmode_buffer ) ) != simx_return_ok )
-            && ( simxGetConnectionId( m_client_id ) != -1 ) 
-         )
-    {
-        usleep( 1000 ); // wait 1 ms
-    }
+    int l_wait = 0;
+    while ( m_frame_seq == m_frame_read_seq && !m_frame_error && l_wait != ETIMEDOUT )
+        l_wait = pthread_cond_timedwait( &m_frame_cond, &m_frame_mutex, &l_deadline );
 
     // timeout or some error? 
-    if ( l_time_limit < 0 || l_retval != simx_return_ok ) return -1;
+    if ( m_frame_seq == m_frame_read_seq )
+    {
+        if ( m_frame_error )
+            m_faults.remote_errors++;
+        else
+            m_faults.timeouts++;
+        pthread_mutex_unlock( &m_frame_mutex );
+        return -1;
+    }
 
     // copy data
     if ( t_image )
-        memcpy( t_image, l_image_camera, sizeof( simxUChar ) * CAR_CAM_RESOLUTION );
-  
-    // remove image from the internal API buffer
-    l_retval = simxGetVisionSensorImage(  m_client_id, m_vision_sensor_handle, 
-            l_cam_resolution, &l_image_camera, 1, simx_opmode_remove );
+        memcpy( t_image, m_frame.data(), sizeof( unsigned char ) * t_camera::pixels );
+
+    // update statistics
+    long long l_now_ns = latencyNow();
+    long long l_age_ns = l_now_ns - m_frame_arrival_ns;
+    double l_age_us = l_age_ns / 1000.0;
+    m_frame_stats.dropped += m_frame_seq - m_frame_read_seq - 1;
+    m_frame_stats.frames++;
+    m_frame_stats.last_age_us = l_age_us;
+    m_frame_stats.avg_age_us += ( l_age_us - m_frame_stats.avg_age_us ) / m_frame_stats.frames;
+    m_frame_stats.max_age_us = MAX( m_frame_stats.max_age_us, l_age_us );
+
+    m_frame_read_seq = m_frame_seq;
+
+    // the image is consumed, the frame eventfd is not readable until the next one
+    if ( m_frame_fd >= 0 )
+    {
+        uint64_t l_count;
+        if ( read( m_frame_fd, &l_count, sizeof( l_count ) ) < 0 && errno != EAGAIN )
+            fprintf( stderr, "Method %s failed!\n", __FUNCTION__ );
+    }
 
-    if ( l_retval != simx_return_ok ) return -1;
+    pthread_mutex_unlock( &m_frame_mutex );
+
+    m_latency[ COPPSIM_LATENCY_AGE ].record( l_age_ns );
+    m_latency[ COPPSIM_LATENCY_WAIT ].record( l_now_ns - l_start_ns );
+
+    // all joints are written again from time to time
+    if ( m_cache_refresh_frames && ++m_cache_age_frames >= m_cache_refresh_frames ) copsimCacheInvalidate();
 
     return 0; 
 }
 
 
-void CoppeliaSimCar::setServo( float t_position )
+template< class t_camera >
+int CoppeliaSimCarT< t_camera >::getFrameFd()
+{
+    // in the synchronous mode getImage waits only for its own round trip
+    if ( m_synchronous ) return -1;
+
+    pthread_mutex_lock( &m_frame_mutex );
+    if ( m_frame_fd < 0 )
+    {
+        m_frame_fd = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+        // an image received before is signalled too
+        uint64_t l_one = 1;
+        if ( m_frame_fd >= 0 && m_frame_seq != m_frame_read_seq && write( m_frame_fd, &l_one, sizeof( l_one ) ) < 0 )
+            fprintf( stderr, "Method %s failed!\n", __FUNCTION__ );
+    }
+    pthread_mutex_unlock( &m_frame_mutex );
+
+    if ( m_frame_fd < 0 )
+    {
+        fprintf( stderr, "Unable to create frame eventfd!\n" );
+        return -1;
+    }
+
+    // images must be received before the first getImage
+    if ( simxGetConnectionId( m_client_id ) < 0 ) return -1;
+    if ( !m_copsim_initialized && copsimStartStreaming() < 0 ) return -1;
+    if ( !m_frame_thread_running && copsimStartReceiver() < 0 ) return -1;
+
+    return m_frame_fd;
+}
+
+
+template< class t_camera >
+void CoppeliaSimCarT< t_camera >::getFrameStats( CarFrameStats &t_stats )
+{
+    pthread_mutex_lock( &m_frame_mutex );
+    t_stats = m_frame_stats;
+    pthread_mutex_unlock( &m_frame_mutex );
+}
+
+
+template< class t_camera >
+void CoppeliaSimCarT< t_camera >::printLatency( FILE *t_file ) const
+{
+    static const char *l_names[ COPPSIM_LATENCY_COUNT ] = { "wait", "age", "command", "step" };
+
+    LatencyHistogram::printHeader( t_file );
+    for ( int i = 0; i < COPPSIM_LATENCY_COUNT; i++ )
+        if ( m_latency[ i ].getCount() ) m_latency[ i ].print( t_file, l_names[ i ] );
+}
+
+
+template< class t_camera >
+void CoppeliaSimCarT< t_camera >::setServo( float t_position )
 {
     // verify allowed range of values
     t_position = MIN( t_position, 1.0 );
@@ -132,7 +353,8 @@ void CoppeliaSimCar::setServo( float t_position )
 }
 
 
-void CoppeliaSimCar::setMotorPWM( float t_l_pwm, float t_r_pwm )
+template< class t_camera >
+void CoppeliaSimCarT< t_camera >::setMotorPWM( float t_l_pwm, float t_r_pwm )
 {
     // verify allowed range of the both pwm values
     t_l_pwm = MIN( t_l_pwm, 1.0 );
@@ -146,24 +368,397 @@ void CoppeliaSimCar::setMotorPWM( float t_l_pwm, float t_r_pwm )
 }
 
 
-void CoppeliaSimCar::resetCar()
+template< class t_camera >
+void CoppeliaSimCarT< t_camera >::resetCar()
 {
+    // the stop commands are always sent
+    copsimCacheInvalidate();
+    beginCommands();
     copsimSetServoPosition( 0.0 );
     copsimSetMotorTorque( 0.0, 0.0 );
+    commit();
     if ( simxCallScriptFunction( m_client_id, "Board", sim_scripttype_childscript , "restart", 0, NULL, 0, NULL, 0,NULL,0, NULL,0, NULL, 0, NULL, 0, NULL, 0, NULL, simx_opmode_blocking ) != simx_return_ok )
+    {
+        m_faults.remote_errors++;
+        fprintf( stderr, "Method %s failed!\n", __FUNCTION__ );
+    }
+
+    // the restarted model does not keep the last values
+    copsimCacheInvalidate();
+}
+
+
+template< class t_camera >
+void CoppeliaSimCarT< t_camera >::beginCommands()
+{
+    if ( m_cmd_batch ) return;
+
+    // all following commands are stored until the communication is resumed
+    if ( simxPauseCommunication( m_client_id, true ) != simx_return_ok )
+    {
+        m_faults.remote_errors++;
         fprintf( stderr, "Method %s failed!\n", __FUNCTION__ );
+        return;
+    }
+
+    m_cmd_batch = true;
+    m_cmd_batch_writes = 0;
+}
+
+
+template< class t_camera >
+int CoppeliaSimCarT< t_camera >::commit()
+{
+    if ( !m_cmd_batch ) return 0;
+
+    m_cmd_batch = false;
+    long long l_start_ns = latencyNow();
+
+    // resumed communication sends all stored commands in one packet
+    if ( simxPauseCommunication( m_client_id, false ) != simx_return_ok )
+    {
+        m_faults.remote_errors++;
+        fprintf( stderr, "Method %s failed!\n", __FUNCTION__ );
+        return -1;
+    }
+
+    // the batch with all commands suppressed is not sent
+    if ( m_cmd_batch_writes )
+    {
+        m_cmd_flushes++;
+        m_latency[ COPPSIM_LATENCY_COMMAND ].record( latencyNow() - l_start_ns );
+    }
+
+    return 0;
+}
+
+
+template< class t_camera >
+void CoppeliaSimCarT< t_camera >::setCommandCache( float t_epsilon, int t_refresh_frames )
+{
+    m_cache_epsilon = t_epsilon;
+    m_cache_refresh_frames = MAX( t_refresh_frames, 0 );
+    copsimCacheInvalidate();
+}
+
+
+template< class t_camera >
+bool CoppeliaSimCarT< t_camera >::copsimCacheUpdate( CoppeliaSimJoint t_joint, float t_value )
+{
+    // the range of values of every joint
+    static const float l_range[ COPPSIM_JOINT_COUNT ] = { CAR_5TH_WHEEL_ANGLE_RAD, 
+        CAR_MAX_SPEED_DEG_S, CAR_MAX_TORQUE_N_M, CAR_MAX_SPEED_DEG_S, CAR_MAX_TORQUE_N_M };
+
+    if ( m_cache_epsilon >= 0 && m_cache_valid[ t_joint ] 
+            && fabsf( t_value - m_cache_value[ t_joint ] ) <= m_cache_epsilon * l_range[ t_joint ] )
+    {
+        m_cmd_suppressed++;
+        return false;
+    }
+
+    m_cache_value[ t_joint ] = t_value;
+    m_cache_valid[ t_joint ] = true;
+    return true;
 }
 
 
-int CoppeliaSimCar::copsimSetServoPosition( float t_angle )
+template< class t_camera >
+void CoppeliaSimCarT< t_camera >::copsimCacheInvalidate()
+{
+    for ( int i = 0; i < COPPSIM_JOINT_COUNT; i++ )
+        m_cache_valid[ i ] = false;
+    m_cache_age_frames = 0;
+}
+
+
+template< class t_camera >
+double CoppeliaSimCarT< t_camera >::getSimTime()
+{
+    return simxGetLastCmdTime( m_client_id ) / 1000.0;
+}
+
+
+template< class t_camera >
+int CoppeliaSimCarT< t_camera >::copsimStartStreaming()
+{
+    simxUChar* l_image_camera;
+    int l_cam_resolution[ 2 ] = { t_camera::resolution, t_camera::lines };  //resolution of vision sensor
+
+    int l_retval = simxGetVisionSensorImage( m_client_id, m_vision_sensor_handle, 
+            l_cam_resolution, &l_image_camera, 1, simx_opmode_streaming );
+    if ( copsimNonBlockingFailed( l_retval ) ) return -1;
+
+    if ( m_body_handle >= 0 && copsimStartPoseStreaming() < 0 ) return -1;
+
+    m_copsim_initialized = true; 
+
+    return 0;
+}
+
+
+template< class t_camera >
+int CoppeliaSimCarT< t_camera >::copsimStartPoseStreaming()
+{
+    simxFloat l_values[ 3 ];
+    simxFloat l_angular[ 3 ];
+    int l_retval = 0;
+
+    // the first call of streaming mode returns no value, the next values are read from buffer
+    l_retval |= simxGetObjectPosition( m_client_id, m_body_handle, -1, l_values, simx_opmode_streaming );
+    l_retval |= simxGetObjectOrientation( m_client_id, m_body_handle, -1, l_values, simx_opmode_streaming );
+    l_retval |= simxGetObjectVelocity( m_client_id, m_body_handle, l_values, l_angular, simx_opmode_streaming );
+    l_retval |= simxGetJointPosition( m_client_id, m_left_motor_handle, l_values, simx_opmode_streaming );
+    l_retval |= simxGetJointPosition( m_client_id, m_right_motor_handle, l_values, simx_opmode_streaming );
+    l_retval |= simxGetJointPosition( m_client_id, m_servo_handle, l_values, simx_opmode_streaming );
+    if ( copsimNonBlockingFailed( l_retval ) )
+    {
+        fprintf( stderr, "Method %s failed!\n", __FUNCTION__ );
+        return -1;
+    }
+
+    return 0;
+}
+
+
+template< class t_camera >
+int CoppeliaSimCarT< t_camera >::getPose( CarPose &t_pose )
+{
+    if ( m_body_handle < 0 || !m_copsim_initialized ) return -1;
+
+    simxFloat l_position[ 3 ];
+    simxFloat l_orientation[ 3 ];
+    simxFloat l_velocity[ 3 ];
+    simxFloat l_angular[ 3 ];
+    simxFloat l_l_wheel, l_r_wheel;
+
+    // only the local buffer is read, the values are refreshed by every simulation step
+    int l_retval = 0;
+    l_retval |= simxGetObjectPosition( m_client_id, m_body_handle, -1, l_position, simx_opmode_buffer );
+    l_retval |= simxGetObjectOrientation( m_client_id, m_body_handle, -1, l_orientation, simx_opmode_buffer );
+    l_retval |= simxGetObjectVelocity( m_client_id, m_body_handle, l_velocity, l_angular, simx_opmode_buffer );
+    l_retval |= simxGetJointPosition( m_client_id, m_left_motor_handle, &l_l_wheel, simx_opmode_buffer );
+    l_retval |= simxGetJointPosition( m_client_id, m_right_motor_handle, &l_r_wheel, simx_opmode_buffer );
+    if ( l_retval != simx_return_ok ) return -1;
+
+    t_pose.time = getSimTime();
+    t_pose.x = l_position[ 0 ];
+    t_pose.y = l_position[ 1 ];
+    t_pose.z = l_position[ 2 ];
+    t_pose.roll = l_orientation[ 0 ];
+    t_pose.pitch = l_orientation[ 1 ];
+    t_pose.yaw = l_orientation[ 2 ];
+    t_pose.vx = l_velocity[ 0 ];
+    t_pose.vy = l_velocity[ 1 ];
+    t_pose.vz = l_velocity[ 2 ];
+    t_pose.yaw_rate = l_angular[ 2 ];
+    // the right motor use the negative rotation direction for a forward moving
+    t_pose.l_wheel = l_l_wheel;
+    t_pose.r_wheel = -l_r_wheel;
+
+    return 0;
+}
+
+
+template< class t_camera >
+int CoppeliaSimCarT< t_camera >::saveSnapshot( CarSnapshot &t_snapshot )
+{
+    if ( getPose( t_snapshot.pose ) < 0 ) return -1;
+
+    simxFloat l_steer;
+    if ( simxGetJointPosition( m_client_id, m_servo_handle, &l_steer, simx_opmode_buffer ) != simx_return_ok ) return -1;
+
+    t_snapshot.steer = l_steer;
+    t_snapshot.l_speed = hypotf( t_snapshot.pose.vx, t_snapshot.pose.vy );
+    t_snapshot.r_speed = t_snapshot.l_speed;
+    t_snapshot.servo_angle = m_servo_angle;
+    t_snapshot.l_torque = m_l_torque;
+    t_snapshot.r_torque = m_r_torque;
+
+    return 0;
+}
+
+
+template< class t_camera >
+int CoppeliaSimCarT< t_camera >::restoreSnapshot( const CarSnapshot &t_snapshot )
+{
+    if ( m_body_handle < 0 || simxGetConnectionId( m_client_id ) < 0 ) return -1;
+
+    const CarPose &l_pose = t_snapshot.pose;
+    simxFloat l_position[ 3 ] = { l_pose.x, l_pose.y, l_pose.z };
+    simxFloat l_orientation[ 3 ] = { l_pose.roll, l_pose.pitch, l_pose.yaw };
+
+    // the state and the commands are applied in the same simulation step
+    bool l_batch = m_cmd_batch;
+    beginCommands();
+
+    int l_retval = 0;
+    l_retval |= simxSetObjectPosition( m_client_id, m_body_handle, -1, l_position, simx_opmode_oneshot );
+    l_retval |= simxSetObjectOrientation( m_client_id, m_body_handle, -1, l_orientation, simx_opmode_oneshot );
+    l_retval |= simxSetJointPosition( m_client_id, m_servo_handle, t_snapshot.steer, simx_opmode_oneshot );
+    // the right motor use the negative rotation direction for a forward moving
+    l_retval |= simxSetJointPosition( m_client_id, m_left_motor_handle, l_pose.l_wheel, simx_opmode_oneshot );
+    l_retval |= simxSetJointPosition( m_client_id, m_right_motor_handle, -l_pose.r_wheel, simx_opmode_oneshot );
+    m_cmd_writes += 5;
+    m_cmd_batch_writes += 5;
+
+    // the saved commands are always sent
+    copsimCacheInvalidate();
+    copsimSetServoPosition( t_snapshot.servo_angle );
+    copsimSetMotorTorque( t_snapshot.l_torque, t_snapshot.r_torque );
+
+    // the batch of caller is sent by its own commit
+    if ( !l_batch && commit() < 0 ) return -1;
+
+    if ( copsimNonBlockingFailed( l_retval ) )
+    {
+        m_faults.remote_errors++;
+        fprintf( stderr, "Method %s failed!\n", __FUNCTION__ );
+        return -1;
+    }
+
+    // the velocity of body needs a dynamics reset, see the header
+    return CAR_SNAPSHOT_NO_VELOCITY;
+}
+
+
+template< class t_camera >
+int CoppeliaSimCarT< t_camera >::copsimStartReceiver()
+{
+    m_frame_thread_stop = false;
+    m_frame_error = false;
+
+    if ( pthread_create( &m_frame_thread_id, nullptr, copsimReceiverThread, this ) != 0 )
+    {
+        fprintf( stderr, "Unable to start frame receiver!\n" );
+        return -1;
+    }
+
+    m_frame_thread_running = true;
+
+    return 0;
+}
+
+
+template< class t_camera >
+void CoppeliaSimCarT< t_camera >::copsimStopReceiver()
+{
+    if ( !m_frame_thread_running ) return;
+
+    // request to stop thread
+    pthread_mutex_lock( &m_frame_mutex );
+    m_frame_thread_stop = true;
+    pthread_mutex_unlock( &m_frame_mutex );
+
+    // wait for the thread
+    pthread_join( m_frame_thread_id, nullptr );
+
+    m_frame_thread_running = false;
+}
+
+
+template< class t_camera >
+void *CoppeliaSimCarT< t_camera >::copsimReceiverThread( void *t_arg )
+{
+    CoppeliaSimCarT *l_car = ( CoppeliaSimCarT * ) t_arg;
+    simxUChar* l_image_camera;
+    int l_cam_resolution[ 2 ] = { t_camera::resolution, t_camera::lines };  //resolution of vision sensor
+    int l_last_cmd_time = -1;
+
+    while ( true )
+    {
+        // test stop request
+        pthread_mutex_lock( &l_car->m_frame_mutex );
+        bool l_stop = l_car->m_frame_thread_stop;
+        pthread_mutex_unlock( &l_car->m_frame_mutex );
+        if ( l_stop ) break;
+
+        // current connection is valid?
+        if ( simxGetConnectionId( l_car->m_client_id ) < 0 )
+        {
+            pthread_mutex_lock( &l_car->m_frame_mutex );
+            l_car->m_frame_error = true;
+            pthread_cond_broadcast( &l_car->m_frame_cond );
+            pthread_mutex_unlock( &l_car->m_frame_mutex );
+            break;
+        }
+
+        // the Remote API does not offer any notification, the time of the last received message
+        // is checked in short period, it is a local variable of client, not a call of server or buffer
+        int l_cmd_time = simxGetLastCmdTime( l_car->m_client_id );
+        if ( l_cmd_time == l_last_cmd_time )
+        {
+            usleep( CAR_FRAME_POLL_US );
+            continue;
+        }
+
+        // the streamed image is replaced in buffer by every message, it is not removed after reading,
+        // when the next message arrived during reading, the image is read again to publish the newest one
+        unsigned long l_raced = 0;
+        int l_result;
+        for ( ;; )
+        {
+            l_result = simxGetVisionSensorImage( l_car->m_client_id, l_car->m_vision_sensor_handle, 
+                    l_cam_resolution, &l_image_camera, 1, simx_opmode_buffer );
+            int l_after_time = simxGetLastCmdTime( l_car->m_client_id );
+            if ( l_result != simx_return_ok || l_after_time == l_cmd_time ) break;
+            l_cmd_time = l_after_time;
+            l_raced++;
+        }
+        if ( l_result != simx_return_ok )
+        {
+            usleep( CAR_FRAME_POLL_US );
+            continue;
+        }
+        l_last_cmd_time = l_cmd_time;
+
+        // store image and wake up waiting getImage
+        pthread_mutex_lock( &l_car->m_frame_mutex );
+        memcpy( l_car->m_frame.data(), l_image_camera, sizeof( simxUChar ) * t_camera::pixels );
+        l_car->m_frame_arrival_ns = latencyNow();
+        l_car->m_frame_seq++;
+        l_car->m_frame_stats.raced += l_raced;
+        pthread_cond_broadcast( &l_car->m_frame_cond );
+        if ( l_car->m_frame_fd >= 0 )
+        {
+            uint64_t l_one = 1;
+            if ( write( l_car->m_frame_fd, &l_one, sizeof( l_one ) ) < 0 && errno != EAGAIN )
+                l_car->m_frame_error = true;
+        }
+        pthread_mutex_unlock( &l_car->m_frame_mutex );
+    }
+
+    return nullptr;
+}
+
+
+template< class t_camera >
+int CoppeliaSimCarT< t_camera >::copsimSetServoPosition( float t_angle )
 {
     t_angle = MIN( t_angle, CAR_5TH_WHEEL_ANGLE_RAD );
     t_angle = MAX( t_angle, -CAR_5TH_WHEEL_ANGLE_RAD );
+    m_servo_angle = t_angle;
+
+    // the same position is not sent again
+    if ( !copsimCacheUpdate( COPPSIM_JOINT_SERVO, t_angle ) ) return 0;
 
     // call Remote API
+    long long l_start_ns = latencyNow();
     int l_retval = simxSetJointTargetPosition( m_client_id, m_servo_handle, t_angle, simx_opmode_oneshot );
-    if ( l_retval != simx_return_ok )
+
+    m_cmd_writes++;
+    if ( m_cmd_batch )
+        m_cmd_batch_writes++;
+    else
+    {
+        m_cmd_flushes++;
+        m_latency[ COPPSIM_LATENCY_COMMAND ].record( latencyNow() - l_start_ns );
+    }
+
+    if ( copsimNonBlockingFailed( l_retval ) )
     {
+        // the value is sent again by the next command
+        m_cache_valid[ COPPSIM_JOINT_SERVO ] = false;
+        m_faults.remote_errors++;
         fprintf( stderr, "Method %s failed!\n", __FUNCTION__ );
         return -1;
     }
@@ -172,12 +767,15 @@ int CoppeliaSimCar::copsimSetServoPosition( float t_angle )
 }
 
 
-int CoppeliaSimCar::copsimSetMotorTorque( float t_l_torque, float t_r_torque )
+template< class t_camera >
+int CoppeliaSimCarT< t_camera >::copsimSetMotorTorque( float t_l_torque, float t_r_torque )
 {
     t_l_torque = MIN( t_l_torque, CAR_MAX_TORQUE_N_M );
     t_l_torque = MAX( t_l_torque, -CAR_MAX_TORQUE_N_M );
     t_r_torque = MIN( t_r_torque, CAR_MAX_TORQUE_N_M );
     t_r_torque = MAX( t_r_torque, -CAR_MAX_TORQUE_N_M );
+    m_l_torque = t_l_torque;
+    m_r_torque = t_r_torque;
 
     float l_l_speed = CAR_MAX_SPEED_DEG_S;
     float l_r_speed = CAR_MAX_SPEED_DEG_S;
@@ -198,15 +796,46 @@ int CoppeliaSimCar::copsimSetMotorTorque( float t_l_torque, float t_r_torque )
     }
 
     int l_retval = 0;
+    int l_writes = 0;
 
-    // call Remote API
-    l_retval |= simxSetJointTargetVelocity( m_client_id, m_left_motor_handle, l_l_speed, simx_opmode_oneshot );
-    l_retval |= simxSetJointForce( m_client_id, m_left_motor_handle, t_l_torque, simx_opmode_oneshot );
-    l_retval |= simxSetJointTargetVelocity( m_client_id, m_right_motor_handle, l_r_speed, simx_opmode_oneshot );
-    l_retval |= simxSetJointForce( m_client_id, m_right_motor_handle, t_r_torque, simx_opmode_oneshot );
+    // call Remote API, only for changed values
+    long long l_start_ns = latencyNow();
+    if ( copsimCacheUpdate( COPPSIM_JOINT_LEFT_VELOCITY, l_l_speed ) )
+    {
+        l_retval |= simxSetJointTargetVelocity( m_client_id, m_left_motor_handle, l_l_speed, simx_opmode_oneshot );
+        l_writes++;
+    }
+    if ( copsimCacheUpdate( COPPSIM_JOINT_LEFT_FORCE, t_l_torque ) )
+    {
+        l_retval |= simxSetJointForce( m_client_id, m_left_motor_handle, t_l_torque, simx_opmode_oneshot );
+        l_writes++;
+    }
+    if ( copsimCacheUpdate( COPPSIM_JOINT_RIGHT_VELOCITY, l_r_speed ) )
+    {
+        l_retval |= simxSetJointTargetVelocity( m_client_id, m_right_motor_handle, l_r_speed, simx_opmode_oneshot );
+        l_writes++;
+    }
+    if ( copsimCacheUpdate( COPPSIM_JOINT_RIGHT_FORCE, t_r_torque ) )
+    {
+        l_retval |= simxSetJointForce( m_client_id, m_right_motor_handle, t_r_torque, simx_opmode_oneshot );
+        l_writes++;
+    }
+    if ( !l_writes ) return 0;
 
-    if ( l_retval != simx_return_ok )
+    m_cmd_writes += l_writes;
+    if ( m_cmd_batch )
+        m_cmd_batch_writes += l_writes;
+    else
     {
+        m_cmd_flushes += l_writes;
+        m_latency[ COPPSIM_LATENCY_COMMAND ].record( latencyNow() - l_start_ns );
+    }
+
+    if ( copsimNonBlockingFailed( l_retval ) )
+    {
+        // the values are sent again by the next command
+        copsimCacheInvalidate();
+        m_faults.remote_errors++;
         fprintf( stderr, "Method %s failed!\n", __FUNCTION__);
         return -1;
     }
@@ -214,3 +843,9 @@ int CoppeliaSimCar::copsimSetMotorTorque( float t_l_torque, float t_r_torque )
     return 0;
 }
 
+
+// the car is compiled for all supported cameras
+template class CoppeliaSimCarT< CarCameraLine128 >;
+template class CoppeliaSimCarT< CarCameraLine256 >;
+template class CoppeliaSimCarT< CarCameraDual128 >;
+
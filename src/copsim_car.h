@@ -14,11 +14,37 @@
 
 /**
  * @mainpage List of all modules.
+ * @see car.h
+ * @see headless_car.h
+ * @see headless_batch.h
+ * @see track_map.h
+ * @see controller.h
+ * @see linedetect.h
+ * @see latency.h
+ * @see remote_server.h
+ * @see reactor.h
+ * @see runner.h
+ * @see laptimer.h
+ * @see optimizer.h
+ * @see telemetry.h
+ * @see linearchive.h
+ * @see metrics.h
+ * @see replay.h
  * @see trackview.h
  * @see gamepad.h
  * @see copsim_car.h
  * @see demo_car_simple.cpp
  * @see demo_car_gamepad.cpp
+ * @see demo_car_runner.cpp
+ * @see replay_check.cpp
+ * @see linedetect_bench.cpp
+ * @see headless_server.cpp
+ * @see car_bench.cpp
+ * @see track_eval.cpp
+ * @see gain_opt.cpp
+ * @see linearchive_tool.cpp
+ * @see batch_bench.cpp
+ * @see alamak_top.cpp
  *
  * @brief The Alamak car model in the CoppeliaSim -- Robotics Simulator.
  *
@@ -33,35 +59,26 @@
  * but they were adopted from previous generation of racing track. 
  */
 
-#include <math.h>
+#include <pthread.h>
 
 extern "C" {
     #include "extApi.h"
 }
 
-/// Line camera (vision sensor) resolution. 
-#define CAR_CAM_RESOLUTION              128 
-
-/// Rotation of 5th (a virtual front) steering wheel in degrees
-#define CAR_5TH_WHEEL_ANGLE_DEG         30
-/// Rotation of 5th wheel in RAD 
-#define CAR_5TH_WHEEL_ANGLE_RAD         ( CAR_5TH_WHEEL_ANGLE_DEG * M_PI / 180 )
-
-/// The Alamak wheel diameter 
-#define CAR_WHEEL_DIAMETER_M           0.064
-/// The limit of car speed in meters per seconds 
-#define CAR_MAX_SPEED_M_S               1.2
-/// The car speed recalculated to rotation speed 
-#define CAR_MAX_SPEED_DEG_S             ( ( CAR_MAX_SPEED_M_S / ( CAR_WHEEL_DIAMETER_M * M_PI ) ) * 360 )
-
-/// The real torque on a rear wheels. 
-#define CAR_MAX_REAL_TORQUE_N_M         0.1
-/// Reduced torque for model, the real torque is too high
-#define CAR_MAX_TORQUE_N_M              ( CAR_MAX_REAL_TORQUE_N_M / 3 )
+#include "car.h"
+#include "latency.h"
 
 /// The timeout for next image from line camera (vision sensor)
 #define CAR_GETIMAGE_TIMEOUT_MS         5000
 
+/// The period of checking the time of the last Remote API message by the frame receiver thread
+#define CAR_FRAME_POLL_US               100
+
+/// Default tolerance of the command cache as a fraction of the joint range, see \ref CoppeliaSimCarT::setCommandCache
+#define COPPSIM_CMD_EPSILON             0.001
+/// Default number of images after which all joints are written again, see \ref CoppeliaSimCarT::setCommandCache
+#define COPPSIM_CMD_REFRESH_FRAMES      50
+
 /// The object names in CoppeliaSim scene 
 /// @name 
 /// @{
@@ -69,8 +86,45 @@ extern "C" {
 #define COPPSIM_OBJNAME_RIGHT_MOTOR     "Motor_Right"
 #define COPPSIM_OBJNAME_SERVO           "Servo"
 #define COPPSIM_OBJNAME_VISION_SENSOR   "Vision_Sensor"
+#define COPPSIM_OBJNAME_BODY            "Board"
 /// @}
 
+/** @brief Statistics of images delivered by \ref CoppeliaSimCar::getImage.
+ *
+ * The age of image is measured from the moment, when the receiver thread noticed it,
+ * so it does not include up to \ref CAR_FRAME_POLL_US before it and the network transfer.
+ */
+struct CarFrameStats
+{
+    unsigned long frames;               ///< Number of consumed images.
+    unsigned long dropped;              ///< Number of received images overwritten before they were consumed.
+    unsigned long raced;                ///< Number of images which arrived during reading of the previous one, the buffer was read again.
+    double last_age_us;                 ///< Time the last image waited in the buffer before it was consumed.
+    double avg_age_us;                  ///< Average time an image waited in the buffer.
+    double max_age_us;                  ///< Maximal time an image waited in the buffer.
+};
+
+/// Latency histograms of \ref CoppeliaSimCar.
+enum CoppeliaSimLatency
+{
+    COPPSIM_LATENCY_WAIT,               ///< Time spent in \ref CoppeliaSimCar::getImage.
+    COPPSIM_LATENCY_AGE,                ///< Time an image waited in the buffer before it was consumed, see \ref CarFrameStats.
+    COPPSIM_LATENCY_COMMAND,            ///< Time of sending command packet (commit or single write).
+    COPPSIM_LATENCY_STEP,               ///< Time of simulation step in the synchronous mode.
+    COPPSIM_LATENCY_COUNT               ///< Number of histograms.
+};
+
+/// Joint values remembered by the command cache of \ref CoppeliaSimCarT.
+enum CoppeliaSimJoint
+{
+    COPPSIM_JOINT_SERVO,                ///< Target position of servo.
+    COPPSIM_JOINT_LEFT_VELOCITY,        ///< Target velocity of left motor.
+    COPPSIM_JOINT_LEFT_FORCE,           ///< Force of left motor.
+    COPPSIM_JOINT_RIGHT_VELOCITY,       ///< Target velocity of right motor.
+    COPPSIM_JOINT_RIGHT_FORCE,          ///< Force of right motor.
+    COPPSIM_JOINT_COUNT                 ///< Number of joint values.
+};
+
 /**
  * @brief The interface between the car model in CoppeliaSim and a remote control program. 
  *
@@ -80,15 +134,20 @@ extern "C" {
  *   - The internal interface must substitute a missing real car hardware with car model in
  *   CoppeliaSim using the Remote API interface. 
  *
+ * The vision sensor in the scene must have the resolution of camera t_camera.
+ * The class is compiled for all cameras listed in car.h, \ref CoppeliaSimCar uses the default one.
+ *
+ * @tparam t_camera The geometry of line camera, see \ref CarCamera.
  */
-class CoppeliaSimCar
+template< class t_camera >
+class CoppeliaSimCarT : public CarT< t_camera >
 {
 public:
 
     /** Constructor initializes member variables. */
-    CoppeliaSimCar();
+    CoppeliaSimCarT();
     /** Destructor */
-    ~CoppeliaSimCar();
+    virtual ~CoppeliaSimCarT();
 
     /**
      * @brief Initialization opens connection to CoppeliaSim.
@@ -97,22 +156,42 @@ public:
      * necessary handles for crucial object in CoppeliaSim scene. 
      * Also the data streaming from CoppeliaSim is started. 
      *
+     * In the synchronous mode the simulation does not run in real time. 
+     * Every simulation step must be triggered by \ref step (or implicitly by \ref getImage), 
+     * so the simulation runs as fast as the control program consumes images. 
+     *
      * @param t_port_number The port number opened in CoppeliaSim for Remote API connection. 
+     * @param t_synchronous Enable the synchronous (lockstep) mode. 
      * @return When the initialization passed correctly the function returns 0, otherwise -1.
      */
-    int init( int t_port_number );
+    int init( int t_port_number, bool t_synchronous = false );
+
+    /** @brief Trigger exactly one simulation step in the synchronous mode. 
+     *
+     * This method triggers next simulation step and it waits until the step is performed 
+     * and all streamed data of this step are delivered. 
+     * The next call of \ref getImage returns image captured in this step without waiting. 
+     * When \ref getImage is called without previous step, the step is triggered implicitly. 
+     *
+     * @return When the step was performed, it returns 0. Otherwise (or when the synchronous mode is not enabled) -1.
+     */
+    int step();
 
     /** @brief Capture single image from line camera (vision sensor).
      *
      * This method waits for next image from line camera, represented by vision sensor. 
      * The timeout for the next image is internally specified by @ref CAR_GETIMAGE_TIMEOUT_MS. 
+     * In the synchronous mode it returns image of the last step triggered by \ref step. 
+     *
+     * Otherwise the images are received by an internal thread and this method is woken up 
+     * by a condition variable immediately when the next image arrives. 
      *
      * @param t_img Buffer for 8bit B&W image from line camera. 
      * The length of this buffer is defined by vision sensor resolution. 
-     * In this code is represented by \ref CAR_CAM_RESOLUTION.
+     * In this code is represented by t_camera::pixels.
      * @return When an image from CoppeliaSim is captured correctly, it returns 0. Otherwise -1.  
      */
-    int getImage( unsigned char *t_img );
+    int getImage( unsigned char *t_img ) override;
 
     /** @brief Set servo position.
      *
@@ -122,7 +201,7 @@ public:
      * @param t_position The position of servo is represented by value of range <-1.0, 1.0>. 
      * According to right-hand rule the value 1.0 is turning to the left and -1.0 to the right. 
      */
-    void setServo( float t_position );
+    void setServo( float t_position ) override;
 
     /** @brief Set power of motors. 
      *
@@ -132,14 +211,126 @@ public:
      * In CoppeliaSim the motor power is represented by torque. 
      * Internally the PWM is recalculated to torque specified by reduced torque \ref CAR_MAX_TORQUE_N_M.
     */
-    void setMotorPWM( float t_l_pwm, float t_r_pwm );
+    void setMotorPWM( float t_l_pwm, float t_r_pwm ) override;
 
     /** @brief Move car back to starting position in the CoppeliaSim scene. 
      */
-    void resetCar();
+    void resetCar() override;
+
+    /** @brief Start a batch of commands. 
+     *
+     * The Remote API communication is paused and all following calls of \ref setServo 
+     * and \ref setMotorPWM are only stored. They are sent together in a single packet by \ref commit, 
+     * so the steering and the power of motors take effect in the same simulation step. 
+     */
+    void beginCommands() override;
+
+    /** @brief Send all commands stored since \ref beginCommands in a single packet. 
+     *
+     * @return When the communication was resumed correctly, it returns 0. Otherwise -1.
+     */
+    int commit() override;
+
+    /** @brief Get simulation time of the last command executed by CoppeliaSim in seconds. 
+     */
+    double getSimTime() override;
+
+    /** @brief Get the number of command flushes. 
+     *
+     * Every \ref commit with at least one write is counted once. 
+     * Without a batch every single Remote API write is counted separately. 
+     * It is a count of calls, not of network packets, the extApi client merges and splits
+     * the packets on its own. The received messages are counted by \ref RemoteApiServer (see headless_server).
+     */
+    unsigned long getCommandFlushes() { return m_cmd_flushes; }
+
+    /** @brief Get the number of Remote API writes (joint commands) sent to CoppeliaSim. 
+     */
+    unsigned long getCommandWrites() { return m_cmd_writes; }
+
+    /** @brief Get the number of joint writes suppressed by the command cache. 
+     */
+    unsigned long getCommandSuppressed() { return m_cmd_suppressed; }
+
+    /** @brief Configure the command cache. 
+     *
+     * The last value sent to every joint is remembered and the write is skipped, 
+     * when the new value differs less than t_epsilon of the joint range 
+     * (\ref CAR_5TH_WHEEL_ANGLE_RAD, \ref CAR_MAX_SPEED_DEG_S, \ref CAR_MAX_TORQUE_N_M). 
+     * All joints are written again after t_refresh_frames images and after \ref resetCar, 
+     * so a lost or overridden value is corrected. 
+     *
+     * @param t_epsilon The tolerance as a fraction of range, 0 suppresses only the same values, negative disables cache. 
+     * @param t_refresh_frames The period of refresh in images, 0 means no periodic refresh. 
+     */
+    void setCommandCache( float t_epsilon, int t_refresh_frames );
+
+    /** @brief Get the last streamed pose of car body \ref COPPSIM_OBJNAME_BODY.
+     *
+     * The position, orientation (Euler angles of CoppeliaSim) and velocity of body in the scene
+     * and the angles of motor joints are streamed since the first image. 
+     * This method only reads the local Remote API buffer, it never waits for CoppeliaSim. 
+     *
+     * @return When all values were received, it returns 0. Otherwise -1.
+     */
+    int getPose( CarPose &t_pose ) override;
+
+    /** @brief Save the last streamed state of car body, servo and the last commands.
+     *
+     * The speeds of wheels are not streamed, they are both set to the speed of body.
+     * @return When the pose was received, it returns 0. Otherwise -1.
+     */
+    int saveSnapshot( CarSnapshot &t_snapshot ) override;
+
+    /** @brief Move car body to the saved state without waiting for CoppeliaSim.
+     *
+     * The pose of body \ref COPPSIM_OBJNAME_BODY, the angles of joints and the saved commands
+     * are sent together in a single packet (see \ref commit), so CoppeliaSim applies them
+     * before the next simulation step. The streamed pose is refreshed by the next step.
+     * The velocity is not restored, the initial velocity of shape is applied only by a dynamics reset,
+     * which the legacy Remote API can not request. The body keeps its current velocity.
+     *
+     * @return When the packet was sent, it returns \ref CAR_SNAPSHOT_NO_VELOCITY. Otherwise -1.
+     */
+    int restoreSnapshot( const CarSnapshot &t_snapshot ) override;
+
+    /** @brief Get file descriptor signalling a new image for an event loop, see \ref Reactor.
+     *
+     * The descriptor (eventfd) is readable when an image was received and not consumed yet,
+     * so the following \ref getImage returns without waiting. It is created and the frame receiver
+     * is started by the first call. The descriptor is owned by the car.
+     *
+     * @return The file descriptor, or -1 in the synchronous mode or when the car is not connected.
+     */
+    int getFrameFd() override;
+
+    /** @brief Get statistics of images delivered by \ref getImage. 
+     *
+     * The age of image is measured from the moment, when the receiver thread noticed it, to its consumption by \ref getImage. 
+     */
+    void getFrameStats( CarFrameStats &t_stats );
+
+    /** @brief Get counters of timeouts of \ref getImage and failed Remote API calls. */
+    void getFaults( CarFaults &t_faults ) override { t_faults = m_faults; }
+
+    /** @brief Get latency histogram, it can be read while the car is running. */
+    const LatencyHistogram &getLatency( CoppeliaSimLatency t_latency ) const { return m_latency[ t_latency ]; }
+
+    /** @brief Print all latency histograms. */
+    void printLatency( FILE *t_file ) const;
 
 protected:
 
+    /** @brief Check the value of joint in command cache. 
+     *
+     * @return When the value must be sent it returns true and the value is remembered, otherwise false. 
+     */
+    bool copsimCacheUpdate( CoppeliaSimJoint t_joint, float t_value );
+
+    /** @brief Forget all remembered values, all joints are written by next commands. 
+     */
+    void copsimCacheInvalidate();
+
     /** @brief The interface between CoppeliaSim Remote API and \ref setServo.
      */
     int copsimSetServoPosition( float t_angle );
@@ -148,15 +339,76 @@ protected:
      */
     int copsimSetMotorTorque( float t_l_torque, float t_r_torque );
 
+    /** @brief Start streaming of images from vision sensor.
+     */
+    int copsimStartStreaming();
+
+    /** @brief Start streaming of pose of car body and angles of wheels.
+     */
+    int copsimStartPoseStreaming();
+
+    /** @brief Start the frame receiver thread. 
+     */
+    int copsimStartReceiver();
+
+    /** @brief Stop the frame receiver thread. 
+     */
+    void copsimStopReceiver();
+
+    /** @brief The frame receiver thread function. 
+     */
+    static void *copsimReceiverThread( void *t_arg );
+
     int m_client_id;                    ///< Remote API Client ID of connection to CoppeliaSim 
     int m_left_motor_handle;            ///< Handle for left motor \ref COPPSIM_OBJNAME_LEFT_MOTOR
     int m_right_motor_handle;           ///< Handle for right motor \ref COPPSIM_OBJNAME_RIGHT_MOTOR
     int m_servo_handle;                 ///< Handle for servo \ref COPPSIM_OBJNAME_SERVO
     int m_vision_sensor_handle;         ///< Handle for vision sensor \ref COPPSIM_OBJNAME_VISION_SENSOR !g!D
+    int m_body_handle;                  ///< Handle for car body \ref COPPSIM_OBJNAME_BODY, -1 when the scene has no body
 
     bool m_copsim_initialized;          ///< Internal variable
+    bool m_synchronous;                 ///< Synchronous (lockstep) mode is enabled
+    bool m_step_pending;                ///< Step was triggered and its image was not read yet
 
-};
+    bool m_cmd_batch;                   ///< The batch of commands is open, communication is paused
+    unsigned long m_cmd_flushes;        ///< Number of commits and single writes outside batch
+    unsigned long m_cmd_writes;         ///< Number of Remote API writes
+    unsigned long m_cmd_suppressed;     ///< Number of writes suppressed by command cache
+    unsigned long m_cmd_batch_writes;   ///< Number of Remote API writes in the open batch
+    float m_servo_angle;                ///< The last requested angle of servo, see \ref saveSnapshot
+    float m_l_torque;                   ///< The last requested torque of left motor
+    float m_r_torque;                   ///< The last requested torque of right motor
+    CarFaults m_faults;                 ///< Counters of failures, see \ref getFaults
+
+    /// @name The command cache, see \ref setCommandCache
+    /// @{
+    float m_cache_epsilon;              ///< Tolerance as a fraction of joint range, negative when disabled
+    int m_cache_refresh_frames;         ///< Period of refresh in images
+    int m_cache_age_frames;             ///< Images since the last refresh
+    float m_cache_value[ COPPSIM_JOINT_COUNT ]; ///< The last sent values
+    bool m_cache_valid[ COPPSIM_JOINT_COUNT ];  ///< The value was sent since the last refresh
+    /// @}
+
+    LatencyHistogram m_latency[ COPPSIM_LATENCY_COUNT ]; ///< Latency histograms, see \ref CoppeliaSimLatency
 
+    /// @name The frame receiver thread and the last received image 
+    /// @{
+    pthread_t m_frame_thread_id;        ///< Thread ID of the frame receiver
+    bool m_frame_thread_running;        ///< The frame receiver is running
+    bool m_frame_thread_stop;           ///< Request to stop the frame receiver
+    bool m_frame_error;                 ///< The frame receiver lost connection
+    pthread_mutex_t m_frame_mutex;      ///< Protects the frame data
+    pthread_cond_t m_frame_cond;        ///< Signalled when a new image arrives
+    typename t_camera::Image m_frame;   ///< The last received image
+    unsigned long m_frame_seq;          ///< Sequence number of the last received image
+    unsigned long m_frame_read_seq;     ///< Sequence number of the last consumed image
+    long long m_frame_arrival_ns;       ///< Monotonic time of arrival of the last image
+    int m_frame_fd;                     ///< Eventfd readable while an image is not consumed, see \ref getFrameFd
+    CarFrameStats m_frame_stats;        ///< Statistics of consumed images
+    /// @}
+
+};
 
+/// The CoppeliaSim car with the default camera.
+typedef CoppeliaSimCarT< CarDefaultCamera > CoppeliaSimCar;
 
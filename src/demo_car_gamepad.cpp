@@ -15,7 +15,6 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
-#include <poll.h>
 #include <math.h>
 #include <fcntl.h>
 #include <string.h>
@@ -23,13 +22,27 @@
 
 #include "gamepad.h"
 #include "copsim_car.h"
+#include "headless_car.h"
+#include "track_map.h"
+#include "laptimer.h"
 #include "trackview.h"
+#include "telemetry.h"
+#include "metrics.h"
+#include "latency.h"
+#include "reactor.h"
 
 #define HELP                                                        \
-    "Usage: %s [-h] [-notrack] port_number\n"                       \
+    "Usage: %s [-h] [-notrack] [-fps N] [-sync] [-record file] [-metrics name] [-track string] [-origin x,y,yaw] port_number|-headless\n" \
     "  -h               this help\n"                                \
     "  -notrack         do not display track\n"                     \
-    "  port_number      localhost port number for Remote API\n\n" 
+    "  -fps N           refresh rate of track display (default 30)\n" \
+    "  -sync            synchronous (lockstep) simulation mode\n"   \
+    "  -record file     record images and commands to telemetry file\n" \
+    "  -metrics name    publish live metrics in shared memory, e.g. /alamak\n" \
+    "  port_number      localhost port number for Remote API\n"     \
+    "  -headless        use headless car model instead of CoppeliaSim\n" \
+    "  -track string    track definition for headless model and lap timer, e.g. \"S R S L S R S R\"\n" \
+    "  -origin x,y,yaw  start of track in the CoppeliaSim scene for lap timer (m, m, deg)\n\n"
 
 int main( int argc, char* argv[] )
 {
@@ -37,6 +50,13 @@ int main( int argc, char* argv[] )
     int l_port_num = -1;
     int l_help = 0;
     int l_notrack = 0;
+    int l_fps = TRACKVIEW_DEFAULT_FPS;
+    int l_sync = 0;
+    int l_headless = 0;
+    const char *l_track = nullptr;
+    const char *l_record = nullptr;
+    const char *l_metrics = nullptr;
+    float l_origin[ 3 ] = { 0, 0, 0 };
 
     for ( int i = 1; i < argc; i++ )
     {
@@ -48,67 +68,171 @@ int main( int argc, char* argv[] )
         {
             l_notrack = 1;
         }
+        if ( !strcmp( argv[ i ], "-sync" ) )
+        {
+            l_sync = 1;
+        }
+        if ( !strcmp( argv[ i ], "-headless" ) )
+        {
+            l_headless = 1;
+        }
+        if ( !strcmp( argv[ i ], "-fps" ) && i + 1 < argc )
+        {
+            l_fps = atoi( argv[ ++i ] );
+            continue;
+        }
+        if ( !strcmp( argv[ i ], "-record" ) && i + 1 < argc )
+        {
+            l_record = argv[ ++i ];
+            continue;
+        }
+        if ( !strcmp( argv[ i ], "-metrics" ) && i + 1 < argc )
+        {
+            l_metrics = argv[ ++i ];
+            continue;
+        }
+        if ( !strcmp( argv[ i ], "-track" ) && i + 1 < argc )
+        {
+            l_track = argv[ ++i ];
+            continue;
+        }
+        if ( !strcmp( argv[ i ], "-origin" ) && i + 1 < argc )
+        {
+            if ( sscanf( argv[ ++i ], "%f,%f,%f", &l_origin[ 0 ], &l_origin[ 1 ], &l_origin[ 2 ] ) != 3 ) l_help = 1;
+            continue;
+        }
         if ( *argv[ i ] != '-' )
         {
             l_port_num = atoi( argv[ i ] );
         }
 
     }
-    if ( l_port_num < 0 || l_help )
+    if ( ( l_port_num < 0 && !l_headless ) || l_help )
     {
         printf( HELP, argv[ 0 ] );
         exit( 0 );
     }
 
+    TrackMap l_track_map;
+    if ( l_track && l_track_map.compile( l_track ) < 0 )
+    {
+        fprintf( stderr, "Unable to compile track!\n" );
+        exit( 1 );
+    }
+
     CoppeliaSimCar l_coppsim_car;
-    if ( l_coppsim_car.init( l_port_num ) < 0 ) 
+    HeadlessCar l_headless_car( l_track ? &l_track_map : nullptr );
+    Car &l_backend_car = l_headless ? ( Car & ) l_headless_car : ( Car & ) l_coppsim_car;
+
+    // all cycles are recorded when requested
+    TelemetryRecorder l_recorder;
+    if ( l_record && l_recorder.open( l_record ) < 0 )
+    {
+        fprintf( stderr, "Unable to open telemetry file!\n" );
+        exit( 1 );
+    }
+    RecordingCar l_recording_car( l_backend_car, l_recorder );
+    Car &l_recorded_car = l_record ? ( Car & ) l_recording_car : l_backend_car;
+
+    // the live metrics are read by alamak_top
+    MetricsPublisher l_metrics_page;
+    if ( l_metrics && l_metrics_page.open( l_metrics, 1 ) < 0 ) exit( 1 );
+    MeteredCar l_metered_car( l_recorded_car, l_metrics_page.getSlot( 0 ) );
+    Car &l_car = l_metrics ? ( Car & ) l_metered_car : l_recorded_car;
+
+    if ( !l_headless && l_coppsim_car.init( l_port_num, l_sync ) < 0 ) 
     {
         fprintf( stderr, "CoppeliaSim not connected!\n" );
         exit( 1 );
     }
 
+    // the gamepad is read by the event loop, no thread is needed
     GamepadThreadData l_gamepad_data;
-    if ( gamepadStart( l_gamepad_data ) < 0 )
+    if ( gamepadOpen( l_gamepad_data ) < 0 )
     {
         fprintf( stderr, "Unable to initialize gamepad!\n" );
         exit( 1 );
     }
 
-    if ( !l_notrack && trackviewStart() < 0 )
+    if ( !l_notrack && trackviewStart( l_fps ) < 0 )
     {
         fprintf( stderr, "Unable to initialize trackview!\n" );
         exit( 1 );
     }
 
-    fprintf( stderr, "Type 'quit'...\n" );
-    pollfd l_pfd = { 0, POLLIN };
+    // every stage of control loop is measured
+    LatencyProfile l_profile;
+    int l_stage_image = l_profile.addStage( "image" );
+    int l_stage_trackview = l_profile.addStage( "trackview" );
+    int l_stage_control = l_profile.addStage( "control" );
+    int l_stage_commands = l_profile.addStage( "commands" );
+
+    // laps are timed on the track given by definition
+    LapTimer l_lap_timer( &l_track_map );
+    l_lap_timer.setOrigin( l_origin[ 0 ], l_origin[ 1 ], l_origin[ 2 ] * M_PI / 180 );
+    bool l_lap_restart = true;
 
-    while ( true ) 
+    unsigned l_restart_presses = 0;
+    unsigned l_last_buttons = 0;
+    CarSnapshot l_snapshot;
+    bool l_has_snapshot = false;
+    Reactor l_reactor;
+
+    // one control cycle for every image
+    auto l_control = [ & ]( unsigned t_events )
     {
+        l_profile.begin();
+
         unsigned char l_img[ CAR_CAM_RESOLUTION ];
-        if ( l_coppsim_car.getImage( l_img ) < 0 )
+        if ( l_car.getImage( l_img ) < 0 )
         {
             fprintf( stderr, "Unable to get image!\n" );
-            break;
+            l_reactor.stop();
+            return;
         }
+        l_profile.mark( l_stage_image );
+
         if ( !l_notrack ) trackviewAddImage( l_img );
+        l_profile.mark( l_stage_trackview );
+
+        // all values come from the same moment
+        GamepadState l_gamepad;
+        gamepadGetState( l_gamepad_data, l_gamepad );
 
-        if ( l_gamepad_data.restart_button )
+        if ( l_gamepad.restart_presses != l_restart_presses )
         {
-            l_coppsim_car.resetCar();
-            l_gamepad_data.restart_button = false;
-            continue;
+            l_car.resetCar();
+            l_restart_presses = l_gamepad.restart_presses;
+            l_lap_restart = true;
+            return;
+        }
+
+        // a hard part of track can be driven again from the saved state
+        unsigned l_pressed = l_gamepad.buttons & ~l_last_buttons;
+        l_last_buttons = l_gamepad.buttons;
+        if ( l_pressed & ( 1u << JS_BUTTON_SNAPSHOT ) )
+        {
+            l_has_snapshot = l_car.saveSnapshot( l_snapshot ) == 0;
+            fprintf( stderr, l_has_snapshot ? "Snapshot saved\n" : "Unable to save snapshot!\n" );
+        }
+        if ( ( l_pressed & ( 1u << JS_BUTTON_RESTORE ) ) && l_has_snapshot )
+        {
+            int l_ret = l_car.restoreSnapshot( l_snapshot );
+            if ( l_ret < 0 ) fprintf( stderr, "Unable to restore snapshot!\n" );
+            else if ( l_ret == CAR_SNAPSHOT_NO_VELOCITY ) fprintf( stderr, "Snapshot restored without velocity\n" );
+            l_lap_restart = true;
+            return;
         }
     
         // servo position computed from thumbstick position
         float l_servo = 0;
-        if ( abs( l_gamepad_data.axis_steer_wheel ) > JS_AXIS_STEPS / 1000 )
-            l_servo = - ( float ) l_gamepad_data.axis_steer_wheel / JS_AXIS_STEPS;
+        if ( abs( l_gamepad.axis_steer_wheel ) > JS_AXIS_STEPS / 1000 )
+            l_servo = - ( float ) l_gamepad.axis_steer_wheel / JS_AXIS_STEPS;
 
         // the motor's power is computed from the thumbstick position
         float l_pwm = 0;
-        if ( abs( l_gamepad_data.axis_speed ) > JS_AXIS_STEPS / 1000 )
-            l_pwm = - ( float ) l_gamepad_data.axis_speed / JS_AXIS_STEPS;
+        if ( abs( l_gamepad.axis_speed ) > JS_AXIS_STEPS / 1000 )
+            l_pwm = - ( float ) l_gamepad.axis_speed / JS_AXIS_STEPS;
         l_pwm *= fabs( l_pwm ); // nonlinear power control
         float l_l_pwm = l_pwm;
         float l_r_pwm = l_pwm;
@@ -119,25 +243,113 @@ int main( int argc, char* argv[] )
             l_l_pwm = l_l_pwm * ( 1.0 - fabs( l_servo ) * l_inner_wheel_reduction ); 
         if ( l_servo < 0 )
             l_r_pwm = l_r_pwm * ( 1.0 - fabs( l_servo ) * l_inner_wheel_reduction ); 
+        l_profile.mark( l_stage_control );
 
-        l_coppsim_car.setServo( l_servo );
-        l_coppsim_car.setMotorPWM( l_l_pwm, l_r_pwm );
+        // steering and power are sent together in one packet
+        l_car.beginCommands();
+        l_car.setServo( l_servo );
+        l_car.setMotorPWM( l_l_pwm, l_r_pwm );
+        l_car.commit();
+        l_profile.mark( l_stage_commands );
+
+        // the pose is only read from buffer, it does not delay the control loop
+        CarPose l_pose;
+        if ( !l_track || l_car.getPose( l_pose ) < 0 ) return;
+        if ( l_lap_restart )
+        {
+            l_lap_timer.restart( l_pose );
+            l_lap_restart = false;
+            return;
+        }
+        LapTimerEvent l_event = l_lap_timer.update( l_pose );
+        if ( l_event == LAPTIMER_LAP )
+        {
+            const LapRecord &l_lap = l_lap_timer.getLaps().back();
+            fprintf( stderr, "Lap %d: %.2f s, %.2f m/s\n", l_lap_timer.getStats().laps, l_lap.time_s, l_lap.avg_speed_m_s );
+        }
+        else if ( l_event == LAPTIMER_OFF_TRACK )
+            fprintf( stderr, "Off track!\n" );
+    };
+
+    // the headless model is driven by gamepad in real time, every step is started by timer
+    int l_frame_fd = l_car.getFrameFd();
+    int l_err;
+    if ( l_frame_fd >= 0 )
+        l_err = l_reactor.addFd( l_frame_fd, l_control );
+    else if ( l_headless )
+        l_err = l_reactor.addTimer( ( long long ) ( HEADLESS_STEP_S * 1000000000LL ), l_control );
+    else
+        l_err = l_reactor.addIdle( l_control );
+    if ( l_err < 0 )
+    {
+        fprintf( stderr, "Unable to initialize event loop!\n" );
+        exit( 1 );
+    }
 
-        if ( poll( &l_pfd, 1, 0 ) == 1 )
+    l_err = l_reactor.addFd( l_gamepad_data.gamepad_fd, [ & ]( unsigned t_events )
+    {
+        if ( gamepadRead( l_gamepad_data ) < 0 )
         {
-            char l_line[ 128 ];
-            int l_len = read( 0, l_line, sizeof( l_line ) );
-            if ( l_len > 0 )
-            {
-                l_line[ l_len ] = 0;
-                if ( strcasecmp( l_line, "quit" ) == 0 ) break;
-            }
+            fprintf( stderr, "Gamepad disconnected!\n" );
+            l_reactor.remove( l_gamepad_data.gamepad_fd );
         }
+    } );
+    if ( l_err < 0 )
+    {
+        fprintf( stderr, "Unable to initialize event loop!\n" );
+        exit( 1 );
     }
 
+    // stdin without epoll support (regular file, /dev/null) is skipped, the demo is stopped by gamepad or Ctrl+C
+    int l_stdin = l_reactor.addFd( 0, [ & ]( unsigned t_events )
+    {
+        char l_line[ 128 ];
+        int l_len = read( 0, l_line, sizeof( l_line ) - 1 );
+        if ( l_len <= 0 )
+        {
+            // without terminal the demo runs until it is killed
+            l_reactor.remove( 0 );
+            return;
+        }
+        l_line[ l_len ] = 0;
+        if ( strncasecmp( l_line, "quit", 4 ) == 0 ) l_reactor.stop();
+        if ( strncasecmp( l_line, "stats", 5 ) == 0 ) l_profile.print( stderr );
+    } );
+
+    if ( l_stdin == 0 ) fprintf( stderr, "Type 'stats' or 'quit'...\n" );
+    l_reactor.run();
+
     fprintf( stderr, "Application exiting....\n" );
 
-    gamepadStop( l_gamepad_data );
+    l_profile.print( stderr );
+    const ReactorStats &l_reactor_stats = l_reactor.getStats();
+    fprintf( stderr, "Event loop wakeups: %lu, callbacks: %lu, timer overruns: %lu\n",
+            l_reactor_stats.wakeups, l_reactor_stats.dispatched, l_reactor_stats.timer_overruns );
+
+    if ( !l_headless )
+    {
+        l_coppsim_car.printLatency( stderr );
+        CarFrameStats l_frame_stats;
+        l_coppsim_car.getFrameStats( l_frame_stats );
+        fprintf( stderr, "Frames: %lu, dropped: %lu, raced: %lu, age avg: %.1f us, max: %.1f us\n", 
+                l_frame_stats.frames, l_frame_stats.dropped, l_frame_stats.raced, l_frame_stats.avg_age_us, l_frame_stats.max_age_us );
+        fprintf( stderr, "Command flushes: %lu, writes: %lu, suppressed: %lu\n", 
+                l_coppsim_car.getCommandFlushes(), l_coppsim_car.getCommandWrites(), 
+                l_coppsim_car.getCommandSuppressed() );
+    }
+
+    TrackviewStats l_trackview_stats;
+    if ( !l_notrack && trackviewGetStats( l_trackview_stats ) == 0 )
+        fprintf( stderr, "Trackview lines: %lu, redraws: %lu, skipped: %lu, render avg: %.2f ms, max: %.2f ms\n", 
+                l_trackview_stats.lines, l_trackview_stats.frames, l_trackview_stats.skipped, 
+                l_trackview_stats.avg_render_ms, l_trackview_stats.max_render_ms );
+
+    if ( l_track ) l_lap_timer.print( stderr );
+
+    if ( l_record )
+        fprintf( stderr, "Telemetry records: %lu, dropped: %lu\n", l_recorder.getCount(), l_recorder.getDropped() );
+
+    gamepadClose( l_gamepad_data );
     if ( !l_notrack ) trackviewStop();
 
     fprintf( stderr, "...done.\n" );
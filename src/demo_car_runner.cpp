@@ -0,0 +1,128 @@
+/**
+ * @file demo_car_runner.cpp
+ * @brief Module demo_car_runner
+ *
+ * This demo runs many cars in parallel, every car is driven by its own \ref LineController.
+ * The cars are connected to several CoppeliaSim instances or they are headless.
+ * The statistics of all cars are printed at the end.
+ *
+ * For more information see header files or use doxygen.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "runner.h"
+
+#define HELP                                                                \
+    "Usage: %s [-h] [-cars N] [-threads N] [-cycles N] [-laps N] [-sync]\n" \
+    "          [-record prefix] [-archive] [-metrics name] [-track string] port_number|-headless\n" \
+    "  -h               this help\n"                                        \
+    "  -cars N          number of cars (default 1)\n"                       \
+    "  -threads N       number of worker threads (default CPU cores)\n"     \
+    "  -cycles N        control cycles of every car (default 10000)\n"     \
+    "  -laps N          laps of every car (closed track), within -cycles\n" \
+    "  -sync            synchronous (lockstep) simulation mode\n"           \
+    "  -record prefix   record telemetry of every car to file prefixN.tel\n" \
+    "  -archive         record compressed line archives prefixN.lsa instead\n" \
+    "  -metrics name    publish live metrics in shared memory, e.g. /alamak\n" \
+    "  -track string    track definition for headless cars and lap timer\n" \
+    "  port_number      port of the first CoppeliaSim, next cars use next ports\n" \
+    "  -headless        use headless car models instead of CoppeliaSim\n\n"
+
+/// Every car gets its own controller with default parameters
+CarController *demoControllerFactory( int t_car, void *t_arg )
+{
+    return new LineController();
+}
+
+int main( int argc, char* argv[] )
+{
+    RunnerConfig l_config;
+    memset( &l_config, 0, sizeof( l_config ) );
+    l_config.cars = 1;
+    l_config.port = -1;
+
+    int l_help = 0;
+    int l_headless = 0;
+    const char *l_track = nullptr;
+
+    for ( int i = 1; i < argc; i++ )
+    {
+        if ( !strcmp( argv[ i ], "-h" ) )
+        {
+            l_help = 1;
+        }
+        else if ( !strcmp( argv[ i ], "-sync" ) )
+        {
+            l_config.synchronous = true;
+        }
+        else if ( !strcmp( argv[ i ], "-headless" ) )
+        {
+            l_headless = 1;
+        }
+        else if ( i + 1 < argc && !strcmp( argv[ i ], "-cars" ) )
+        {
+            l_config.cars = atoi( argv[ ++i ] );
+        }
+        else if ( i + 1 < argc && !strcmp( argv[ i ], "-threads" ) )
+        {
+            l_config.threads = atoi( argv[ ++i ] );
+        }
+        else if ( i + 1 < argc && !strcmp( argv[ i ], "-cycles" ) )
+        {
+            l_config.cycles = atol( argv[ ++i ] );
+        }
+        else if ( i + 1 < argc && !strcmp( argv[ i ], "-laps" ) )
+        {
+            l_config.laps = atoi( argv[ ++i ] );
+        }
+        else if ( !strcmp( argv[ i ], "-archive" ) )
+        {
+            l_config.archive = true;
+        }
+        else if ( i + 1 < argc && !strcmp( argv[ i ], "-record" ) )
+        {
+            l_config.record = argv[ ++i ];
+        }
+        else if ( i + 1 < argc && !strcmp( argv[ i ], "-metrics" ) )
+        {
+            l_config.metrics = argv[ ++i ];
+        }
+        else if ( i + 1 < argc && !strcmp( argv[ i ], "-track" ) )
+        {
+            l_track = argv[ ++i ];
+        }
+        else if ( *argv[ i ] != '-' )
+        {
+            l_config.port = atoi( argv[ i ] );
+        }
+    }
+    if ( ( l_config.port < 0 && !l_headless ) || l_config.cars < 1 || l_help )
+    {
+        printf( HELP, argv[ 0 ] );
+        exit( 0 );
+    }
+    if ( l_headless ) l_config.port = -1;
+
+    TrackMap l_track_map;
+    if ( l_track )
+    {
+        if ( l_track_map.compile( l_track ) < 0 )
+        {
+            fprintf( stderr, "Unable to compile track!\n" );
+            exit( 1 );
+        }
+        l_config.track = &l_track_map;
+    }
+
+    CarRunner l_runner( l_config, demoControllerFactory );
+    int l_ret = l_runner.run();
+    // the refused configuration has no statistics
+    if ( !l_runner.getCarStats().empty() ) l_runner.print( stdout );
+
+    return l_ret < 0 ? 1 : 0;
+}
+
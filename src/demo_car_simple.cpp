@@ -21,51 +21,72 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
-#include <poll.h>
 #include <math.h>
 #include <fcntl.h>
 #include <string.h>
 #include <pthread.h>
 
 #include "copsim_car.h"
+#include "headless_car.h"
+#include "latency.h"
+#include "reactor.h"
 
 int main(int argc,char* argv[])
 {
 
     int portNb=0;
+    bool l_sync = false;
+    bool l_headless = false;
 
     if (argc>=2)
     {
-        portNb=atoi(argv[1]);
+        if ( !strcmp( argv[ 1 ], "-headless" ) ) 
+            l_headless = true;
+        else
+            portNb=atoi(argv[1]);
     }
     else
     {
-        printf("Parametr port!\n");
+        printf("Parametr port|-headless [-sync]!\n");
         return 1;
     }
 
+    // optional synchronous (lockstep) mode
+    if ( argc >= 3 && !strcmp( argv[ 2 ], "-sync" ) ) l_sync = true;
+
     CoppeliaSimCar l_coppsim_car;
-    if ( l_coppsim_car.init( portNb ) < 0 ) 
+    HeadlessCar l_headless_car;
+    Car &l_car = l_headless ? ( Car & ) l_headless_car : ( Car & ) l_coppsim_car;
+
+    if ( !l_headless && l_coppsim_car.init( portNb, l_sync ) < 0 ) 
     {
         fprintf( stderr, "CoppeliaSim not connected!\n" );
         exit( 1 );
     }
 
-    fprintf( stderr, "Type 'quit'...\n" );
-    pollfd l_pfd = { 0, POLLIN };
-
     int l_turn = 0;
     int l_tout_limit = 100;
     int l_tout = l_tout_limit / 2; 
 
-    while ( true ) 
+    LatencyProfile l_profile;
+    int l_stage_image = l_profile.addStage( "image" );
+    int l_stage_commands = l_profile.addStage( "commands" );
+
+    Reactor l_reactor;
+
+    // one control cycle for every image
+    auto l_control = [ & ]( unsigned t_events )
     {
+        l_profile.begin();
+
         // Image from camera is ignored. Function is used only for synchronization with CoppeliaSim. 
-        if ( l_coppsim_car.getImage( nullptr ) < 0 )
+        if ( l_car.getImage( nullptr ) < 0 )
         {
             fprintf( stderr, "Unable to get image!\n" );
-            break;
+            l_reactor.stop();
+            return;
         }
+        l_profile.mark( l_stage_image );
 
         if ( !l_tout-- ) 
         {
@@ -73,31 +94,56 @@ int main(int argc,char* argv[])
             l_turn = !l_turn;
         }
 
+        // steering and power are sent together in one packet
+        l_car.beginCommands();
         if ( l_turn )
         {
-            l_coppsim_car.setServo( -0.5 );
-            l_coppsim_car.setMotorPWM( 0.5, 0.1 );
+            l_car.setServo( -0.5 );
+            l_car.setMotorPWM( 0.5, 0.1 );
         }
         else
         {
-            l_coppsim_car.setServo( 0.5 );
-            l_coppsim_car.setMotorPWM( -0.1, -0.5 );
+            l_car.setServo( 0.5 );
+            l_car.setMotorPWM( -0.1, -0.5 );
         }
+        l_car.commit();
+        l_profile.mark( l_stage_commands );
+    };
 
+    // the image arrival is signalled by descriptor, otherwise getImage does not wait for anything
+    int l_frame_fd = l_car.getFrameFd();
+    if ( ( l_frame_fd >= 0 ? l_reactor.addFd( l_frame_fd, l_control ) : l_reactor.addIdle( l_control ) ) < 0 )
+    {
+        fprintf( stderr, "Unable to initialize event loop!\n" );
+        exit( 1 );
+    }
 
-        if ( poll( &l_pfd, 1, 0 ) == 1 )
+    // stdin without epoll support (regular file, /dev/null) is skipped, the demo is stopped by Ctrl+C
+    int l_stdin = l_reactor.addFd( 0, [ & ]( unsigned t_events )
+    {
+        char l_line[ 128 ];
+        int l_len = read( 0, l_line, sizeof( l_line ) - 1 );
+        if ( l_len <= 0 )
         {
-            char l_line[ 128 ];
-            int l_len = read( 0, l_line, sizeof( l_line ) );
-            if ( l_len > 0 )
-            {
-                l_line[ l_len ] = 0;
-                if ( strcasecmp( l_line, "quit" ) == 0 ) break;
-            }
+            // without terminal the demo runs until it is killed
+            l_reactor.remove( 0 );
+            return;
         }
-    }
+        l_line[ l_len ] = 0;
+        if ( strncasecmp( l_line, "quit", 4 ) == 0 ) l_reactor.stop();
+    } );
+
+    if ( l_stdin == 0 ) fprintf( stderr, "Type 'quit'...\n" );
+    l_reactor.run();
 
     fprintf( stderr, "Application exiting....\n" );
+
+    l_profile.print( stderr );
+    const ReactorStats &l_reactor_stats = l_reactor.getStats();
+    fprintf( stderr, "Event loop wakeups: %lu, callbacks: %lu, timer overruns: %lu\n",
+            l_reactor_stats.wakeups, l_reactor_stats.dispatched, l_reactor_stats.timer_overruns );
+    if ( !l_headless ) l_coppsim_car.printLatency( stderr );
+
     fprintf( stderr, "...done.\n" );
 
     return 0;
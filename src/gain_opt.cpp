@@ -0,0 +1,351 @@
+/**
+ * @file gain_opt.cpp
+ * @brief Module gain_opt
+ *
+ * This program searches the parameters of \ref LineController with the best lap time on every track.
+ * Every track has its own search by \ref CmaEs. All candidates of one generation of all tracks are
+ * driven at once by headless cars (\ref CarRunner), so all CPU cores are used.
+ *
+ * The cost of candidate is the average lap time. When the car does not finish all laps within the time limit,
+ * the cost is the time limit increased by the part of unfinished laps. Every crash adds \ref RUNNER_CRASH_PENALTY_S,
+ * see \ref runnerCost.
+ *
+ * The state of search is stored to the checkpoint file after every generation, the search interrupted
+ * by Ctrl+C (or killed) continues from the last generation with -resume.
+ *
+ * For more information see header files or use doxygen.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <sys/param.h>
+#include <string>
+#include <vector>
+
+#include "runner.h"
+#include "optimizer.h"
+
+#define HELP                                                                \
+    "Usage: %s [-h] [-gen N] [-lambda N] [-sigma S] [-seed N] [-laps N] [-time S] [-threads N]\n" \
+    "          [-file name] [-track string]... [-param name=value]... [-checkpoint file] [-resume]\n" \
+    "  -h               this help\n"                                        \
+    "  -gen N           number of generations (default 50)\n"              \
+    "  -lambda N        population size, 0 for default (default 0)\n"       \
+    "  -sigma S         initial step size as a fraction of range (default 0.3)\n" \
+    "  -seed N          seed of random generator (default 1)\n"             \
+    "  -laps N          laps of every candidate (default 2)\n"              \
+    "  -time S          limit of simulation time of every candidate (default 60 s)\n" \
+    "  -threads N       number of worker threads (default CPU cores)\n"     \
+    "  -file name       file with track definitions, one per line, # for comments\n" \
+    "  -track string    track definition, it can be repeated\n"             \
+    "  -param name=value initial value of parameter, it can be repeated\n"  \
+    "  -checkpoint file state of search stored after every generation (default gain_opt.ckpt)\n" \
+    "  -resume          continue the search stored in checkpoint file\n\n"   \
+    "Without -file and -track the scene track \"" OPT_DEFAULT_TRACK "\" is used.\n\n"
+
+/// The track used when no other is specified
+#define OPT_DEFAULT_TRACK       "S R S L S R S R S S S O R S S O S R"
+/// The default checkpoint file
+#define OPT_DEFAULT_CHECKPOINT  "gain_opt.ckpt"
+
+/// The optimized parameter of \ref LineControllerParams and its range
+struct OptParam
+{
+    const char *name;                   ///< Name of parameter, see \ref lineControllerSetValue
+    float min;                          ///< Minimal value
+    float max;                          ///< Maximal value
+};
+
+/// The optimized parameters, the other parameters keep initial values
+static const OptParam g_opt_params[] =
+{
+    { "steer_p",                0.5,    6.0 },
+    { "steer_d",                0.0,    4.0 },
+    { "speed",                  0.2,    1.0 },
+    { "curve_slowdown",         0.0,    1.0 },
+    { "inner_wheel_reduction",  0.0,    1.0 },
+};
+
+/// The number of optimized parameters
+#define OPT_DIM                 ( ( int ) ( sizeof( g_opt_params ) / sizeof( g_opt_params[ 0 ] ) ) )
+
+/// Request to stop search after the current generation
+static volatile sig_atomic_t g_opt_stop = 0;
+
+/// Signal handler of Ctrl+C
+static void optSignal( int t_signal )
+{
+    g_opt_stop = 1;
+}
+
+/// Every car gets controller with the parameters of its candidate
+CarController *optControllerFactory( int t_car, void *t_arg )
+{
+    const std::vector< LineControllerParams > *l_params = ( const std::vector< LineControllerParams > * ) t_arg;
+    return new LineController( ( *l_params )[ t_car ] );
+}
+
+/// Convert point of unit box to parameters of controller
+static void optDecode( const std::vector< double > &t_x, const LineControllerParams &t_base, LineControllerParams &t_params )
+{
+    t_params = t_base;
+    for ( int i = 0; i < OPT_DIM; i++ )
+        lineControllerSetValue( t_params, g_opt_params[ i ].name,
+                g_opt_params[ i ].min + t_x[ i ] * ( g_opt_params[ i ].max - g_opt_params[ i ].min ) );
+}
+
+/// Store state of all searches, the file is replaced at once
+static int optSaveCheckpoint( const char *t_file_name, const std::vector< std::string > &t_tracks,
+        const std::vector< CmaEs > &t_opts, const LineControllerParams &t_base )
+{
+    std::string l_tmp_name = std::string( t_file_name ) + ".tmp";
+    FILE *l_file = fopen( l_tmp_name.c_str(), "w" );
+    if ( !l_file )
+    {
+        fprintf( stderr, "Unable to write checkpoint %s!\n", l_tmp_name.c_str() );
+        return -1;
+    }
+
+    fprintf( l_file, "gain_opt %d %d\n", ( int ) t_tracks.size(), OPT_DIM );
+    lineControllerPrintParams( l_file, t_base );
+    for ( int t = 0; t < ( int ) t_tracks.size(); t++ )
+    {
+        fprintf( l_file, "%s\n", t_tracks[ t ].c_str() );
+        t_opts[ t ].save( l_file );
+    }
+
+    int l_err = ferror( l_file );
+    if ( fclose( l_file ) || l_err || rename( l_tmp_name.c_str(), t_file_name ) )
+    {
+        fprintf( stderr, "Unable to write checkpoint %s!\n", t_file_name );
+        return -1;
+    }
+
+    return 0;
+}
+
+/// Load state of all searches
+static int optLoadCheckpoint( const char *t_file_name, std::vector< std::string > &t_tracks,
+        std::vector< CmaEs > &t_opts, LineControllerParams &t_base )
+{
+    FILE *l_file = fopen( t_file_name, "r" );
+    if ( !l_file )
+    {
+        fprintf( stderr, "Unable to open checkpoint %s!\n", t_file_name );
+        return -1;
+    }
+
+    int l_tracks, l_dim;
+    char l_line[ 1024 ];
+    int l_ret = -1;
+    if ( fscanf( l_file, "gain_opt %d %d ", &l_tracks, &l_dim ) == 2 && l_dim == OPT_DIM && l_tracks > 0
+            && fgets( l_line, sizeof( l_line ), l_file ) )
+    {
+        // the base parameters are stored as assignments
+        l_ret = 0;
+        for ( char *l_item = strtok( l_line, " \r\n" ); l_item; l_item = strtok( nullptr, " \r\n" ) )
+            if ( lineControllerSetParam( t_base, l_item ) < 0 ) l_ret = -1;
+
+        t_tracks.clear();
+        t_opts.assign( l_tracks, CmaEs() );
+        for ( int t = 0; t < l_tracks && !l_ret; t++ )
+        {
+            if ( !fgets( l_line, sizeof( l_line ), l_file ) ) l_ret = -1;
+            l_line[ strcspn( l_line, "\r\n" ) ] = 0;
+            t_tracks.push_back( l_line );
+            if ( !l_ret && ( t_opts[ t ].load( l_file ) < 0 || t_opts[ t ].getDim() != OPT_DIM ) ) l_ret = -1;
+            // the rest of the last line
+            if ( !l_ret && !fgets( l_line, sizeof( l_line ), l_file ) ) l_ret = -1;
+        }
+    }
+
+    fclose( l_file );
+    if ( l_ret < 0 ) fprintf( stderr, "Invalid checkpoint %s!\n", t_file_name );
+
+    return l_ret;
+}
+
+int main( int argc, char* argv[] )
+{
+    int l_generations = 50;
+    int l_lambda = 0;
+    double l_sigma = 0.3;
+    unsigned long long l_seed = 1;
+    int l_laps = 2;
+    double l_time_limit_s = 60;
+    int l_threads = 0;
+    int l_resume = 0;
+    int l_help = 0;
+    const char *l_checkpoint = OPT_DEFAULT_CHECKPOINT;
+    std::vector< std::string > l_tracks;
+    LineControllerParams l_base = g_line_controller_default;
+
+    for ( int i = 1; i < argc; i++ )
+    {
+        if ( !strcmp( argv[ i ], "-h" ) )
+            l_help = 1;
+        else if ( !strcmp( argv[ i ], "-resume" ) )
+            l_resume = 1;
+        else if ( i + 1 < argc && !strcmp( argv[ i ], "-gen" ) )
+            l_generations = atoi( argv[ ++i ] );
+        else if ( i + 1 < argc && !strcmp( argv[ i ], "-lambda" ) )
+            l_lambda = atoi( argv[ ++i ] );
+        else if ( i + 1 < argc && !strcmp( argv[ i ], "-sigma" ) )
+            l_sigma = atof( argv[ ++i ] );
+        else if ( i + 1 < argc && !strcmp( argv[ i ], "-seed" ) )
+            l_seed = strtoull( argv[ ++i ], nullptr, 10 );
+        else if ( i + 1 < argc && !strcmp( argv[ i ], "-laps" ) )
+            l_laps = atoi( argv[ ++i ] );
+        else if ( i + 1 < argc && !strcmp( argv[ i ], "-time" ) )
+            l_time_limit_s = atof( argv[ ++i ] );
+        else if ( i + 1 < argc && !strcmp( argv[ i ], "-threads" ) )
+            l_threads = atoi( argv[ ++i ] );
+        else if ( i + 1 < argc && !strcmp( argv[ i ], "-checkpoint" ) )
+            l_checkpoint = argv[ ++i ];
+        else if ( i + 1 < argc && !strcmp( argv[ i ], "-file" ) )
+        {
+            if ( runnerReadTracks( argv[ ++i ], l_tracks ) < 0 ) exit( 1 );
+        }
+        else if ( i + 1 < argc && !strcmp( argv[ i ], "-track" ) )
+            l_tracks.push_back( argv[ ++i ] );
+        else if ( i + 1 < argc && !strcmp( argv[ i ], "-param" ) )
+        {
+            if ( lineControllerSetParam( l_base, argv[ ++i ] ) < 0 )
+            {
+                fprintf( stderr, "Unknown parameter %s!\n", argv[ i ] );
+                exit( 1 );
+            }
+        }
+        else
+            l_help = 1;
+    }
+    if ( l_help || l_generations < 1 || l_laps < 1 || l_time_limit_s <= 0 || l_sigma <= 0 || l_lambda < 0 )
+    {
+        printf( HELP, argv[ 0 ] );
+        exit( 0 );
+    }
+
+    // the search starts from the initial parameters or from the checkpoint
+    std::vector< CmaEs > l_opts;
+    if ( l_resume )
+    {
+        std::vector< std::string > l_checkpoint_tracks;
+        if ( optLoadCheckpoint( l_checkpoint, l_checkpoint_tracks, l_opts, l_base ) < 0 ) exit( 1 );
+        if ( !l_tracks.empty() && l_tracks != l_checkpoint_tracks )
+        {
+            fprintf( stderr, "The tracks differ from the checkpoint %s!\n", l_checkpoint );
+            exit( 1 );
+        }
+        l_tracks = l_checkpoint_tracks;
+    }
+    else
+    {
+        if ( l_tracks.empty() ) l_tracks.push_back( OPT_DEFAULT_TRACK );
+
+        // the initial parameters are the mean of the first generation
+        double l_mean[ OPT_DIM ];
+        for ( int i = 0; i < OPT_DIM; i++ )
+        {
+            float l_value;
+            lineControllerGetValue( l_base, g_opt_params[ i ].name, l_value );
+            l_mean[ i ] = ( l_value - g_opt_params[ i ].min ) / ( g_opt_params[ i ].max - g_opt_params[ i ].min );
+            l_mean[ i ] = MIN( MAX( l_mean[ i ], 0.0 ), 1.0 );
+        }
+
+        l_opts.assign( l_tracks.size(), CmaEs() );
+        for ( int t = 0; t < ( int ) l_tracks.size(); t++ )
+            l_opts[ t ].init( OPT_DIM, l_mean, l_sigma, l_lambda, l_seed + t );
+    }
+
+    int l_track_count = l_tracks.size();
+    std::vector< TrackMap > l_maps( l_track_count );
+    std::vector< const TrackMap * > l_map_ptrs( l_track_count );
+    for ( int t = 0; t < l_track_count; t++ )
+    {
+        if ( l_maps[ t ].compile( l_tracks[ t ].c_str() ) < 0 )
+        {
+            fprintf( stderr, "Unable to compile track %d \"%s\"!\n", t, l_tracks[ t ].c_str() );
+            exit( 1 );
+        }
+        l_map_ptrs[ t ] = &l_maps[ t ];
+    }
+
+    signal( SIGINT, optSignal );
+    signal( SIGTERM, optSignal );
+
+    int l_pop = l_opts[ 0 ].getLambda();
+    printf( "Tracks: %d, parameters: %d, population: %d, laps: %d, time limit: %.0f s\n",
+            l_track_count, OPT_DIM, l_pop, l_laps, l_time_limit_s );
+
+    // all candidates of all tracks are evaluated by one run, car c * tracks + t drives track t
+    RunnerConfig l_config;
+    memset( &l_config, 0, sizeof( l_config ) );
+    l_config.port = -1;
+    l_config.threads = l_threads;
+    l_config.tracks = l_map_ptrs.data();
+    l_config.track_count = l_track_count;
+    l_config.cars = l_pop * l_track_count;
+    l_config.laps = l_laps;
+    l_config.time_limit_s = l_time_limit_s;
+
+    std::vector< std::vector< std::vector< double > > > l_populations( l_track_count );
+    std::vector< LineControllerParams > l_car_params( l_config.cars );
+
+    while ( l_opts[ 0 ].getGeneration() < l_generations && !g_opt_stop )
+    {
+        for ( int t = 0; t < l_track_count; t++ )
+        {
+            l_opts[ t ].ask( l_populations[ t ] );
+            for ( int c = 0; c < l_pop; c++ )
+                optDecode( l_populations[ t ][ c ], l_base, l_car_params[ c * l_track_count + t ] );
+        }
+
+        CarRunner l_runner( l_config, optControllerFactory, &l_car_params );
+        if ( l_runner.run() < 0 )
+        {
+            fprintf( stderr, "Unable to evaluate generation!\n" );
+            exit( 1 );
+        }
+
+        const std::vector< RunnerCarStats > &l_cars = l_runner.getCarStats();
+        printf( "gen %4d  %8.0f cycles/s  best:", l_opts[ 0 ].getGeneration() + 1, l_runner.getStats().cycles_per_s );
+        for ( int t = 0; t < l_track_count; t++ )
+        {
+            std::vector< double > l_costs( l_pop );
+            for ( int c = 0; c < l_pop; c++ )
+                l_costs[ c ] = runnerCost( l_cars[ c * l_track_count + t ], l_laps, l_time_limit_s );
+            l_opts[ t ].tell( l_costs );
+            printf( " %.2f", l_opts[ t ].getBestCost() );
+        }
+        printf( "\n" );
+        fflush( stdout );
+
+        if ( optSaveCheckpoint( l_checkpoint, l_tracks, l_opts, l_base ) < 0 ) exit( 1 );
+    }
+
+    if ( g_opt_stop )
+        printf( "Interrupted, continue by -resume -checkpoint %s\n", l_checkpoint );
+
+    // the best parameters are printed as options of track_eval
+    printf( "\n%5s %10s %8s  %s\n", "track", "cost [s]", "evals", "definition / parameters" );
+    for ( int t = 0; t < l_track_count; t++ )
+    {
+        LineControllerParams l_best;
+        optDecode( l_opts[ t ].getBest(), l_base, l_best );
+        printf( "%5d %10.2f %8ld  %s\n%25s", t, l_opts[ t ].getBestCost(), l_opts[ t ].getEvaluations(),
+                l_tracks[ t ].c_str(), "" );
+        for ( int i = 0; i < OPT_DIM; i++ )
+        {
+            float l_value;
+            lineControllerGetValue( l_best, g_opt_params[ i ].name, l_value );
+            printf( " -param %s=%.4g", g_opt_params[ i ].name, l_value );
+        }
+        printf( "\n" );
+    }
+
+    return 0;
+}
+
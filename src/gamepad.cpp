@@ -10,62 +10,129 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/eventfd.h>
 #include <fcntl.h>
 #include <poll.h>
 #include <linux/joystick.h>
 
 #include "gamepad.h"
+#include "latency.h"
 
-/// Internal thread function
-void *gamepadThread( void *t_args )
+int gamepadRead( GamepadThreadData &t_gamepad_data )
 {
-    GamepadThreadData *t_gamepad_data = ( ( GamepadThreadData * ) t_args );
-    struct js_event js_ev;
-
-    pollfd l_pfds = { t_gamepad_data->gamepad_fd, POLLIN, 0 };
-
-    // test stop request
-    while( !t_gamepad_data->stop_thread )     
+    struct js_event l_js_ev[ JS_READ_EVENTS ];
+
+    // the state is written by one thread only, so its last values are valid
+    int l_axis_speed = t_gamepad_data.axis_speed.load( std::memory_order_relaxed );
+    int l_axis_steer_wheel = t_gamepad_data.axis_steer_wheel.load( std::memory_order_relaxed );
+    unsigned l_buttons = t_gamepad_data.buttons.load( std::memory_order_relaxed );
+    unsigned l_restart_presses = t_gamepad_data.restart_presses.load( std::memory_order_relaxed );
+    unsigned l_time_ms = t_gamepad_data.time_ms.load( std::memory_order_relaxed );
+    unsigned long l_events = t_gamepad_data.events.load( std::memory_order_relaxed );
+
+    // drain all pending events
+    int l_read = 0;
+    bool l_new_data = false;
+    bool l_failed = false;
+    while ( true )
     {
-        // wait for data
-        int l_err = poll( &l_pfds, 1, 10 );
-        if ( !l_err ) continue; // timeout
-        if ( l_err < 0 ) break; // error
-
-        // get data
-        l_err = read( t_gamepad_data->gamepad_fd, &js_ev, sizeof( js_ev ) );
-        if ( l_err < 0 ) break;
-
-        bool l_new_data = false;
-
-        if ( js_ev.type == JS_EVENT_AXIS )
+        int l_len = read( t_gamepad_data.gamepad_fd, l_js_ev, sizeof( l_js_ev ) );
+        if ( l_len < 0 )
         {
-            if ( js_ev.number == JS_AXIS_STEER_WHEEL ) {
-                t_gamepad_data->axis_steer_wheel = js_ev.value;
-                l_new_data = true;
-            }
-
-            if ( js_ev.number == JS_AXIS_SPEED )
-            {
-                t_gamepad_data->axis_speed = js_ev.value;
-                l_new_data = true;
-            }
+            if ( errno == EINTR ) continue;
+            if ( errno != EAGAIN ) l_failed = true;
+            break;
         }
-        else if ( js_ev.type == JS_EVENT_BUTTON )
+        if ( l_len == 0 )
         {
-            if ( js_ev.number == JS_BUTTON_RESET )
+            l_failed = true;
+            break;
+        }
+
+        int l_count = l_len / sizeof( js_event );
+        for ( int i = 0; i < l_count; i++ )
+        {
+            js_event &l_ev = l_js_ev[ i ];
+            // initial state of device is reported by events with JS_EVENT_INIT flag
+            int l_type = l_ev.type & ~JS_EVENT_INIT;
+            l_time_ms = l_ev.time;
+            l_events++;
+            l_read++;
+
+            if ( l_type == JS_EVENT_AXIS )
             {
-                if ( js_ev.value == 1 )
+                if ( l_ev.number == JS_AXIS_STEER_WHEEL )
+                {
+                    l_axis_steer_wheel = l_ev.value;
+                    l_new_data = true;
+                }
+
+                if ( l_ev.number == JS_AXIS_SPEED )
                 {
-                    t_gamepad_data->restart_button = true;
+                    l_axis_speed = l_ev.value;
                     l_new_data = true;
                 }
             }
+            else if ( l_type == JS_EVENT_BUTTON && l_ev.number < 32 )
+            {
+                unsigned l_mask = 1u << l_ev.number;
+                if ( l_ev.value ) l_buttons |= l_mask;
+                else l_buttons &= ~l_mask;
+
+                // only a real press restarts the car
+                if ( l_ev.number == JS_BUTTON_RESET && l_ev.value == 1 && !( l_ev.type & JS_EVENT_INIT ) )
+                    l_restart_presses++;
+                l_new_data = true;
+            }
         }
-        t_gamepad_data->new_data = l_new_data;
+
+        if ( l_len < ( int ) sizeof( l_js_ev ) ) break; // nothing more pending
+    }
+
+    // one update of state for all events
+    if ( l_new_data )
+    {
+        unsigned l_seq = t_gamepad_data.seq.load( std::memory_order_relaxed );
+        t_gamepad_data.seq.store( l_seq + 1, std::memory_order_relaxed );
+        std::atomic_thread_fence( std::memory_order_release );
+
+        t_gamepad_data.axis_speed.store( l_axis_speed, std::memory_order_relaxed );
+        t_gamepad_data.axis_steer_wheel.store( l_axis_steer_wheel, std::memory_order_relaxed );
+        t_gamepad_data.buttons.store( l_buttons, std::memory_order_relaxed );
+        t_gamepad_data.restart_presses.store( l_restart_presses, std::memory_order_relaxed );
+        t_gamepad_data.time_ms.store( l_time_ms, std::memory_order_relaxed );
+        t_gamepad_data.update_ns.store( latencyNow(), std::memory_order_relaxed );
+        t_gamepad_data.events.store( l_events, std::memory_order_relaxed );
+
+        t_gamepad_data.seq.store( l_seq + 2, std::memory_order_release );
+    }
+
+    return l_failed ? -1 : l_read;
+}
+
+
+/// Internal thread function
+void *gamepadThread( void *t_args )
+{
+    GamepadThreadData *t_gamepad_data = ( ( GamepadThreadData * ) t_args );
+
+    pollfd l_pfds[ 2 ] = { { t_gamepad_data->gamepad_fd, POLLIN, 0 }, { t_gamepad_data->stop_fd, POLLIN, 0 } };
+
+    while ( true )
+    {
+        // wait for data or stop request
+        int l_err = poll( l_pfds, 2, -1 );
+        if ( l_err < 0 && errno == EINTR ) continue;
+        if ( l_err < 0 ) break; // error
+        if ( l_pfds[ 1 ].revents ) break; // stop request
+        if ( l_pfds[ 0 ].revents & ( POLLERR | POLLHUP | POLLNVAL ) ) break; // device disconnected
+
+        if ( gamepadRead( *t_gamepad_data ) < 0 ) break;
     }
 
     printf( "Gamepad thread finished.\n" );
@@ -73,23 +140,56 @@ void *gamepadThread( void *t_args )
 }
 
 
-int gamepadStart( GamepadThreadData &t_gamepad_data, const char *t_dev_name )
+int gamepadOpen( GamepadThreadData &t_gamepad_data, const char *t_dev_name )
 {
-    t_gamepad_data.stop_thread = false;
-    t_gamepad_data.thread_id = -1;
-    t_gamepad_data.new_data = false;
+    t_gamepad_data.stop_fd = -1;
+    t_gamepad_data.seq = 0;
     t_gamepad_data.axis_speed = 0;
     t_gamepad_data.axis_steer_wheel = 0;
-    t_gamepad_data.restart_button = 0;
+    t_gamepad_data.buttons = 0;
+    t_gamepad_data.restart_presses = 0;
+    t_gamepad_data.time_ms = 0;
+    t_gamepad_data.update_ns = 0;
+    t_gamepad_data.events = 0;
 
-    // open device
+    // open device, all reads drain the device until it is empty
     if ( !t_dev_name ) t_dev_name = JS_DEFAULT_DEVICENAME;
-    t_gamepad_data.gamepad_fd = open( t_dev_name, O_RDONLY );
+    t_gamepad_data.gamepad_fd = open( t_dev_name, O_RDONLY | O_NONBLOCK | O_CLOEXEC );
+
+    return t_gamepad_data.gamepad_fd;
+}
 
-    if ( t_gamepad_data.gamepad_fd < 0 ) return t_gamepad_data.gamepad_fd;
+
+int gamepadClose( GamepadThreadData &t_gamepad_data )
+{
+    if ( t_gamepad_data.gamepad_fd < 0 ) return -1;
+
+    close( t_gamepad_data.gamepad_fd );
+    t_gamepad_data.gamepad_fd = -1;
+
+    return 0;
+}
+
+
+int gamepadStart( GamepadThreadData &t_gamepad_data, const char *t_dev_name )
+{
+    if ( gamepadOpen( t_gamepad_data, t_dev_name ) < 0 ) return -1;
+
+    t_gamepad_data.stop_fd = eventfd( 0, EFD_NONBLOCK );
+    if ( t_gamepad_data.stop_fd < 0 )
+    {
+        gamepadClose( t_gamepad_data );
+        return -1;
+    }
 
     // create thread
-    pthread_create( &t_gamepad_data.thread_id, nullptr, gamepadThread, &t_gamepad_data );
+    if ( pthread_create( &t_gamepad_data.thread_id, nullptr, gamepadThread, &t_gamepad_data ) )
+    {
+        close( t_gamepad_data.stop_fd );
+        t_gamepad_data.stop_fd = -1;
+        gamepadClose( t_gamepad_data );
+        return -1;
+    }
 
     return t_gamepad_data.gamepad_fd;
 }
@@ -100,16 +200,39 @@ int gamepadStop( GamepadThreadData &t_gamepad_data )
     if ( t_gamepad_data.gamepad_fd < 0 ) return -1;
 
     // request to stop thread
-    t_gamepad_data.stop_thread = true;
+    uint64_t l_one = 1;
+    if ( write( t_gamepad_data.stop_fd, &l_one, sizeof( l_one ) ) != sizeof( l_one ) )
+        fprintf( stderr, "Unable to stop gamepad thread!\n" );
 
     // wait for the thread
     pthread_join( t_gamepad_data.thread_id, nullptr );
 
-    // close device
-    close( t_gamepad_data.gamepad_fd );
+    // close eventfd and device
+    close( t_gamepad_data.stop_fd );
+    t_gamepad_data.stop_fd = -1;
 
-    t_gamepad_data.gamepad_fd = -1;
+    return gamepadClose( t_gamepad_data );
+}
 
-    return 0;
+
+void gamepadGetState( const GamepadThreadData &t_gamepad_data, GamepadState &t_state )
+{
+    unsigned l_seq;
+    do
+    {
+        l_seq = t_gamepad_data.seq.load( std::memory_order_acquire );
+        t_state.axis_speed = t_gamepad_data.axis_speed.load( std::memory_order_relaxed );
+        t_state.axis_steer_wheel = t_gamepad_data.axis_steer_wheel.load( std::memory_order_relaxed );
+        t_state.buttons = t_gamepad_data.buttons.load( std::memory_order_relaxed );
+        t_state.restart_presses = t_gamepad_data.restart_presses.load( std::memory_order_relaxed );
+        t_state.time_ms = t_gamepad_data.time_ms.load( std::memory_order_relaxed );
+        t_state.update_ns = t_gamepad_data.update_ns.load( std::memory_order_relaxed );
+        t_state.events = t_gamepad_data.events.load( std::memory_order_relaxed );
+        std::atomic_thread_fence( std::memory_order_acquire );
+    }
+    // retry when the state was changed during reading
+    while ( ( l_seq & 1 ) || l_seq != t_gamepad_data.seq.load( std::memory_order_relaxed ) );
+
+    t_state.seq = l_seq;
 }
 
@@ -11,10 +11,18 @@
  *
  * The module gamepad is continuously gaining data from gamepad and it stores current positions of thumbsticks. 
  * Currently tested with Logitech F710
+ *
+ * The thread sleeps until the gamepad or the stop request (eventfd) is readable, then it reads all
+ * pending events at once. The state is published by a sequence lock, so the control loop always gets
+ * a consistent snapshot by \ref gamepadGetState without blocking the gamepad thread.
+ * Without the thread the device can be read by an event loop, see \ref gamepadOpen.
+ * The demos use the event loop, the thread (\ref gamepadStart, \ref gamepadStop) is kept as API
+ * for programs which have no event loop.
  */
 
 
 #include <pthread.h>
+#include <atomic>
 
 /// Default name of gamepad device.
 #define JS_DEFAULT_DEVICENAME           "/dev/input/js0"
@@ -25,20 +33,46 @@
 #define JS_AXIS_SPEED                   1
 /// The button for car model reset.
 #define JS_BUTTON_RESET                 5
+/// The button saving the state of car model (snapshot).
+#define JS_BUTTON_SNAPSHOT              4
+/// The button moving car model back to the saved state.
+#define JS_BUTTON_RESTORE               6
 /// Resolution/range of gamepad axis
 #define JS_AXIS_STEPS                   32767
+/// Maximal number of events read by one read call
+#define JS_READ_EVENTS                  64
+
+/// Consistent snapshot of gamepad state.
+struct GamepadState
+{
+    unsigned seq;                       ///< Sequence number, it is changed by every update.
+    int axis_speed;                     ///< Current position of speed axis.
+    int axis_steer_wheel;               ///< Current position of steering axis.
+    unsigned buttons;                   ///< Currently pressed buttons, bit per button (first 32 buttons).
+    unsigned restart_presses;           ///< Number of presses of reset button since start.
+    unsigned time_ms;                   ///< Timestamp of the last event from driver in ms.
+    long long update_ns;                ///< Monotonic time of the last update, see \ref latencyNow.
+    unsigned long events;               ///< Number of events read since start.
+};
 
 /// Structure to control thread and storing gamepad data.
 struct GamepadThreadData 
 {
     int gamepad_fd;                     ///< File descriptor of opened device.
-    bool stop_thread;                   ///< Request to stop gamepad thread.
+    int stop_fd;                        ///< Eventfd to wake up and stop gamepad thread.
     pthread_t thread_id;                ///< Thread ID.
 
-    bool new_data;                      ///< Detect change on gamepad.
-    int axis_speed;                     ///< Current position of speed axis.
-    int axis_steer_wheel;               ///< Current position of steering axis.
-    bool restart_button;                ///< Reset button pressed.
+    /// @name State published by sequence lock, odd sequence number means the update in progress.
+    /// @{
+    std::atomic< unsigned > seq;
+    std::atomic< int > axis_speed;
+    std::atomic< int > axis_steer_wheel;
+    std::atomic< unsigned > buttons;
+    std::atomic< unsigned > restart_presses;
+    std::atomic< unsigned > time_ms;
+    std::atomic< long long > update_ns;
+    std::atomic< unsigned long > events;
+    /// @}
 };
 
 /**
@@ -62,4 +96,42 @@ int gamepadStart( GamepadThreadData &t_gamepad_data, const char *t_dev_name = nu
  */
 int gamepadStop( GamepadThreadData &t_gamepad_data );
 
+/** @brief Function opens gamepad device without thread, e.g. for \ref Reactor.
+ *
+ *  The device is opened in non-blocking mode. The caller waits for the returned descriptor
+ *  and it calls \ref gamepadRead when it is readable.
+ *
+ *  @param t_gamepad_data Structure for gamepad module control and storing data.
+ *  @param t_dev_name Alternate device name
+ *  @return The file descriptor of device, -1 when the device can not be opened.
+ */
+int gamepadOpen( GamepadThreadData &t_gamepad_data, const char *t_dev_name = nullptr );
+
+/** @brief Function reads all pending events and it publishes the new state.
+ *
+ *  It must be called from one thread only, by the gamepad thread or by the owner of \ref gamepadOpen.
+ *
+ *  @param t_gamepad_data The structure with opened device.
+ *  @return The number of read events, -1 when the device failed or it was disconnected.
+ */
+int gamepadRead( GamepadThreadData &t_gamepad_data );
+
+/** @brief Function closes device opened by \ref gamepadOpen.
+ *
+ *  @param t_gamepad_data The structure with opened device.
+ *  @return When the device was closed, return 0. Otherwise -1.
+ */
+int gamepadClose( GamepadThreadData &t_gamepad_data );
+
+/** @brief Function gets consistent snapshot of gamepad state.
+ *
+ *  It never blocks, it only retries when the gamepad thread is just updating the state.
+ *  The change of state is detected by \ref GamepadState::seq, the press of reset button
+ *  by \ref GamepadState::restart_presses.
+ *
+ *  @param t_gamepad_data The structure with previously initalized data.
+ *  @param t_state The snapshot of state.
+ */
+void gamepadGetState( const GamepadThreadData &t_gamepad_data, GamepadState &t_state );
+
 
@@ -0,0 +1,362 @@
+/**
+ * @file headless_batch.cpp
+ * @brief Module headless_batch
+ *
+ */
+
+#include <math.h>
+#include <string.h>
+#include <sys/param.h>
+
+#include "headless_batch.h"
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#define HEADLESS_BATCH_X86
+#endif
+
+/// Default track of batches without track
+static HeadlessStraightTrack g_headless_batch_straight_track;
+
+
+/** @brief The step kernel of t_count cars.
+ *
+ * It is compiled for every implementation, the loop has no calls and no branches,
+ * the conditions are only selections of values, so it can be vectorized.
+ */
+__attribute__(( always_inline ))
+static inline void headlessBatchKernel( HeadlessBatchState &t_state, int t_count )
+{
+    const float l_dt = HEADLESS_STEP_S;
+    const float l_steer_step = HEADLESS_SERVO_SPEED_RAD_S * l_dt;
+    const float l_wheel_step = l_dt / ( CAR_WHEEL_DIAMETER_M / 2 );
+    const float l_pi = M_PI;
+    const float l_2pi = 2 * M_PI;
+
+    float *l_x = t_state.x.data();
+    float *l_y = t_state.y.data();
+    float *l_hx = t_state.hx.data();
+    float *l_hy = t_state.hy.data();
+    float *l_steer = t_state.steer.data();
+    float *l_l_speed = t_state.l_speed.data();
+    float *l_r_speed = t_state.r_speed.data();
+    float *l_l_wheel = t_state.l_wheel.data();
+    float *l_r_wheel = t_state.r_wheel.data();
+    const float *l_servo_angle = t_state.servo_angle.data();
+    const float *l_l_target = t_state.l_target.data();
+    const float *l_l_dv = t_state.l_dv.data();
+    const float *l_r_target = t_state.r_target.data();
+    const float *l_r_dv = t_state.r_dv.data();
+
+#pragma GCC ivdep
+    for ( int i = 0; i < t_count; i++ )
+    {
+        // servo moves to requested angle by limited speed
+        float l_steer_diff = l_servo_angle[ i ] - l_steer[ i ];
+        float l_st = l_steer[ i ] + MAX( MIN( l_steer_diff, l_steer_step ), -l_steer_step );
+        l_steer[ i ] = l_st;
+
+        // wheels accelerate to the target speed of torque as headlessWheelSpeed, the both directions are computed
+        float l_ls = l_l_speed[ i ], l_rs = l_r_speed[ i ];
+        float l_ls_up = MIN( l_ls + l_l_dv[ i ], l_l_target[ i ] ), l_ls_down = MAX( l_ls - l_l_dv[ i ], l_l_target[ i ] );
+        float l_rs_up = MIN( l_rs + l_r_dv[ i ], l_r_target[ i ] ), l_rs_down = MAX( l_rs - l_r_dv[ i ], l_r_target[ i ] );
+        l_ls = l_ls < l_l_target[ i ] ? l_ls_up : l_ls_down;
+        l_rs = l_rs < l_r_target[ i ] ? l_rs_up : l_rs_down;
+        l_l_speed[ i ] = l_ls;
+        l_r_speed[ i ] = l_rs;
+
+        // tangent of steering angle, |steer| <= 30 deg, the error of polynomials is below 1e-9
+        float l_s2 = l_st * l_st;
+        float l_sin = l_st * ( 1 - l_s2 / 6 * ( 1 - l_s2 / 20 * ( 1 - l_s2 / 42 * ( 1 - l_s2 / 72 ) ) ) );
+        float l_cos = 1 - l_s2 / 2 * ( 1 - l_s2 / 12 * ( 1 - l_s2 / 30 * ( 1 - l_s2 / 56 * ( 1 - l_s2 / 90 ) ) ) );
+
+        // bicycle model, the heading is rotated by a half of step to the middle and by a half to the end
+        float l_speed = ( l_ls + l_rs ) / 2;
+        float l_half = l_speed * l_sin / l_cos * ( l_dt / 2 / CAR_WHEELBASE_M );
+        float l_h2 = l_half * l_half;
+        float l_rot_sin = l_half * ( 1 - l_h2 / 6 * ( 1 - l_h2 / 20 ) );
+        float l_rot_cos = 1 - l_h2 / 2 * ( 1 - l_h2 / 12 );
+
+        float l_mx = l_hx[ i ] * l_rot_cos - l_hy[ i ] * l_rot_sin;
+        float l_my = l_hx[ i ] * l_rot_sin + l_hy[ i ] * l_rot_cos;
+        l_x[ i ] += l_speed * l_mx * l_dt;
+        l_y[ i ] += l_speed * l_my * l_dt;
+
+        // the length of heading is corrected by one Newton step, it does not drift
+        float l_nx = l_mx * l_rot_cos - l_my * l_rot_sin;
+        float l_ny = l_mx * l_rot_sin + l_my * l_rot_cos;
+        float l_norm = 1.5f - 0.5f * ( l_nx * l_nx + l_ny * l_ny );
+        l_hx[ i ] = l_nx * l_norm;
+        l_hy[ i ] = l_ny * l_norm;
+
+        // wheels do not slip, the wheel turns less than PI in one step
+        float l_lw = l_l_wheel[ i ] + l_ls * l_wheel_step;
+        float l_rw = l_r_wheel[ i ] + l_rs * l_wheel_step;
+        l_lw += ( l_lw < -l_pi ? l_2pi : 0 ) - ( l_lw > l_pi ? l_2pi : 0 );
+        l_rw += ( l_rw < -l_pi ? l_2pi : 0 ) - ( l_rw > l_pi ? l_2pi : 0 );
+        l_l_wheel[ i ] = l_lw;
+        l_r_wheel[ i ] = l_rw;
+    }
+}
+
+
+/// The kernel function of implementation
+typedef void ( *HeadlessBatchKernel )( HeadlessBatchState &t_state, int t_count );
+
+
+// the reference implementation is never vectorized
+__attribute__(( optimize( "no-tree-vectorize" ) ))
+static void headlessBatchScalar( HeadlessBatchState &t_state, int t_count )
+{
+    headlessBatchKernel( t_state, t_count );
+}
+
+
+#ifdef HEADLESS_BATCH_X86
+
+// the SSE2 is the base of x86-64, the loop is vectorized with the default target (the module is compiled with -O3)
+static void headlessBatchSSE2( HeadlessBatchState &t_state, int t_count )
+{
+    headlessBatchKernel( t_state, t_count );
+}
+
+
+// without fma, the results are the same as of other implementations
+__attribute__(( target( "avx2" ) ))
+static void headlessBatchAVX2( HeadlessBatchState &t_state, int t_count )
+{
+    headlessBatchKernel( t_state, t_count );
+}
+
+#endif // HEADLESS_BATCH_X86
+
+
+/// Is the implementation supported by CPU
+static bool headlessBatchSupported( HeadlessBatchImpl t_impl )
+{
+    switch ( t_impl )
+    {
+        case HEADLESS_BATCH_AUTO:
+        case HEADLESS_BATCH_SCALAR:
+            return true;
+#ifdef HEADLESS_BATCH_X86
+        // CPU features may be tested before main, when they are not initialized yet
+        case HEADLESS_BATCH_SSE2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports( "sse2" );
+        case HEADLESS_BATCH_AVX2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports( "avx2" );
+#endif
+        default:
+            return false;
+    }
+}
+
+
+/// The best implementation supported by CPU
+static HeadlessBatchImpl headlessBatchBest()
+{
+    if ( headlessBatchSupported( HEADLESS_BATCH_AVX2 ) ) return HEADLESS_BATCH_AVX2;
+    if ( headlessBatchSupported( HEADLESS_BATCH_SSE2 ) ) return HEADLESS_BATCH_SSE2;
+    return HEADLESS_BATCH_SCALAR;
+}
+
+
+/// Kernel function of implementation
+static HeadlessBatchKernel headlessBatchKernelOf( HeadlessBatchImpl t_impl )
+{
+    switch ( t_impl )
+    {
+#ifdef HEADLESS_BATCH_X86
+        case HEADLESS_BATCH_SSE2: return headlessBatchSSE2;
+        case HEADLESS_BATCH_AVX2: return headlessBatchAVX2;
+#endif
+        default: return headlessBatchScalar;
+    }
+}
+
+
+static HeadlessBatchImpl g_headless_batch_impl = headlessBatchBest();
+
+
+int headlessBatchSetImpl( HeadlessBatchImpl t_impl )
+{
+    if ( t_impl == HEADLESS_BATCH_AUTO ) t_impl = headlessBatchBest();
+    if ( !headlessBatchSupported( t_impl ) ) return -1;
+
+    g_headless_batch_impl = t_impl;
+    return 0;
+}
+
+
+HeadlessBatchImpl headlessBatchGetImpl()
+{
+    return g_headless_batch_impl;
+}
+
+
+const char *headlessBatchImplName( HeadlessBatchImpl t_impl )
+{
+    switch ( t_impl )
+    {
+        case HEADLESS_BATCH_AUTO: return "auto";
+        case HEADLESS_BATCH_SCALAR: return "scalar";
+        case HEADLESS_BATCH_SSE2: return "sse2";
+        case HEADLESS_BATCH_AVX2: return "avx2";
+        default: return "unknown";
+    }
+}
+
+
+template< class t_camera >
+HeadlessBatchT< t_camera >::HeadlessBatchT( int t_cars, const HeadlessTrack *t_track )
+{
+    m_track = t_track ? t_track : &g_headless_batch_straight_track;
+    m_cars = MAX( t_cars, 0 );
+
+    std::vector< float > *l_arrays[] = { &m_state.x, &m_state.y, &m_state.hx, &m_state.hy, &m_state.steer,
+        &m_state.l_speed, &m_state.r_speed, &m_state.l_wheel, &m_state.r_wheel, &m_state.servo_angle,
+        &m_state.l_target, &m_state.l_dv, &m_state.r_target, &m_state.r_dv };
+    for ( std::vector< float > *l_array : l_arrays )
+        l_array->assign( m_cars, 0 );
+
+    resetCars();
+}
+
+
+template< class t_camera >
+void HeadlessBatchT< t_camera >::setCommand( int t_car, const CarCommands &t_cmd )
+{
+    // verify allowed range of values as HeadlessCarT
+    float l_servo = MAX( MIN( t_cmd.servo, 1.0 ), -1.0 );
+    float l_pwm[ 2 ] = { MAX( MIN( t_cmd.l_pwm, 1.0 ), -1.0 ), MAX( MIN( t_cmd.r_pwm, 1.0 ), -1.0 ) };
+    float *l_target[ 2 ] = { &m_state.l_target[ t_car ], &m_state.r_target[ t_car ] };
+    float *l_dv[ 2 ] = { &m_state.l_dv[ t_car ], &m_state.r_dv[ t_car ] };
+
+    m_state.servo_angle[ t_car ] = l_servo * CAR_5TH_WHEEL_ANGLE_RAD;
+
+    for ( int w = 0; w < 2; w++ )
+    {
+        // the motor accelerates to the maximal speed in direction of torque, without torque the car is freely rolling
+        float l_torque = l_pwm[ w ] * CAR_MAX_TORQUE_N_M;
+        float l_accel = fabsf( l_torque ) / ( CAR_WHEEL_DIAMETER_M / 2 ) / ( CAR_MASS_KG / 2 );
+        *l_target[ w ] = l_torque > 0 ? CAR_MAX_SPEED_M_S : -CAR_MAX_SPEED_M_S;
+        if ( l_torque == 0 )
+        {
+            *l_target[ w ] = 0;
+            l_accel = HEADLESS_ROLL_DECEL_M_S2;
+        }
+        *l_dv[ w ] = l_accel * ( float ) HEADLESS_STEP_S;
+    }
+}
+
+
+template< class t_camera >
+void HeadlessBatchT< t_camera >::setCommands( const CarCommands *t_cmds )
+{
+    for ( int i = 0; i < m_cars; i++ )
+        setCommand( i, t_cmds[ i ] );
+}
+
+
+template< class t_camera >
+int HeadlessBatchT< t_camera >::getImages( unsigned char *t_imgs )
+{
+    step();
+
+    if ( t_imgs )
+        render( t_imgs );
+
+    return 0;
+}
+
+
+template< class t_camera >
+void HeadlessBatchT< t_camera >::step()
+{
+    headlessBatchKernelOf( g_headless_batch_impl )( m_state, m_cars );
+    m_time += ( float ) HEADLESS_STEP_S;
+}
+
+
+template< class t_camera >
+void HeadlessBatchT< t_camera >::render( unsigned char *t_imgs )
+{
+    const float l_hw = HEADLESS_CAM_WIDTH_M / 2;
+
+    for ( int i = 0; i < m_cars; i++ )
+    {
+        unsigned char *l_img = t_imgs + i * t_camera::pixels;
+        float l_cos = m_state.hx[ i ];
+        float l_sin = m_state.hy[ i ];
+
+        // the same lines as HeadlessCarT, the heading is already known as vector
+        for ( int l = 0; l < t_camera::lines; l++ )
+        {
+            float l_distance = HEADLESS_CAM_DISTANCE_M + l * HEADLESS_CAM_LINE_GAP_M;
+            float l_cx = m_state.x[ i ] + l_distance * l_cos;
+            float l_cy = m_state.y[ i ] + l_distance * l_sin;
+
+            m_track->renderLine( l_cx - l_hw * l_sin, l_cy + l_hw * l_cos,
+                                 l_cx + l_hw * l_sin, l_cy - l_hw * l_cos, t_camera::line( l_img, l ), t_camera::resolution );
+        }
+    }
+}
+
+
+template< class t_camera >
+void HeadlessBatchT< t_camera >::resetCar( int t_car )
+{
+    float l_x, l_y, l_yaw;
+    m_track->startPose( l_x, l_y, l_yaw );
+
+    m_state.x[ t_car ] = l_x;
+    m_state.y[ t_car ] = l_y;
+    m_state.hx[ t_car ] = cosf( l_yaw );
+    m_state.hy[ t_car ] = sinf( l_yaw );
+    m_state.steer[ t_car ] = 0;
+    m_state.l_speed[ t_car ] = 0;
+    m_state.r_speed[ t_car ] = 0;
+    m_state.l_wheel[ t_car ] = 0;
+    m_state.r_wheel[ t_car ] = 0;
+
+    CarCommands l_stop = { 0, 0, 0 };
+    setCommand( t_car, l_stop );
+}
+
+
+template< class t_camera >
+void HeadlessBatchT< t_camera >::resetCars()
+{
+    m_time = 0;
+    for ( int i = 0; i < m_cars; i++ )
+        resetCar( i );
+}
+
+
+template< class t_camera >
+int HeadlessBatchT< t_camera >::getPose( int t_car, CarPose &t_pose ) const
+{
+    if ( t_car < 0 || t_car >= m_cars ) return -1;
+
+    float l_speed = ( m_state.l_speed[ t_car ] + m_state.r_speed[ t_car ] ) / 2;
+
+    memset( &t_pose, 0, sizeof( t_pose ) );
+    t_pose.time = m_time;
+    t_pose.x = m_state.x[ t_car ];
+    t_pose.y = m_state.y[ t_car ];
+    t_pose.yaw = atan2f( m_state.hy[ t_car ], m_state.hx[ t_car ] );
+    t_pose.vx = l_speed * m_state.hx[ t_car ];
+    t_pose.vy = l_speed * m_state.hy[ t_car ];
+    t_pose.yaw_rate = l_speed * tanf( m_state.steer[ t_car ] ) / CAR_WHEELBASE_M;
+    t_pose.l_wheel = m_state.l_wheel[ t_car ];
+    t_pose.r_wheel = m_state.r_wheel[ t_car ];
+
+    return 0;
+}
+
+
+// the batch is compiled for all supported cameras
+template class HeadlessBatchT< CarCameraLine128 >;
+template class HeadlessBatchT< CarCameraLine256 >;
+template class HeadlessBatchT< CarCameraDual128 >;
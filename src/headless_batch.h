@@ -0,0 +1,142 @@
+#pragma once
+
+/**
+ * @file headless_batch.h
+ * @brief Module headless_batch
+ *
+ * This module headless_batch simulates hundreds of headless cars on the same track at once.
+ * The state of cars is stored as structure of arrays, every variable of all cars in one array,
+ * and all cars are moved by one loop without branches and function calls, which is vectorized
+ * by compiler for SSE2 or AVX2 (selected by CPU as in \ref linedetect.h).
+ *
+ * The model is the same as in \ref HeadlessCarT, only the heading is kept as unit vector
+ * and it is rotated by polynomial approximation instead of sinf and cosf,
+ * so the trajectories of both models differ only by rounding errors.
+ */
+
+#include <vector>
+
+#include "headless_car.h"
+#include "controller.h"
+
+/// The implementations of step kernel
+enum HeadlessBatchImpl
+{
+    HEADLESS_BATCH_AUTO,                ///< The best implementation supported by CPU.
+    HEADLESS_BATCH_SCALAR,              ///< One car after another.
+    HEADLESS_BATCH_SSE2,                ///< 4 cars by one instruction.
+    HEADLESS_BATCH_AVX2                 ///< 8 cars by one instruction.
+};
+
+/** @brief Select implementation of step kernel for all batches.
+ *
+ * All implementations give exactly the same results.
+ * @return When the implementation is supported by CPU, it returns 0. Otherwise -1.
+ */
+int headlessBatchSetImpl( HeadlessBatchImpl t_impl );
+
+/** @brief Get the selected implementation of step kernel. */
+HeadlessBatchImpl headlessBatchGetImpl();
+
+/** @brief Get name of implementation. */
+const char *headlessBatchImplName( HeadlessBatchImpl t_impl );
+
+/// The state of all cars of \ref HeadlessBatchT, every member has one item per car.
+struct HeadlessBatchState
+{
+    std::vector< float > x;             ///< Position of rear axle centre.
+    std::vector< float > y;             ///< Position of rear axle centre.
+    std::vector< float > hx;            ///< Heading of car as unit vector, cos( yaw ).
+    std::vector< float > hy;            ///< Heading of car as unit vector, sin( yaw ).
+    std::vector< float > steer;         ///< Current angle of the 5th wheel in RAD.
+    std::vector< float > l_speed;       ///< Speed of left rear wheel in m/s.
+    std::vector< float > r_speed;       ///< Speed of right rear wheel in m/s.
+    std::vector< float > l_wheel;       ///< Angle of left rear wheel in RAD.
+    std::vector< float > r_wheel;       ///< Angle of right rear wheel in RAD.
+
+    /// @name The commands recalculated for the step kernel
+    /// @{
+    std::vector< float > servo_angle;   ///< Requested angle of the 5th wheel.
+    std::vector< float > l_target;      ///< Speed of left wheel reached by the current torque.
+    std::vector< float > l_dv;          ///< Change of left wheel speed in one step.
+    std::vector< float > r_target;      ///< Speed of right wheel reached by the current torque.
+    std::vector< float > r_dv;          ///< Change of right wheel speed in one step.
+    /// @}
+};
+
+/**
+ * @brief The batch of headless cars driving on the same track.
+ *
+ * The batch is used in the same way as a single car: the commands of all cars are set by \ref setCommands
+ * and \ref getImages performs one simulation step \ref HEADLESS_STEP_S of all cars and renders their images.
+ * The simulation time is common for all cars.
+ *
+ * The batch is not thread safe, a parallel program uses one batch per thread.
+ *
+ * @tparam t_camera The geometry of line camera, see \ref CarCamera.
+ */
+template< class t_camera >
+class HeadlessBatchT
+{
+public:
+
+    /** @brief Constructor places all cars to the start of track.
+     *
+     * @param t_cars The number of cars.
+     * @param t_track The track, when nullptr the \ref HeadlessStraightTrack is used.
+     * The track must exist during the whole life of batch.
+     */
+    HeadlessBatchT( int t_cars, const HeadlessTrack *t_track = nullptr );
+
+    /** @brief The number of cars. */
+    int getCars() const { return m_cars; }
+
+    /** @brief Set servo and motors of all cars, as \ref CarT::setServo and \ref CarT::setMotorPWM.
+     *
+     * @param t_cmds The commands, one item per car.
+     */
+    void setCommands( const CarCommands *t_cmds );
+
+    /** @brief Set servo and motors of one car. */
+    void setCommand( int t_car, const CarCommands &t_cmd );
+
+    /** @brief Perform one simulation step of all cars and capture images from their line cameras.
+     *
+     * @param t_imgs Buffer for images of all cars, the image of car i starts at t_imgs + i * t_camera::pixels.
+     * When it is nullptr, the cars are only moved.
+     * @return Always 0.
+     */
+    int getImages( unsigned char *t_imgs );
+
+    /** @brief Move all cars by one simulation step. */
+    void step();
+
+    /** @brief Render images of all cars in their current positions, see \ref getImages. */
+    void render( unsigned char *t_imgs );
+
+    /** @brief Place one car to the start of track and stop it, the simulation time is not changed. */
+    void resetCar( int t_car );
+
+    /** @brief Place all cars to the start of track and set the simulation time to 0. */
+    void resetCars();
+
+    /** @brief The simulation time of all cars. */
+    double getSimTime() const { return m_time; }
+
+    /** @brief Get pose of the rear axle centre of one car, see \ref HeadlessCarT::getPose. */
+    int getPose( int t_car, CarPose &t_pose ) const;
+
+    /** @brief Get state of all cars. */
+    const HeadlessBatchState &getState() const { return m_state; }
+
+protected:
+
+    const HeadlessTrack *m_track;       ///< The track
+    int m_cars;                         ///< Number of cars
+    double m_time;                      ///< Simulation time
+    HeadlessBatchState m_state;         ///< State of all cars
+
+};
+
+/// The batch of headless cars with the default camera.
+typedef HeadlessBatchT< CarDefaultCamera > HeadlessBatch;
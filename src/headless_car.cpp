@@ -0,0 +1,260 @@
+/**
+ * @file headless_car.cpp
+ * @brief Module headless_car
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/param.h>
+
+#include "headless_car.h"
+
+/// Default track of cars without track
+static HeadlessStraightTrack g_headless_straight_track;
+
+
+/// Current monotonic time in ns
+static long long headlessTimeNs()
+{
+    timespec l_ts;
+    clock_gettime( CLOCK_MONOTONIC, &l_ts );
+    return l_ts.tv_sec * 1000000000LL + l_ts.tv_nsec;
+}
+
+
+/// Pixel intensity of the track in lateral distance from the track centre
+static unsigned char headlessTrackPixel( float t_offset )
+{
+    t_offset = fabsf( t_offset );
+    if ( t_offset > HEADLESS_TRACK_WIDTH_M / 2 ) return HEADLESS_PIXEL_FLOOR;
+    if ( t_offset > HEADLESS_TRACK_WIDTH_M / 2 - HEADLESS_TRACK_LINE_WIDTH_M ) return HEADLESS_PIXEL_LINE;
+    return HEADLESS_PIXEL_TRACK;
+}
+
+
+void HeadlessStraightTrack::renderLine( float t_x0, float t_y0, float t_x1, float t_y1, unsigned char *t_img, int t_len ) const
+{
+    // the lateral offset is the y coordinate
+    float l_dy = ( t_y1 - t_y0 ) / t_len;
+    for ( int i = 0; i < t_len; i++ )
+        t_img[ i ] = headlessTrackPixel( t_y0 + ( i + 0.5f ) * l_dy );
+}
+
+
+void HeadlessStraightTrack::startPose( float &t_x, float &t_y, float &t_yaw ) const
+{
+    t_x = 0;
+    t_y = 0;
+    t_yaw = 0;
+}
+
+
+template< class t_camera >
+HeadlessCarT< t_camera >::HeadlessCarT( const HeadlessTrack *t_track )
+{
+    m_track = t_track ? t_track : &g_headless_straight_track;
+    m_real_time = false;
+    m_real_time_ns = 0;
+
+    resetCar();
+}
+
+
+template< class t_camera >
+int HeadlessCarT< t_camera >::getImage( unsigned char *t_img )
+{
+    headlessStep( HEADLESS_STEP_S );
+
+    if ( t_img )
+        headlessRender( t_img );
+
+    // wait until the time of step elapses
+    if ( m_real_time )
+    {
+        long long l_now_ns = headlessTimeNs();
+        m_real_time_ns += ( long long ) ( HEADLESS_STEP_S * 1000000000LL );
+        if ( m_real_time_ns > l_now_ns )
+        {
+            long long l_wait_ns = m_real_time_ns - l_now_ns;
+            timespec l_ts = { ( time_t ) ( l_wait_ns / 1000000000LL ), ( long ) ( l_wait_ns % 1000000000LL ) };
+            nanosleep( &l_ts, nullptr );
+        }
+        else
+            m_real_time_ns = l_now_ns;
+    }
+
+    return 0;
+}
+
+
+template< class t_camera >
+void HeadlessCarT< t_camera >::setServo( float t_position )
+{
+    // verify allowed range of values
+    t_position = MIN( t_position, 1.0 );
+    t_position = MAX( t_position, - 1.0 );
+
+    m_servo_angle = t_position * CAR_5TH_WHEEL_ANGLE_RAD;
+}
+
+
+template< class t_camera >
+void HeadlessCarT< t_camera >::setMotorPWM( float t_l_pwm, float t_r_pwm )
+{
+    // verify allowed range of the both pwm values
+    t_l_pwm = MIN( t_l_pwm, 1.0 );
+    t_l_pwm = MAX( t_l_pwm, - 1.0 );
+
+    t_r_pwm = MIN( t_r_pwm, 1.0 );
+    t_r_pwm = MAX( t_r_pwm, - 1.0 );
+
+    // recalculate PWM to torque as in CoppeliaSim
+    m_l_torque = t_l_pwm * CAR_MAX_TORQUE_N_M;
+    m_r_torque = t_r_pwm * CAR_MAX_TORQUE_N_M;
+}
+
+
+template< class t_camera >
+void HeadlessCarT< t_camera >::resetCar()
+{
+    memset( &m_state, 0, sizeof( m_state ) );
+    m_track->startPose( m_state.x, m_state.y, m_state.yaw );
+
+    m_servo_angle = 0;
+    m_l_torque = 0;
+    m_r_torque = 0;
+    m_real_time_ns = headlessTimeNs();
+}
+
+
+/// Speed of one rear wheel after a step, the wheel drives a half of car weight
+static float headlessWheelSpeed( float t_speed, float t_torque, float t_dt )
+{
+    // the motor accelerates to the maximal speed in direction of torque
+    float l_target = t_torque > 0 ? CAR_MAX_SPEED_M_S : -CAR_MAX_SPEED_M_S;
+    float l_accel = fabsf( t_torque ) / ( CAR_WHEEL_DIAMETER_M / 2 ) / ( CAR_MASS_KG / 2 );
+
+    // without torque the car is freely rolling
+    if ( t_torque == 0 )
+    {
+        l_target = 0;
+        l_accel = HEADLESS_ROLL_DECEL_M_S2;
+    }
+
+    float l_dv = l_accel * t_dt;
+    if ( t_speed < l_target ) return MIN( t_speed + l_dv, l_target );
+    return MAX( t_speed - l_dv, l_target );
+}
+
+
+template< class t_camera >
+void HeadlessCarT< t_camera >::headlessStep( float t_dt )
+{
+    // servo moves to requested angle by limited speed
+    float l_steer_step = HEADLESS_SERVO_SPEED_RAD_S * t_dt;
+    float l_steer_diff = m_servo_angle - m_state.steer;
+    m_state.steer += MAX( MIN( l_steer_diff, l_steer_step ), -l_steer_step );
+
+    m_state.l_speed = headlessWheelSpeed( m_state.l_speed, m_l_torque, t_dt );
+    m_state.r_speed = headlessWheelSpeed( m_state.r_speed, m_r_torque, t_dt );
+
+    // bicycle model, the 5th wheel represents the both front wheels
+    float l_speed = ( m_state.l_speed + m_state.r_speed ) / 2;
+    float l_yaw_rate = l_speed * tanf( m_state.steer ) / CAR_WHEELBASE_M;
+    float l_yaw_mid = m_state.yaw + l_yaw_rate * t_dt / 2;
+
+    m_state.x += l_speed * cosf( l_yaw_mid ) * t_dt;
+    m_state.y += l_speed * sinf( l_yaw_mid ) * t_dt;
+    m_state.yaw = remainderf( m_state.yaw + l_yaw_rate * t_dt, 2 * M_PI );
+    m_state.time += t_dt;
+
+    // wheels do not slip
+    m_state.l_wheel = remainderf( m_state.l_wheel + m_state.l_speed * t_dt / ( CAR_WHEEL_DIAMETER_M / 2 ), 2 * M_PI );
+    m_state.r_wheel = remainderf( m_state.r_wheel + m_state.r_speed * t_dt / ( CAR_WHEEL_DIAMETER_M / 2 ), 2 * M_PI );
+}
+
+
+template< class t_camera >
+int HeadlessCarT< t_camera >::getPose( CarPose &t_pose )
+{
+    float l_speed = ( m_state.l_speed + m_state.r_speed ) / 2;
+
+    memset( &t_pose, 0, sizeof( t_pose ) );
+    t_pose.time = m_state.time;
+    t_pose.x = m_state.x;
+    t_pose.y = m_state.y;
+    t_pose.yaw = m_state.yaw;
+    t_pose.vx = l_speed * cosf( m_state.yaw );
+    t_pose.vy = l_speed * sinf( m_state.yaw );
+    t_pose.yaw_rate = l_speed * tanf( m_state.steer ) / CAR_WHEELBASE_M;
+    t_pose.l_wheel = m_state.l_wheel;
+    t_pose.r_wheel = m_state.r_wheel;
+
+    return 0;
+}
+
+
+template< class t_camera >
+int HeadlessCarT< t_camera >::saveSnapshot( CarSnapshot &t_snapshot )
+{
+    getPose( t_snapshot.pose );
+    t_snapshot.steer = m_state.steer;
+    t_snapshot.l_speed = m_state.l_speed;
+    t_snapshot.r_speed = m_state.r_speed;
+    t_snapshot.servo_angle = m_servo_angle;
+    t_snapshot.l_torque = m_l_torque;
+    t_snapshot.r_torque = m_r_torque;
+
+    return 0;
+}
+
+
+template< class t_camera >
+int HeadlessCarT< t_camera >::restoreSnapshot( const CarSnapshot &t_snapshot )
+{
+    // the time is not moved back, the lap timer and time limits keep counting
+    m_state.x = t_snapshot.pose.x;
+    m_state.y = t_snapshot.pose.y;
+    m_state.yaw = t_snapshot.pose.yaw;
+    m_state.l_wheel = t_snapshot.pose.l_wheel;
+    m_state.r_wheel = t_snapshot.pose.r_wheel;
+    m_state.steer = t_snapshot.steer;
+    m_state.l_speed = t_snapshot.l_speed;
+    m_state.r_speed = t_snapshot.r_speed;
+
+    m_servo_angle = t_snapshot.servo_angle;
+    m_l_torque = t_snapshot.l_torque;
+    m_r_torque = t_snapshot.r_torque;
+
+    return 0;
+}
+
+
+template< class t_camera >
+void HeadlessCarT< t_camera >::headlessRender( unsigned char *t_img )
+{
+    float l_cos = cosf( m_state.yaw );
+    float l_sin = sinf( m_state.yaw );
+
+    for ( int l = 0; l < t_camera::lines; l++ )
+    {
+        // centre of the scanned line in front of car
+        float l_distance = HEADLESS_CAM_DISTANCE_M + l * HEADLESS_CAM_LINE_GAP_M;
+        float l_cx = m_state.x + l_distance * l_cos;
+        float l_cy = m_state.y + l_distance * l_sin;
+
+        // the line goes from the left to the right side of car
+        float l_hw = HEADLESS_CAM_WIDTH_M / 2;
+        m_track->renderLine( l_cx - l_hw * l_sin, l_cy + l_hw * l_cos,
+                             l_cx + l_hw * l_sin, l_cy - l_hw * l_cos, t_camera::line( t_img, l ), t_camera::resolution );
+    }
+}
+
+
+// the car is compiled for all supported cameras
+template class HeadlessCarT< CarCameraLine128 >;
+template class HeadlessCarT< CarCameraLine256 >;
+template class HeadlessCarT< CarCameraDual128 >;
+
@@ -0,0 +1,168 @@
+#pragma once
+
+/**
+ * @file headless_car.h
+ * @brief Module headless_car
+ *
+ * This module headless_car is a native simulator of the Alamak car without CoppeliaSim.
+ * It uses the kinematic bicycle model and a synthetic line camera,
+ * so it runs without GPU or display many times faster than real time.
+ */
+
+#include "car.h"
+
+/// Simulation step of the headless model, the same timing as a real line camera
+#define HEADLESS_STEP_S                 0.010
+
+/// The distance of the line scanned by camera in front of the rear axle
+#define HEADLESS_CAM_DISTANCE_M         0.30
+/// The width of the line scanned by camera
+#define HEADLESS_CAM_WIDTH_M            0.60
+/// The distance between lines of multi-line camera, the next lines are farther from car
+#define HEADLESS_CAM_LINE_GAP_M         0.05
+
+/// The rotation speed of steering servo
+#define HEADLESS_SERVO_SPEED_RAD_S      ( 60 * M_PI / 180 / 0.1 )
+/// The deceleration of a free rolling car
+#define HEADLESS_ROLL_DECEL_M_S2        0.5
+
+/// The width of racing track including border lines
+#define HEADLESS_TRACK_WIDTH_M          0.53
+/// The width of black border lines of track
+#define HEADLESS_TRACK_LINE_WIDTH_M     0.025
+
+/// The intensities of track, border lines and floor in camera image
+/// @name
+/// @{
+#define HEADLESS_PIXEL_TRACK            230
+#define HEADLESS_PIXEL_LINE             20
+#define HEADLESS_PIXEL_FLOOR            90
+/// @}
+
+/**
+ * @brief The track surface seen by the synthetic line camera of \ref HeadlessCar.
+ */
+class HeadlessTrack
+{
+public:
+
+    /** Destructor */
+    virtual ~HeadlessTrack() {}
+
+    /** @brief Render image of the line on the floor.
+     *
+     * The line is sampled in t_len pixels from the point [t_x0, t_y0] to the point [t_x1, t_y1].
+     *
+     * @param t_img Buffer for image of length t_len.
+     */
+    virtual void renderLine( float t_x0, float t_y0, float t_x1, float t_y1, unsigned char *t_img, int t_len ) const = 0;
+
+    /** @brief Get the starting position of car.
+     *
+     * @param t_x The position of rear axle centre.
+     * @param t_y The position of rear axle centre.
+     * @param t_yaw The heading of car in RAD.
+     */
+    virtual void startPose( float &t_x, float &t_y, float &t_yaw ) const = 0;
+};
+
+/**
+ * @brief The endless straight track along x axis, used when no other track is specified.
+ */
+class HeadlessStraightTrack : public HeadlessTrack
+{
+public:
+    void renderLine( float t_x0, float t_y0, float t_x1, float t_y1, unsigned char *t_img, int t_len ) const override;
+    void startPose( float &t_x, float &t_y, float &t_yaw ) const override;
+};
+
+/// The state of headless car model.
+struct HeadlessCarState
+{
+    double time;                        ///< Simulation time in seconds.
+    float x;                            ///< Position of rear axle centre.
+    float y;                            ///< Position of rear axle centre.
+    float yaw;                          ///< Heading of car in RAD.
+    float steer;                        ///< Current angle of the 5th wheel in RAD.
+    float l_speed;                      ///< Speed of left rear wheel in m/s.
+    float r_speed;                      ///< Speed of right rear wheel in m/s.
+    float l_wheel;                      ///< Angle of left rear wheel in RAD.
+    float r_wheel;                      ///< Angle of right rear wheel in RAD.
+};
+
+/**
+ * @brief The headless model of Alamak car.
+ *
+ * The model moves by the kinematic bicycle model: the 5th (virtual) front wheel is turned by servo
+ * and the rear wheels are driven by torque up to \ref CAR_MAX_SPEED_M_S, as the motors in CoppeliaSim.
+ * Every call of \ref getImage performs one simulation step \ref HEADLESS_STEP_S
+ * and renders the line camera image from the \ref HeadlessTrack.
+ *
+ * The class is compiled for all cameras listed in car.h, \ref HeadlessCar uses the default one.
+ *
+ * @tparam t_camera The geometry of line camera, see \ref CarCamera.
+ */
+template< class t_camera >
+class HeadlessCarT : public CarT< t_camera >
+{
+public:
+
+    /** @brief Constructor places car to the start of track.
+     *
+     * @param t_track The track, when nullptr the \ref HeadlessStraightTrack is used.
+     * The track must exist during the whole life of car.
+     */
+    HeadlessCarT( const HeadlessTrack *t_track = nullptr );
+
+    /** @brief Perform one simulation step and capture image from line camera.
+     *
+     * The pixel 0 is on the left side of car, the line 0 is the nearest one.
+     * @return Always 0.
+     */
+    int getImage( unsigned char *t_img ) override;
+
+    void setServo( float t_position ) override;
+    void setMotorPWM( float t_l_pwm, float t_r_pwm ) override;
+    void resetCar() override;
+    double getSimTime() override { return m_state.time; }
+
+    /** @brief Get pose of the rear axle centre, it is always available. */
+    int getPose( CarPose &t_pose ) override;
+
+    /** @brief Save the whole state of model, the restore of snapshot is exact. */
+    int saveSnapshot( CarSnapshot &t_snapshot ) override;
+
+    /** @brief Restore the state of model immediately, the simulation time keeps running. */
+    int restoreSnapshot( const CarSnapshot &t_snapshot ) override;
+
+    /** @brief Slow down simulation to real time.
+     *
+     * By default the simulation runs as fast as the control program consumes images.
+     * In the real time mode every step waits until its time elapses, e.g. for a control by gamepad.
+     */
+    void setRealTime( bool t_real_time ) { m_real_time = t_real_time; }
+
+    /** @brief Get current state of the model. */
+    const HeadlessCarState &getState() const { return m_state; }
+
+protected:
+
+    /** @brief Move model by one simulation step. */
+    void headlessStep( float t_dt );
+
+    /** @brief Render image from line camera in current position. */
+    void headlessRender( unsigned char *t_img );
+
+    const HeadlessTrack *m_track;       ///< The track
+    HeadlessCarState m_state;           ///< Current state of model
+    float m_servo_angle;                ///< Requested angle of the 5th wheel
+    float m_l_torque;                   ///< Requested torque of left motor
+    float m_r_torque;                   ///< Requested torque of right motor
+    bool m_real_time;                   ///< Real time mode
+    long long m_real_time_ns;           ///< Monotonic time of the last step in real time mode
+
+};
+
+/// The headless car with the default camera.
+typedef HeadlessCarT< CarDefaultCamera > HeadlessCar;
+
@@ -0,0 +1,128 @@
+/**
+ * @file headless_server.cpp
+ * @brief Module headless_server
+ *
+ * This program replaces CoppeliaSim by \ref RemoteApiServer with headless car models.
+ * Every car listens on its own port, so the demo programs including \ref demo_car_runner.cpp
+ * can use the Remote API code path on a computer without CoppeliaSim and display.
+ *
+ * For more information see header files or use doxygen.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <poll.h>
+#include <string.h>
+#include <pthread.h>
+#include <vector>
+
+#include "headless_car.h"
+#include "track_map.h"
+#include "remote_server.h"
+
+#define HELP                                                        \
+    "Usage: %s [-h] [-cars N] [-track string] port_number\n"        \
+    "  -h               this help\n"                                \
+    "  -cars N          number of cars, next cars use next ports (default 1)\n" \
+    "  -track string    track definition, e.g. \"S R S L S R S R\"\n" \
+    "  port_number      localhost port number of the first car\n\n"
+
+/// Thread serving one car
+void *serverThread( void *t_arg )
+{
+    ( ( RemoteApiServer * ) t_arg )->run();
+    return nullptr;
+}
+
+int main( int argc, char* argv[] )
+{
+    int l_port_num = -1;
+    int l_cars = 1;
+    const char *l_track = nullptr;
+
+    for ( int i = 1; i < argc; i++ )
+    {
+        if ( !strcmp( argv[ i ], "-cars" ) && i + 1 < argc )
+        {
+            l_cars = atoi( argv[ ++i ] );
+            continue;
+        }
+        if ( !strcmp( argv[ i ], "-track" ) && i + 1 < argc )
+        {
+            l_track = argv[ ++i ];
+            continue;
+        }
+        if ( *argv[ i ] != '-' )
+        {
+            l_port_num = atoi( argv[ i ] );
+            continue;
+        }
+        l_port_num = -1;
+        break;
+    }
+    if ( l_port_num < 0 || l_cars < 1 )
+    {
+        printf( HELP, argv[ 0 ] );
+        exit( 0 );
+    }
+
+    TrackMap l_track_map;
+    if ( l_track && l_track_map.compile( l_track ) < 0 )
+    {
+        fprintf( stderr, "Unable to compile track!\n" );
+        exit( 1 );
+    }
+
+    // every car has its own server and thread
+    std::vector< HeadlessCar * > l_car_list;
+    std::vector< RemoteApiServer * > l_server_list;
+    std::vector< pthread_t > l_thread_list( l_cars );
+    for ( int i = 0; i < l_cars; i++ )
+    {
+        HeadlessCar *l_car = new HeadlessCar( l_track ? &l_track_map : nullptr );
+        RemoteApiServer *l_server = new RemoteApiServer( *l_car, HEADLESS_STEP_S * 1000 );
+        if ( l_server->open( l_port_num + i ) < 0 ) exit( 1 );
+        pthread_create( &l_thread_list[ i ], nullptr, serverThread, l_server );
+        l_car_list.push_back( l_car );
+        l_server_list.push_back( l_server );
+    }
+
+    fprintf( stderr, "Listening on ports %d-%d. Type 'quit'...\n", l_port_num, l_port_num + l_cars - 1 );
+    while ( true )
+    {
+        char l_line[ 128 ];
+        int l_len = read( 0, l_line, sizeof( l_line ) - 1 );
+        if ( l_len <= 0 )
+        {
+            // without terminal the server runs until it is killed
+            pause();
+            continue;
+        }
+        l_line[ l_len ] = 0;
+        if ( strncasecmp( l_line, "quit", 4 ) == 0 ) break;
+    }
+
+    fprintf( stderr, "Application exiting....\n" );
+
+    fprintf( stderr, "%4s %6s %10s %10s %10s %10s %12s %12s\n",
+            "car", "conn", "messages", "commands", "streamed", "steps", "bytes in", "bytes out" );
+    for ( int i = 0; i < l_cars; i++ )
+    {
+        l_server_list[ i ]->stop();
+        pthread_join( l_thread_list[ i ], nullptr );
+
+        const RemoteServerStats &l_stats = l_server_list[ i ]->getStats();
+        fprintf( stderr, "%4d %6lu %10lu %10lu %10lu %10lu %12lu %12lu\n", i, l_stats.connections,
+                l_stats.messages, l_stats.commands, l_stats.streamed, l_stats.steps, l_stats.bytes_in, l_stats.bytes_out );
+
+        delete l_server_list[ i ];
+        delete l_car_list[ i ];
+    }
+
+    fprintf( stderr, "...done.\n" );
+
+    return 0;
+}
+
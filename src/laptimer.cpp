@@ -0,0 +1,166 @@
+/**
+ * @file laptimer.cpp
+ * @brief Module laptimer
+ *
+ */
+
+#include <string.h>
+#include <sys/param.h>
+
+#include "laptimer.h"
+
+LapTimer::LapTimer( const TrackMap *t_track, int t_off_track_updates )
+{
+    m_track = t_track;
+    m_off_track_updates = MAX( t_off_track_updates, 1 );
+    setOrigin( 0, 0, 0 );
+
+    m_started = false;
+    m_lap_valid = false;
+    m_lap_start = 0;
+    m_lap_distance = 0;
+    m_lap_max_speed = 0;
+    m_lap_max_offset = 0;
+    m_last_s = 0;
+    m_off_track = 0;
+    m_on_track = false;
+    memset( &m_location, 0, sizeof( m_location ) );
+    memset( &m_last_pose, 0, sizeof( m_last_pose ) );
+    memset( &m_stats, 0, sizeof( m_stats ) );
+}
+
+
+void LapTimer::setOrigin( float t_x, float t_y, float t_yaw )
+{
+    m_origin_x = t_x;
+    m_origin_y = t_y;
+    m_origin_cos = cosf( t_yaw );
+    m_origin_sin = sinf( t_yaw );
+}
+
+
+int LapTimer::laptimerLocate( const CarPose &t_pose, TrackLocation &t_loc ) const
+{
+    // rotate the pose into track coordinates
+    float l_dx = t_pose.x - m_origin_x;
+    float l_dy = t_pose.y - m_origin_y;
+
+    return m_track->locate( l_dx * m_origin_cos + l_dy * m_origin_sin,
+                            l_dy * m_origin_cos - l_dx * m_origin_sin, t_loc );
+}
+
+
+void LapTimer::laptimerOdometry( const CarPose &t_pose )
+{
+    float l_wheels = carWheelDelta( m_last_pose.l_wheel, t_pose.l_wheel ) + carWheelDelta( m_last_pose.r_wheel, t_pose.r_wheel );
+    float l_distance = l_wheels / 2 * ( CAR_WHEEL_DIAMETER_M / 2 );
+
+    m_stats.distance_m += l_distance;
+    m_lap_distance += l_distance;
+    m_lap_max_speed = MAX( m_lap_max_speed, hypotf( t_pose.vx, t_pose.vy ) );
+    m_last_pose = t_pose;
+}
+
+
+void LapTimer::restart( const CarPose &t_pose )
+{
+    m_started = true;
+    m_lap_valid = true;
+    m_lap_start = t_pose.time;
+    m_lap_distance = 0;
+    m_lap_max_speed = 0;
+    m_lap_max_offset = 0;
+    m_off_track = 0;
+    m_last_pose = t_pose;
+
+    m_on_track = laptimerLocate( t_pose, m_location ) == 0;
+    m_last_s = m_on_track ? m_location.s : 0;
+}
+
+
+LapTimerEvent LapTimer::update( const CarPose &t_pose )
+{
+    if ( !m_started ) restart( t_pose );
+
+    laptimerOdometry( t_pose );
+
+    m_on_track = laptimerLocate( t_pose, m_location ) == 0;
+    if ( !m_on_track )
+    {
+        if ( ++m_off_track < m_off_track_updates ) return LAPTIMER_NONE;
+
+        // the crashed lap is not counted
+        m_stats.off_track++;
+        m_off_track = 0;
+        m_lap_valid = false;
+        return LAPTIMER_OFF_TRACK;
+    }
+    m_off_track = 0;
+
+    float l_offset = fabsf( m_location.offset );
+    m_lap_max_offset = MAX( m_lap_max_offset, l_offset );
+    m_stats.max_offset_m = MAX( m_stats.max_offset_m, l_offset );
+
+    float l_length = m_track->getLength();
+    float l_last_s = m_last_s;
+    m_last_s = m_location.s;
+
+    // the start line is crossed when the distance on track jumps from the end to the beginning
+    if ( l_last_s > l_length * 3 / 4 && m_location.s < l_length / 4 )
+    {
+        bool l_finished = m_lap_valid;
+        if ( l_finished )
+        {
+            LapRecord l_lap;
+            l_lap.start_s = m_lap_start;
+            l_lap.time_s = t_pose.time - m_lap_start;
+            l_lap.distance_m = m_lap_distance;
+            l_lap.avg_speed_m_s = l_lap.time_s > 0 ? l_lap.distance_m / l_lap.time_s : 0;
+            l_lap.max_speed_m_s = m_lap_max_speed;
+            l_lap.max_offset_m = m_lap_max_offset;
+            m_laps.push_back( l_lap );
+
+            if ( !m_stats.laps || l_lap.time_s < m_stats.best_lap_s ) m_stats.best_lap_s = l_lap.time_s;
+            m_stats.last_lap_s = l_lap.time_s;
+            m_stats.total_lap_s += l_lap.time_s;
+            m_stats.lap_distance_m += l_lap.distance_m;
+            m_stats.laps++;
+            if ( m_stats.total_lap_s > 0 ) m_stats.avg_speed_m_s = m_stats.lap_distance_m / m_stats.total_lap_s;
+        }
+
+        // the next lap starts immediately
+        m_lap_valid = true;
+        m_lap_start = t_pose.time;
+        m_lap_distance = 0;
+        m_lap_max_speed = 0;
+        m_lap_max_offset = 0;
+
+        return l_finished ? LAPTIMER_LAP : LAPTIMER_NONE;
+    }
+
+    // crossing backward does not count
+    if ( l_last_s < l_length / 4 && m_location.s > l_length * 3 / 4 )
+        m_lap_valid = false;
+
+    return LAPTIMER_NONE;
+}
+
+
+void LapTimer::print( FILE *t_file ) const
+{
+    fprintf( t_file, "%4s %10s %10s %12s %12s %12s %12s\n",
+            "lap", "start [s]", "time [s]", "distance [m]", "avg [m/s]", "max [m/s]", "offset [m]" );
+    for ( int i = 0; i < ( int ) m_laps.size(); i++ )
+    {
+        const LapRecord &l_lap = m_laps[ i ];
+        fprintf( t_file, "%4d %10.2f %10.2f %12.2f %12.2f %12.2f %12.3f\n", i + 1, l_lap.start_s, l_lap.time_s,
+                l_lap.distance_m, l_lap.avg_speed_m_s, l_lap.max_speed_m_s, l_lap.max_offset_m );
+    }
+
+    if ( m_stats.laps )
+        fprintf( t_file, "Laps: %d, best lap: %.2f s, average lap: %.2f s, average speed: %.2f m/s, off track: %d\n",
+                m_stats.laps, m_stats.best_lap_s, m_stats.total_lap_s / m_stats.laps, m_stats.avg_speed_m_s, m_stats.off_track );
+    else
+        fprintf( t_file, "Laps: 0, off track: %d\n", m_stats.off_track );
+}
+
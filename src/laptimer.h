@@ -0,0 +1,142 @@
+#pragma once
+
+/**
+ * @file laptimer.h
+ * @brief Module laptimer
+ *
+ * This module laptimer measures laps of a car on the \ref TrackMap from the poses of car
+ * (\ref Car::getPose). It detects the crossing of start/finish line and the car out of track,
+ * and it computes lap times, the distance driven by wheel odometry and the average speed.
+ */
+
+#include <stdio.h>
+#include <vector>
+
+#include "car.h"
+#include "track_map.h"
+
+/// The default number of poses out of track, after which the car is reported as crashed
+#define LAPTIMER_OFF_TRACK_UPDATES      50
+
+/// The event reported by \ref LapTimer::update.
+enum LapTimerEvent
+{
+    LAPTIMER_NONE,                      ///< Nothing happened.
+    LAPTIMER_LAP,                       ///< The lap was finished, see \ref LapTimer::getLaps.
+    LAPTIMER_OFF_TRACK                  ///< The car is out of track, the current lap is not counted.
+};
+
+/// Single finished lap.
+struct LapRecord
+{
+    double start_s;                     ///< Simulation time of the start of lap.
+    double time_s;                      ///< Lap time.
+    float distance_m;                   ///< Distance driven by wheel odometry.
+    float avg_speed_m_s;                ///< Average speed, odometry distance divided by lap time.
+    float max_speed_m_s;                ///< Maximal speed of car body.
+    float max_offset_m;                 ///< Maximal lateral distance from the track centre.
+};
+
+/// Statistics of \ref LapTimer.
+struct LapTimerStats
+{
+    int laps;                           ///< Number of finished laps.
+    double best_lap_s;                  ///< The best lap time.
+    double last_lap_s;                  ///< The last lap time.
+    double total_lap_s;                 ///< Time of all finished laps.
+    double lap_distance_m;              ///< Odometry distance of all finished laps.
+    double avg_speed_m_s;               ///< Average speed of all finished laps.
+    int off_track;                      ///< Number of off track events (crashes).
+    double distance_m;                  ///< Odometry distance since the start of timer.
+    double max_offset_m;                ///< Maximal lateral distance from the track centre on track since the start of timer.
+};
+
+/**
+ * @brief The lap timer of single car.
+ *
+ * The start/finish line is the start of track. The line is crossed when the distance along
+ * the track centre jumps from the last quarter of track to the first quarter.
+ * A crossing in the opposite direction or the off track event cancels the current lap,
+ * the next lap is timed from the next forward crossing or from \ref restart.
+ */
+class LapTimer
+{
+public:
+
+    /** @brief Constructor.
+     *
+     * @param t_track The track, it must exist during the whole life of timer.
+     * @param t_off_track_updates The number of successive poses out of track reported as \ref LAPTIMER_OFF_TRACK.
+     */
+    LapTimer( const TrackMap *t_track, int t_off_track_updates = LAPTIMER_OFF_TRACK_UPDATES );
+
+    /** @brief Set the pose of track start in coordinates of car backend.
+     *
+     * The headless car uses the coordinates of track directly. The track in the scene of CoppeliaSim
+     * can be placed anywhere, the poses are transformed to the track coordinates.
+     */
+    void setOrigin( float t_x, float t_y, float t_yaw );
+
+    /** @brief Start timing of new lap from the pose, e.g. after \ref Car::resetCar.
+     *
+     * Without restart the first lap starts by the first pose passed to \ref update.
+     */
+    void restart( const CarPose &t_pose );
+
+    /** @brief Process the next pose of car.
+     *
+     * @return The event caused by the pose.
+     */
+    LapTimerEvent update( const CarPose &t_pose );
+
+    /** @brief The statistics of all laps. */
+    const LapTimerStats &getStats() const { return m_stats; }
+
+    /** @brief All finished laps. */
+    const std::vector< LapRecord > &getLaps() const { return m_laps; }
+
+    /** @brief The location of the last pose on track, valid when \ref isOnTrack. */
+    const TrackLocation &getLocation() const { return m_location; }
+
+    /** @brief The last pose was on track. */
+    bool isOnTrack() const { return m_on_track; }
+
+    /** @brief Print all laps and statistics. */
+    void print( FILE *t_file ) const;
+
+protected:
+
+    /** @brief Find the position of pose on track. */
+    int laptimerLocate( const CarPose &t_pose, TrackLocation &t_loc ) const;
+
+    /** @brief Add distance driven since the last pose. */
+    void laptimerOdometry( const CarPose &t_pose );
+
+    const TrackMap *m_track;            ///< The track
+    int m_off_track_updates;            ///< Limit of poses out of track
+
+    /// @name The pose of track start in coordinates of car backend
+    /// @{
+    float m_origin_x;
+    float m_origin_y;
+    float m_origin_cos;
+    float m_origin_sin;
+    /// @}
+
+    bool m_started;                     ///< The first pose was processed
+    bool m_lap_valid;                   ///< The current lap is timed
+    double m_lap_start;                 ///< Simulation time of the start of current lap
+    float m_lap_distance;               ///< Odometry distance of current lap
+    float m_lap_max_speed;              ///< Maximal speed in current lap
+    float m_lap_max_offset;             ///< Maximal lateral distance in current lap
+    float m_last_s;                     ///< The last distance along track
+    int m_off_track;                    ///< Number of successive poses out of track
+    bool m_on_track;                    ///< The last pose was on track
+    TrackLocation m_location;           ///< The location of the last pose on track
+    CarPose m_last_pose;                ///< The last pose for odometry
+
+    LapTimerStats m_stats;              ///< Statistics
+    std::vector< LapRecord > m_laps;    ///< Finished laps
+
+};
+
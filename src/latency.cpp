@@ -0,0 +1,116 @@
+/**
+ * @file latency.cpp
+ * @brief Module latency
+ *
+ */
+
+#include <sys/param.h>
+
+#include "latency.h"
+
+
+LatencyHistogram::LatencyHistogram()
+{
+    reset();
+}
+
+
+void LatencyHistogram::reset()
+{
+    for ( int i = 0; i < LATENCY_BUCKETS; i++ )
+        m_buckets[ i ].store( 0, std::memory_order_relaxed );
+    m_count.store( 0, std::memory_order_relaxed );
+    m_sum.store( 0, std::memory_order_relaxed );
+    m_max.store( 0, std::memory_order_relaxed );
+}
+
+
+double LatencyHistogram::getMean() const
+{
+    unsigned long l_count = getCount();
+    return l_count ? ( double ) m_sum.load( std::memory_order_relaxed ) / l_count : 0;
+}
+
+
+long long LatencyHistogram::latencyBucketLow( int t_bucket )
+{
+    if ( t_bucket < ( 1 << LATENCY_SUB_BITS ) ) return t_bucket;
+    int l_exp = ( t_bucket >> LATENCY_SUB_BITS ) + LATENCY_SUB_BITS - 1;
+    long long l_sub = t_bucket & ( ( 1 << LATENCY_SUB_BITS ) - 1 );
+    return ( ( 1LL << LATENCY_SUB_BITS ) + l_sub ) << ( l_exp - LATENCY_SUB_BITS );
+}
+
+
+long long LatencyHistogram::getPercentile( double t_percent ) const
+{
+    unsigned long l_count = getCount();
+    if ( !l_count ) return 0;
+
+    // rank of sample, at least the first one
+    unsigned long l_rank = MAX( ( unsigned long ) ( t_percent / 100.0 * l_count + 0.5 ), 1UL );
+    unsigned long l_sum = 0;
+    for ( int i = 0; i < LATENCY_BUCKETS; i++ )
+    {
+        l_sum += m_buckets[ i ].load( std::memory_order_relaxed );
+        if ( l_sum < l_rank ) continue;
+
+        // the middle of bucket, but never above the maximum
+        long long l_low = latencyBucketLow( i );
+        long long l_high = i + 1 < LATENCY_BUCKETS ? latencyBucketLow( i + 1 ) - 1 : l_low;
+        return MIN( ( l_low + l_high ) / 2, getMax() );
+    }
+
+    // samples were added during the walk
+    return getMax();
+}
+
+
+void LatencyHistogram::printHeader( FILE *t_file )
+{
+    fprintf( t_file, "%-12s %10s %10s %10s %10s %10s %10s\n",
+            "[us]", "count", "avg", "p50", "p99", "p99.9", "max" );
+}
+
+
+void LatencyHistogram::print( FILE *t_file, const char *t_name ) const
+{
+    fprintf( t_file, "%-12s %10lu %10.1f %10.1f %10.1f %10.1f %10.1f\n", t_name, getCount(),
+            getMean() / 1000.0, getPercentile( 50 ) / 1000.0, getPercentile( 99 ) / 1000.0,
+            getPercentile( 99.9 ) / 1000.0, getMax() / 1000.0 );
+}
+
+
+LatencyProfile::LatencyProfile()
+{
+    m_stage_count = 0;
+    m_begin = 0;
+    m_last = 0;
+}
+
+
+int LatencyProfile::addStage( const char *t_name )
+{
+    if ( m_stage_count >= LATENCY_MAX_STAGES ) return -1;
+
+    m_names[ m_stage_count ] = t_name;
+    return m_stage_count++;
+}
+
+
+void LatencyProfile::reset()
+{
+    for ( int i = 0; i < m_stage_count; i++ )
+        m_stages[ i ].reset();
+    m_cycle.reset();
+    m_begin = 0;
+}
+
+
+void LatencyProfile::print( FILE *t_file ) const
+{
+    LatencyHistogram::printHeader( t_file );
+    for ( int i = 0; i < m_stage_count; i++ )
+        m_stages[ i ].print( t_file, m_names[ i ] );
+    m_cycle.print( t_file, "cycle" );
+}
+
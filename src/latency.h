@@ -0,0 +1,170 @@
+#pragma once
+
+/**
+ * @file latency.h
+ * @brief Module latency
+ *
+ * This module latency measures durations of control loop stages by monotonic clock.
+ * The samples are stored in log-linear (HDR-style) histograms with relative precision about 3 %.
+ * The histogram is updated by atomic operations only, so it can be printed by other thread
+ * while the control loop is running.
+ */
+
+#include <stdio.h>
+#include <time.h>
+#include <atomic>
+
+/// Number of bits of linear sub-buckets in every power of two
+#define LATENCY_SUB_BITS                5
+/// Longer durations than 2^LATENCY_MAX_BITS ns (about 18 minutes) are stored in the last bucket
+#define LATENCY_MAX_BITS                40
+/// Number of buckets of histogram
+#define LATENCY_BUCKETS                 ( ( LATENCY_MAX_BITS - LATENCY_SUB_BITS + 1 ) << LATENCY_SUB_BITS )
+/// Maximal number of stages of \ref LatencyProfile
+#define LATENCY_MAX_STAGES              8
+
+/// Current monotonic time in ns
+inline long long latencyNow()
+{
+    timespec l_ts;
+    clock_gettime( CLOCK_MONOTONIC, &l_ts );
+    return l_ts.tv_sec * 1000000000LL + l_ts.tv_nsec;
+}
+
+/**
+ * @brief Histogram of durations in nanoseconds.
+ *
+ * The values up to 2^LATENCY_SUB_BITS ns are stored exactly, every next power of two
+ * is split into 2^LATENCY_SUB_BITS linear buckets.
+ */
+class LatencyHistogram
+{
+public:
+
+    /** Constructor clears histogram. */
+    LatencyHistogram();
+
+    /** @brief Clear all samples. */
+    void reset();
+
+    /** @brief Add single duration.
+     *
+     * @param t_ns Duration in nanoseconds, negative values are stored as 0.
+     */
+    void record( long long t_ns )
+    {
+        if ( t_ns < 0 ) t_ns = 0;
+        m_buckets[ latencyBucket( t_ns ) ].fetch_add( 1, std::memory_order_relaxed );
+        m_count.fetch_add( 1, std::memory_order_relaxed );
+        m_sum.fetch_add( t_ns, std::memory_order_relaxed );
+        long long l_max = m_max.load( std::memory_order_relaxed );
+        while ( t_ns > l_max && !m_max.compare_exchange_weak( l_max, t_ns, std::memory_order_relaxed ) );
+    }
+
+    /** @brief Number of samples. */
+    unsigned long getCount() const { return m_count.load( std::memory_order_relaxed ); }
+
+    /** @brief Maximal sample in ns. */
+    long long getMax() const { return m_max.load( std::memory_order_relaxed ); }
+
+    /** @brief Average of samples in ns. */
+    double getMean() const;
+
+    /** @brief Value of percentile in ns.
+     *
+     * @param t_percent Percentile from 0 to 100.
+     * @return The middle value of bucket containing the percentile, 0 when histogram is empty.
+     */
+    long long getPercentile( double t_percent ) const;
+
+    /** @brief Print one line with count, average, p50, p99, p99.9 and max in microseconds. */
+    void print( FILE *t_file, const char *t_name ) const;
+
+    /** @brief Print header of columns printed by \ref print. */
+    static void printHeader( FILE *t_file );
+
+protected:
+
+    /** @brief Index of bucket for the value. */
+    static int latencyBucket( long long t_ns )
+    {
+        if ( t_ns < ( 1LL << LATENCY_SUB_BITS ) ) return ( int ) t_ns;
+        if ( t_ns >= ( 1LL << LATENCY_MAX_BITS ) ) return LATENCY_BUCKETS - 1;
+        int l_exp = 63 - __builtin_clzll( t_ns );
+        int l_sub = ( t_ns >> ( l_exp - LATENCY_SUB_BITS ) ) & ( ( 1 << LATENCY_SUB_BITS ) - 1 );
+        return ( ( l_exp - LATENCY_SUB_BITS + 1 ) << LATENCY_SUB_BITS ) + l_sub;
+    }
+
+    /** @brief The lowest value of bucket. */
+    static long long latencyBucketLow( int t_bucket );
+
+    std::atomic< unsigned long > m_buckets[ LATENCY_BUCKETS ]; ///< Counts of samples in buckets
+    std::atomic< unsigned long > m_count; ///< Number of samples
+    std::atomic< long long > m_sum;     ///< Sum of samples
+    std::atomic< long long > m_max;     ///< Maximal sample
+
+};
+
+/**
+ * @brief Durations of stages of control loop.
+ *
+ * The cycle is started by \ref begin and every stage is finished by \ref mark.
+ * The duration of stage is measured from the previous mark (or from the beginning of cycle).
+ * The whole cycle is measured from one \ref begin to the next one.
+ *
+ * The stages are measured by single thread, the statistics can be printed by any thread.
+ */
+class LatencyProfile
+{
+public:
+
+    /** Constructor creates profile without stages. */
+    LatencyProfile();
+
+    /** @brief Add stage with the name.
+     *
+     * @param t_name Name of stage, the string must be valid during the whole life of profile.
+     * @return Index of stage for \ref mark or -1 when there are already \ref LATENCY_MAX_STAGES stages.
+     */
+    int addStage( const char *t_name );
+
+    /** @brief Start next cycle. */
+    void begin()
+    {
+        long long l_now = latencyNow();
+        if ( m_begin ) m_cycle.record( l_now - m_begin );
+        m_begin = l_now;
+        m_last = l_now;
+    }
+
+    /** @brief Finish the stage. */
+    void mark( int t_stage )
+    {
+        long long l_now = latencyNow();
+        m_stages[ t_stage ].record( l_now - m_last );
+        m_last = l_now;
+    }
+
+    /** @brief Clear all samples. */
+    void reset();
+
+    /** @brief Histogram of stage. */
+    const LatencyHistogram &getStage( int t_stage ) const { return m_stages[ t_stage ]; }
+
+    /** @brief Histogram of the whole cycle. */
+    const LatencyHistogram &getCycle() const { return m_cycle; }
+
+    /** @brief Print statistics of all stages and the whole cycle. */
+    void print( FILE *t_file ) const;
+
+protected:
+
+    int m_stage_count;                  ///< Number of stages
+    const char *m_names[ LATENCY_MAX_STAGES ]; ///< Names of stages
+    LatencyHistogram m_stages[ LATENCY_MAX_STAGES ]; ///< Durations of stages
+    LatencyHistogram m_cycle;           ///< Durations of the whole cycle
+    long long m_begin;                  ///< Beginning of current cycle
+    long long m_last;                   ///< The last mark
+
+};
+
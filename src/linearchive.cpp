@@ -0,0 +1,539 @@
+/**
+ * @file linearchive.cpp
+ * @brief Module linearchive
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <sys/param.h>
+
+#include "linearchive.h"
+
+/// The longest run of unchanged or changed pixels coded by one byte
+#define LINEARCHIVE_MAX_RUN             128
+/// The longest varint of 64bit value
+#define LINEARCHIVE_MAX_VARINT          10
+
+
+/// Append unsigned varint, 7 bits per byte, the lowest bits first
+static void linearchivePutVarint( std::vector< unsigned char > &t_out, uint64_t t_value )
+{
+    while ( t_value >= 0x80 )
+    {
+        t_out.push_back( ( t_value & 0x7f ) | 0x80 );
+        t_value >>= 7;
+    }
+    t_out.push_back( t_value );
+}
+
+
+/// Read unsigned varint, it returns -1 when the data end
+static int linearchiveGetVarint( const unsigned char *&t_data, const unsigned char *t_end, uint64_t &t_value )
+{
+    t_value = 0;
+    for ( int l_shift = 0; l_shift < 7 * LINEARCHIVE_MAX_VARINT; l_shift += 7 )
+    {
+        if ( t_data >= t_end ) return -1;
+        unsigned char l_byte = *t_data++;
+        t_value |= ( uint64_t ) ( l_byte & 0x7f ) << l_shift;
+        if ( !( l_byte & 0x80 ) ) return 0;
+    }
+    return -1;
+}
+
+
+/// Signed difference to unsigned value with small numbers for small magnitudes
+static uint64_t linearchiveZigzag( int64_t t_value )
+{
+    return ( ( uint64_t ) t_value << 1 ) ^ ( uint64_t ) ( t_value >> 63 );
+}
+
+
+static int64_t linearchiveUnzigzag( uint64_t t_value )
+{
+    return ( int64_t ) ( t_value >> 1 ) ^ -( int64_t ) ( t_value & 1 );
+}
+
+
+static uint32_t linearchiveFloatBits( float t_value )
+{
+    uint32_t l_bits;
+    memcpy( &l_bits, &t_value, sizeof( l_bits ) );
+    return l_bits;
+}
+
+
+/// Blank state, every block starts from it
+static void linearchiveResetState( LineArchiveState &t_state )
+{
+    memset( &t_state, 0, sizeof( t_state ) );
+}
+
+
+/// Code one frame as difference against the previous one, the state is updated
+static void linearchiveEncodeFrame( const unsigned char *t_img, const LineArchiveMeta &t_meta, int t_pixels,
+        LineArchiveState &t_state, std::vector< unsigned char > &t_out )
+{
+    int64_t l_sim_us = llround( t_meta.sim_time * 1e6 );
+    int64_t l_wall_us = llround( t_meta.wall_time * 1e6 );
+    linearchivePutVarint( t_out, linearchiveZigzag( l_sim_us - t_state.sim_us ) );
+    linearchivePutVarint( t_out, linearchiveZigzag( l_wall_us - t_state.wall_us ) );
+    t_state.sim_us = l_sim_us;
+    t_state.wall_us = l_wall_us;
+
+    // the unchanged commands take one byte
+    uint32_t l_commands[ 3 ] = { linearchiveFloatBits( t_meta.servo ),
+        linearchiveFloatBits( t_meta.l_pwm ), linearchiveFloatBits( t_meta.r_pwm ) };
+    for ( int i = 0; i < 3; i++ )
+    {
+        linearchivePutVarint( t_out, l_commands[ i ] ^ t_state.commands[ i ] );
+        t_state.commands[ i ] = l_commands[ i ];
+    }
+    linearchivePutVarint( t_out, t_meta.flags );
+
+    unsigned char *l_prev = t_state.image;
+    int i = 0;
+    while ( i < t_pixels )
+    {
+        int l_start = i;
+        if ( t_img[ i ] == l_prev[ i ] )
+        {
+            while ( i < t_pixels && i - l_start < LINEARCHIVE_MAX_RUN && t_img[ i ] == l_prev[ i ] ) i++;
+            t_out.push_back( i - l_start - 1 );
+            continue;
+        }
+
+        // a single unchanged pixel inside of changed ones is cheaper as a difference
+        while ( i < t_pixels && i - l_start < LINEARCHIVE_MAX_RUN &&
+                ( t_img[ i ] != l_prev[ i ] || ( i + 1 < t_pixels && t_img[ i + 1 ] != l_prev[ i + 1 ] ) ) ) i++;
+        t_out.push_back( 0x80 | ( i - l_start - 1 ) );
+        for ( int k = l_start; k < i; k++ )
+            t_out.push_back( ( unsigned char ) ( t_img[ k ] - l_prev[ k ] ) );
+    }
+
+    memcpy( l_prev, t_img, t_pixels );
+}
+
+
+/// Decode one frame, it returns -1 for damaged data
+static int linearchiveDecodeFrame( const unsigned char *&t_data, const unsigned char *t_end, int t_pixels, int t_version,
+        LineArchiveState &t_state, unsigned char *t_img, LineArchiveMeta &t_meta )
+{
+    uint64_t l_value;
+    if ( linearchiveGetVarint( t_data, t_end, l_value ) < 0 ) return -1;
+    t_state.sim_us += linearchiveUnzigzag( l_value );
+    if ( linearchiveGetVarint( t_data, t_end, l_value ) < 0 ) return -1;
+    t_state.wall_us += linearchiveUnzigzag( l_value );
+    t_meta.sim_time = t_state.sim_us / 1e6;
+    t_meta.wall_time = t_state.wall_us / 1e6;
+
+    float *l_commands[ 3 ] = { &t_meta.servo, &t_meta.l_pwm, &t_meta.r_pwm };
+    for ( int i = 0; i < 3; i++ )
+    {
+        if ( linearchiveGetVarint( t_data, t_end, l_value ) < 0 ) return -1;
+        t_state.commands[ i ] ^= ( uint32_t ) l_value;
+        memcpy( l_commands[ i ], &t_state.commands[ i ], sizeof( float ) );
+    }
+
+    // the version 1 has no flags
+    t_meta.flags = 0;
+    if ( t_version >= 2 )
+    {
+        if ( linearchiveGetVarint( t_data, t_end, l_value ) < 0 ) return -1;
+        t_meta.flags = ( uint32_t ) l_value;
+    }
+
+    unsigned char *l_prev = t_state.image;
+    int i = 0;
+    while ( i < t_pixels )
+    {
+        if ( t_data >= t_end ) return -1;
+        unsigned char l_token = *t_data++;
+        int l_len = ( l_token & 0x7f ) + 1;
+        if ( i + l_len > t_pixels ) return -1;
+
+        if ( l_token & 0x80 )
+        {
+            if ( t_end - t_data < l_len ) return -1;
+            for ( int k = 0; k < l_len; k++ )
+                l_prev[ i + k ] += t_data[ k ];
+            t_data += l_len;
+        }
+        i += l_len;
+    }
+
+    memcpy( t_img, l_prev, t_pixels );
+    return 0;
+}
+
+
+LineArchiveWriter::LineArchiveWriter()
+{
+    m_file = nullptr;
+    memset( &m_header, 0, sizeof( m_header ) );
+    m_pixels = 0;
+    m_frames = 0;
+    m_offset = 0;
+    m_block_frames = 0;
+    m_error = false;
+    m_head = 0;
+    m_tail = 0;
+    m_stalls = 0;
+    m_thread_stop = false;
+    pthread_mutex_init( &m_mutex, nullptr );
+    pthread_cond_init( &m_cond, nullptr );
+}
+
+
+LineArchiveWriter::~LineArchiveWriter()
+{
+    close();
+    pthread_cond_destroy( &m_cond );
+    pthread_mutex_destroy( &m_mutex );
+}
+
+
+int LineArchiveWriter::open( const char *t_file_name, int t_resolution, int t_lines, int t_block_frames )
+{
+    if ( m_file ) return -1;
+    if ( t_resolution < 1 || t_lines < 1 || t_resolution * t_lines > LINEARCHIVE_MAX_PIXELS || t_block_frames < 1 )
+    {
+        fprintf( stderr, "Unsupported geometry of line archive %s!\n", t_file_name );
+        return -1;
+    }
+
+    m_file = fopen( t_file_name, "wb" );
+    if ( !m_file )
+    {
+        fprintf( stderr, "Unable to create line archive %s!\n", t_file_name );
+        return -1;
+    }
+
+    // the header is completed by close, the blocks are readable also without it
+    memset( &m_header, 0, sizeof( m_header ) );
+    m_header.magic = LINEARCHIVE_MAGIC;
+    m_header.version = LINEARCHIVE_VERSION;
+    m_header.resolution = t_resolution;
+    m_header.lines = t_lines;
+    m_header.block_frames = t_block_frames;
+
+    m_pixels = t_resolution * t_lines;
+    m_frames = 0;
+    m_offset = sizeof( m_header );
+    m_block_frames = 0;
+    m_index.clear();
+    linearchiveResetState( m_state );
+
+    // the blocks are allocated once, the control thread only codes to them
+    for ( int i = 0; i < LINEARCHIVE_WRITE_BLOCKS; i++ )
+    {
+        m_blocks[ i ].clear();
+        m_blocks[ i ].reserve( sizeof( LineArchiveBlock ) + t_block_frames * ( m_pixels + 32 ) );
+    }
+    m_head = 0;
+    m_tail = 0;
+    m_stalls = 0;
+    m_blocks[ 0 ].resize( sizeof( LineArchiveBlock ) );
+
+    m_error = fwrite( &m_header, sizeof( m_header ), 1, m_file ) != 1;
+    m_thread_stop = false;
+    if ( m_error || pthread_create( &m_thread_id, nullptr, linearchiveWriterThread, this ) != 0 )
+    {
+        fprintf( stderr, "Unable to start writer of line archive %s!\n", t_file_name );
+        fclose( m_file );
+        m_file = nullptr;
+        return -1;
+    }
+
+    return 0;
+}
+
+
+void *LineArchiveWriter::linearchiveWriterThread( void *t_arg )
+{
+    LineArchiveWriter *l_writer = ( LineArchiveWriter * ) t_arg;
+
+    pthread_mutex_lock( &l_writer->m_mutex );
+    while ( true )
+    {
+        while ( l_writer->m_tail == l_writer->m_head && !l_writer->m_thread_stop )
+            pthread_cond_wait( &l_writer->m_cond, &l_writer->m_mutex );
+
+        // the stop request is served when all handed blocks are written
+        if ( l_writer->m_tail == l_writer->m_head ) break;
+
+        std::vector< unsigned char > &l_block = l_writer->m_blocks[ l_writer->m_tail % LINEARCHIVE_WRITE_BLOCKS ];
+        pthread_mutex_unlock( &l_writer->m_mutex );
+
+        // the block reaches the file immediately, it is readable also when the program crashes later
+        if ( !l_writer->m_error && ( fwrite( l_block.data(), l_block.size(), 1, l_writer->m_file ) != 1
+                    || fflush( l_writer->m_file ) != 0 ) )
+        {
+            fprintf( stderr, "Unable to write line archive!\n" );
+            l_writer->m_error = true;
+        }
+
+        pthread_mutex_lock( &l_writer->m_mutex );
+        l_writer->m_tail++;
+        pthread_cond_broadcast( &l_writer->m_cond );
+    }
+    pthread_mutex_unlock( &l_writer->m_mutex );
+
+    return nullptr;
+}
+
+
+int LineArchiveWriter::linearchiveFlush()
+{
+    if ( !m_block_frames ) return 0;
+
+    std::vector< unsigned char > &l_current = m_blocks[ m_head % LINEARCHIVE_WRITE_BLOCKS ];
+    LineArchiveBlock l_block;
+    l_block.magic = LINEARCHIVE_BLOCK_MAGIC;
+    l_block.frames = m_block_frames;
+    l_block.size = l_current.size() - sizeof( l_block );
+    l_block.reserved = 0;
+    memcpy( l_current.data(), &l_block, sizeof( l_block ) );
+
+    // the blocks are written in order, so the offset is known before the write
+    m_index.push_back( m_offset );
+    m_offset += l_current.size();
+    m_block_frames = 0;
+
+    // the next block does not depend on this one
+    linearchiveResetState( m_state );
+
+    // the next block is free, when the writer thread is not behind by the whole ring
+    pthread_mutex_lock( &m_mutex );
+    m_head++;
+    pthread_cond_broadcast( &m_cond );
+    if ( m_head - m_tail >= LINEARCHIVE_WRITE_BLOCKS )
+    {
+        m_stalls++;
+        while ( m_head - m_tail >= LINEARCHIVE_WRITE_BLOCKS )
+            pthread_cond_wait( &m_cond, &m_mutex );
+    }
+    pthread_mutex_unlock( &m_mutex );
+
+    m_blocks[ m_head % LINEARCHIVE_WRITE_BLOCKS ].resize( sizeof( LineArchiveBlock ) );
+
+    return m_error ? -1 : 0;
+}
+
+
+int LineArchiveWriter::append( const unsigned char *t_img, const LineArchiveMeta &t_meta )
+{
+    if ( !m_file || m_error ) return -1;
+
+    linearchiveEncodeFrame( t_img, t_meta, m_pixels, m_state, m_blocks[ m_head % LINEARCHIVE_WRITE_BLOCKS ] );
+    m_block_frames++;
+    m_frames++;
+
+    if ( m_block_frames >= ( int ) m_header.block_frames ) return linearchiveFlush();
+
+    return 0;
+}
+
+
+int LineArchiveWriter::append( const TelemetryRecord &t_record )
+{
+    if ( m_pixels != CAR_CAM_RESOLUTION ) return -1;
+
+    LineArchiveMeta l_meta;
+    l_meta.sim_time = t_record.sim_time;
+    l_meta.wall_time = t_record.wall_time;
+    l_meta.servo = t_record.servo;
+    l_meta.l_pwm = t_record.l_pwm;
+    l_meta.r_pwm = t_record.r_pwm;
+    l_meta.flags = t_record.flags;
+
+    return append( t_record.image, l_meta );
+}
+
+
+int LineArchiveWriter::close()
+{
+    if ( !m_file ) return 0;
+
+    int l_ret = 0;
+    if ( !m_error ) linearchiveFlush();
+
+    // the writer thread stops after the last handed block
+    pthread_mutex_lock( &m_mutex );
+    m_thread_stop = true;
+    pthread_cond_broadcast( &m_cond );
+    pthread_mutex_unlock( &m_mutex );
+    pthread_join( m_thread_id, nullptr );
+
+    // the index and the complete header are written only for the valid blocks
+    if ( !m_error )
+    {
+        uint64_t l_blocks = m_index.size();
+        m_header.frames = m_frames;
+        m_header.index_offset = m_offset;
+        if ( fwrite( &l_blocks, sizeof( l_blocks ), 1, m_file ) != 1
+                || ( l_blocks && fwrite( m_index.data(), sizeof( uint64_t ), l_blocks, m_file ) != l_blocks )
+                || fseek( m_file, 0, SEEK_SET ) < 0
+                || fwrite( &m_header, sizeof( m_header ), 1, m_file ) != 1 )
+            m_error = true;
+    }
+
+    if ( fclose( m_file ) || m_error )
+    {
+        fprintf( stderr, "Unable to complete line archive!\n" );
+        l_ret = -1;
+    }
+
+    m_file = nullptr;
+    return l_ret;
+}
+
+
+LineArchiveReader::LineArchiveReader()
+{
+    m_file = nullptr;
+    memset( &m_header, 0, sizeof( m_header ) );
+    m_pixels = 0;
+    m_frames = 0;
+    m_recovered = false;
+    m_cache_block = -1;
+    m_cache_frames = 0;
+}
+
+
+LineArchiveReader::~LineArchiveReader()
+{
+    close();
+}
+
+
+int LineArchiveReader::open( const char *t_file_name )
+{
+    if ( m_file ) return -1;
+
+    m_file = fopen( t_file_name, "rb" );
+    if ( !m_file )
+    {
+        fprintf( stderr, "Unable to open line archive %s!\n", t_file_name );
+        return -1;
+    }
+
+    if ( fread( &m_header, sizeof( m_header ), 1, m_file ) != 1 || m_header.magic != LINEARCHIVE_MAGIC
+            || m_header.version < 1 || m_header.version > LINEARCHIVE_VERSION || m_header.resolution < 1 || m_header.lines < 1
+            || ( uint64_t ) m_header.resolution * m_header.lines > LINEARCHIVE_MAX_PIXELS || m_header.block_frames < 1 )
+    {
+        fprintf( stderr, "File %s is not a line archive!\n", t_file_name );
+        close();
+        return -1;
+    }
+
+    m_pixels = m_header.resolution * m_header.lines;
+    m_cache_block = -1;
+    m_cache_images.resize( ( size_t ) m_header.block_frames * m_pixels );
+    m_cache_meta.resize( m_header.block_frames );
+
+    if ( linearchiveReadIndex() < 0 )
+    {
+        fprintf( stderr, "Line archive %s is damaged!\n", t_file_name );
+        close();
+        return -1;
+    }
+
+    return 0;
+}
+
+
+void LineArchiveReader::close()
+{
+    if ( m_file ) fclose( m_file );
+    m_file = nullptr;
+    m_index.clear();
+    m_frames = 0;
+    m_cache_block = -1;
+}
+
+
+int LineArchiveReader::linearchiveReadIndex()
+{
+    m_index.clear();
+    m_recovered = false;
+
+    if ( m_header.index_offset )
+    {
+        uint64_t l_blocks;
+        if ( fseek( m_file, m_header.index_offset, SEEK_SET ) < 0 || fread( &l_blocks, sizeof( l_blocks ), 1, m_file ) != 1
+                || l_blocks != ( m_header.frames + m_header.block_frames - 1 ) / m_header.block_frames )
+            return -1;
+
+        m_index.resize( l_blocks );
+        if ( l_blocks && fread( m_index.data(), sizeof( uint64_t ), l_blocks, m_file ) != l_blocks ) return -1;
+        m_frames = m_header.frames;
+        return 0;
+    }
+
+    // the archive was not closed, all complete blocks are found by their headers
+    m_recovered = true;
+    m_frames = 0;
+    uint64_t l_offset = sizeof( m_header );
+    LineArchiveBlock l_block;
+    while ( fseek( m_file, l_offset, SEEK_SET ) == 0 && fread( &l_block, sizeof( l_block ), 1, m_file ) == 1 )
+    {
+        if ( l_block.magic != LINEARCHIVE_BLOCK_MAGIC || l_block.frames != m_header.block_frames ) break;
+
+        // the last block can be incomplete
+        if ( fseek( m_file, l_offset + sizeof( l_block ) + l_block.size - 1, SEEK_SET ) < 0 || fgetc( m_file ) == EOF ) break;
+
+        m_index.push_back( l_offset );
+        m_frames += l_block.frames;
+        l_offset += sizeof( l_block ) + l_block.size;
+    }
+
+    return 0;
+}
+
+
+int LineArchiveReader::linearchiveDecodeBlock( unsigned long t_block )
+{
+    LineArchiveBlock l_block;
+    if ( fseek( m_file, m_index[ t_block ], SEEK_SET ) < 0 || fread( &l_block, sizeof( l_block ), 1, m_file ) != 1
+            || l_block.magic != LINEARCHIVE_BLOCK_MAGIC || l_block.frames < 1 || l_block.frames > m_header.block_frames )
+        return -1;
+
+    m_coded.resize( l_block.size );
+    if ( l_block.size && fread( m_coded.data(), l_block.size, 1, m_file ) != 1 ) return -1;
+
+    LineArchiveState l_state;
+    linearchiveResetState( l_state );
+    const unsigned char *l_data = m_coded.data();
+    const unsigned char *l_end = l_data + m_coded.size();
+    for ( int i = 0; i < ( int ) l_block.frames; i++ )
+    {
+        if ( linearchiveDecodeFrame( l_data, l_end, m_pixels, m_header.version, l_state, &m_cache_images[ ( size_t ) i * m_pixels ], m_cache_meta[ i ] ) < 0 )
+        {
+            m_cache_block = -1;
+            return -1;
+        }
+    }
+
+    m_cache_block = t_block;
+    m_cache_frames = l_block.frames;
+    return 0;
+}
+
+
+int LineArchiveReader::read( unsigned long t_frame, unsigned char *t_img, LineArchiveMeta *t_meta )
+{
+    if ( !m_file || t_frame >= m_frames ) return -1;
+
+    unsigned long l_block = t_frame / m_header.block_frames;
+    int l_frame = t_frame % m_header.block_frames;
+    if ( ( long ) l_block != m_cache_block && linearchiveDecodeBlock( l_block ) < 0 ) return -1;
+    if ( l_frame >= m_cache_frames ) return -1;
+
+    if ( t_img ) memcpy( t_img, &m_cache_images[ ( size_t ) l_frame * m_pixels ], m_pixels );
+    if ( t_meta ) *t_meta = m_cache_meta[ l_frame ];
+
+    return 0;
+}
@@ -0,0 +1,243 @@
+#pragma once
+
+/**
+ * @file linearchive.h
+ * @brief Module linearchive
+ *
+ * This module linearchive stores images from line camera and commands of every control cycle
+ * in a compressed file (line archive, *.lsa). The consecutive images differ only around
+ * the border lines, so every image is coded as a difference against the previous one
+ * and the runs of unchanged pixels are coded by a single byte.
+ *
+ * The frames are grouped to blocks of fixed number of frames. Every block starts
+ * with a difference against a blank image, so it can be decoded without the previous blocks.
+ * The seek index of blocks is stored at the end of file, any frame is found by decoding
+ * at most one block. An archive which was not closed (e.g. the program crashed) is still readable,
+ * the index is rebuilt from the block headers.
+ *
+ * The file format (all numbers in the byte order of CPU):
+ *   - \ref LineArchiveHeader,
+ *   - blocks: \ref LineArchiveBlock followed by coded frames,
+ *   - index: the number of blocks (uint64_t) and the file offset of every block (uint64_t).
+ *
+ * A coded frame is:
+ *   - the simulation time and the real time in microseconds, zigzag varints of difference to the previous frame,
+ *   - the bits of servo, left and right power (float), varints of XOR with the previous frame,
+ *   - the pixel differences: a byte 0..127 is a run of 1..128 unchanged pixels,
+ *     a byte 128..255 is followed by 1..128 differences (modulo 256) of changed pixels.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <atomic>
+#include <vector>
+
+#include "telemetry.h"
+
+/// Identification of line archive "ALSA"
+#define LINEARCHIVE_MAGIC               0x41534c41
+/// Identification of block "ABLK"
+#define LINEARCHIVE_BLOCK_MAGIC         0x4b4c4241
+/// Version of line archive format
+#define LINEARCHIVE_VERSION             2
+/// The default number of frames in block, it limits the cost of random access
+#define LINEARCHIVE_DEFAULT_BLOCK_FRAMES 256
+/// The maximal number of pixels of one image
+#define LINEARCHIVE_MAX_PIXELS          4096
+/// The number of blocks of writer, the current one and the ones waiting for the writer thread
+#define LINEARCHIVE_WRITE_BLOCKS        4
+
+/// Header of line archive.
+struct LineArchiveHeader
+{
+    uint32_t magic;                     ///< \ref LINEARCHIVE_MAGIC
+    uint32_t version;                   ///< \ref LINEARCHIVE_VERSION
+    uint32_t resolution;                ///< Resolution of line camera.
+    uint32_t lines;                     ///< Number of lines of one image.
+    uint32_t block_frames;              ///< Number of frames of every block except the last one.
+    uint32_t reserved;                  ///< Not used, alignment.
+    uint64_t frames;                    ///< Number of frames, 0 when the archive was not closed.
+    uint64_t index_offset;              ///< File offset of index, 0 when the archive was not closed.
+};
+
+/// Header of block of frames.
+struct LineArchiveBlock
+{
+    uint32_t magic;                     ///< \ref LINEARCHIVE_BLOCK_MAGIC
+    uint32_t frames;                    ///< Number of frames in block.
+    uint32_t size;                      ///< Size of coded frames in bytes.
+    uint32_t reserved;                  ///< Not used, alignment.
+};
+
+/// The values stored with every image, the same as in \ref TelemetryRecord.
+struct LineArchiveMeta
+{
+    double sim_time;                    ///< Simulation time of image in seconds, stored with 1 us resolution.
+    double wall_time;                   ///< Real (monotonic) time of image in seconds, stored with 1 us resolution.
+    float servo;                        ///< Servo position set after the image.
+    float l_pwm;                        ///< Power of left motor set after the image.
+    float r_pwm;                        ///< Power of right motor set after the image.
+    uint32_t flags;                     ///< Flags of control cycle, see \ref TELEMETRY_FLAG_RESET (0 in version 1).
+};
+
+/// The values of previous frame, the next frame is coded as difference against them.
+struct LineArchiveState
+{
+    int64_t sim_us;                     ///< Simulation time in microseconds.
+    int64_t wall_us;                    ///< Real time in microseconds.
+    uint32_t commands[ 3 ];             ///< Bits of servo, left and right power.
+    unsigned char image[ LINEARCHIVE_MAX_PIXELS ]; ///< Image.
+};
+
+/**
+ * @brief The streaming writer of line archive.
+ *
+ * The frames are coded immediately to the current block in memory, the complete block
+ * is handed to the writer thread, so the cost of \ref append is the coding of one image.
+ * The control thread waits only when all \ref LINEARCHIVE_WRITE_BLOCKS blocks wait for write,
+ * see \ref getStalls.
+ * It can replace \ref TelemetryRecorder in \ref RecordingCar.
+ */
+class LineArchiveWriter : public TelemetrySink
+{
+public:
+
+    /** Constructor */
+    LineArchiveWriter();
+    /** Destructor closes file. */
+    virtual ~LineArchiveWriter();
+
+    /** @brief Create line archive.
+     *
+     * @param t_file_name The name of file.
+     * @param t_resolution The resolution of line camera.
+     * @param t_lines The number of lines of one image.
+     * @param t_block_frames The number of frames in block.
+     * @return When the file was created, it returns 0. Otherwise -1.
+     */
+    int open( const char *t_file_name, int t_resolution = CAR_CAM_RESOLUTION, int t_lines = 1,
+            int t_block_frames = LINEARCHIVE_DEFAULT_BLOCK_FRAMES );
+
+    /** @brief Write the last block and the index, close file.
+     *
+     * @return When the archive was completed, it returns 0. Otherwise -1.
+     */
+    int close();
+
+    /** @brief Append frame.
+     *
+     * @param t_img The image of resolution * lines pixels.
+     * @param t_meta The time and commands of image.
+     * @return When the frame was stored, it returns 0. Otherwise (closed file, write error) -1.
+     */
+    int append( const unsigned char *t_img, const LineArchiveMeta &t_meta );
+
+    /** @brief Append telemetry record, the archive must have the resolution of the default camera. */
+    int append( const TelemetryRecord &t_record ) override;
+
+    /** @brief The number of stored frames. */
+    unsigned long getFrames() const { return m_frames; }
+
+    /** @brief The size of file in bytes, including the current block and the blocks waiting for write. */
+    unsigned long getBytes() const { return m_offset + m_blocks[ m_head % LINEARCHIVE_WRITE_BLOCKS ].size(); }
+
+    /** @brief The number of complete blocks, which waited for the writer thread in \ref append. */
+    unsigned long getStalls() const { return m_stalls; }
+
+protected:
+
+    /** @brief Hand the current block to the writer thread. */
+    int linearchiveFlush();
+
+    /** @brief Writer thread, it writes the handed blocks to file. */
+    static void *linearchiveWriterThread( void *t_arg );
+
+    FILE *m_file;                       ///< The file
+    LineArchiveHeader m_header;         ///< Header of file
+    int m_pixels;                       ///< Pixels of one image
+    unsigned long m_frames;             ///< Number of stored frames
+    unsigned long m_offset;             ///< File offset of the current block
+    int m_block_frames;                 ///< Number of frames in the current block
+    std::vector< uint64_t > m_index;    ///< Offsets of written blocks
+    LineArchiveState m_state;           ///< Values of the previous frame
+    std::atomic< bool > m_error;        ///< Write failed, the next frames are not stored
+
+    /// @name The blocks handed to the writer thread
+    /// @{
+    std::vector< unsigned char > m_blocks[ LINEARCHIVE_WRITE_BLOCKS ]; ///< Ring of blocks, the current one is m_head
+    unsigned long m_head;               ///< Number of blocks handed to the writer thread
+    unsigned long m_tail;               ///< Number of blocks written by the writer thread
+    unsigned long m_stalls;             ///< Number of waits for the writer thread
+    pthread_t m_thread_id;              ///< Thread ID of the writer
+    bool m_thread_stop;                 ///< Request to stop the writer, when all blocks are written
+    pthread_mutex_t m_mutex;            ///< Protects the ring
+    pthread_cond_t m_cond;              ///< Signalled when a block is handed or written
+    /// @}
+
+};
+
+/**
+ * @brief The reader of line archive with random access.
+ *
+ * The block of the last read frame is kept decoded, so the sequential reading decodes every frame once.
+ */
+class LineArchiveReader
+{
+public:
+
+    /** Constructor */
+    LineArchiveReader();
+    /** Destructor closes file. */
+    ~LineArchiveReader();
+
+    /** @brief Open line archive.
+     *
+     * @return When the file is valid, it returns 0. Otherwise -1.
+     */
+    int open( const char *t_file_name );
+
+    /** @brief Close file. */
+    void close();
+
+    /** @brief Read any frame.
+     *
+     * @param t_frame The index of frame.
+     * @param t_img Buffer for image of \ref getPixels pixels, it can be nullptr.
+     * @param t_meta The time and commands of image, it can be nullptr.
+     * @return When the frame was read, it returns 0. Otherwise (no such frame, damaged file) -1.
+     */
+    int read( unsigned long t_frame, unsigned char *t_img, LineArchiveMeta *t_meta );
+
+    unsigned long getFrames() const { return m_frames; }              ///< The number of frames
+    int getResolution() const { return m_header.resolution; }         ///< The resolution of line camera
+    int getLines() const { return m_header.lines; }                   ///< The number of lines of one image
+    int getPixels() const { return m_pixels; }                        ///< The pixels of one image
+    unsigned long getBlocks() const { return m_index.size(); }        ///< The number of blocks
+    bool isRecovered() const { return m_recovered; }                  ///< The index was rebuilt, the archive was not closed
+
+protected:
+
+    /** @brief Read the block offsets from the end of file or from the block headers. */
+    int linearchiveReadIndex();
+
+    /** @brief Decode the whole block to the cache. */
+    int linearchiveDecodeBlock( unsigned long t_block );
+
+    FILE *m_file;                       ///< The file
+    LineArchiveHeader m_header;         ///< Header of file
+    int m_pixels;                       ///< Pixels of one image
+    unsigned long m_frames;             ///< Number of frames
+    bool m_recovered;                   ///< The index was rebuilt
+    std::vector< uint64_t > m_index;    ///< Offsets of blocks
+
+    /// @name The last decoded block
+    /// @{
+    long m_cache_block;                 ///< Index of block, -1 for none
+    int m_cache_frames;                 ///< Number of frames in block
+    std::vector< unsigned char > m_cache_images; ///< Decoded images
+    std::vector< LineArchiveMeta > m_cache_meta; ///< Decoded times and commands
+    std::vector< unsigned char > m_coded; ///< Coded block read from file
+    /// @}
+
+};
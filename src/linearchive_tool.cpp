@@ -0,0 +1,301 @@
+/**
+ * @file linearchive_tool.cpp
+ * @brief Module linearchive_tool
+ *
+ * This program converts line archives (\ref linearchive.h) to and from raw logs:
+ * telemetry files (*.tel) recorded by -record, or plain files of raw images one after another.
+ * It also exports a range of frames to PNG strips like the trackview window,
+ * the newest image of every strip is in the top row.
+ *
+ * For more information see header files or use doxygen.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+#include <vector>
+#include <opencv2/highgui.hpp>
+#include <opencv2/core.hpp>
+
+#include "linearchive.h"
+
+#define HELP                                                                \
+    "Usage: %s [options] encode input.tel|input.raw output.lsa\n"           \
+    "       %s [options] decode input.lsa output.tel|output.raw\n"          \
+    "       %s [options] png input.lsa prefix\n"                            \
+    "       %s info input.lsa\n"                                            \
+    "  -h               this help\n"                                        \
+    "  -block N         frames in block of archive (default 256)\n"         \
+    "  -res N           resolution of raw images (default 128)\n"           \
+    "  -lines N         lines of raw images (default 1)\n"                  \
+    "  -from N          the first exported frame (default 0)\n"             \
+    "  -count N         number of exported frames (default all)\n"          \
+    "  -rows N          rows of one PNG strip, prefixNNNNNN.png (default 1000)\n\n" \
+    "The files with extension .tel are telemetry files, the other files are raw images.\n\n"
+
+/// Check extension of telemetry file
+static bool toolIsTelemetry( const char *t_file_name )
+{
+    size_t l_len = strlen( t_file_name );
+    return l_len >= 4 && !strcmp( t_file_name + l_len - 4, ".tel" );
+}
+
+
+static long toolFileSize( const char *t_file_name )
+{
+    struct stat l_stat;
+    return stat( t_file_name, &l_stat ) < 0 ? -1 : l_stat.st_size;
+}
+
+
+/// Compress telemetry file or raw images
+static int toolEncode( const char *t_input, const char *t_output, int t_resolution, int t_lines, int t_block_frames )
+{
+    FILE *l_in = fopen( t_input, "rb" );
+    if ( !l_in )
+    {
+        fprintf( stderr, "Unable to open %s!\n", t_input );
+        return -1;
+    }
+
+    bool l_telemetry = toolIsTelemetry( t_input );
+    if ( l_telemetry )
+    {
+        // the records start after the header page
+        TelemetryHeader l_header;
+        if ( fread( &l_header, sizeof( l_header ), 1, l_in ) != 1 || l_header.magic != TELEMETRY_MAGIC
+                || l_header.version != TELEMETRY_VERSION || l_header.record_size != sizeof( TelemetryRecord )
+                || l_header.resolution != CAR_CAM_RESOLUTION || fseek( l_in, TELEMETRY_HEADER_SIZE, SEEK_SET ) < 0 )
+        {
+            fprintf( stderr, "File %s is not a telemetry file!\n", t_input );
+            fclose( l_in );
+            return -1;
+        }
+        t_resolution = CAR_CAM_RESOLUTION;
+        t_lines = 1;
+    }
+
+    LineArchiveWriter l_writer;
+    if ( l_writer.open( t_output, t_resolution, t_lines, t_block_frames ) < 0 )
+    {
+        fclose( l_in );
+        return -1;
+    }
+
+    int l_ret = 0;
+    if ( l_telemetry )
+    {
+        TelemetryRecord l_record;
+        while ( fread( &l_record, sizeof( l_record ), 1, l_in ) == 1 )
+            if ( l_writer.append( l_record ) < 0 ) { l_ret = -1; break; }
+    }
+    else
+    {
+        // the raw images have no time and commands
+        std::vector< unsigned char > l_img( t_resolution * t_lines );
+        LineArchiveMeta l_meta;
+        memset( &l_meta, 0, sizeof( l_meta ) );
+        while ( fread( l_img.data(), l_img.size(), 1, l_in ) == 1 )
+            if ( l_writer.append( l_img.data(), l_meta ) < 0 ) { l_ret = -1; break; }
+    }
+    fclose( l_in );
+
+    unsigned long l_frames = l_writer.getFrames();
+    if ( l_writer.close() < 0 ) l_ret = -1;
+
+    long l_in_size = toolFileSize( t_input );
+    long l_out_size = toolFileSize( t_output );
+    printf( "Frames: %lu, input: %ld B, archive: %ld B, ratio: %.1f\n", l_frames, l_in_size, l_out_size,
+            l_out_size > 0 ? ( double ) l_in_size / l_out_size : 0 );
+
+    return l_ret;
+}
+
+
+/// Decompress archive to telemetry file or raw images
+static int toolDecode( const char *t_input, const char *t_output )
+{
+    LineArchiveReader l_reader;
+    if ( l_reader.open( t_input ) < 0 ) return -1;
+    if ( l_reader.isRecovered() ) fprintf( stderr, "Archive %s was not closed, %lu frames recovered\n", t_input, l_reader.getFrames() );
+
+    std::vector< unsigned char > l_img( l_reader.getPixels() );
+    LineArchiveMeta l_meta;
+
+    if ( toolIsTelemetry( t_output ) )
+    {
+        if ( l_reader.getPixels() != CAR_CAM_RESOLUTION )
+        {
+            fprintf( stderr, "Telemetry file needs images of %d pixels!\n", CAR_CAM_RESOLUTION );
+            return -1;
+        }
+
+        TelemetryRecorder l_recorder;
+        if ( l_recorder.open( t_output, MAX( l_reader.getFrames(), 1UL ) ) < 0 ) return -1;
+        for ( unsigned long f = 0; f < l_reader.getFrames(); f++ )
+        {
+            TelemetryRecord l_record;
+            memset( &l_record, 0, sizeof( l_record ) );
+            if ( l_reader.read( f, l_record.image, &l_meta ) < 0 )
+            {
+                fprintf( stderr, "Unable to read frame %lu!\n", f );
+                return -1;
+            }
+            l_record.sim_time = l_meta.sim_time;
+            l_record.wall_time = l_meta.wall_time;
+            l_record.servo = l_meta.servo;
+            l_record.l_pwm = l_meta.l_pwm;
+            l_record.r_pwm = l_meta.r_pwm;
+            l_record.flags = l_meta.flags;
+            l_recorder.append( l_record );
+        }
+        l_recorder.close();
+        return 0;
+    }
+
+    FILE *l_out = fopen( t_output, "wb" );
+    if ( !l_out )
+    {
+        fprintf( stderr, "Unable to create %s!\n", t_output );
+        return -1;
+    }
+    int l_ret = 0;
+    for ( unsigned long f = 0; f < l_reader.getFrames() && !l_ret; f++ )
+        if ( l_reader.read( f, l_img.data(), nullptr ) < 0 || fwrite( l_img.data(), l_img.size(), 1, l_out ) != 1 )
+        {
+            fprintf( stderr, "Unable to convert frame %lu!\n", f );
+            l_ret = -1;
+        }
+    if ( fclose( l_out ) ) l_ret = -1;
+
+    return l_ret;
+}
+
+
+/// Export range of frames to PNG strips
+static int toolPng( const char *t_input, const char *t_prefix, unsigned long t_from, unsigned long t_count, int t_rows )
+{
+    LineArchiveReader l_reader;
+    if ( l_reader.open( t_input ) < 0 ) return -1;
+
+    unsigned long l_end = t_count ? MIN( t_from + t_count, l_reader.getFrames() ) : l_reader.getFrames();
+    int l_width = l_reader.getResolution();
+    int l_lines = l_reader.getLines();
+    std::vector< unsigned char > l_img( l_reader.getPixels() );
+
+    int l_strips = 0;
+    for ( unsigned long l_first = t_from; l_first < l_end; l_first += t_rows )
+    {
+        int l_frames = MIN( ( unsigned long ) t_rows, l_end - l_first );
+
+        // every line of multi-line camera has its own row, the newest frame is on top
+        cv::Mat l_strip( l_frames * l_lines, l_width, CV_8UC1 );
+        for ( int r = 0; r < l_frames; r++ )
+        {
+            if ( l_reader.read( l_first + l_frames - 1 - r, l_img.data(), nullptr ) < 0 )
+            {
+                fprintf( stderr, "Unable to read frame %lu!\n", l_first + l_frames - 1 - r );
+                return -1;
+            }
+            for ( int l = 0; l < l_lines; l++ )
+                memcpy( l_strip.ptr( r * l_lines + l_lines - 1 - l ), &l_img[ l * l_width ], l_width );
+        }
+
+        char l_file_name[ 512 ];
+        snprintf( l_file_name, sizeof( l_file_name ), "%s%06lu.png", t_prefix, l_first );
+        if ( !cv::imwrite( l_file_name, l_strip ) )
+        {
+            fprintf( stderr, "Unable to write %s!\n", l_file_name );
+            return -1;
+        }
+        l_strips++;
+    }
+
+    printf( "Frames: %lu - %lu, strips: %d\n", t_from, l_end, l_strips );
+    return 0;
+}
+
+
+/// Print parameters of archive
+static int toolInfo( const char *t_input )
+{
+    LineArchiveReader l_reader;
+    if ( l_reader.open( t_input ) < 0 ) return -1;
+
+    long l_size = toolFileSize( t_input );
+    double l_raw = ( double ) l_reader.getFrames() * l_reader.getPixels();
+    printf( "Resolution: %d x %d, frames: %lu, blocks: %lu%s\n", l_reader.getResolution(), l_reader.getLines(),
+            l_reader.getFrames(), l_reader.getBlocks(), l_reader.isRecovered() ? " (not closed, recovered)" : "" );
+    printf( "Size: %ld B, %.2f B/frame, ratio to raw images: %.1f\n", l_size,
+            l_reader.getFrames() ? ( double ) l_size / l_reader.getFrames() : 0, l_size > 0 ? l_raw / l_size : 0 );
+
+    LineArchiveMeta l_first, l_last;
+    if ( l_reader.getFrames() && l_reader.read( 0, nullptr, &l_first ) == 0
+            && l_reader.read( l_reader.getFrames() - 1, nullptr, &l_last ) == 0 )
+        printf( "Simulation time: %.3f - %.3f s\n", l_first.sim_time, l_last.sim_time );
+
+    return 0;
+}
+
+
+int main( int argc, char* argv[] )
+{
+    int l_block_frames = LINEARCHIVE_DEFAULT_BLOCK_FRAMES;
+    int l_resolution = CAR_CAM_RESOLUTION;
+    int l_lines = 1;
+    unsigned long l_from = 0;
+    unsigned long l_count = 0;
+    int l_rows = 1000;
+    const char *l_args[ 3 ];
+    int l_arg_count = 0;
+    int l_help = 0;
+
+    for ( int i = 1; i < argc; i++ )
+    {
+        if ( !strcmp( argv[ i ], "-h" ) )
+            l_help = 1;
+        else if ( i + 1 < argc && !strcmp( argv[ i ], "-block" ) )
+            l_block_frames = atoi( argv[ ++i ] );
+        else if ( i + 1 < argc && !strcmp( argv[ i ], "-res" ) )
+            l_resolution = atoi( argv[ ++i ] );
+        else if ( i + 1 < argc && !strcmp( argv[ i ], "-lines" ) )
+            l_lines = atoi( argv[ ++i ] );
+        else if ( i + 1 < argc && !strcmp( argv[ i ], "-from" ) )
+            l_from = strtoul( argv[ ++i ], nullptr, 10 );
+        else if ( i + 1 < argc && !strcmp( argv[ i ], "-count" ) )
+            l_count = strtoul( argv[ ++i ], nullptr, 10 );
+        else if ( i + 1 < argc && !strcmp( argv[ i ], "-rows" ) )
+            l_rows = atoi( argv[ ++i ] );
+        else if ( *argv[ i ] != '-' && l_arg_count < 3 )
+            l_args[ l_arg_count++ ] = argv[ i ];
+        else
+            l_help = 1;
+    }
+
+    int l_ret = -1;
+    if ( l_help || l_arg_count < 2 || l_block_frames < 1 || l_rows < 1 )
+        l_help = 1;
+    else if ( !strcmp( l_args[ 0 ], "info" ) && l_arg_count == 2 )
+        l_ret = toolInfo( l_args[ 1 ] );
+    else if ( l_arg_count < 3 )
+        l_help = 1;
+    else if ( !strcmp( l_args[ 0 ], "encode" ) )
+        l_ret = toolEncode( l_args[ 1 ], l_args[ 2 ], l_resolution, l_lines, l_block_frames );
+    else if ( !strcmp( l_args[ 0 ], "decode" ) )
+        l_ret = toolDecode( l_args[ 1 ], l_args[ 2 ] );
+    else if ( !strcmp( l_args[ 0 ], "png" ) )
+        l_ret = toolPng( l_args[ 1 ], l_args[ 2 ], l_from, l_count, l_rows );
+    else
+        l_help = 1;
+
+    if ( l_help )
+    {
+        printf( HELP, argv[ 0 ], argv[ 0 ], argv[ 0 ], argv[ 0 ] );
+        exit( 0 );
+    }
+
+    return l_ret < 0 ? 1 : 0;
+}
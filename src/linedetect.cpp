@@ -0,0 +1,331 @@
+/**
+ * @file linedetect.cpp
+ * @brief Module linedetect
+ *
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/param.h>
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#define LINEDETECT_X86
+#include <immintrin.h>
+#endif
+
+#include "linedetect.h"
+
+/// Number of 64 bit words of bit mask of dark pixels
+#define LINEDETECT_MASK_WORDS( t_resolution ) ( ( t_resolution + 63 ) / 64 )
+
+/** @brief The pixel kernel.
+ *
+ * It smooths the padded image (t_pad[ 0 ] and t_pad[ resolution + 1 ] are copies of border pixels),
+ * finds the minimal and maximal smoothed pixel and sets bits of pixels darker than the adaptive threshold.
+ */
+typedef void ( *LinedetectKernel )( const unsigned char *t_pad, unsigned char *t_smooth, uint64_t *t_mask,
+        int &t_min, int &t_max );
+
+
+/// Adaptive threshold in the middle between the darkest and the lightest pixel
+static inline int linedetectThreshold( int t_min, int t_max )
+{
+    return ( t_min + t_max + 1 ) >> 1;
+}
+
+
+// The smoothing is ( l + 2 * c + r ) / 4 computed as two rounded averages, exactly as the SIMD instruction pavgb.
+template< int t_resolution >
+static void linedetectScalar( const unsigned char *t_pad, unsigned char *t_smooth, uint64_t *t_mask,
+        int &t_min, int &t_max )
+{
+    t_min = 255;
+    t_max = 0;
+    for ( int i = 0; i < t_resolution; i++ )
+    {
+        int l_avg = ( t_pad[ i ] + t_pad[ i + 2 ] + 1 ) >> 1;
+        int l_smooth = ( l_avg + t_pad[ i + 1 ] + 1 ) >> 1;
+        t_smooth[ i ] = l_smooth;
+        t_min = MIN( t_min, l_smooth );
+        t_max = MAX( t_max, l_smooth );
+    }
+
+    int l_threshold = linedetectThreshold( t_min, t_max );
+    memset( t_mask, 0, LINEDETECT_MASK_WORDS( t_resolution ) * sizeof( uint64_t ) );
+    for ( int i = 0; i < t_resolution; i++ )
+        if ( t_smooth[ i ] < l_threshold )
+            t_mask[ i >> 6 ] |= 1ull << ( i & 63 );
+}
+
+
+#ifdef LINEDETECT_X86
+
+/// Horizontal minimum and maximum of 16 bytes
+static inline void linedetectReduce( __m128i t_min, __m128i t_max, int &t_min_out, int &t_max_out )
+{
+    t_min = _mm_min_epu8( t_min, _mm_srli_si128( t_min, 8 ) );
+    t_min = _mm_min_epu8( t_min, _mm_srli_si128( t_min, 4 ) );
+    t_min = _mm_min_epu8( t_min, _mm_srli_si128( t_min, 2 ) );
+    t_min = _mm_min_epu8( t_min, _mm_srli_si128( t_min, 1 ) );
+    t_max = _mm_max_epu8( t_max, _mm_srli_si128( t_max, 8 ) );
+    t_max = _mm_max_epu8( t_max, _mm_srli_si128( t_max, 4 ) );
+    t_max = _mm_max_epu8( t_max, _mm_srli_si128( t_max, 2 ) );
+    t_max = _mm_max_epu8( t_max, _mm_srli_si128( t_max, 1 ) );
+    t_min_out = _mm_cvtsi128_si32( t_min ) & 0xff;
+    t_max_out = _mm_cvtsi128_si32( t_max ) & 0xff;
+}
+
+
+template< int t_resolution >
+static void linedetectSSE2( const unsigned char *t_pad, unsigned char *t_smooth, uint64_t *t_mask,
+        int &t_min, int &t_max )
+{
+    __m128i l_min = _mm_set1_epi8( ( char ) 255 );
+    __m128i l_max = _mm_setzero_si128();
+    for ( int i = 0; i < t_resolution; i += 16 )
+    {
+        __m128i l_l = _mm_loadu_si128( ( const __m128i * ) ( t_pad + i ) );
+        __m128i l_c = _mm_loadu_si128( ( const __m128i * ) ( t_pad + i + 1 ) );
+        __m128i l_r = _mm_loadu_si128( ( const __m128i * ) ( t_pad + i + 2 ) );
+        __m128i l_smooth = _mm_avg_epu8( _mm_avg_epu8( l_l, l_r ), l_c );
+        _mm_storeu_si128( ( __m128i * ) ( t_smooth + i ), l_smooth );
+        l_min = _mm_min_epu8( l_min, l_smooth );
+        l_max = _mm_max_epu8( l_max, l_smooth );
+    }
+    linedetectReduce( l_min, l_max, t_min, t_max );
+
+    // pixel is dark when saturated threshold - pixel is not zero
+    __m128i l_threshold = _mm_set1_epi8( ( char ) linedetectThreshold( t_min, t_max ) );
+    __m128i l_zero = _mm_setzero_si128();
+    memset( t_mask, 0, LINEDETECT_MASK_WORDS( t_resolution ) * sizeof( uint64_t ) );
+    for ( int i = 0; i < t_resolution; i += 16 )
+    {
+        __m128i l_smooth = _mm_loadu_si128( ( const __m128i * ) ( t_smooth + i ) );
+        __m128i l_light = _mm_cmpeq_epi8( _mm_subs_epu8( l_threshold, l_smooth ), l_zero );
+        uint64_t l_bits = ~_mm_movemask_epi8( l_light ) & 0xffff;
+        t_mask[ i >> 6 ] |= l_bits << ( i & 63 );
+    }
+}
+
+
+template< int t_resolution >
+__attribute__(( target( "avx2" ) ))
+static void linedetectAVX2( const unsigned char *t_pad, unsigned char *t_smooth, uint64_t *t_mask,
+        int &t_min, int &t_max )
+{
+    __m256i l_min = _mm256_set1_epi8( ( char ) 255 );
+    __m256i l_max = _mm256_setzero_si256();
+    for ( int i = 0; i < t_resolution; i += 32 )
+    {
+        __m256i l_l = _mm256_loadu_si256( ( const __m256i * ) ( t_pad + i ) );
+        __m256i l_c = _mm256_loadu_si256( ( const __m256i * ) ( t_pad + i + 1 ) );
+        __m256i l_r = _mm256_loadu_si256( ( const __m256i * ) ( t_pad + i + 2 ) );
+        __m256i l_smooth = _mm256_avg_epu8( _mm256_avg_epu8( l_l, l_r ), l_c );
+        _mm256_storeu_si256( ( __m256i * ) ( t_smooth + i ), l_smooth );
+        l_min = _mm256_min_epu8( l_min, l_smooth );
+        l_max = _mm256_max_epu8( l_max, l_smooth );
+    }
+    linedetectReduce(
+            _mm_min_epu8( _mm256_castsi256_si128( l_min ), _mm256_extracti128_si256( l_min, 1 ) ),
+            _mm_max_epu8( _mm256_castsi256_si128( l_max ), _mm256_extracti128_si256( l_max, 1 ) ),
+            t_min, t_max );
+
+    __m256i l_threshold = _mm256_set1_epi8( ( char ) linedetectThreshold( t_min, t_max ) );
+    __m256i l_zero = _mm256_setzero_si256();
+    memset( t_mask, 0, LINEDETECT_MASK_WORDS( t_resolution ) * sizeof( uint64_t ) );
+    for ( int i = 0; i < t_resolution; i += 32 )
+    {
+        __m256i l_smooth = _mm256_loadu_si256( ( const __m256i * ) ( t_smooth + i ) );
+        __m256i l_light = _mm256_cmpeq_epi8( _mm256_subs_epu8( l_threshold, l_smooth ), l_zero );
+        uint64_t l_bits = ~( uint32_t ) _mm256_movemask_epi8( l_light ) & 0xffffffffull;
+        t_mask[ i >> 6 ] |= l_bits << ( i & 63 );
+    }
+}
+
+#endif // LINEDETECT_X86
+
+
+/// The best implementation supported by CPU
+static LinedetectImpl linedetectBest()
+{
+    if ( linedetectSupported( LINEDETECT_AVX2 ) ) return LINEDETECT_AVX2;
+    if ( linedetectSupported( LINEDETECT_SSE2 ) ) return LINEDETECT_SSE2;
+    return LINEDETECT_SCALAR;
+}
+
+
+/// Kernel function of implementation for the camera resolution
+template< int t_resolution >
+static LinedetectKernel linedetectKernel( LinedetectImpl t_impl )
+{
+    switch ( t_impl )
+    {
+#ifdef LINEDETECT_X86
+        case LINEDETECT_SSE2: return linedetectSSE2< t_resolution >;
+        case LINEDETECT_AVX2: return linedetectAVX2< t_resolution >;
+#endif
+        default: return linedetectScalar< t_resolution >;
+    }
+}
+
+
+static LinedetectImpl g_linedetect_impl = linedetectBest();
+
+
+bool linedetectSupported( LinedetectImpl t_impl )
+{
+    switch ( t_impl )
+    {
+        case LINEDETECT_AUTO:
+        case LINEDETECT_SCALAR:
+            return true;
+#ifdef LINEDETECT_X86
+        // CPU features may be tested before main, when they are not initialized yet
+        case LINEDETECT_SSE2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports( "sse2" );
+        case LINEDETECT_AVX2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports( "avx2" );
+#endif
+        default:
+            return false;
+    }
+}
+
+
+int linedetectSetImpl( LinedetectImpl t_impl )
+{
+    if ( t_impl == LINEDETECT_AUTO ) t_impl = linedetectBest();
+    if ( !linedetectSupported( t_impl ) ) return -1;
+
+    g_linedetect_impl = t_impl;
+    return 0;
+}
+
+
+LinedetectImpl linedetectGetImpl()
+{
+    return g_linedetect_impl;
+}
+
+
+const char *linedetectImplName( LinedetectImpl t_impl )
+{
+    switch ( t_impl )
+    {
+        case LINEDETECT_AUTO: return "auto";
+        case LINEDETECT_SCALAR: return "scalar";
+        case LINEDETECT_SSE2: return "sse2";
+        case LINEDETECT_AVX2: return "avx2";
+        default: return "unknown";
+    }
+}
+
+
+/// The last dark pixel at or before t_pos, -1 when there is none
+static inline int linedetectLastDark( const uint64_t *t_mask, int t_pos )
+{
+    int l_word = t_pos >> 6;
+    uint64_t l_bits = t_mask[ l_word ] & ( ( 2ull << ( t_pos & 63 ) ) - 1 );
+    while ( !l_bits && l_word > 0 ) l_bits = t_mask[ --l_word ];
+    if ( l_bits ) return l_word * 64 + 63 - __builtin_clzll( l_bits );
+    return -1;
+}
+
+
+/// The first dark pixel at or after t_pos, -1 when there is none
+template< int t_resolution >
+static inline int linedetectFirstDark( const uint64_t *t_mask, int t_pos )
+{
+    int l_word = t_pos >> 6;
+    uint64_t l_bits = t_mask[ l_word ] & ( ~0ull << ( t_pos & 63 ) );
+    while ( !l_bits && l_word + 1 < LINEDETECT_MASK_WORDS( t_resolution ) ) l_bits = t_mask[ ++l_word ];
+    if ( l_bits ) return l_word * 64 + __builtin_ctzll( l_bits );
+    return -1;
+}
+
+
+/** @brief Subpixel position of edge between dark pixel t_dark and light pixel t_light.
+ *
+ * The gradient across the edge relative to contrast is added to t_sharpness.
+ */
+template< int t_resolution >
+static float linedetectEdge( const unsigned char *t_smooth, int t_dark, int t_light, int t_threshold, int t_contrast,
+        float &t_sharpness )
+{
+    if ( t_light < 0 || t_light >= t_resolution || t_smooth[ t_light ] < t_threshold )
+        return t_dark;
+
+    int l_dir = t_light - t_dark;
+    int l_outer = MIN( MAX( t_dark - l_dir, 0 ), t_resolution - 1 );
+    int l_inner = MIN( MAX( t_light + l_dir, 0 ), t_resolution - 1 );
+    float l_gradient = t_smooth[ l_inner ] - t_smooth[ l_outer ];
+    t_sharpness += MIN( l_gradient / t_contrast, 1.0f );
+
+    // linear interpolation of threshold crossing
+    float l_frac = ( float ) ( t_threshold - t_smooth[ t_dark ] ) / ( t_smooth[ t_light ] - t_smooth[ t_dark ] );
+    return t_dark + l_dir * l_frac;
+}
+
+
+template< int t_resolution >
+int linedetectFindT( const unsigned char *t_img, int t_search, int t_min_contrast, int t_track_width_px,
+        LinedetectResult &t_result )
+{
+    // the kernels of all implementations, indexed by LinedetectImpl
+    static const LinedetectKernel l_kernels[] = {
+        linedetectKernel< t_resolution >( LINEDETECT_SCALAR ),
+        linedetectKernel< t_resolution >( LINEDETECT_SCALAR ),
+        linedetectKernel< t_resolution >( LINEDETECT_SSE2 ),
+        linedetectKernel< t_resolution >( LINEDETECT_AVX2 ) };
+
+    // border pixels are repeated for smoothing, the rest of padding is only for 32 byte loads
+    unsigned char l_pad[ t_resolution + 32 ];
+    unsigned char l_smooth[ t_resolution ];
+    uint64_t l_mask[ LINEDETECT_MASK_WORDS( t_resolution ) ];
+    memcpy( l_pad + 1, t_img, t_resolution );
+    l_pad[ 0 ] = t_img[ 0 ];
+    l_pad[ t_resolution + 1 ] = t_img[ t_resolution - 1 ];
+
+    int l_min, l_max;
+    l_kernels[ g_linedetect_impl ]( l_pad, l_smooth, l_mask, l_min, l_max );
+
+    t_result.threshold = linedetectThreshold( l_min, l_max );
+    t_result.contrast = l_max - l_min;
+    t_result.left = -1;
+    t_result.right = -1;
+    t_result.centre = ( t_resolution - 1 ) / 2.0;
+    t_result.confidence = 0;
+
+    if ( t_result.contrast < MAX( t_min_contrast, 1 ) ) return 0;
+
+    t_search = MIN( MAX( t_search, 0 ), t_resolution - 1 );
+    int l_left = linedetectLastDark( l_mask, t_search );
+    int l_right = linedetectFirstDark< t_resolution >( l_mask, t_search );
+
+    float l_sharpness = 0;
+    if ( l_left >= 0 )
+        t_result.left = linedetectEdge< t_resolution >( l_smooth, l_left, l_left + 1, t_result.threshold, t_result.contrast, l_sharpness );
+    if ( l_right >= 0 )
+        t_result.right = linedetectEdge< t_resolution >( l_smooth, l_right, l_right - 1, t_result.threshold, t_result.contrast, l_sharpness );
+
+    // missing border line is estimated from width of track
+    if ( l_left >= 0 && l_right >= 0 )
+        t_result.centre = ( t_result.left + t_result.right ) / 2;
+    else if ( l_left >= 0 )
+        t_result.centre = t_result.left + t_track_width_px / 2.0;
+    else if ( l_right >= 0 )
+        t_result.centre = t_result.right - t_track_width_px / 2.0;
+
+    t_result.confidence = MIN( ( float ) t_result.contrast / LINEDETECT_FULL_CONTRAST, 1.0f ) * l_sharpness / 2;
+
+    return ( l_left >= 0 ) + ( l_right >= 0 );
+}
+
+
+// the line detection is compiled for all supported cameras
+template int linedetectFindT< CarCameraLine128::resolution >( const unsigned char *, int, int, int, LinedetectResult & );
+template int linedetectFindT< CarCameraLine256::resolution >( const unsigned char *, int, int, int, LinedetectResult & );
+
@@ -0,0 +1,81 @@
+#pragma once
+
+/**
+ * @file linedetect.h
+ * @brief Module linedetect
+ *
+ * This module linedetect finds border lines of track in the image from line camera.
+ * The image is smoothed, thresholded by an adaptive threshold between its minimal and maximal intensity
+ * and the inner edges of border lines are searched from the given position to the both sides.
+ * The pixel kernel has SSE2, AVX2 and scalar implementation selected at runtime, all of them give
+ * the same results bit by bit.
+ */
+
+#include "car.h"
+
+/// Minimal difference between the lightest and the darkest pixel to detect border lines
+#define LINEDETECT_DEFAULT_MIN_CONTRAST 40
+/// Contrast of image giving full confidence
+#define LINEDETECT_FULL_CONTRAST        128
+
+/// Implementation of the pixel kernel.
+enum LinedetectImpl
+{
+    LINEDETECT_AUTO,                    ///< The best implementation supported by CPU.
+    LINEDETECT_SCALAR,                  ///< Portable scalar code.
+    LINEDETECT_SSE2,                    ///< 16 pixels in one instruction.
+    LINEDETECT_AVX2,                    ///< 32 pixels in one instruction.
+};
+
+/// Result of \ref linedetectFind.
+struct LinedetectResult
+{
+    float left;                         ///< Inner edge of left border line in pixels (subpixel), -1 when not found.
+    float right;                        ///< Inner edge of right border line in pixels (subpixel), -1 when not found.
+    float centre;                       ///< Centre of track, missing line is estimated from track width.
+    float confidence;                   ///< Confidence of result from 0 (nothing found) to 1 (both lines with full contrast).
+    int threshold;                      ///< Adaptive threshold, darker pixels belong to lines.
+    int contrast;                       ///< Difference between the lightest and the darkest smoothed pixel.
+};
+
+/** @brief Select implementation of the pixel kernel.
+ *
+ * @param t_impl The requested implementation, \ref LINEDETECT_AUTO selects the best one.
+ * @return When the implementation is supported by CPU it returns 0. Otherwise -1 and the implementation is not changed.
+ */
+int linedetectSetImpl( LinedetectImpl t_impl );
+
+/** @brief The current implementation of the pixel kernel. */
+LinedetectImpl linedetectGetImpl();
+
+/** @brief Check if CPU supports the implementation. */
+bool linedetectSupported( LinedetectImpl t_impl );
+
+/** @brief Name of implementation for printing. */
+const char *linedetectImplName( LinedetectImpl t_impl );
+
+/** @brief Find border lines of track in one line of image from line camera.
+ *
+ * The function is compiled for resolutions of all cameras listed in car.h.
+ *
+ * @tparam t_resolution The number of pixels of line, t_camera::resolution of \ref CarCamera.
+ * @param t_img Line of image from line camera of length t_resolution.
+ * @param t_search Pixel from which border lines are searched to the both sides, usually the last track centre.
+ * @param t_min_contrast Minimal contrast of image, see \ref LINEDETECT_DEFAULT_MIN_CONTRAST.
+ * @param t_track_width_px Width of track in pixels, used when only one border line is visible.
+ * @param t_result Found lines.
+ * @return The number of found border lines (0, 1 or 2).
+ */
+template< int t_resolution >
+int linedetectFindT( const unsigned char *t_img, int t_search, int t_min_contrast, int t_track_width_px,
+        LinedetectResult &t_result );
+
+/** @brief Find border lines of track in the image from the default camera, see \ref linedetectFindT.
+ *
+ * @param t_img Image from line camera of length \ref CAR_CAM_RESOLUTION.
+ */
+inline int linedetectFind( const unsigned char *t_img, int t_search, int t_min_contrast, int t_track_width_px,
+        LinedetectResult &t_result )
+{
+    return linedetectFindT< CAR_CAM_RESOLUTION >( t_img, t_search, t_min_contrast, t_track_width_px, t_result );
+}
@@ -0,0 +1,151 @@
+/**
+ * @file linedetect_bench.cpp
+ * @brief Module linedetect_bench
+ *
+ * This program measures time of \ref linedetectFindT for every implementation supported by CPU
+ * and for every camera resolution.
+ * The images are synthetic camera lines with noise, one or two border lines and uneven lighting.
+ * Results of all implementations are compared with the scalar one.
+ *
+ * For more information see header files or use doxygen.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/param.h>
+
+#include "linedetect.h"
+
+#define HELP                                                        \
+    "Usage: %s [-h] [-lines N] [-iter N]\n"                         \
+    "  -h               this help\n"                                \
+    "  -lines N         number of different images (default 4096)\n" \
+    "  -iter N          number of passes over all images (default 200)\n\n"
+
+/// Width of border line in pixels
+#define BENCH_LINE_WIDTH_PX     5
+
+/// Synthetic image from line camera, the positions of lines are scaled to resolution
+template< int t_resolution >
+static void benchImage( unsigned char *t_img )
+{
+    int l_light = 150 + rand() % 100;
+    int l_slope = rand() % 61 - 30;
+    int l_left = ( rand() % 100 - 20 ) * t_resolution / 128;
+    int l_right = l_left + ( 80 + rand() % 40 ) * t_resolution / 128;
+
+    for ( int i = 0; i < t_resolution; i++ )
+    {
+        int l_value = l_light + l_slope * i / t_resolution;
+        if ( ( i >= l_left && i < l_left + BENCH_LINE_WIDTH_PX ) || ( i >= l_right && i < l_right + BENCH_LINE_WIDTH_PX ) )
+            l_value = 20;
+        l_value += rand() % 11 - 5;
+        t_img[ i ] = MIN( MAX( l_value, 0 ), 255 );
+    }
+}
+
+
+/** @brief Measure all implementations for one camera resolution.
+ *
+ * @return The number of results different from the scalar implementation.
+ */
+template< int t_resolution >
+static int benchResolution( int t_lines, int t_iter )
+{
+    // the track is about 100 pixels wide on the 128 pixel camera
+    const int l_track_width_px = 100 * t_resolution / 128;
+
+    srand( 1 );
+    unsigned char *l_images = new unsigned char[ t_lines * t_resolution ];
+    for ( int i = 0; i < t_lines; i++ )
+        benchImage< t_resolution >( l_images + i * t_resolution );
+
+    // results of scalar implementation are the reference
+    LinedetectResult *l_reference = new LinedetectResult[ t_lines ];
+    linedetectSetImpl( LINEDETECT_SCALAR );
+    for ( int i = 0; i < t_lines; i++ )
+        linedetectFindT< t_resolution >( l_images + i * t_resolution, t_resolution / 2,
+                LINEDETECT_DEFAULT_MIN_CONTRAST, l_track_width_px, l_reference[ i ] );
+
+    int l_errors = 0;
+    const LinedetectImpl l_impls[] = { LINEDETECT_SCALAR, LINEDETECT_SSE2, LINEDETECT_AVX2 };
+    for ( LinedetectImpl l_impl : l_impls )
+    {
+        if ( linedetectSetImpl( l_impl ) < 0 )
+        {
+            printf( "%4d px %-8s not supported\n", t_resolution, linedetectImplName( l_impl ) );
+            continue;
+        }
+
+        int l_mismatch = 0;
+        for ( int i = 0; i < t_lines; i++ )
+        {
+            LinedetectResult l_result;
+            linedetectFindT< t_resolution >( l_images + i * t_resolution, t_resolution / 2,
+                    LINEDETECT_DEFAULT_MIN_CONTRAST, l_track_width_px, l_result );
+            if ( memcmp( &l_result, &l_reference[ i ], sizeof( l_result ) ) ) l_mismatch++;
+        }
+        l_errors += l_mismatch;
+
+        // the search position depends on the previous result as in the control loop
+        timespec l_start, l_stop;
+        clock_gettime( CLOCK_MONOTONIC, &l_start );
+        int l_search = t_resolution / 2;
+        for ( int k = 0; k < t_iter; k++ )
+            for ( int i = 0; i < t_lines; i++ )
+            {
+                LinedetectResult l_result;
+                linedetectFindT< t_resolution >( l_images + i * t_resolution, l_search,
+                        LINEDETECT_DEFAULT_MIN_CONTRAST, l_track_width_px, l_result );
+                l_search = MIN( MAX( ( int ) l_result.centre, 0 ), t_resolution - 1 );
+            }
+        clock_gettime( CLOCK_MONOTONIC, &l_stop );
+
+        double l_ns = ( l_stop.tv_sec - l_start.tv_sec ) * 1e9 + ( l_stop.tv_nsec - l_start.tv_nsec );
+        printf( "%4d px %-8s %8.1f ns/line, mismatches %d\n", t_resolution, linedetectImplName( l_impl ),
+                l_ns / ( ( double ) t_iter * t_lines ), l_mismatch );
+    }
+
+    delete [] l_images;
+    delete [] l_reference;
+
+    return l_errors;
+}
+
+
+int main( int argc, char* argv[] )
+{
+    int l_lines = 4096;
+    int l_iter = 200;
+
+    for ( int i = 1; i < argc; i++ )
+    {
+        if ( i + 1 < argc && !strcmp( argv[ i ], "-lines" ) )
+            l_lines = atoi( argv[ ++i ] );
+        else if ( i + 1 < argc && !strcmp( argv[ i ], "-iter" ) )
+            l_iter = atoi( argv[ ++i ] );
+        else
+        {
+            printf( HELP, argv[ 0 ] );
+            exit( 0 );
+        }
+    }
+
+    if ( l_lines < 1 || l_iter < 1 )
+    {
+        printf( HELP, argv[ 0 ] );
+        exit( 0 );
+    }
+
+    int l_errors = benchResolution< CarCameraLine128::resolution >( l_lines, l_iter );
+    l_errors += benchResolution< CarCameraLine256::resolution >( l_lines, l_iter );
+
+    linedetectSetImpl( LINEDETECT_AUTO );
+    printf( "Selected implementation: %s\n", linedetectImplName( linedetectGetImpl() ) );
+
+    return l_errors ? 1 : 0;
+}
+
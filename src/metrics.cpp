@@ -0,0 +1,316 @@
+/**
+ * @file metrics.cpp
+ * @brief Module metrics
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <sched.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/param.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "metrics.h"
+
+
+void metricsWrite( MetricsSlot *t_slot, const MetricsCarData &t_data )
+{
+    uint32_t l_seq = t_slot->seq.load( std::memory_order_relaxed );
+    t_slot->seq.store( l_seq + 1, std::memory_order_relaxed );
+    // the odd number must be visible before any byte of data
+    std::atomic_thread_fence( std::memory_order_release );
+    memcpy( &t_slot->data, &t_data, sizeof( t_data ) );
+    t_slot->seq.store( l_seq + 2, std::memory_order_release );
+}
+
+
+int metricsRead( const MetricsSlot *t_slot, MetricsCarData &t_data )
+{
+    // the writer needs less than microsecond, so a few attempts are enough,
+    // unless the writer was preempted in the middle of writing
+    for ( int i = 0; i < 100; i++ )
+    {
+        uint32_t l_seq1 = t_slot->seq.load( std::memory_order_acquire );
+        if ( l_seq1 & 1 )
+        {
+            sched_yield();
+            continue;
+        }
+        memcpy( &t_data, ( const void * ) &t_slot->data, sizeof( t_data ) );
+        // the data must be read before the second load of sequence number
+        std::atomic_thread_fence( std::memory_order_acquire );
+        if ( t_slot->seq.load( std::memory_order_relaxed ) == l_seq1 ) return 0;
+    }
+
+    return -1;
+}
+
+
+MetricsPublisher::MetricsPublisher()
+{
+    m_page = nullptr;
+    m_name[ 0 ] = 0;
+}
+
+
+MetricsPublisher::~MetricsPublisher()
+{
+    close();
+}
+
+
+int MetricsPublisher::open( const char *t_name, int t_cars )
+{
+    close();
+
+    if ( t_name[ 0 ] != '/' || strlen( t_name ) >= sizeof( m_name ) )
+    {
+        fprintf( stderr, "Metrics name must start with '/' and it must be shorter than %d characters.\n", ( int ) sizeof( m_name ) );
+        return -1;
+    }
+
+    // the readers keep mapping of the old page, they must not see new page through it
+    shm_unlink( t_name );
+    int l_fd = shm_open( t_name, O_CREAT | O_EXCL | O_RDWR, 0644 );
+    if ( l_fd < 0 )
+    {
+        fprintf( stderr, "Unable to create shared memory '%s' (%s).\n", t_name, strerror( errno ) );
+        return -1;
+    }
+
+    if ( ftruncate( l_fd, sizeof( MetricsPage ) ) < 0 )
+    {
+        fprintf( stderr, "Unable to resize shared memory '%s' (%s).\n", t_name, strerror( errno ) );
+        ::close( l_fd );
+        shm_unlink( t_name );
+        return -1;
+    }
+
+    void *l_map = mmap( nullptr, sizeof( MetricsPage ), PROT_READ | PROT_WRITE, MAP_SHARED, l_fd, 0 );
+    ::close( l_fd );
+    if ( l_map == MAP_FAILED )
+    {
+        fprintf( stderr, "Unable to map shared memory '%s' (%s).\n", t_name, strerror( errno ) );
+        shm_unlink( t_name );
+        return -1;
+    }
+
+    // ftruncate fills the page by zeros, so all slots are free and all sequence numbers are even
+    m_page = ( MetricsPage * ) l_map;
+    m_page->version = METRICS_VERSION;
+    m_page->cars = MIN( MAX( t_cars, 0 ), METRICS_MAX_CARS );
+    m_page->size = sizeof( MetricsPage );
+    m_page->pid = getpid();
+    m_page->start_ns = latencyNow();
+    __atomic_store_n( &m_page->magic, METRICS_MAGIC, __ATOMIC_RELEASE );
+    strcpy( m_name, t_name );
+
+    if ( t_cars > METRICS_MAX_CARS )
+        fprintf( stderr, "Metrics are published only for the first %d cars.\n", METRICS_MAX_CARS );
+
+    return 0;
+}
+
+
+void MetricsPublisher::close()
+{
+    if ( !m_page ) return;
+
+    munmap( m_page, sizeof( MetricsPage ) );
+    shm_unlink( m_name );
+    m_page = nullptr;
+    m_name[ 0 ] = 0;
+}
+
+
+MetricsSlot *MetricsPublisher::getSlot( int t_car )
+{
+    if ( !m_page || t_car < 0 || t_car >= ( int ) m_page->cars ) return nullptr;
+    return &m_page->slots[ t_car ];
+}
+
+
+MetricsReader::MetricsReader()
+{
+    m_page = nullptr;
+}
+
+
+MetricsReader::~MetricsReader()
+{
+    close();
+}
+
+
+int MetricsReader::open( const char *t_name )
+{
+    close();
+
+    int l_fd = shm_open( t_name, O_RDONLY, 0 );
+    if ( l_fd < 0 ) return -1;
+
+    struct stat l_stat;
+    if ( fstat( l_fd, &l_stat ) < 0 || l_stat.st_size < ( off_t ) sizeof( MetricsPage ) )
+    {
+        ::close( l_fd );
+        return -1;
+    }
+
+    void *l_map = mmap( nullptr, sizeof( MetricsPage ), PROT_READ, MAP_SHARED, l_fd, 0 );
+    ::close( l_fd );
+    if ( l_map == MAP_FAILED ) return -1;
+
+    const MetricsPage *l_page = ( const MetricsPage * ) l_map;
+    if ( __atomic_load_n( &l_page->magic, __ATOMIC_ACQUIRE ) != METRICS_MAGIC || l_page->version != METRICS_VERSION
+            || l_page->size != sizeof( MetricsPage ) || l_page->cars > METRICS_MAX_CARS )
+    {
+        munmap( l_map, sizeof( MetricsPage ) );
+        return -1;
+    }
+
+    m_page = l_page;
+    return 0;
+}
+
+
+void MetricsReader::close()
+{
+    if ( !m_page ) return;
+
+    munmap( ( void * ) m_page, sizeof( MetricsPage ) );
+    m_page = nullptr;
+}
+
+
+bool MetricsReader::isAlive() const
+{
+    if ( !m_page ) return false;
+    return kill( ( pid_t ) m_page->pid, 0 ) == 0 || errno == EPERM;
+}
+
+
+/// Fill percentiles of histogram
+static void metricsLatency( const LatencyHistogram &t_hist, MetricsLatency &t_latency )
+{
+    t_latency.p50_us = t_hist.getPercentile( 50 ) / 1e3;
+    t_latency.p99_us = t_hist.getPercentile( 99 ) / 1e3;
+    t_latency.p999_us = t_hist.getPercentile( 99.9 ) / 1e3;
+    t_latency.max_us = t_hist.getMax() / 1e3;
+}
+
+
+MeteredCar::MeteredCar( Car &t_car, MetricsSlot *t_slot ) : m_car( t_car ), m_slot( t_slot )
+{
+    memset( &m_data, 0, sizeof( m_data ) );
+    m_image_ns = 0;
+    m_command_ns = 0;
+    m_window_ns = latencyNow();
+    m_window_frames = 0;
+    m_pending = false;
+}
+
+
+int MeteredCar::getImage( unsigned char *t_img )
+{
+    // the commands of previous image are complete now
+    if ( m_pending ) metricsPublish();
+
+    long long l_start = latencyNow();
+    int l_ret = m_car.getImage( t_img );
+    long long l_now = latencyNow();
+    m_wait.record( l_now - l_start );
+
+    if ( l_ret < 0 )
+    {
+        m_data.image_errors++;
+        metricsPublish();
+        return l_ret;
+    }
+
+    if ( m_image_ns ) m_cycle.record( l_now - m_image_ns );
+    m_image_ns = l_now;
+    m_command_ns = l_now;
+    m_data.frames++;
+    m_data.sim_time = m_car.getSimTime();
+    m_window_frames++;
+    m_pending = true;
+
+    return l_ret;
+}
+
+
+void MeteredCar::setServo( float t_position )
+{
+    m_data.servo = MIN( MAX( t_position, -1.0 ), 1.0 );
+    m_car.setServo( t_position );
+    m_command_ns = latencyNow();
+}
+
+
+void MeteredCar::setMotorPWM( float t_l_pwm, float t_r_pwm )
+{
+    m_data.l_pwm = MIN( MAX( t_l_pwm, -1.0 ), 1.0 );
+    m_data.r_pwm = MIN( MAX( t_r_pwm, -1.0 ), 1.0 );
+    m_car.setMotorPWM( t_l_pwm, t_r_pwm );
+    m_command_ns = latencyNow();
+}
+
+
+void MeteredCar::resetCar()
+{
+    m_data.servo = 0;
+    m_data.l_pwm = 0;
+    m_data.r_pwm = 0;
+    m_data.resets++;
+    m_car.resetCar();
+    // the reset is not a part of control loop
+    m_image_ns = 0;
+    m_pending = false;
+    metricsPublish();
+}
+
+
+int MeteredCar::commit()
+{
+    int l_ret = m_car.commit();
+    m_command_ns = latencyNow();
+    if ( m_pending ) metricsPublish();
+    return l_ret;
+}
+
+
+void MeteredCar::metricsPublish()
+{
+    long long l_now = latencyNow();
+
+    if ( m_pending ) m_control.record( m_command_ns - m_image_ns );
+    m_pending = false;
+
+    if ( !m_slot ) return;
+
+    CarFaults l_faults;
+    m_car.getFaults( l_faults );
+    m_data.timeouts = l_faults.timeouts;
+    m_data.remote_errors = l_faults.remote_errors;
+
+    if ( l_now - m_window_ns >= METRICS_WINDOW_NS )
+    {
+        m_data.loop_hz = m_window_frames * 1e9 / ( l_now - m_window_ns );
+        metricsLatency( m_cycle, m_data.cycle );
+        metricsLatency( m_wait, m_data.wait );
+        metricsLatency( m_control, m_data.control );
+        m_cycle.reset();
+        m_wait.reset();
+        m_control.reset();
+        m_window_frames = 0;
+        m_window_ns = l_now;
+    }
+
+    m_data.update_ns = l_now;
+    metricsWrite( m_slot, m_data );
+}
@@ -0,0 +1,206 @@
+#pragma once
+
+/**
+ * @file metrics.h
+ * @brief Module metrics
+ *
+ * This module metrics publishes live counters and gauges of running cars in a POSIX shared memory page,
+ * so an external monitor (\ref alamak_top.cpp) can read them without any cooperation of the control process.
+ *
+ * Every car has its own slot, which is written only by the control thread of the car.
+ * The slot is protected by a sequence lock: the writer makes the sequence number odd, copies the data
+ * and makes the number even again. The reader copies the data and it repeats the copy, when the number
+ * was odd or it changed meanwhile. The writer never waits and never calls the kernel.
+ */
+
+#include <stdint.h>
+#include <atomic>
+
+#include "car.h"
+#include "latency.h"
+
+/// Identification of metrics page "ALKM"
+#define METRICS_MAGIC                   0x4d4b4c41
+/// Version of layout of metrics page
+#define METRICS_VERSION                 1
+/// The maximal number of cars in one page
+#define METRICS_MAX_CARS                64
+/// The default name of shared memory
+#define METRICS_DEFAULT_NAME            "/alamak"
+/// The period of publication of percentiles and loop rate, the histograms are cleared after it
+#define METRICS_WINDOW_NS               1000000000LL
+
+static_assert( ATOMIC_INT_LOCK_FREE == 2, "The sequence lock in shared memory needs lock free atomic int" );
+
+/// The percentiles of one latency histogram in microseconds, see \ref LatencyHistogram.
+struct MetricsLatency
+{
+    float p50_us;                       ///< Median.
+    float p99_us;                       ///< 99th percentile.
+    float p999_us;                      ///< 99.9th percentile.
+    float max_us;                       ///< Maximum.
+};
+
+/// The values of one car published in the metrics page.
+struct MetricsCarData
+{
+    int64_t update_ns;                  ///< Monotonic time of the last update, 0 when the car has not started.
+    uint64_t frames;                    ///< Images received by the control loop.
+    uint64_t image_errors;              ///< Calls of getImage without image.
+    uint64_t timeouts;                  ///< Timeouts of backend, see \ref CarFaults.
+    uint64_t remote_errors;             ///< Failed calls of backend, see \ref CarFaults.
+    uint64_t resets;                    ///< Resets of car (e.g. after crash).
+    double sim_time;                    ///< Simulation time of the last image.
+    float servo;                        ///< The last servo position.
+    float l_pwm;                        ///< The last power of left motor.
+    float r_pwm;                        ///< The last power of right motor.
+    float loop_hz;                      ///< Rate of control loop in the last window \ref METRICS_WINDOW_NS.
+    MetricsLatency cycle;               ///< Period of control loop in the last window.
+    MetricsLatency wait;                ///< Waiting for image in the last window.
+    MetricsLatency control;             ///< From image to committed commands in the last window.
+};
+
+/// Slot of one car in the metrics page.
+struct MetricsSlot
+{
+    std::atomic< uint32_t > seq;        ///< Sequence number, odd while the data are written.
+    uint32_t reserved;                  ///< Not used, alignment.
+    MetricsCarData data;                ///< The published values.
+};
+
+/// The layout of shared memory.
+struct MetricsPage
+{
+    uint32_t magic;                     ///< \ref METRICS_MAGIC, it is written as the last item of header.
+    uint32_t version;                   ///< \ref METRICS_VERSION
+    uint32_t cars;                      ///< Number of used slots.
+    uint32_t size;                      ///< Size of page in bytes.
+    int64_t pid;                        ///< Process ID of the publisher.
+    int64_t start_ns;                   ///< Monotonic time of the creation of page.
+    MetricsSlot slots[ METRICS_MAX_CARS ]; ///< Slots of cars.
+};
+
+/** @brief Write data to slot, the writer is the only one of slot. */
+void metricsWrite( MetricsSlot *t_slot, const MetricsCarData &t_data );
+
+/** @brief Read consistent copy of slot.
+ *
+ * @return When the copy is consistent, it returns 0. Otherwise (the writer is too fast or it stopped in the middle) -1.
+ */
+int metricsRead( const MetricsSlot *t_slot, MetricsCarData &t_data );
+
+/**
+ * @brief The owner of metrics page, it creates the shared memory and removes it.
+ */
+class MetricsPublisher
+{
+public:
+
+    /** Constructor */
+    MetricsPublisher();
+    /** Destructor removes the page. */
+    ~MetricsPublisher();
+
+    /** @brief Create the page, an old page of the same name is replaced.
+     *
+     * @param t_name The name of shared memory, e.g. \ref METRICS_DEFAULT_NAME.
+     * @param t_cars The number of cars, only the first \ref METRICS_MAX_CARS cars get slot.
+     * @return When the page was created, it returns 0. Otherwise -1.
+     */
+    int open( const char *t_name, int t_cars );
+
+    /** @brief Unmap and remove the page, the readers keep their mappings. */
+    void close();
+
+    /** @brief Get slot of car, nullptr when the page is not open or the car has no slot. */
+    MetricsSlot *getSlot( int t_car );
+
+protected:
+
+    MetricsPage *m_page;                ///< The mapped page
+    char m_name[ 256 ];                 ///< Name of shared memory
+
+};
+
+/**
+ * @brief The reader of metrics page, it maps the page read only.
+ */
+class MetricsReader
+{
+public:
+
+    /** Constructor */
+    MetricsReader();
+    /** Destructor unmaps the page. */
+    ~MetricsReader();
+
+    /** @brief Map the page.
+     *
+     * @return When the page exists and it has the right version, it returns 0. Otherwise -1.
+     */
+    int open( const char *t_name );
+
+    /** @brief Unmap the page. */
+    void close();
+
+    /** @brief Is the publisher process still running. */
+    bool isAlive() const;
+
+    /** @brief The page, nullptr when it is not open. */
+    const MetricsPage *getPage() const { return m_page; }
+
+protected:
+
+    const MetricsPage *m_page;          ///< The mapped page
+
+};
+
+/**
+ * @brief The car which publishes metrics of its control loop.
+ *
+ * It forwards all calls to other car and it measures the control loop in the same way as \ref RecordingCar:
+ * the cycle starts by \ref getImage and it is finished by \ref commit or by the next \ref getImage.
+ * The counters and commands are published every cycle, the percentiles and the loop rate every \ref METRICS_WINDOW_NS.
+ */
+class MeteredCar : public Car
+{
+public:
+
+    /** @brief Constructor.
+     *
+     * @param t_car The measured car.
+     * @param t_slot The slot of car, when nullptr nothing is published.
+     */
+    MeteredCar( Car &t_car, MetricsSlot *t_slot );
+
+    int getImage( unsigned char *t_img ) override;
+    void setServo( float t_position ) override;
+    void setMotorPWM( float t_l_pwm, float t_r_pwm ) override;
+    void resetCar() override;
+    void beginCommands() override { m_car.beginCommands(); }
+    int commit() override;
+    double getSimTime() override { return m_car.getSimTime(); }
+    int getFrameFd() override { return m_car.getFrameFd(); }
+    int getPose( CarPose &t_pose ) override { return m_car.getPose( t_pose ); }
+    int saveSnapshot( CarSnapshot &t_snapshot ) override { return m_car.saveSnapshot( t_snapshot ); }
+    int restoreSnapshot( const CarSnapshot &t_snapshot ) override { return m_car.restoreSnapshot( t_snapshot ); }
+    void getFaults( CarFaults &t_faults ) override { m_car.getFaults( t_faults ); }
+
+protected:
+
+    /** @brief Update counters and percentiles and write the slot. */
+    void metricsPublish();
+
+    Car &m_car;                         ///< The measured car
+    MetricsSlot *m_slot;                ///< The slot of car
+    MetricsCarData m_data;              ///< The values of slot
+    LatencyHistogram m_cycle;           ///< Period of control loop in the current window
+    LatencyHistogram m_wait;            ///< Waiting for image in the current window
+    LatencyHistogram m_control;         ///< From image to commands in the current window
+    long long m_image_ns;               ///< Time of the last image
+    long long m_command_ns;             ///< Time of the last command
+    long long m_window_ns;              ///< Start of the current window
+    unsigned long m_window_frames;      ///< Images of the current window
+    bool m_pending;                     ///< The commands of the last image are not published yet
+
+};
@@ -0,0 +1,232 @@
+/**
+ * @file optimizer.cpp
+ * @brief Module optimizer
+ *
+ */
+
+#include <math.h>
+#include <string.h>
+#include <sys/param.h>
+#include <algorithm>
+
+#include "optimizer.h"
+
+CmaEs::CmaEs()
+{
+    m_dim = 0;
+    m_lambda = 0;
+    m_mu = 0;
+    m_generation = 0;
+    m_evaluations = 0;
+    m_rng = 1;
+    m_sigma = 0;
+    m_best_cost = HUGE_VAL;
+}
+
+
+int CmaEs::init( int t_dim, const double *t_mean, double t_sigma, int t_lambda, unsigned long long t_seed )
+{
+    if ( t_dim < 1 || t_dim > OPTIMIZER_MAX_DIM || t_sigma <= 0 ) return -1;
+
+    m_dim = t_dim;
+    m_lambda = t_lambda > 0 ? MAX( t_lambda, 2 ) : 4 + ( int ) ( 3 * log( t_dim ) );
+    m_generation = 0;
+    m_evaluations = 0;
+    // the state of xorshift must not be zero
+    m_rng = t_seed ? t_seed : 1;
+
+    m_sigma = t_sigma;
+    m_mean.assign( t_mean, t_mean + t_dim );
+    m_diag.assign( t_dim, 1.0 );
+    m_pc.assign( t_dim, 0.0 );
+    m_ps.assign( t_dim, 0.0 );
+    m_best = m_mean;
+    m_best_cost = HUGE_VAL;
+
+    optimizerSetup();
+
+    return 0;
+}
+
+
+void CmaEs::optimizerSetup()
+{
+    double l_n = m_dim;
+
+    // log weights of the better half of population
+    m_mu = m_lambda / 2;
+    m_weights.resize( m_mu );
+    double l_sum = 0, l_sum2 = 0;
+    for ( int i = 0; i < m_mu; i++ )
+    {
+        m_weights[ i ] = log( m_mu + 0.5 ) - log( i + 1.0 );
+        l_sum += m_weights[ i ];
+    }
+    for ( int i = 0; i < m_mu; i++ )
+    {
+        m_weights[ i ] /= l_sum;
+        l_sum2 += m_weights[ i ] * m_weights[ i ];
+    }
+    m_mueff = 1 / l_sum2;
+
+    m_cs = ( m_mueff + 2 ) / ( l_n + m_mueff + 5 );
+    m_ds = 1 + 2 * MAX( 0.0, sqrt( ( m_mueff - 1 ) / ( l_n + 1 ) ) - 1 ) + m_cs;
+    m_cc = ( 4 + m_mueff / l_n ) / ( l_n + 4 + 2 * m_mueff / l_n );
+    m_c1 = 2 / ( ( l_n + 1.3 ) * ( l_n + 1.3 ) + m_mueff );
+    m_cmu = MIN( 1 - m_c1, 2 * ( m_mueff - 2 + 1 / m_mueff ) / ( ( l_n + 2 ) * ( l_n + 2 ) + m_mueff ) );
+
+    // the diagonal matrix learns faster than the full one
+    double l_sep = ( l_n + 2 ) / 3;
+    m_c1 = MIN( m_c1 * l_sep, 1.0 );
+    m_cmu = MIN( m_cmu * l_sep, 1 - m_c1 );
+
+    m_chi = sqrt( l_n ) * ( 1 - 1 / ( 4 * l_n ) + 1 / ( 21 * l_n * l_n ) );
+}
+
+
+double CmaEs::optimizerUniform()
+{
+    m_rng ^= m_rng >> 12;
+    m_rng ^= m_rng << 25;
+    m_rng ^= m_rng >> 27;
+    return ( ( ( m_rng * 2685821657736338717ULL ) >> 11 ) + 0.5 ) / 9007199254740992.0;
+}
+
+
+double CmaEs::optimizerGauss()
+{
+    // Box-Muller, the second value is not used to keep the state simple
+    double l_u1 = optimizerUniform();
+    double l_u2 = optimizerUniform();
+    return sqrt( -2 * log( l_u1 ) ) * cos( 2 * M_PI * l_u2 );
+}
+
+
+void CmaEs::ask( std::vector< std::vector< double > > &t_population )
+{
+    m_z.assign( m_lambda, std::vector< double >( m_dim ) );
+    t_population.assign( m_lambda, std::vector< double >( m_dim ) );
+
+    for ( int k = 0; k < m_lambda; k++ )
+        for ( int i = 0; i < m_dim; i++ )
+        {
+            m_z[ k ][ i ] = optimizerGauss();
+            double l_x = m_mean[ i ] + m_sigma * sqrt( m_diag[ i ] ) * m_z[ k ][ i ];
+            t_population[ k ][ i ] = MIN( MAX( l_x, 0.0 ), 1.0 );
+        }
+}
+
+
+void CmaEs::tell( const std::vector< double > &t_costs )
+{
+    if ( ( int ) t_costs.size() != m_lambda || ( int ) m_z.size() != m_lambda ) return;
+
+    // rank candidates by cost
+    std::vector< int > l_order( m_lambda );
+    for ( int k = 0; k < m_lambda; k++ ) l_order[ k ] = k;
+    std::stable_sort( l_order.begin(), l_order.end(), [ & ]( int a, int b ) { return t_costs[ a ] < t_costs[ b ]; } );
+
+    m_evaluations += m_lambda;
+    int l_best = l_order[ 0 ];
+    if ( t_costs[ l_best ] < m_best_cost )
+    {
+        m_best_cost = t_costs[ l_best ];
+        for ( int i = 0; i < m_dim; i++ )
+            m_best[ i ] = MIN( MAX( m_mean[ i ] + m_sigma * sqrt( m_diag[ i ] ) * m_z[ l_best ][ i ], 0.0 ), 1.0 );
+    }
+
+    // weighted mean of the selected steps, z_w in N(0, I) and y_w = sqrt( C ) z_w
+    std::vector< double > l_zw( m_dim, 0.0 );
+    for ( int j = 0; j < m_mu; j++ )
+        for ( int i = 0; i < m_dim; i++ )
+            l_zw[ i ] += m_weights[ j ] * m_z[ l_order[ j ] ][ i ];
+
+    double l_ps_norm2 = 0;
+    for ( int i = 0; i < m_dim; i++ )
+    {
+        m_ps[ i ] = ( 1 - m_cs ) * m_ps[ i ] + sqrt( m_cs * ( 2 - m_cs ) * m_mueff ) * l_zw[ i ];
+        l_ps_norm2 += m_ps[ i ] * m_ps[ i ];
+    }
+    double l_ps_norm = sqrt( l_ps_norm2 );
+
+    // the covariance path is stalled when the step size grows fast
+    double l_hs_limit = ( 1.4 + 2 / ( m_dim + 1.0 ) ) * m_chi;
+    bool l_hs = l_ps_norm / sqrt( 1 - pow( 1 - m_cs, 2.0 * ( m_generation + 1 ) ) ) < l_hs_limit;
+
+    for ( int i = 0; i < m_dim; i++ )
+    {
+        double l_sd = sqrt( m_diag[ i ] );
+        double l_yw = l_sd * l_zw[ i ];
+
+        m_mean[ i ] += m_sigma * l_yw;
+        m_pc[ i ] = ( 1 - m_cc ) * m_pc[ i ] + ( l_hs ? sqrt( m_cc * ( 2 - m_cc ) * m_mueff ) * l_yw : 0 );
+
+        double l_rank_mu = 0;
+        for ( int j = 0; j < m_mu; j++ )
+        {
+            double l_y = l_sd * m_z[ l_order[ j ] ][ i ];
+            l_rank_mu += m_weights[ j ] * l_y * l_y;
+        }
+
+        m_diag[ i ] = ( 1 - m_c1 - m_cmu ) * m_diag[ i ]
+                + m_c1 * ( m_pc[ i ] * m_pc[ i ] + ( l_hs ? 0 : m_cc * ( 2 - m_cc ) * m_diag[ i ] ) )
+                + m_cmu * l_rank_mu;
+    }
+
+    m_sigma *= exp( ( m_cs / m_ds ) * ( l_ps_norm / m_chi - 1 ) );
+    // the whole box is the largest meaningful step
+    m_sigma = MIN( m_sigma, 1.0 );
+    m_generation++;
+}
+
+
+int CmaEs::save( FILE *t_file ) const
+{
+    fprintf( t_file, "cmaes %d %d %d %ld %llu %.17g %.17g\n", m_dim, m_lambda, m_generation, m_evaluations,
+            m_rng, m_sigma, m_best_cost );
+
+    const std::vector< double > *l_vectors[] = { &m_mean, &m_diag, &m_pc, &m_ps, &m_best };
+    for ( const std::vector< double > *l_vector : l_vectors )
+    {
+        for ( int i = 0; i < m_dim; i++ )
+            fprintf( t_file, "%s%.17g", i ? " " : "", ( *l_vector )[ i ] );
+        fprintf( t_file, "\n" );
+    }
+
+    return ferror( t_file ) ? -1 : 0;
+}
+
+
+int CmaEs::load( FILE *t_file )
+{
+    int l_dim, l_lambda, l_generation;
+    long l_evaluations;
+    unsigned long long l_rng;
+    double l_sigma, l_best_cost;
+
+    if ( fscanf( t_file, " cmaes %d %d %d %ld %llu %lg %lg", &l_dim, &l_lambda, &l_generation, &l_evaluations,
+                &l_rng, &l_sigma, &l_best_cost ) != 7 ) return -1;
+    if ( l_dim < 1 || l_dim > OPTIMIZER_MAX_DIM || l_lambda < 2 ) return -1;
+
+    m_dim = l_dim;
+    m_lambda = l_lambda;
+    m_generation = l_generation;
+    m_evaluations = l_evaluations;
+    m_rng = l_rng;
+    m_sigma = l_sigma;
+    m_best_cost = l_best_cost;
+
+    std::vector< double > *l_vectors[] = { &m_mean, &m_diag, &m_pc, &m_ps, &m_best };
+    for ( std::vector< double > *l_vector : l_vectors )
+    {
+        l_vector->resize( m_dim );
+        for ( int i = 0; i < m_dim; i++ )
+            if ( fscanf( t_file, "%lg", &( *l_vector )[ i ] ) != 1 ) return -1;
+    }
+
+    optimizerSetup();
+    m_z.clear();
+
+    return 0;
+}
+
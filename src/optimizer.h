@@ -0,0 +1,126 @@
+#pragma once
+
+/**
+ * @file optimizer.h
+ * @brief Module optimizer
+ *
+ * This module optimizer contains the black box optimizer of controller parameters.
+ * It is the separable CMA-ES (Ros, Hansen: A Simple Modification in CMA-ES Achieving Linear Time
+ * and Space Complexity, 2008), the evolution strategy with diagonal covariance matrix.
+ * The whole population of one generation is generated at once, so all candidates can be evaluated
+ * in parallel. The state can be stored to a text file and loaded again to continue the search.
+ */
+
+#include <stdio.h>
+#include <vector>
+
+/// The maximal number of optimized parameters
+#define OPTIMIZER_MAX_DIM               32
+
+/**
+ * @brief The separable CMA-ES minimizing a cost function in the unit box <0, 1>^dim.
+ *
+ * The caller maps the unit box to the ranges of parameters. The candidates are clipped to the box,
+ * the search distribution is updated by the unclipped samples.
+ *
+ * Usage: \ref init, then repeat \ref ask, evaluate all candidates and \ref tell.
+ */
+class CmaEs
+{
+public:
+
+    /** Constructor creates empty optimizer, see \ref init. */
+    CmaEs();
+
+    /** @brief Start new search.
+     *
+     * @param t_dim The number of parameters.
+     * @param t_mean The initial mean in the unit box.
+     * @param t_sigma The initial step size, e.g. 0.3 of the box.
+     * @param t_lambda The population size, 0 for the default 4 + 3 ln( dim ).
+     * @param t_seed The seed of random generator.
+     * @return When the parameters are valid, it returns 0. Otherwise -1.
+     */
+    int init( int t_dim, const double *t_mean, double t_sigma, int t_lambda = 0, unsigned long long t_seed = 1 );
+
+    /** @brief Generate population of the next generation.
+     *
+     * @param t_population The candidates, \ref getLambda vectors of \ref getDim values in <0, 1>.
+     */
+    void ask( std::vector< std::vector< double > > &t_population );
+
+    /** @brief Update the search distribution by the costs of population from the last \ref ask.
+     *
+     * @param t_costs The cost of every candidate, lower is better.
+     */
+    void tell( const std::vector< double > &t_costs );
+
+    /** @brief Store the state of search.
+     *
+     * @return When the state was written, it returns 0. Otherwise -1.
+     */
+    int save( FILE *t_file ) const;
+
+    /** @brief Load the state of search stored by \ref save.
+     *
+     * @return When the state was read, it returns 0. Otherwise -1.
+     */
+    int load( FILE *t_file );
+
+    int getDim() const { return m_dim; }                ///< The number of parameters
+    int getLambda() const { return m_lambda; }          ///< The population size
+    int getGeneration() const { return m_generation; }  ///< The number of finished generations
+    long getEvaluations() const { return m_evaluations; } ///< The number of evaluated candidates
+    double getSigma() const { return m_sigma; }         ///< The current step size
+    const std::vector< double > &getMean() const { return m_mean; } ///< The current mean
+
+    /** @brief The best candidate evaluated so far. */
+    const std::vector< double > &getBest() const { return m_best; }
+    /** @brief The cost of the best candidate, HUGE_VAL before the first generation. */
+    double getBestCost() const { return m_best_cost; }
+
+protected:
+
+    /** @brief Compute the strategy parameters from dimension and population size. */
+    void optimizerSetup();
+
+    /** @brief Uniform random number in (0, 1). */
+    double optimizerUniform();
+
+    /** @brief Normal random number N(0, 1). */
+    double optimizerGauss();
+
+    int m_dim;                          ///< Number of parameters
+    int m_lambda;                       ///< Population size
+    int m_mu;                           ///< Number of selected candidates
+    int m_generation;                   ///< Number of finished generations
+    long m_evaluations;                 ///< Number of evaluated candidates
+    unsigned long long m_rng;           ///< State of random generator (xorshift64*)
+
+    /// @name The strategy parameters, see \ref optimizerSetup
+    /// @{
+    std::vector< double > m_weights;    ///< Recombination weights
+    double m_mueff;                     ///< Variance effective selection mass
+    double m_cs;                        ///< Learning rate of step size path
+    double m_ds;                        ///< Damping of step size
+    double m_cc;                        ///< Learning rate of covariance path
+    double m_c1;                        ///< Learning rate of rank one update
+    double m_cmu;                       ///< Learning rate of rank mu update
+    double m_chi;                       ///< Expected length of N(0, I) vector
+    /// @}
+
+    /// @name The search distribution
+    /// @{
+    double m_sigma;                     ///< Step size
+    std::vector< double > m_mean;       ///< Mean
+    std::vector< double > m_diag;       ///< Diagonal of covariance matrix
+    std::vector< double > m_pc;         ///< Evolution path of covariance
+    std::vector< double > m_ps;         ///< Evolution path of step size
+    /// @}
+
+    std::vector< std::vector< double > > m_z;   ///< Standard normal samples of the last population
+    std::vector< double > m_best;       ///< The best candidate
+    double m_best_cost;                 ///< The cost of the best candidate
+
+};
+
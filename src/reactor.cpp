@@ -0,0 +1,225 @@
+/**
+ * @file reactor.cpp
+ * @brief Module reactor
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#include "reactor.h"
+
+/// Types of sources
+enum ReactorSourceType
+{
+    REACTOR_SOURCE_FD,                  ///< Descriptor of caller
+    REACTOR_SOURCE_TIMER,               ///< Timerfd owned by reactor
+    REACTOR_SOURCE_IDLE                 ///< Eventfd owned by reactor, always ready
+};
+
+Reactor::Reactor()
+{
+    m_stop = false;
+    m_dispatching = false;
+    memset( &m_stats, 0, sizeof( m_stats ) );
+
+    m_epoll_fd = epoll_create1( EPOLL_CLOEXEC );
+    if ( m_epoll_fd < 0 ) fprintf( stderr, "Unable to create epoll instance!\n" );
+
+    // the stop request from other thread wakes up epoll_wait, it has no source
+    m_wakeup_fd = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+    epoll_event l_ev;
+    l_ev.events = EPOLLIN;
+    l_ev.data.ptr = nullptr;
+    if ( m_wakeup_fd < 0 || epoll_ctl( m_epoll_fd, EPOLL_CTL_ADD, m_wakeup_fd, &l_ev ) < 0 )
+        fprintf( stderr, "Unable to create wake up eventfd!\n" );
+}
+
+
+Reactor::~Reactor()
+{
+    for ( ReactorSource *l_source : m_sources )
+    {
+        if ( l_source->type != REACTOR_SOURCE_FD ) close( l_source->fd );
+        delete l_source;
+    }
+
+    if ( m_wakeup_fd >= 0 ) close( m_wakeup_fd );
+    if ( m_epoll_fd >= 0 ) close( m_epoll_fd );
+}
+
+
+int Reactor::reactorAdd( int t_fd, int t_type, ReactorCallback &t_callback, unsigned t_events )
+{
+    ReactorSource *l_source = new ReactorSource;
+    l_source->fd = t_fd;
+    l_source->type = t_type;
+    l_source->callback = t_callback;
+    l_source->removed = false;
+
+    epoll_event l_ev;
+    l_ev.events = t_events;
+    l_ev.data.ptr = l_source;
+    if ( epoll_ctl( m_epoll_fd, EPOLL_CTL_ADD, t_fd, &l_ev ) < 0 )
+    {
+        // the descriptor without epoll support is reported by return value only, caller may skip it
+        if ( errno != EPERM ) fprintf( stderr, "Unable to register descriptor %d: %s\n", t_fd, strerror( errno ) );
+        delete l_source;
+        return -1;
+    }
+
+    m_sources.push_back( l_source );
+
+    return 0;
+}
+
+
+int Reactor::addFd( int t_fd, ReactorCallback t_callback, unsigned t_events )
+{
+    if ( t_fd < 0 ) return -1;
+
+    return reactorAdd( t_fd, REACTOR_SOURCE_FD, t_callback, t_events ? t_events : EPOLLIN );
+}
+
+
+int Reactor::addTimer( long long t_period_ns, ReactorCallback t_callback )
+{
+    if ( t_period_ns <= 0 ) return -1;
+
+    int l_fd = timerfd_create( CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC );
+    if ( l_fd < 0 )
+    {
+        fprintf( stderr, "Unable to create timer!\n" );
+        return -1;
+    }
+
+    timespec l_period = { ( time_t ) ( t_period_ns / 1000000000LL ), ( long ) ( t_period_ns % 1000000000LL ) };
+    itimerspec l_spec = { l_period, l_period };
+    if ( timerfd_settime( l_fd, 0, &l_spec, nullptr ) < 0 || reactorAdd( l_fd, REACTOR_SOURCE_TIMER, t_callback, EPOLLIN ) < 0 )
+    {
+        close( l_fd );
+        return -1;
+    }
+
+    return l_fd;
+}
+
+
+int Reactor::addIdle( ReactorCallback t_callback )
+{
+    // the counter of eventfd is never read, so it is readable forever
+    int l_fd = eventfd( 1, EFD_NONBLOCK | EFD_CLOEXEC );
+    if ( l_fd < 0 )
+    {
+        fprintf( stderr, "Unable to create idle source!\n" );
+        return -1;
+    }
+
+    if ( reactorAdd( l_fd, REACTOR_SOURCE_IDLE, t_callback, EPOLLIN ) < 0 )
+    {
+        close( l_fd );
+        return -1;
+    }
+
+    return l_fd;
+}
+
+
+int Reactor::remove( int t_fd )
+{
+    for ( unsigned i = 0; i < m_sources.size(); i++ )
+    {
+        ReactorSource *l_source = m_sources[ i ];
+        if ( l_source->fd != t_fd || l_source->removed ) continue;
+
+        epoll_ctl( m_epoll_fd, EPOLL_CTL_DEL, t_fd, nullptr );
+        if ( l_source->type != REACTOR_SOURCE_FD ) close( t_fd );
+
+        // the source can be in events returned by the current epoll_wait
+        l_source->removed = true;
+        if ( !m_dispatching )
+        {
+            delete l_source;
+            m_sources.erase( m_sources.begin() + i );
+        }
+
+        return 0;
+    }
+
+    return -1;
+}
+
+
+void Reactor::stop()
+{
+    m_stop = true;
+
+    uint64_t l_one = 1;
+    if ( write( m_wakeup_fd, &l_one, sizeof( l_one ) ) < 0 && errno != EAGAIN )
+        fprintf( stderr, "Method %s failed!\n", __FUNCTION__ );
+}
+
+
+int Reactor::run()
+{
+    epoll_event l_events[ REACTOR_MAX_EVENTS ];
+
+    while ( !m_stop && !m_sources.empty() )
+    {
+        int l_count = epoll_wait( m_epoll_fd, l_events, REACTOR_MAX_EVENTS, -1 );
+        if ( l_count < 0 )
+        {
+            if ( errno == EINTR ) continue;
+            fprintf( stderr, "Method %s failed: %s\n", __FUNCTION__, strerror( errno ) );
+            return -1;
+        }
+        m_stats.wakeups++;
+
+        m_dispatching = true;
+        for ( int i = 0; i < l_count && !m_stop; i++ )
+        {
+            ReactorSource *l_source = ( ReactorSource * ) l_events[ i ].data.ptr;
+            if ( !l_source || l_source->removed ) continue;
+
+            // the timer is consumed here, the callback is called once for all expirations
+            if ( l_source->type == REACTOR_SOURCE_TIMER )
+            {
+                uint64_t l_expirations;
+                if ( read( l_source->fd, &l_expirations, sizeof( l_expirations ) ) != sizeof( l_expirations ) ) continue;
+                m_stats.timer_overruns += l_expirations - 1;
+            }
+
+            m_stats.dispatched++;
+            l_source->callback( l_events[ i ].events );
+        }
+        m_dispatching = false;
+
+        // delete sources removed by callbacks
+        for ( unsigned i = 0; i < m_sources.size(); )
+        {
+            if ( m_sources[ i ]->removed )
+            {
+                delete m_sources[ i ];
+                m_sources.erase( m_sources.begin() + i );
+            }
+            else
+                i++;
+        }
+    }
+
+    // drain stop request, the loop can be run again
+    uint64_t l_count;
+    if ( read( m_wakeup_fd, &l_count, sizeof( l_count ) ) < 0 && errno != EAGAIN )
+        fprintf( stderr, "Method %s failed!\n", __FUNCTION__ );
+    m_stop = false;
+
+    return 0;
+}
+
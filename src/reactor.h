@@ -0,0 +1,118 @@
+#pragma once
+
+/**
+ * @file reactor.h
+ * @brief Module reactor
+ *
+ * This module reactor is a single threaded event loop based on epoll. All event sources of a control
+ * program are registered on one epoll instance: the terminal (stdin), the gamepad (\ref gamepadOpen),
+ * the arrival of images (\ref Car::getFrameFd) and periodic timers (timerfd). The control program
+ * is written as callbacks reacting to these events and the thread sleeps only in epoll_wait.
+ */
+
+#include <atomic>
+#include <vector>
+#include <functional>
+
+/// Maximal number of events processed by one epoll_wait
+#define REACTOR_MAX_EVENTS              16
+
+/**
+ * @brief Callback of event source.
+ *
+ * The parameter is the mask of epoll events (EPOLLIN, EPOLLHUP, ...).
+ */
+typedef std::function< void( unsigned t_events ) > ReactorCallback;
+
+/// Statistics of \ref Reactor.
+struct ReactorStats
+{
+    unsigned long wakeups;              ///< Number of returns from epoll_wait.
+    unsigned long dispatched;           ///< Number of called callbacks.
+    unsigned long timer_overruns;       ///< Number of timer expirations lost because the loop was late.
+};
+
+/**
+ * @brief Event loop calling callbacks of ready file descriptors.
+ *
+ * The descriptors are level-triggered, the callback must consume the event (read data),
+ * otherwise it is called again. Timers and idle sources are consumed by the reactor itself.
+ * The sources can be added and removed also from callbacks.
+ */
+class Reactor
+{
+public:
+
+    /** Constructor creates epoll instance. */
+    Reactor();
+    /** Destructor closes all descriptors owned by reactor. */
+    virtual ~Reactor();
+
+    /** @brief Register file descriptor, the descriptor stays owned by caller.
+     *
+     * @param t_fd The file descriptor.
+     * @param t_callback Called when the descriptor is ready.
+     * @param t_events The mask of epoll events, EPOLLIN by default.
+     * @return When the descriptor was registered, it returns 0. Otherwise -1,
+     *         the descriptor without epoll support (regular file, /dev/null) is refused without message.
+     */
+    int addFd( int t_fd, ReactorCallback t_callback, unsigned t_events = 0 );
+
+    /** @brief Register periodic timer (timerfd).
+     *
+     * @param t_period_ns Period of timer in ns, the first expiration is after one period.
+     * @param t_callback Called after every expiration, the late expirations are merged.
+     * @return The file descriptor of timer owned by reactor, -1 on error.
+     */
+    int addTimer( long long t_period_ns, ReactorCallback t_callback );
+
+    /** @brief Register source which is always ready.
+     *
+     * It is used for cars whose \ref Car::getImage does not wait for any external event,
+     * the callback is called in every iteration of loop together with other ready sources.
+     *
+     * @return The file descriptor (eventfd) owned by reactor, -1 on error.
+     */
+    int addIdle( ReactorCallback t_callback );
+
+    /** @brief Unregister source, the descriptors owned by reactor are closed.
+     *
+     * @return When the source was registered, it returns 0. Otherwise -1.
+     */
+    int remove( int t_fd );
+
+    /** @brief Run event loop until \ref stop is called or until no source is registered.
+     *
+     * @return When the loop was stopped, it returns 0. When epoll failed -1.
+     */
+    int run();
+
+    /** @brief Request to stop \ref run, it can be called from callback or from any thread. */
+    void stop();
+
+    /** @brief Statistics of reactor. */
+    const ReactorStats &getStats() const { return m_stats; }
+
+protected:
+
+    /// Registered event source
+    struct ReactorSource
+    {
+        int fd;                         ///< File descriptor
+        int type;                       ///< Type of source, see \ref reactorAdd
+        ReactorCallback callback;       ///< Callback of source
+        bool removed;                   ///< Source was removed during dispatching
+    };
+
+    /** @brief Register source of given type. */
+    int reactorAdd( int t_fd, int t_type, ReactorCallback &t_callback, unsigned t_events );
+
+    int m_epoll_fd;                     ///< Epoll instance
+    int m_wakeup_fd;                    ///< Eventfd waking up loop on stop request
+    std::atomic< bool > m_stop;         ///< Request to stop loop
+    bool m_dispatching;                 ///< Callbacks are being called, removed sources are deleted later
+    std::vector< ReactorSource * > m_sources; ///< Registered sources
+    ReactorStats m_stats;               ///< Statistics
+
+};
+
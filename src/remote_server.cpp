@@ -0,0 +1,550 @@
+/**
+ * @file remote_server.cpp
+ * @brief Module remote_server
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/param.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "simConst.h"
+#include "latency.h"
+#include "copsim_car.h"
+#include "remote_server.h"
+
+
+/// Read int from unaligned position of message
+static inline int remoteGetInt( const unsigned char *t_ptr )
+{
+    int l_value;
+    memcpy( &l_value, t_ptr, sizeof( l_value ) );
+    return l_value;
+}
+
+
+/// Write int to unaligned position of message
+static inline void remotePutInt( unsigned char *t_ptr, int t_value )
+{
+    memcpy( t_ptr, &t_value, sizeof( t_value ) );
+}
+
+
+/// Write unsigned short to unaligned position of message
+static inline void remotePutShort( unsigned char *t_ptr, unsigned short t_value )
+{
+    memcpy( t_ptr, &t_value, sizeof( t_value ) );
+}
+
+
+/// Append int to message
+static inline void remoteAppendInt( std::vector< unsigned char > &t_msg, int t_value )
+{
+    t_msg.resize( t_msg.size() + sizeof( t_value ) );
+    remotePutInt( &t_msg[ t_msg.size() - sizeof( t_value ) ], t_value );
+}
+
+
+/// Append floats to message
+static inline void remoteAppendFloats( std::vector< unsigned char > &t_msg, const float *t_values, int t_count )
+{
+    const unsigned char *l_bytes = ( const unsigned char * ) t_values;
+    t_msg.insert( t_msg.end(), l_bytes, l_bytes + t_count * sizeof( float ) );
+}
+
+
+/// Receive exactly t_len bytes
+static int remoteReadFull( int t_fd, void *t_buf, int t_len )
+{
+    int l_done = 0;
+    while ( l_done < t_len )
+    {
+        int l_ret = recv( t_fd, ( char * ) t_buf + l_done, t_len - l_done, MSG_WAITALL );
+        if ( l_ret <= 0 ) return -1;
+        l_done += l_ret;
+    }
+    return 0;
+}
+
+
+RemoteApiServer::RemoteApiServer( Car &t_car, int t_step_ms ) : m_car( t_car )
+{
+    m_step_ns = t_step_ms * 1000000LL;
+    m_listen_fd = -1;
+    m_stop = false;
+    m_synchronous = false;
+    m_last_step_ns = 0;
+    m_frame_seq = 0;
+    memset( m_image, 0, sizeof( m_image ) );
+    memset( &m_snapshot, 0, sizeof( m_snapshot ) );
+    m_snapshot_valid = false;
+    m_l_velocity = m_r_velocity = 0;
+    m_l_force = m_r_force = 0;
+    memset( &m_stats, 0, sizeof( m_stats ) );
+}
+
+
+RemoteApiServer::~RemoteApiServer()
+{
+    close();
+}
+
+
+int RemoteApiServer::open( int t_port )
+{
+    close();
+
+    m_listen_fd = socket( AF_INET, SOCK_STREAM, 0 );
+    if ( m_listen_fd < 0 )
+    {
+        fprintf( stderr, "Unable to create socket!\n" );
+        return -1;
+    }
+
+    int l_opt = 1;
+    setsockopt( m_listen_fd, SOL_SOCKET, SO_REUSEADDR, &l_opt, sizeof( l_opt ) );
+
+    sockaddr_in l_addr;
+    memset( &l_addr, 0, sizeof( l_addr ) );
+    l_addr.sin_family = AF_INET;
+    l_addr.sin_port = htons( t_port );
+    l_addr.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+
+    if ( bind( m_listen_fd, ( sockaddr * ) &l_addr, sizeof( l_addr ) ) < 0 || listen( m_listen_fd, 1 ) < 0 )
+    {
+        fprintf( stderr, "Unable to listen on port %d!\n", t_port );
+        close();
+        return -1;
+    }
+
+    return 0;
+}
+
+
+void RemoteApiServer::close()
+{
+    if ( m_listen_fd >= 0 ) ::close( m_listen_fd );
+    m_listen_fd = -1;
+}
+
+
+int RemoteApiServer::run()
+{
+    if ( m_listen_fd < 0 ) return -1;
+
+    while ( !m_stop )
+    {
+        // the stop request is checked periodically
+        pollfd l_pfd = { m_listen_fd, POLLIN, 0 };
+        int l_ret = poll( &l_pfd, 1, REMOTE_POLL_MS );
+        if ( l_ret < 0 ) return -1;
+        if ( l_ret == 0 ) continue;
+
+        int l_fd = accept( m_listen_fd, nullptr, nullptr );
+        if ( l_fd < 0 ) continue;
+
+        // short messages are sent immediately
+        int l_opt = 1;
+        setsockopt( l_fd, IPPROTO_TCP, TCP_NODELAY, &l_opt, sizeof( l_opt ) );
+
+        m_stats.connections++;
+        remoteServe( l_fd );
+        ::close( l_fd );
+    }
+
+    return 0;
+}
+
+
+void RemoteApiServer::remoteServe( int t_fd )
+{
+    // every client starts in the asynchronous mode without streams
+    m_synchronous = false;
+    m_streams.clear();
+    m_last_step_ns = latencyNow();
+
+    std::vector< unsigned char > l_in, l_out;
+    while ( !m_stop )
+    {
+        int l_ret = remoteReceive( t_fd, l_in );
+        if ( l_ret < 0 ) break;
+        if ( l_ret == 0 ) continue;
+
+        remoteProcess( l_in, l_out );
+
+        if ( remoteSend( t_fd, l_out ) < 0 ) break;
+    }
+}
+
+
+int RemoteApiServer::remoteReceive( int t_fd, std::vector< unsigned char > &t_msg )
+{
+    pollfd l_pfd = { t_fd, POLLIN, 0 };
+    int l_ret = poll( &l_pfd, 1, REMOTE_POLL_MS );
+    if ( l_ret < 0 ) return -1;
+    if ( l_ret == 0 ) return 0;
+
+    // the message can be split to more packets
+    t_msg.clear();
+    while ( true )
+    {
+        short l_header[ REMOTE_SOCKET_HEADER_SIZE / sizeof( short ) ];
+        if ( remoteReadFull( t_fd, l_header, sizeof( l_header ) ) < 0 ) return -1;
+
+        int l_size = ( unsigned short ) l_header[ 1 ];
+        int l_offset = t_msg.size();
+        t_msg.resize( l_offset + l_size );
+        if ( l_size && remoteReadFull( t_fd, &t_msg[ l_offset ], l_size ) < 0 ) return -1;
+        m_stats.bytes_in += sizeof( l_header ) + l_size;
+
+        if ( l_header[ 2 ] <= 0 ) break;
+    }
+
+    m_stats.messages++;
+
+    return 1;
+}
+
+
+int RemoteApiServer::remoteSend( int t_fd, const std::vector< unsigned char > &t_msg )
+{
+    const int l_max_data = REMOTE_SOCKET_MAX_PACKET - REMOTE_SOCKET_HEADER_SIZE;
+    int l_packets = MAX( ( ( int ) t_msg.size() + l_max_data - 1 ) / l_max_data, 1 );
+
+    unsigned char l_packet[ REMOTE_SOCKET_MAX_PACKET ];
+    for ( int i = 0; i < l_packets; i++ )
+    {
+        int l_size = MIN( ( int ) t_msg.size() - i * l_max_data, l_max_data );
+        short l_header[ REMOTE_SOCKET_HEADER_SIZE / sizeof( short ) ] = { 1, ( short ) l_size, ( short ) ( l_packets - i - 1 ) };
+        memcpy( l_packet, l_header, sizeof( l_header ) );
+        memcpy( l_packet + REMOTE_SOCKET_HEADER_SIZE, t_msg.data() + i * l_max_data, l_size );
+
+        int l_len = REMOTE_SOCKET_HEADER_SIZE + l_size;
+        if ( send( t_fd, l_packet, l_len, MSG_NOSIGNAL ) != l_len ) return -1;
+        m_stats.bytes_out += l_len;
+    }
+
+    return 0;
+}
+
+
+void RemoteApiServer::remoteProcess( const std::vector< unsigned char > &t_in, std::vector< unsigned char > &t_out )
+{
+    t_out.assign( SIMX_HEADER_SIZE, 0 );
+
+    // all commands of message, every command starts by its size
+    int l_offset = SIMX_HEADER_SIZE;
+    while ( l_offset + SIMX_SUBHEADER_SIZE <= ( int ) t_in.size() )
+    {
+        const unsigned char *l_cmd = &t_in[ l_offset ];
+        int l_size = remoteGetInt( l_cmd + simx_cmdheaderoffset_mem_size );
+        if ( l_size < SIMX_SUBHEADER_SIZE || l_offset + l_size > ( int ) t_in.size() ) break;
+
+        remoteCommand( l_cmd, l_size, t_out );
+        l_offset += l_size;
+    }
+
+    // the simulation runs in real time in the asynchronous mode
+    if ( !m_synchronous )
+    {
+        long long l_now_ns = latencyNow();
+        for ( int i = 0; i < REMOTE_MAX_CATCHUP_STEPS && l_now_ns - m_last_step_ns >= m_step_ns; i++ )
+        {
+            remoteStep();
+            m_last_step_ns += m_step_ns;
+        }
+        if ( l_now_ns - m_last_step_ns >= m_step_ns ) m_last_step_ns = l_now_ns;
+    }
+
+    // the streamed commands are answered once after every step
+    for ( RemoteStream &l_stream : m_streams )
+    {
+        if ( l_stream.sent_seq == m_frame_seq ) continue;
+        l_stream.sent_seq = m_frame_seq;
+        remoteExecute( l_stream.cmd, l_stream.arg, nullptr, 0, t_out );
+        m_stats.streamed++;
+    }
+
+    // the header of reply, the client finds its message by id and time
+    if ( t_in.size() >= SIMX_HEADER_SIZE )
+    {
+        t_out[ simx_headeroffset_version ] = t_in[ simx_headeroffset_version ];
+        memcpy( &t_out[ simx_headeroffset_message_id ], &t_in[ simx_headeroffset_message_id ], sizeof( int ) );
+        memcpy( &t_out[ simx_headeroffset_client_time ], &t_in[ simx_headeroffset_client_time ], sizeof( int ) );
+    }
+    // simxGetLastCmdTime of client reads this field, it has to be the simulation time of the last step
+    remotePutInt( &t_out[ simx_headeroffset_server_time ], ( int ) ( m_car.getSimTime() * 1000 + 0.5 ) );
+    remotePutShort( &t_out[ simx_headeroffset_scene_id ], 1 );
+    t_out[ simx_headeroffset_server_state ] = 1; // simulation is running
+
+    unsigned short l_crc = 0;
+    for ( int i = simx_headeroffset_version; i < ( int ) t_out.size(); i++ )
+        l_crc += t_out[ i ];
+    remotePutShort( &t_out[ simx_headeroffset_crc ], l_crc );
+}
+
+
+void RemoteApiServer::remoteCommand( const unsigned char *t_cmd, int t_size, std::vector< unsigned char > &t_out )
+{
+    m_stats.commands++;
+
+    int l_cmd = remoteGetInt( t_cmd + simx_cmdheaderoffset_cmd );
+    int l_opmode = l_cmd & ~simx_cmdmask;
+
+    // the argument (handle or name) is between subheader and pure data
+    unsigned short l_pdata;
+    memcpy( &l_pdata, t_cmd + simx_cmdheaderoffset_pdata_offset0, sizeof( l_pdata ) );
+    int l_pdata_offset = MIN( MAX( ( int ) l_pdata, SIMX_SUBHEADER_SIZE ), t_size );
+    std::string l_arg( ( const char * ) t_cmd + SIMX_SUBHEADER_SIZE, l_pdata_offset - SIMX_SUBHEADER_SIZE );
+
+    // the streams are identified by command and argument
+    if ( l_opmode == simx_opmode_streaming || l_opmode == simx_opmode_discontinue )
+    {
+        for ( int i = 0; i < ( int ) m_streams.size(); i++ )
+            if ( ( m_streams[ i ].cmd & simx_cmdmask ) == ( l_cmd & simx_cmdmask ) && m_streams[ i ].arg == l_arg )
+            {
+                m_streams.erase( m_streams.begin() + i );
+                break;
+            }
+
+        // the first value is sent in this reply
+        if ( l_opmode == simx_opmode_streaming )
+            m_streams.push_back( RemoteStream{ l_cmd, l_arg, ~0UL } );
+        return;
+    }
+
+    remoteExecute( l_cmd, l_arg, t_cmd + l_pdata_offset, t_size - l_pdata_offset, t_out );
+}
+
+
+void RemoteApiServer::remoteExecute( int t_cmd, const std::string &t_arg, const unsigned char *t_data, int t_data_len,
+        std::vector< unsigned char > &t_out )
+{
+    // the reply has the same subheader and argument as the command
+    int l_start = t_out.size();
+    t_out.resize( l_start + SIMX_SUBHEADER_SIZE );
+    t_out.insert( t_out.end(), t_arg.begin(), t_arg.end() );
+    int l_pdata_offset = t_out.size() - l_start;
+    unsigned char l_status = 0;
+
+    int l_handle = t_arg.size() >= sizeof( int ) ? remoteGetInt( ( const unsigned char * ) t_arg.data() ) : 0;
+    float l_value = 0;
+    if ( t_data_len >= ( int ) sizeof( float ) ) memcpy( &l_value, t_data, sizeof( float ) );
+
+    switch ( t_cmd & simx_cmdmask )
+    {
+        case simx_cmd_get_object_handle:
+        {
+            std::string l_name( t_arg.c_str() );
+            if ( l_name == COPPSIM_OBJNAME_LEFT_MOTOR ) remoteAppendInt( t_out, REMOTE_HANDLE_LEFT_MOTOR );
+            else if ( l_name == COPPSIM_OBJNAME_RIGHT_MOTOR ) remoteAppendInt( t_out, REMOTE_HANDLE_RIGHT_MOTOR );
+            else if ( l_name == COPPSIM_OBJNAME_SERVO ) remoteAppendInt( t_out, REMOTE_HANDLE_SERVO );
+            else if ( l_name == COPPSIM_OBJNAME_VISION_SENSOR ) remoteAppendInt( t_out, REMOTE_HANDLE_VISION_SENSOR );
+            else if ( l_name == COPPSIM_OBJNAME_BODY ) remoteAppendInt( t_out, REMOTE_HANDLE_BODY );
+            else l_status = REMOTE_STATUS_ERROR;
+            break;
+        }
+
+        case simx_cmd_get_vision_sensor_image_bw:
+            if ( l_handle != REMOTE_HANDLE_VISION_SENSOR )
+            {
+                l_status = REMOTE_STATUS_ERROR;
+                break;
+            }
+            remoteAppendInt( t_out, CAR_CAM_RESOLUTION );
+            remoteAppendInt( t_out, 1 );
+            t_out.insert( t_out.end(), m_image, m_image + CAR_CAM_RESOLUTION );
+            break;
+
+        case simx_cmd_set_joint_target_velocity:
+        case simx_cmd_set_joint_force:
+        case simx_cmd_set_joint_target_position:
+            if ( l_handle < REMOTE_HANDLE_LEFT_MOTOR || l_handle > REMOTE_HANDLE_SERVO )
+                l_status = REMOTE_STATUS_ERROR;
+            else
+                remoteJoint( t_cmd & simx_cmdmask, l_handle, l_value );
+            break;
+
+        case simx_cmd_get_object_position:
+        case simx_cmd_get_object_orientation:
+        case simx_cmd_get_object_velocity:
+        case simx_cmd_get_joint_position:
+            if ( remoteGetPose( t_cmd & simx_cmdmask, l_handle, t_out ) < 0 ) l_status = REMOTE_STATUS_ERROR;
+            break;
+
+        case simx_cmd_set_object_position:
+        case simx_cmd_set_object_orientation:
+        case simx_cmd_set_joint_position:
+            if ( remoteSetPose( t_cmd & simx_cmdmask, l_handle, t_data, t_data_len ) < 0 ) l_status = REMOTE_STATUS_ERROR;
+            break;
+
+        case simx_cmd_call_script_function:
+        {
+            // only the restart function of Board script is known
+            std::string l_call = t_arg + std::string( ( const char * ) t_data, MAX( t_data_len, 0 ) );
+            if ( l_call.find( "restart" ) == std::string::npos )
+            {
+                l_status = REMOTE_STATUS_ERROR;
+                break;
+            }
+            m_car.resetCar();
+            m_l_velocity = m_r_velocity = 0;
+            m_l_force = m_r_force = 0;
+            // no output integers, floats, strings and buffer
+            for ( int i = 0; i < 4; i++ ) remoteAppendInt( t_out, 0 );
+            break;
+        }
+
+        case simx_cmd_synchronous_enable:
+            m_synchronous = true;
+            break;
+
+        case simx_cmd_synchronous_disable:
+            m_synchronous = false;
+            m_last_step_ns = latencyNow();
+            break;
+
+        case simx_cmd_synchronous_next:
+            if ( m_synchronous ) remoteStep();
+            else l_status = REMOTE_STATUS_ERROR;
+            break;
+
+        case simx_cmd_get_integer_parameter:
+            remoteAppendInt( t_out, REMOTE_PROGRAM_VERSION );
+            break;
+
+        default:
+            break;
+    }
+
+    // complete subheader
+    unsigned char *l_sub = &t_out[ l_start ];
+    int l_size = t_out.size() - l_start;
+    remotePutInt( l_sub + simx_cmdheaderoffset_mem_size, l_size );
+    remotePutInt( l_sub + simx_cmdheaderoffset_full_mem_size, l_size );
+    remotePutShort( l_sub + simx_cmdheaderoffset_pdata_offset0, l_pdata_offset );
+    remotePutInt( l_sub + simx_cmdheaderoffset_pdata_offset1, 0 );
+    remotePutInt( l_sub + simx_cmdheaderoffset_cmd, t_cmd );
+    remotePutShort( l_sub + simx_cmdheaderoffset_delay_or_split, 0 );
+    remotePutInt( l_sub + simx_cmdheaderoffset_sim_time, ( int ) ( m_car.getSimTime() * 1000 + 0.5 ) );
+    l_sub[ simx_cmdheaderoffset_status ] = l_status;
+    l_sub[ simx_cmdheaderoffset_reserved ] = 0;
+}
+
+
+void RemoteApiServer::remoteJoint( int t_cmd_id, int t_handle, float t_value )
+{
+    if ( t_handle == REMOTE_HANDLE_SERVO )
+    {
+        if ( t_cmd_id == simx_cmd_set_joint_target_position )
+            m_car.setServo( t_value / CAR_5TH_WHEEL_ANGLE_RAD );
+        return;
+    }
+
+    bool l_left = t_handle == REMOTE_HANDLE_LEFT_MOTOR;
+    if ( t_cmd_id == simx_cmd_set_joint_target_velocity )
+        ( l_left ? m_l_velocity : m_r_velocity ) = t_value;
+    else if ( t_cmd_id == simx_cmd_set_joint_force )
+        ( l_left ? m_l_force : m_r_force ) = t_value;
+    else
+        return;
+
+    // the direction is given by velocity and the power by force, the right motor rotates in opposite direction
+    float l_l_pwm = ( m_l_velocity < 0 ? -m_l_force : m_l_force ) / CAR_MAX_TORQUE_N_M;
+    float l_r_pwm = ( m_r_velocity < 0 ? m_r_force : -m_r_force ) / CAR_MAX_TORQUE_N_M;
+    m_car.setMotorPWM( l_l_pwm, l_r_pwm );
+}
+
+
+int RemoteApiServer::remoteGetPose( int t_cmd_id, int t_handle, std::vector< unsigned char > &t_out )
+{
+    if ( !m_snapshot_valid ) return -1;
+
+    const CarPose &l_pose = m_snapshot.pose;
+    if ( t_handle == REMOTE_HANDLE_BODY && t_cmd_id == simx_cmd_get_object_position )
+    {
+        float l_values[ 3 ] = { l_pose.x, l_pose.y, l_pose.z };
+        remoteAppendFloats( t_out, l_values, 3 );
+    }
+    else if ( t_handle == REMOTE_HANDLE_BODY && t_cmd_id == simx_cmd_get_object_orientation )
+    {
+        float l_values[ 3 ] = { l_pose.roll, l_pose.pitch, l_pose.yaw };
+        remoteAppendFloats( t_out, l_values, 3 );
+    }
+    else if ( t_handle == REMOTE_HANDLE_BODY && t_cmd_id == simx_cmd_get_object_velocity )
+    {
+        // linear and angular velocity
+        float l_values[ 6 ] = { l_pose.vx, l_pose.vy, l_pose.vz, 0, 0, l_pose.yaw_rate };
+        remoteAppendFloats( t_out, l_values, 6 );
+    }
+    else if ( t_cmd_id == simx_cmd_get_joint_position && t_handle >= REMOTE_HANDLE_LEFT_MOTOR && t_handle <= REMOTE_HANDLE_SERVO )
+    {
+        // the right motor rotates in opposite direction
+        float l_value = t_handle == REMOTE_HANDLE_LEFT_MOTOR ? l_pose.l_wheel
+                : t_handle == REMOTE_HANDLE_RIGHT_MOTOR ? -l_pose.r_wheel : m_snapshot.steer;
+        remoteAppendFloats( t_out, &l_value, 1 );
+    }
+    else
+        return -1;
+
+    return 0;
+}
+
+
+int RemoteApiServer::remoteSetPose( int t_cmd_id, int t_handle, const unsigned char *t_data, int t_data_len )
+{
+    // the current state includes the last commands, the streamed pose is refreshed by the next step
+    CarSnapshot l_snapshot;
+    if ( m_car.saveSnapshot( l_snapshot ) < 0 ) return -1;
+
+    if ( t_cmd_id == simx_cmd_set_object_position || t_cmd_id == simx_cmd_set_object_orientation )
+    {
+        // the handle of relative object and three values
+        float l_values[ 3 ];
+        if ( t_handle != REMOTE_HANDLE_BODY || t_data_len < ( int ) ( sizeof( int ) + sizeof( l_values ) ) ) return -1;
+        memcpy( l_values, t_data + sizeof( int ), sizeof( l_values ) );
+
+        CarPose &l_pose = l_snapshot.pose;
+        if ( t_cmd_id == simx_cmd_set_object_position )
+        {
+            l_pose.x = l_values[ 0 ];
+            l_pose.y = l_values[ 1 ];
+            l_pose.z = l_values[ 2 ];
+        }
+        else
+        {
+            l_pose.roll = l_values[ 0 ];
+            l_pose.pitch = l_values[ 1 ];
+            l_pose.yaw = l_values[ 2 ];
+        }
+    }
+    else
+    {
+        float l_value;
+        if ( t_data_len < ( int ) sizeof( l_value ) ) return -1;
+        memcpy( &l_value, t_data, sizeof( l_value ) );
+
+        if ( t_handle == REMOTE_HANDLE_LEFT_MOTOR ) l_snapshot.pose.l_wheel = l_value;
+        else if ( t_handle == REMOTE_HANDLE_RIGHT_MOTOR ) l_snapshot.pose.r_wheel = -l_value;
+        else if ( t_handle == REMOTE_HANDLE_SERVO ) l_snapshot.steer = l_value;
+        else return -1;
+    }
+
+    return m_car.restoreSnapshot( l_snapshot ) < 0 ? -1 : 0;
+}
+
+
+void RemoteApiServer::remoteStep()
+{
+    m_car.getImage( m_image );
+    m_snapshot_valid = m_car.saveSnapshot( m_snapshot ) == 0;
+    m_frame_seq++;
+    m_stats.steps++;
+}
+
@@ -0,0 +1,180 @@
+#pragma once
+
+/**
+ * @file remote_server.h
+ * @brief Module remote_server
+ *
+ * This module remote_server is a local stand-in for CoppeliaSim. It speaks the subset
+ * of the legacy Remote API protocol used by \ref CoppeliaSimCar, so the real client code path
+ * can be tested and benchmarked without CoppeliaSim and without display.
+ * The simulation itself is done by any \ref Car implementation, typically \ref HeadlessCar.
+ *
+ * The protocol messages are in the byte order of the host (little-endian), as in CoppeliaSim.
+ * The header layouts and command codes are taken from simConst.h of CoppeliaSim.
+ */
+
+#include <atomic>
+#include <vector>
+#include <string>
+
+#include "car.h"
+
+/// Length of header of every socket packet: 1, packet size, number of following packets (3 x short)
+#define REMOTE_SOCKET_HEADER_SIZE       6
+/// Maximal length of socket packet including header
+#define REMOTE_SOCKET_MAX_PACKET        1300
+/// Period of checking stop request while waiting for client
+#define REMOTE_POLL_MS                  100
+/// Default period of simulation step in the asynchronous mode
+#define REMOTE_DEFAULT_STEP_MS          10
+/// Maximal number of steps performed at once, when the server is late
+#define REMOTE_MAX_CATCHUP_STEPS        10
+/// Version of simulator reported to client (simxGetPingTime asks for it)
+#define REMOTE_PROGRAM_VERSION          40000
+/// Error flag in command status
+#define REMOTE_STATUS_ERROR             1
+
+/// Object handles of simulated scene
+/// @name
+/// @{
+#define REMOTE_HANDLE_LEFT_MOTOR        1
+#define REMOTE_HANDLE_RIGHT_MOTOR       2
+#define REMOTE_HANDLE_SERVO             3
+#define REMOTE_HANDLE_VISION_SENSOR     4
+#define REMOTE_HANDLE_BODY              5
+/// @}
+
+/// Statistics of \ref RemoteApiServer.
+struct RemoteServerStats
+{
+    unsigned long connections;          ///< Number of accepted clients.
+    unsigned long messages;             ///< Number of received messages.
+    unsigned long commands;             ///< Number of received commands.
+    unsigned long streamed;             ///< Number of streamed replies.
+    unsigned long steps;                ///< Number of simulation steps.
+    unsigned long bytes_in;             ///< Received bytes.
+    unsigned long bytes_out;            ///< Sent bytes.
+};
+
+/**
+ * @brief The server of legacy Remote API backed by a car model.
+ *
+ * It serves one client at a time. The client must use the names of objects from CoppeliaSim
+ * scene (\ref COPPSIM_OBJNAME_LEFT_MOTOR etc.) and it can use:
+ *   - simxGetObjectHandle,
+ *   - simxGetVisionSensorImage in greyscale mode, also streamed,
+ *   - simxSetJointTargetVelocity, simxSetJointForce and simxSetJointTargetPosition,
+ *   - simxGetObjectPosition, simxGetObjectOrientation and simxGetObjectVelocity of body
+ *     \ref COPPSIM_OBJNAME_BODY and simxGetJointPosition of joints, also streamed (\ref Car::saveSnapshot),
+ *   - simxSetObjectPosition, simxSetObjectOrientation and simxSetJointPosition (\ref Car::restoreSnapshot),
+ *   - simxCallScriptFunction of script restart (\ref Car::resetCar),
+ *   - simxSynchronous, simxSynchronousTrigger and simxGetPingTime.
+ *
+ * Other commands are answered without data. In the asynchronous mode the car performs
+ * a step every step period, in the synchronous mode after every trigger.
+ */
+class RemoteApiServer
+{
+public:
+
+    /** @brief Constructor of server.
+     *
+     * @param t_car The simulated car, it must exist during the whole life of server.
+     * @param t_step_ms Period of simulation step in the asynchronous mode, it should match the step of car.
+     */
+    RemoteApiServer( Car &t_car, int t_step_ms = REMOTE_DEFAULT_STEP_MS );
+    /** Destructor */
+    virtual ~RemoteApiServer();
+
+    /** @brief Open listening socket on localhost.
+     *
+     * @return When the port is opened, it returns 0. Otherwise -1.
+     */
+    int open( int t_port );
+
+    /** @brief Close listening socket. */
+    void close();
+
+    /** @brief Serve clients until \ref stop is called.
+     *
+     * @return When the server was stopped, it returns 0. When the socket failed -1.
+     */
+    int run();
+
+    /** @brief Request to stop \ref run, it can be called from any thread. */
+    void stop() { m_stop = true; }
+
+    /** @brief Statistics of server. */
+    const RemoteServerStats &getStats() const { return m_stats; }
+
+protected:
+
+    /// The command with streaming operation mode, it is answered after every step
+    struct RemoteStream
+    {
+        int cmd;                        ///< Command with operation mode
+        std::string arg;                ///< Argument of command (handle or name)
+        unsigned long sent_seq;         ///< The last step sent to client
+    };
+
+    /** @brief Serve single connected client. */
+    void remoteServe( int t_fd );
+
+    /** @brief Receive one message from client.
+     *
+     * @return When the message was received it returns 1, on timeout 0, when the client disconnected -1.
+     */
+    int remoteReceive( int t_fd, std::vector< unsigned char > &t_msg );
+
+    /** @brief Send message to client split to socket packets. */
+    int remoteSend( int t_fd, const std::vector< unsigned char > &t_msg );
+
+    /** @brief Process all commands of message and create reply. */
+    void remoteProcess( const std::vector< unsigned char > &t_in, std::vector< unsigned char > &t_out );
+
+    /** @brief Process single command. */
+    void remoteCommand( const unsigned char *t_cmd, int t_size, std::vector< unsigned char > &t_out );
+
+    /** @brief Execute command and append its reply. */
+    void remoteExecute( int t_cmd, const std::string &t_arg, const unsigned char *t_data, int t_data_len,
+            std::vector< unsigned char > &t_out );
+
+    /** @brief Set joint of car. */
+    void remoteJoint( int t_cmd_id, int t_handle, float t_value );
+
+    /** @brief Append the pose of body or the position of joint from the last step.
+     *
+     * @return When the object has the value, it returns 0. Otherwise -1.
+     */
+    int remoteGetPose( int t_cmd_id, int t_handle, std::vector< unsigned char > &t_out );
+
+    /** @brief Move body or joint by restoring the current state of car with the changed value.
+     *
+     * @return When the object can be moved, it returns 0. Otherwise -1.
+     */
+    int remoteSetPose( int t_cmd_id, int t_handle, const unsigned char *t_data, int t_data_len );
+
+    /** @brief Perform one simulation step. */
+    void remoteStep();
+
+    Car &m_car;                         ///< Simulated car
+    long long m_step_ns;                ///< Period of step in the asynchronous mode
+    int m_listen_fd;                    ///< Listening socket
+    std::atomic< bool > m_stop;         ///< Request to stop server
+
+    bool m_synchronous;                 ///< Synchronous mode enabled by client
+    long long m_last_step_ns;           ///< Time of the last step in the asynchronous mode
+    unsigned long m_frame_seq;          ///< Number of the last step
+    unsigned char m_image[ CAR_CAM_RESOLUTION ]; ///< Image of the last step
+    CarSnapshot m_snapshot;             ///< State of car of the last step, the source of streamed pose
+    bool m_snapshot_valid;              ///< The car has snapshots
+    std::vector< RemoteStream > m_streams; ///< Streamed commands
+    float m_l_velocity;                 ///< Target velocity of left motor
+    float m_l_force;                    ///< Force of left motor
+    float m_r_velocity;                 ///< Target velocity of right motor
+    float m_r_force;                    ///< Force of right motor
+
+    RemoteServerStats m_stats;          ///< Statistics
+
+};
+
@@ -0,0 +1,181 @@
+/**
+ * @file replay.cpp
+ * @brief Module replay
+ *
+ */
+
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "replay.h"
+
+
+ReplayCar::ReplayCar()
+{
+    m_records = nullptr;
+    m_map = nullptr;
+    m_map_size = 0;
+    m_count = 0;
+    m_epsilon = REPLAY_DEFAULT_EPSILON;
+    m_report = nullptr;
+    close();
+}
+
+
+ReplayCar::~ReplayCar()
+{
+    close();
+}
+
+
+int ReplayCar::open( const char *t_file_name )
+{
+    close();
+
+    int l_fd = ::open( t_file_name, O_RDONLY );
+    if ( l_fd < 0 )
+    {
+        fprintf( stderr, "Unable to open telemetry file %s!\n", t_file_name );
+        return -1;
+    }
+
+    struct stat l_stat;
+    if ( fstat( l_fd, &l_stat ) < 0 || l_stat.st_size < TELEMETRY_HEADER_SIZE )
+    {
+        fprintf( stderr, "Invalid telemetry file %s!\n", t_file_name );
+        ::close( l_fd );
+        return -1;
+    }
+
+    void *l_map = mmap( nullptr, l_stat.st_size, PROT_READ, MAP_PRIVATE, l_fd, 0 );
+    ::close( l_fd );
+    if ( l_map == MAP_FAILED )
+    {
+        fprintf( stderr, "Unable to map telemetry file %s!\n", t_file_name );
+        return -1;
+    }
+
+    const TelemetryHeader *l_header = ( const TelemetryHeader * ) l_map;
+    if ( l_header->magic != TELEMETRY_MAGIC || l_header->version != TELEMETRY_VERSION
+            || l_header->record_size != sizeof( TelemetryRecord ) || l_header->resolution != CAR_CAM_RESOLUTION )
+    {
+        fprintf( stderr, "Invalid telemetry file %s!\n", t_file_name );
+        munmap( l_map, l_stat.st_size );
+        return -1;
+    }
+
+    m_map = l_map;
+    m_map_size = l_stat.st_size;
+    m_records = ( const TelemetryRecord * ) ( ( const char * ) l_map + TELEMETRY_HEADER_SIZE );
+
+    // the file of interrupted recording can be longer than valid records
+    m_count = MIN( l_header->count, ( m_map_size - TELEMETRY_HEADER_SIZE ) / sizeof( TelemetryRecord ) );
+
+    madvise( m_map, m_map_size, MADV_SEQUENTIAL );
+
+    return 0;
+}
+
+
+void ReplayCar::close()
+{
+    if ( m_map ) munmap( m_map, m_map_size );
+
+    m_map = nullptr;
+    m_records = nullptr;
+    m_map_size = 0;
+    m_count = 0;
+    m_frame = -1;
+    m_compared = true;
+    m_servo = 0;
+    m_l_pwm = 0;
+    m_r_pwm = 0;
+    memset( &m_stats, 0, sizeof( m_stats ) );
+    m_stats.first_diverged = -1;
+}
+
+
+int ReplayCar::getImage( unsigned char *t_img )
+{
+    // the commands of previous image are complete now
+    if ( !m_compared ) replayCompare();
+
+    if ( m_frame + 1 >= ( long ) m_count ) return -1;
+
+    m_frame++;
+    m_compared = false;
+
+    if ( t_img )
+        memcpy( t_img, m_records[ m_frame ].image, CAR_CAM_RESOLUTION );
+
+    return 0;
+}
+
+
+void ReplayCar::setServo( float t_position )
+{
+    m_servo = MIN( MAX( t_position, -1.0 ), 1.0 );
+}
+
+
+void ReplayCar::setMotorPWM( float t_l_pwm, float t_r_pwm )
+{
+    m_l_pwm = MIN( MAX( t_l_pwm, -1.0 ), 1.0 );
+    m_r_pwm = MIN( MAX( t_r_pwm, -1.0 ), 1.0 );
+}
+
+
+void ReplayCar::resetCar()
+{
+    m_servo = 0;
+    m_l_pwm = 0;
+    m_r_pwm = 0;
+}
+
+
+double ReplayCar::getSimTime()
+{
+    return m_frame >= 0 ? m_records[ m_frame ].sim_time : 0;
+}
+
+
+void ReplayCar::finish()
+{
+    if ( !m_compared ) replayCompare();
+}
+
+
+void ReplayCar::replayCompare()
+{
+    const TelemetryRecord &l_rec = m_records[ m_frame ];
+    m_compared = true;
+
+    if ( l_rec.flags & TELEMETRY_FLAG_RESET )
+    {
+        m_stats.resets++;
+        return;
+    }
+
+    double l_servo_diff = fabs( m_servo - l_rec.servo );
+    double l_pwm_diff = MAX( fabs( m_l_pwm - l_rec.l_pwm ), fabs( m_r_pwm - l_rec.r_pwm ) );
+
+    m_stats.frames++;
+    m_stats.max_servo_diff = MAX( m_stats.max_servo_diff, l_servo_diff );
+    m_stats.max_pwm_diff = MAX( m_stats.max_pwm_diff, l_pwm_diff );
+    m_stats.avg_servo_diff += ( l_servo_diff - m_stats.avg_servo_diff ) / m_stats.frames;
+    m_stats.avg_pwm_diff += ( l_pwm_diff - m_stats.avg_pwm_diff ) / m_stats.frames;
+
+    if ( l_servo_diff <= m_epsilon && l_pwm_diff <= m_epsilon ) return;
+
+    m_stats.diverged++;
+    if ( m_stats.first_diverged < 0 ) m_stats.first_diverged = m_frame;
+
+    if ( m_report )
+        fprintf( m_report, "frame %ld: servo %.4f (recorded %.4f), pwm %.4f %.4f (recorded %.4f %.4f)\n",
+                m_frame, m_servo, l_rec.servo, m_l_pwm, m_r_pwm, l_rec.l_pwm, l_rec.r_pwm );
+}
+
@@ -0,0 +1,107 @@
+#pragma once
+
+/**
+ * @file replay.h
+ * @brief Module replay
+ *
+ * This module replay drives a control program by images recorded by module telemetry.
+ * The images are returned as fast as the control program consumes them
+ * and the new commands are compared with the recorded commands.
+ */
+
+#include <stdio.h>
+
+#include "telemetry.h"
+
+/// Default tolerance of difference between recorded and new commands
+#define REPLAY_DEFAULT_EPSILON          1e-4
+
+/// Statistics of differences between recorded and new commands.
+struct ReplayStats
+{
+    unsigned long frames;               ///< Number of compared frames.
+    unsigned long resets;               ///< Number of frames not compared, because the car was reset after them.
+    unsigned long diverged;             ///< Number of frames with difference above tolerance.
+    long first_diverged;                ///< The first frame with difference above tolerance, -1 for none.
+    double max_servo_diff;              ///< Maximal difference of servo position.
+    double max_pwm_diff;                ///< Maximal difference of motor power.
+    double avg_servo_diff;              ///< Average difference of servo position.
+    double avg_pwm_diff;                ///< Average difference of motor power.
+};
+
+/**
+ * @brief Car replaying recorded telemetry file.
+ *
+ * Every \ref getImage returns next recorded image. The commands set after an image
+ * are compared with the commands recorded after the same image.
+ * The car can not be moved, so \ref resetCar only clears commands.
+ * The commands of frame with \ref TELEMETRY_FLAG_RESET are not compared, they were replaced by reset.
+ * The control program must reset its controller after such frame, see \ref isResetFrame.
+ */
+class ReplayCar : public Car
+{
+public:
+
+    /** Constructor */
+    ReplayCar();
+    /** Destructor closes file. */
+    virtual ~ReplayCar();
+
+    /** @brief Open telemetry file.
+     *
+     * @return When the file is valid, it returns 0. Otherwise -1.
+     */
+    int open( const char *t_file_name );
+
+    /** @brief Close file. */
+    void close();
+
+    /** @brief Return next recorded image.
+     *
+     * @return When the next image was available, it returns 0. At the end of file -1.
+     */
+    int getImage( unsigned char *t_img ) override;
+
+    void setServo( float t_position ) override;
+    void setMotorPWM( float t_l_pwm, float t_r_pwm ) override;
+    void resetCar() override;
+    double getSimTime() override;
+
+    /** @brief The car was reset after the commands of the current frame in the recorded run. */
+    bool isResetFrame() const { return m_frame >= 0 && ( m_records[ m_frame ].flags & TELEMETRY_FLAG_RESET ); }
+
+    /** @brief Compare commands of the last image, must be called after the last control cycle. */
+    void finish();
+
+    /** @brief Set tolerance of differences. */
+    void setEpsilon( double t_epsilon ) { m_epsilon = t_epsilon; }
+
+    /** @brief Print every frame with difference above tolerance to file, nullptr to disable. */
+    void setReport( FILE *t_report ) { m_report = t_report; }
+
+    /** @brief Number of records in file. */
+    unsigned long getCount() const { return m_count; }
+
+    /** @brief Statistics of differences. */
+    const ReplayStats &getStats() const { return m_stats; }
+
+protected:
+
+    /** @brief Compare current commands with the record of current frame. */
+    void replayCompare();
+
+    const TelemetryRecord *m_records;   ///< Mapped records
+    void *m_map;                        ///< Mapped file
+    size_t m_map_size;                  ///< Size of mapped file
+    unsigned long m_count;              ///< Number of records
+    long m_frame;                       ///< The current frame, -1 before the first image
+    bool m_compared;                    ///< Commands of the current frame were compared
+    float m_servo;                      ///< Current servo position
+    float m_l_pwm;                      ///< Current power of left motor
+    float m_r_pwm;                      ///< Current power of right motor
+    double m_epsilon;                   ///< Tolerance of differences
+    FILE *m_report;                     ///< Report of diverged frames
+    ReplayStats m_stats;                ///< Statistics
+
+};
+
@@ -0,0 +1,102 @@
+/**
+ * @file replay_check.cpp
+ * @brief Module replay_check
+ *
+ * This program replays recorded telemetry files to \ref LineController as fast as possible
+ * and it reports frames where the new commands differ from the recorded ones.
+ * It is used for regression test of controller changes without simulator.
+ *
+ * For more information see header files or use doxygen.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "controller.h"
+#include "replay.h"
+
+#define HELP                                                        \
+    "Usage: %s [-h] [-v] [-eps value] file...\n"                    \
+    "  -h               this help\n"                                \
+    "  -v               print every diverged frame\n"               \
+    "  -eps value       tolerance of command difference\n"          \
+    "  file             telemetry file recorded by -record\n\n"
+
+int main( int argc, char* argv[] )
+{
+    int l_verbose = 0;
+    double l_epsilon = REPLAY_DEFAULT_EPSILON;
+    int l_files = 0;
+    int l_diverged = 0;
+
+    for ( int i = 1; i < argc; i++ )
+    {
+        if ( !strcmp( argv[ i ], "-h" ) )
+        {
+            printf( HELP, argv[ 0 ] );
+            exit( 0 );
+        }
+        if ( !strcmp( argv[ i ], "-v" ) )
+        {
+            l_verbose = 1;
+            continue;
+        }
+        if ( !strcmp( argv[ i ], "-eps" ) && i + 1 < argc )
+        {
+            l_epsilon = atof( argv[ ++i ] );
+            continue;
+        }
+
+        ReplayCar l_car;
+        if ( l_car.open( argv[ i ] ) < 0 ) exit( 1 );
+        l_car.setEpsilon( l_epsilon );
+        if ( l_verbose ) l_car.setReport( stdout );
+
+        timespec l_start, l_stop;
+        clock_gettime( CLOCK_MONOTONIC, &l_start );
+
+        // the same control loop as in the recorded run
+        LineController l_controller;
+        unsigned char l_img[ CAR_CAM_RESOLUTION ];
+        while ( l_car.getImage( l_img ) == 0 )
+        {
+            CarCommands l_cmd;
+            l_controller.control( l_img, l_cmd );
+            l_car.setServo( l_cmd.servo );
+            l_car.setMotorPWM( l_cmd.l_pwm, l_cmd.r_pwm );
+
+            // the recorded run reset the car and its controller after this frame
+            if ( l_car.isResetFrame() )
+            {
+                l_car.resetCar();
+                l_controller.reset();
+            }
+        }
+        l_car.finish();
+
+        clock_gettime( CLOCK_MONOTONIC, &l_stop );
+        double l_time = ( l_stop.tv_sec - l_start.tv_sec ) + ( l_stop.tv_nsec - l_start.tv_nsec ) * 1e-9;
+
+        const ReplayStats &l_stats = l_car.getStats();
+        printf( "%s: frames %lu, resets %lu, diverged %lu (first %ld), servo diff max %.4f avg %.4f, pwm diff max %.4f avg %.4f, %.3f s\n",
+                argv[ i ], l_stats.frames, l_stats.resets, l_stats.diverged, l_stats.first_diverged,
+                l_stats.max_servo_diff, l_stats.avg_servo_diff, l_stats.max_pwm_diff, l_stats.avg_pwm_diff, l_time );
+
+        l_files++;
+        if ( l_stats.diverged ) l_diverged++;
+    }
+
+    if ( !l_files )
+    {
+        printf( HELP, argv[ 0 ] );
+        exit( 0 );
+    }
+
+    printf( "Files: %d, diverged: %d\n", l_files, l_diverged );
+
+    return l_diverged ? 1 : 0;
+}
+
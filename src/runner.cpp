@@ -0,0 +1,316 @@
+/**
+ * @file runner.cpp
+ * @brief Module runner
+ *
+ */
+
+#include <math.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/param.h>
+
+#include "copsim_car.h"
+#include "headless_car.h"
+#include "telemetry.h"
+#include "linearchive.h"
+#include "laptimer.h"
+#include "runner.h"
+
+
+/// Current monotonic time in seconds
+static double runnerTime()
+{
+    timespec l_ts;
+    clock_gettime( CLOCK_MONOTONIC, &l_ts );
+    return l_ts.tv_sec + l_ts.tv_nsec * 1e-9;
+}
+
+
+double runnerCost( const RunnerCarStats &t_car, int t_laps, double t_time_limit_s )
+{
+    if ( t_car.error ) return HUGE_VAL;
+
+    double l_cost;
+    int l_laps = MAX( t_laps, 1 );
+    if ( t_car.laps >= l_laps )
+        l_cost = t_car.total_lap_s / t_car.laps;
+    else
+        l_cost = t_time_limit_s * ( 1 + ( double ) ( l_laps - MAX( t_car.laps, 0 ) ) / l_laps );
+
+    return l_cost + RUNNER_CRASH_PENALTY_S * t_car.crashes;
+}
+
+
+int runnerReadTracks( const char *t_file_name, std::vector< std::string > &t_tracks )
+{
+    FILE *l_file = fopen( t_file_name, "r" );
+    if ( !l_file )
+    {
+        fprintf( stderr, "Unable to open %s!\n", t_file_name );
+        return -1;
+    }
+
+    char l_line[ 1024 ];
+    while ( fgets( l_line, sizeof( l_line ), l_file ) )
+    {
+        l_line[ strcspn( l_line, "#\r\n" ) ] = 0;
+        if ( strspn( l_line, " \t" ) == strlen( l_line ) ) continue;
+        t_tracks.push_back( l_line );
+    }
+
+    fclose( l_file );
+    return 0;
+}
+
+
+CarRunner::CarRunner( const RunnerConfig &t_config, RunnerControllerFactory t_factory, void *t_arg )
+{
+    m_config = t_config;
+    m_factory = t_factory;
+    m_factory_arg = t_arg;
+    m_next_car = 0;
+    memset( &m_stats, 0, sizeof( m_stats ) );
+}
+
+
+int CarRunner::run()
+{
+    int l_threads = m_config.threads;
+    if ( l_threads <= 0 ) l_threads = sysconf( _SC_NPROCESSORS_ONLN );
+    l_threads = MAX( MIN( l_threads, m_config.cars ), 1 );
+
+    if ( m_config.port >= 0 && m_config.cars > MAX_EXT_API_CONNECTIONS )
+    {
+        fprintf( stderr, "Too many cars, the limit of connections is %d!\n", MAX_EXT_API_CONNECTIONS );
+        return -1;
+    }
+
+    // the laps are counted only on a closed track
+    if ( m_config.laps )
+        for ( int i = 0; i < m_config.cars; i++ )
+        {
+            const TrackMap *l_track = runnerTrack( i );
+            if ( !l_track )
+            {
+                fprintf( stderr, "Laps need a track!\n" );
+                return -1;
+            }
+            if ( !l_track->isClosed() )
+            {
+                fprintf( stderr, "Car %d: track is not closed (%.2f m), laps will not be finished!\n", i, l_track->getClosureError() );
+                return -1;
+            }
+        }
+
+    m_car_stats.assign( m_config.cars, RunnerCarStats() );
+    memset( m_car_stats.data(), 0, sizeof( RunnerCarStats ) * m_config.cars );
+    m_next_car = 0;
+
+    if ( m_config.metrics && m_metrics.open( m_config.metrics, m_config.cars ) < 0 ) return -1;
+
+    double l_start = runnerTime();
+
+    // every worker takes next car until all cars finish
+    std::vector< pthread_t > l_thread_ids( l_threads );
+    for ( int i = 0; i < l_threads; i++ )
+        pthread_create( &l_thread_ids[ i ], nullptr, runnerThread, this );
+    for ( int i = 0; i < l_threads; i++ )
+        pthread_join( l_thread_ids[ i ], nullptr );
+
+    // aggregate statistics
+    memset( &m_stats, 0, sizeof( m_stats ) );
+    m_stats.cars = m_config.cars;
+    m_stats.wall_time_s = runnerTime() - l_start;
+    double l_lap_time = 0;
+    for ( const RunnerCarStats &l_car : m_car_stats )
+    {
+        if ( l_car.error ) m_stats.failed++;
+        m_stats.cycles += l_car.cycles;
+        m_stats.crashes += l_car.crashes;
+        if ( l_car.laps > 0 )
+        {
+            if ( !m_stats.laps || l_car.best_lap_s < m_stats.best_lap_s ) m_stats.best_lap_s = l_car.best_lap_s;
+            m_stats.laps += l_car.laps;
+            l_lap_time += l_car.total_lap_s;
+        }
+    }
+    if ( m_stats.laps ) m_stats.avg_lap_s = l_lap_time / m_stats.laps;
+    if ( m_stats.wall_time_s > 0 ) m_stats.cycles_per_s = m_stats.cycles / m_stats.wall_time_s;
+
+    m_metrics.close();
+
+    return m_stats.failed ? -1 : 0;
+}
+
+
+void *CarRunner::runnerThread( void *t_arg )
+{
+    CarRunner *l_runner = ( CarRunner * ) t_arg;
+
+    int l_car;
+    while ( ( l_car = l_runner->m_next_car++ ) < l_runner->m_config.cars )
+        l_runner->runnerCar( l_car );
+
+    return nullptr;
+}
+
+
+const TrackMap *CarRunner::runnerTrack( int t_car ) const
+{
+    if ( m_config.tracks && m_config.track_count > 0 ) return m_config.tracks[ t_car % m_config.track_count ];
+    return m_config.track;
+}
+
+
+void CarRunner::runnerCar( int t_car )
+{
+    RunnerCarStats &l_stats = m_car_stats[ t_car ];
+    bool l_headless = m_config.port < 0;
+    const TrackMap *l_track = runnerTrack( t_car );
+    if ( m_config.tracks && m_config.track_count > 0 ) l_stats.track = t_car % m_config.track_count;
+
+    CoppeliaSimCar l_coppsim_car;
+    HeadlessCar l_headless_car( l_track );
+    Car &l_backend_car = l_headless ? ( Car & ) l_headless_car : ( Car & ) l_coppsim_car;
+
+    if ( !l_headless && l_coppsim_car.init( m_config.port + t_car, m_config.synchronous ) < 0 )
+    {
+        fprintf( stderr, "Car %d: CoppeliaSim not connected!\n", t_car );
+        l_stats.error = 1;
+        return;
+    }
+
+    // every car has its own telemetry file or line archive
+    TelemetryRecorder l_recorder;
+    LineArchiveWriter l_archive;
+    if ( m_config.record )
+    {
+        char l_file_name[ 256 ];
+        snprintf( l_file_name, sizeof( l_file_name ), "%s%d.%s", m_config.record, t_car, m_config.archive ? "lsa" : "tel" );
+        if ( ( m_config.archive ? l_archive.open( l_file_name ) : l_recorder.open( l_file_name ) ) < 0 )
+        {
+            l_stats.error = 1;
+            return;
+        }
+    }
+    RecordingCar l_recording_car( l_backend_car, m_config.archive ? ( TelemetrySink & ) l_archive : ( TelemetrySink & ) l_recorder );
+    Car &l_recorded_car = m_config.record ? ( Car & ) l_recording_car : l_backend_car;
+    MeteredCar l_metered_car( l_recorded_car, m_metrics.getSlot( t_car ) );
+    Car &l_car = m_config.metrics ? ( Car & ) l_metered_car : l_recorded_car;
+
+    CarController *l_controller = m_factory( t_car, m_factory_arg );
+
+    long l_max_cycles = m_config.cycles;
+    // a car which never finishes laps must stop too
+    if ( !l_max_cycles && m_config.time_limit_s <= 0 ) l_max_cycles = RUNNER_DEFAULT_CYCLES;
+
+    // laps are measured by position of car on track
+    LapTimer l_lap_timer( l_track, RUNNER_CRASH_CYCLES );
+    l_stats.laps = l_track ? 0 : -1;
+    CarPose l_pose;
+    if ( l_track && l_car.getPose( l_pose ) == 0 ) l_lap_timer.restart( l_pose );
+    bool l_lap_restart = false;
+
+    double l_start = runnerTime();
+    double l_sim_last = -1;
+    double l_sim_elapsed = 0;
+
+    while ( !l_max_cycles || l_stats.cycles < l_max_cycles )
+    {
+        unsigned char l_img[ CAR_CAM_RESOLUTION ];
+        if ( l_car.getImage( l_img ) < 0 )
+        {
+            fprintf( stderr, "Car %d: Unable to get image!\n", t_car );
+            l_stats.error = 1;
+            break;
+        }
+
+        CarCommands l_cmd;
+        l_controller->control( l_img, l_cmd );
+
+        l_car.beginCommands();
+        l_car.setServo( l_cmd.servo );
+        l_car.setMotorPWM( l_cmd.l_pwm, l_cmd.r_pwm );
+        l_car.commit();
+
+        l_stats.cycles++;
+
+        // the time limit is measured from the first image, the time can start again after reset
+        double l_sim_time = l_car.getSimTime();
+        if ( l_sim_last >= 0 && l_sim_time > l_sim_last ) l_sim_elapsed += l_sim_time - l_sim_last;
+        l_sim_last = l_sim_time;
+        if ( m_config.time_limit_s > 0 && l_sim_elapsed >= m_config.time_limit_s ) break;
+
+        if ( !l_track ) continue;
+
+        if ( l_car.getPose( l_pose ) < 0 ) continue;
+
+        // the pose before the first image after reset can be the old one
+        if ( l_lap_restart )
+        {
+            l_lap_timer.restart( l_pose );
+            l_lap_restart = false;
+            continue;
+        }
+
+        LapTimerEvent l_event = l_lap_timer.update( l_pose );
+        if ( l_event == LAPTIMER_OFF_TRACK )
+        {
+            // car out of track is reset to start
+            l_car.resetCar();
+            l_controller->reset();
+            l_lap_restart = true;
+        }
+        else if ( l_event == LAPTIMER_LAP && m_config.laps && l_lap_timer.getStats().laps >= m_config.laps )
+            break;
+    }
+
+    if ( l_track )
+    {
+        const LapTimerStats &l_laps = l_lap_timer.getStats();
+        l_stats.laps = l_laps.laps;
+        l_stats.best_lap_s = l_laps.best_lap_s;
+        l_stats.total_lap_s = l_laps.total_lap_s;
+        l_stats.avg_speed_m_s = l_laps.avg_speed_m_s;
+        l_stats.crashes = l_laps.off_track;
+        l_stats.max_offset_m = l_laps.max_offset_m;
+    }
+
+    l_stats.wall_time_s = runnerTime() - l_start;
+    if ( l_headless ) l_stats.sim_time_s = l_sim_elapsed;
+
+    delete l_controller;
+}
+
+
+void CarRunner::print( FILE *t_file ) const
+{
+    fprintf( t_file, "%4s %10s %10s %10s %6s %10s %10s %8s %8s %10s\n",
+            "car", "cycles", "sim [s]", "wall [s]", "laps", "best [s]", "avg [s]", "v [m/s]", "crashes", "offset [m]" );
+    for ( int i = 0; i < ( int ) m_car_stats.size(); i++ )
+    {
+        const RunnerCarStats &l_car = m_car_stats[ i ];
+        if ( l_car.error )
+        {
+            fprintf( t_file, "%4d %10s\n", i, "failed" );
+            continue;
+        }
+        fprintf( t_file, "%4d %10ld %10.2f %10.3f", i, l_car.cycles, l_car.sim_time_s, l_car.wall_time_s );
+        if ( l_car.laps < 0 )
+            fprintf( t_file, " %6s %10s %10s %8s %8s %10s\n", "n/a", "n/a", "n/a", "n/a", "n/a", "n/a" );
+        else if ( l_car.laps == 0 )
+            fprintf( t_file, " %6d %10s %10s %8s %8d %10.3f\n", 0, "-", "-", "-", l_car.crashes, l_car.max_offset_m );
+        else
+            fprintf( t_file, " %6d %10.2f %10.2f %8.2f %8d %10.3f\n", l_car.laps, l_car.best_lap_s,
+                    l_car.total_lap_s / l_car.laps, l_car.avg_speed_m_s, l_car.crashes, l_car.max_offset_m );
+    }
+
+    fprintf( t_file, "Cars: %d (failed %d), cycles: %ld, wall time: %.3f s, throughput: %.0f cycles/s\n",
+            m_stats.cars, m_stats.failed, m_stats.cycles, m_stats.wall_time_s, m_stats.cycles_per_s );
+    if ( m_stats.laps )
+        fprintf( t_file, "Laps: %d, best lap: %.2f s, average lap: %.2f s, crashes: %d\n",
+                m_stats.laps, m_stats.best_lap_s, m_stats.avg_lap_s, m_stats.crashes );
+}
+
@@ -0,0 +1,155 @@
+#pragma once
+
+/**
+ * @file runner.h
+ * @brief Module runner
+ *
+ * This module runner drives many car instances in parallel by a pool of worker threads.
+ * Every car has its own controller and control loop. The statistics of all cars are aggregated.
+ */
+
+#include <stdio.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "controller.h"
+#include "track_map.h"
+#include "metrics.h"
+
+/// The number of control cycles out of track, after which the car is counted as crashed and it is reset
+#define RUNNER_CRASH_CYCLES             50
+/// The number of control cycles when neither cycles nor time limit is specified
+#define RUNNER_DEFAULT_CYCLES           10000
+/// The cost of single crash in seconds, see \ref runnerCost
+#define RUNNER_CRASH_PENALTY_S          10.0
+
+/// Configuration of \ref CarRunner.
+struct RunnerConfig
+{
+    int cars;                           ///< Number of car instances.
+    int threads;                        ///< Number of worker threads, 0 for number of CPU cores.
+    int port;                           ///< Port of CoppeliaSim for the first car, next cars use next ports. Negative for headless cars.
+    bool synchronous;                   ///< Synchronous mode of CoppeliaSim.
+    const TrackMap *track;              ///< Track of all cars, nullptr for straight track.
+    const TrackMap *const *tracks;      ///< Tracks of cars, car i runs track i % track_count. nullptr to use track for all cars.
+    int track_count;                    ///< Number of tracks.
+    long cycles;                        ///< Maximal number of control cycles of every car, 0 unlimited.
+    int laps;                           ///< Number of laps of every car, 0 unlimited. It needs closed tracks, the cycles or time limit still apply.
+    double time_limit_s;                ///< Maximal simulation time of every car, 0 unlimited.
+    const char *record;                 ///< Prefix of telemetry files, the car index is appended. nullptr for no recording.
+    bool archive;                       ///< Record compressed line archives prefixN.lsa instead of telemetry files, see \ref LineArchiveWriter.
+    const char *metrics;                ///< Name of shared memory with live metrics, see \ref MetricsPublisher. nullptr for no metrics.
+};
+
+/// Statistics of single car.
+struct RunnerCarStats
+{
+    int error;                          ///< The car was not able to run.
+    int track;                          ///< Index of track in \ref RunnerConfig::tracks, 0 for the single track.
+    long cycles;                        ///< Number of control cycles.
+    double sim_time_s;                  ///< Simulation time (headless car only).
+    double wall_time_s;                 ///< Real time of control loop.
+    int laps;                           ///< Number of finished laps, -1 when not available.
+    double best_lap_s;                  ///< The best lap time.
+    double total_lap_s;                 ///< Time of all finished laps.
+    double avg_speed_m_s;               ///< Average speed of all finished laps, see \ref LapTimer.
+    int crashes;                        ///< Number of crashes (car out of track).
+    double max_offset_m;                ///< Maximal lateral distance from the track centre.
+};
+
+/// Aggregated statistics of all cars.
+struct RunnerStats
+{
+    int cars;                           ///< Number of cars.
+    int failed;                         ///< Number of cars which were not able to run.
+    long cycles;                        ///< Number of control cycles of all cars.
+    double wall_time_s;                 ///< Real time of whole run.
+    double cycles_per_s;                ///< Throughput of all cars.
+    int laps;                           ///< Number of laps of all cars.
+    double best_lap_s;                  ///< The best lap time of all cars.
+    double avg_lap_s;                   ///< Average lap time.
+    int crashes;                        ///< Number of crashes of all cars.
+};
+
+/** @brief The cost of single car run in seconds, lower is better.
+ *
+ * The cost is the average lap time, when the car finished t_laps laps (at least one).
+ * Otherwise it is the time limit increased by the part of unfinished laps, so a car which
+ * finished no lap costs twice the time limit. Every crash adds \ref RUNNER_CRASH_PENALTY_S.
+ *
+ * @param t_car The statistics of car.
+ * @param t_laps The number of laps of run, 0 when the run was limited by time only.
+ * @param t_time_limit_s The time limit of run.
+ * @return The cost, HUGE_VAL when the car was not able to run.
+ */
+double runnerCost( const RunnerCarStats &t_car, int t_laps, double t_time_limit_s );
+
+/** @brief Read track definitions from file, see \ref TrackMap::compile.
+ *
+ * Every line contains one track, the text after '#' is a comment and empty lines are skipped.
+ *
+ * @param t_file_name The name of file.
+ * @param t_tracks The vector where the tracks are appended.
+ * @return When the file was read it returns 0. Otherwise -1.
+ */
+int runnerReadTracks( const char *t_file_name, std::vector< std::string > &t_tracks );
+
+/// Function creating controller for car t_car. The controller is deleted by runner.
+typedef CarController *( *RunnerControllerFactory )( int t_car, void *t_arg );
+
+/**
+ * @brief The parallel runner of many cars.
+ *
+ * The cars are connected to CoppeliaSim instances on ports \ref RunnerConfig::port + car index
+ * (up to MAX_EXT_API_CONNECTIONS connections), or they are headless cars on \ref RunnerConfig::track.
+ * When a track is given, the laps and crashes are measured by \ref LapTimer from the pose of car.
+ * The scene of CoppeliaSim instance must contain the same track starting in the origin.
+ */
+class CarRunner
+{
+public:
+
+    /** @brief Constructor stores configuration.
+     *
+     * @param t_factory The function creating controller for every car.
+     * @param t_arg The argument of t_factory.
+     */
+    CarRunner( const RunnerConfig &t_config, RunnerControllerFactory t_factory, void *t_arg = nullptr );
+
+    /** @brief Run all cars and wait until all of them finish.
+     *
+     * @return When all cars finished correctly it returns 0. Otherwise -1.
+     */
+    int run();
+
+    /** @brief The aggregated statistics of the last run. */
+    const RunnerStats &getStats() const { return m_stats; }
+
+    /** @brief The statistics of every car of the last run. */
+    const std::vector< RunnerCarStats > &getCarStats() const { return m_car_stats; }
+
+    /** @brief Print statistics of all cars and aggregated statistics. */
+    void print( FILE *t_file ) const;
+
+protected:
+
+    /** @brief The worker thread function. */
+    static void *runnerThread( void *t_arg );
+
+    /** @brief The track of car, nullptr for straight track. */
+    const TrackMap *runnerTrack( int t_car ) const;
+
+    /** @brief Control loop of single car. */
+    void runnerCar( int t_car );
+
+    RunnerConfig m_config;              ///< Configuration
+    RunnerControllerFactory m_factory;  ///< Factory of controllers
+    void *m_factory_arg;                ///< Argument of factory
+    std::atomic< int > m_next_car;      ///< The next car for worker thread
+    std::vector< RunnerCarStats > m_car_stats; ///< Statistics of every car
+    RunnerStats m_stats;                ///< Aggregated statistics
+    MetricsPublisher m_metrics;         ///< Live metrics of cars
+
+};
+
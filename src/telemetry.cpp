@@ -0,0 +1,196 @@
+/**
+ * @file telemetry.cpp
+ * @brief Module telemetry
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/param.h>
+#include <sys/mman.h>
+
+#include "telemetry.h"
+
+
+TelemetryRecorder::TelemetryRecorder()
+{
+    m_fd = -1;
+    m_header = nullptr;
+    m_records = nullptr;
+    m_capacity = 0;
+    m_count = 0;
+    m_dropped = 0;
+}
+
+
+TelemetryRecorder::~TelemetryRecorder()
+{
+    close();
+}
+
+
+int TelemetryRecorder::open( const char *t_file_name, unsigned long t_capacity )
+{
+    if ( m_fd >= 0 ) return -1;
+
+    m_fd = ::open( t_file_name, O_RDWR | O_CREAT | O_TRUNC, 0644 );
+    if ( m_fd < 0 )
+    {
+        fprintf( stderr, "Unable to create telemetry file %s!\n", t_file_name );
+        return -1;
+    }
+
+    // the whole file is allocated in advance, the recording does not extend it
+    size_t l_size = TELEMETRY_HEADER_SIZE + t_capacity * sizeof( TelemetryRecord );
+    if ( posix_fallocate( m_fd, 0, l_size ) != 0 && ftruncate( m_fd, l_size ) < 0 )
+    {
+        fprintf( stderr, "Unable to allocate telemetry file %s!\n", t_file_name );
+        ::close( m_fd );
+        m_fd = -1;
+        return -1;
+    }
+
+    void *l_map = mmap( nullptr, l_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0 );
+    if ( l_map == MAP_FAILED )
+    {
+        fprintf( stderr, "Unable to map telemetry file %s!\n", t_file_name );
+        ::close( m_fd );
+        m_fd = -1;
+        return -1;
+    }
+    madvise( l_map, l_size, MADV_SEQUENTIAL );
+
+    m_header = ( TelemetryHeader * ) l_map;
+    m_records = ( TelemetryRecord * ) ( ( char * ) l_map + TELEMETRY_HEADER_SIZE );
+    m_capacity = t_capacity;
+    m_count = 0;
+    m_dropped = 0;
+
+    m_header->magic = TELEMETRY_MAGIC;
+    m_header->version = TELEMETRY_VERSION;
+    m_header->record_size = sizeof( TelemetryRecord );
+    m_header->resolution = CAR_CAM_RESOLUTION;
+    m_header->capacity = t_capacity;
+    m_header->count = 0;
+
+    return 0;
+}
+
+
+void TelemetryRecorder::close()
+{
+    if ( m_fd < 0 ) return;
+
+    size_t l_size = TELEMETRY_HEADER_SIZE + m_capacity * sizeof( TelemetryRecord );
+    munmap( m_header, l_size );
+
+    // the unused preallocated space is released
+    if ( ftruncate( m_fd, TELEMETRY_HEADER_SIZE + m_count * sizeof( TelemetryRecord ) ) < 0 )
+        fprintf( stderr, "Unable to truncate telemetry file!\n" );
+    ::close( m_fd );
+
+    m_fd = -1;
+    m_header = nullptr;
+    m_records = nullptr;
+}
+
+
+int TelemetryRecorder::append( const TelemetryRecord &t_record )
+{
+    if ( !m_records || m_count >= m_capacity )
+    {
+        m_dropped++;
+        return -1;
+    }
+
+    memcpy( &m_records[ m_count ], &t_record, sizeof( TelemetryRecord ) );
+    m_count++;
+
+    // the record is complete before the reader can see the new count
+    __atomic_store_n( &m_header->count, m_count, __ATOMIC_RELEASE );
+
+    return 0;
+}
+
+
+RecordingCar::RecordingCar( Car &t_car, TelemetrySink &t_recorder ) : m_car( t_car ), m_recorder( t_recorder )
+{
+    memset( &m_record, 0, sizeof( m_record ) );
+    m_pending = false;
+}
+
+
+RecordingCar::~RecordingCar()
+{
+    if ( m_pending ) m_recorder.append( m_record );
+}
+
+
+int RecordingCar::getImage( unsigned char *t_img )
+{
+    // the commands of previous image are complete now
+    if ( m_pending ) m_recorder.append( m_record );
+    m_pending = false;
+
+    if ( m_car.getImage( m_record.image ) < 0 ) return -1;
+
+    m_record.flags = 0;
+    timespec l_ts;
+    clock_gettime( CLOCK_MONOTONIC, &l_ts );
+    m_record.wall_time = l_ts.tv_sec + l_ts.tv_nsec * 1e-9;
+    m_record.sim_time = m_car.getSimTime();
+    m_pending = true;
+
+    if ( t_img )
+        memcpy( t_img, m_record.image, CAR_CAM_RESOLUTION );
+
+    return 0;
+}
+
+
+void RecordingCar::setServo( float t_position )
+{
+    m_record.servo = MIN( MAX( t_position, -1.0 ), 1.0 );
+    m_car.setServo( t_position );
+}
+
+
+void RecordingCar::setMotorPWM( float t_l_pwm, float t_r_pwm )
+{
+    m_record.l_pwm = MIN( MAX( t_l_pwm, -1.0 ), 1.0 );
+    m_record.r_pwm = MIN( MAX( t_r_pwm, -1.0 ), 1.0 );
+    m_car.setMotorPWM( t_l_pwm, t_r_pwm );
+}
+
+
+void RecordingCar::resetCar()
+{
+    // the replay resets its controller after this record
+    if ( m_pending ) m_record.flags |= TELEMETRY_FLAG_RESET;
+    m_record.servo = 0;
+    m_record.l_pwm = 0;
+    m_record.r_pwm = 0;
+    m_car.resetCar();
+}
+
+
+void RecordingCar::beginCommands()
+{
+    m_car.beginCommands();
+}
+
+
+int RecordingCar::commit()
+{
+    return m_car.commit();
+}
+
+
+double RecordingCar::getSimTime()
+{
+    return m_car.getSimTime();
+}
+
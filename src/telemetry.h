@@ -0,0 +1,158 @@
+#pragma once
+
+/**
+ * @file telemetry.h
+ * @brief Module telemetry
+ *
+ * This module telemetry records images from line camera and commands of every control cycle
+ * to a binary file for a later analysis. The file is preallocated and memory mapped,
+ * so the recording is only a copy of record to memory without any system call.
+ */
+
+#include <stdint.h>
+
+#include "car.h"
+
+/// Identification of telemetry file "ALMK"
+#define TELEMETRY_MAGIC                 0x4b4d4c41
+/// Version of telemetry file format
+#define TELEMETRY_VERSION               1
+/// The size of file header, records start at the next memory page
+#define TELEMETRY_HEADER_SIZE           4096
+/// The default capacity of file, 4 hours of 100 Hz records
+#define TELEMETRY_DEFAULT_RECORDS       ( 4UL * 3600 * 100 )
+
+/// Header of telemetry file.
+struct TelemetryHeader
+{
+    uint32_t magic;                     ///< \ref TELEMETRY_MAGIC
+    uint32_t version;                   ///< \ref TELEMETRY_VERSION
+    uint32_t record_size;               ///< Size of \ref TelemetryRecord.
+    uint32_t resolution;                ///< Resolution of line camera.
+    uint64_t capacity;                  ///< Number of preallocated records.
+    uint64_t count;                     ///< Number of valid records, updated after every record.
+};
+
+/// The car was reset after the commands of record, the recorded commands are the neutral ones of reset
+#define TELEMETRY_FLAG_RESET            1
+
+/// Single record of telemetry: one control cycle.
+struct TelemetryRecord
+{
+    unsigned char image[ CAR_CAM_RESOLUTION ]; ///< Image from line camera.
+    float servo;                        ///< Servo position set after the image.
+    float l_pwm;                        ///< Power of left motor set after the image.
+    float r_pwm;                        ///< Power of right motor set after the image.
+    uint32_t flags;                     ///< Flags of control cycle, e.g. \ref TELEMETRY_FLAG_RESET.
+    double sim_time;                    ///< Simulation time of image in seconds.
+    double wall_time;                   ///< Real (monotonic) time of image in seconds.
+};
+
+/**
+ * @brief The destination of records of \ref RecordingCar.
+ */
+class TelemetrySink
+{
+public:
+
+    /** Destructor */
+    virtual ~TelemetrySink() {}
+
+    /** @brief Append record.
+     *
+     * @return When the record was stored, it returns 0. Otherwise -1.
+     */
+    virtual int append( const TelemetryRecord &t_record ) = 0;
+};
+
+/**
+ * @brief The writer of telemetry file.
+ *
+ * The file is preallocated for the given number of records and mapped to memory.
+ * Records are appended until the capacity is reached, the next records are only counted as dropped.
+ * When the file is closed, it is truncated to the valid records.
+ */
+class TelemetryRecorder : public TelemetrySink
+{
+public:
+
+    /** Constructor */
+    TelemetryRecorder();
+    /** Destructor closes file. */
+    ~TelemetryRecorder();
+
+    /** @brief Create and preallocate telemetry file.
+     *
+     * @param t_file_name The name of file.
+     * @param t_capacity The maximal number of records.
+     * @return When the file was created, it returns 0. Otherwise -1.
+     */
+    int open( const char *t_file_name, unsigned long t_capacity = TELEMETRY_DEFAULT_RECORDS );
+
+    /** @brief Close file and truncate it to valid records. */
+    void close();
+
+    /** @brief Append record.
+     *
+     * @return When the record was stored, it returns 0. When the file is full or closed -1.
+     */
+    int append( const TelemetryRecord &t_record ) override;
+
+    /** @brief The number of stored records. */
+    unsigned long getCount() const { return m_count; }
+
+    /** @brief The number of records dropped, because the file was full. */
+    unsigned long getDropped() const { return m_dropped; }
+
+protected:
+
+    int m_fd;                           ///< File descriptor
+    TelemetryHeader *m_header;          ///< Mapped file
+    TelemetryRecord *m_records;         ///< Mapped records
+    unsigned long m_capacity;           ///< Capacity of file
+    unsigned long m_count;              ///< Number of stored records
+    unsigned long m_dropped;            ///< Number of dropped records
+
+};
+
+/**
+ * @brief Car recording telemetry of another car.
+ *
+ * All calls are passed to the recorded car. The image of every \ref getImage
+ * is stored together with the commands set after it and with the simulation and real time.
+ */
+class RecordingCar : public Car
+{
+public:
+
+    /** @brief Constructor.
+     *
+     * @param t_car The recorded car.
+     * @param t_recorder The opened recorder, \ref TelemetryRecorder or \ref LineArchiveWriter.
+     */
+    RecordingCar( Car &t_car, TelemetrySink &t_recorder );
+    /** Destructor stores the last record. */
+    virtual ~RecordingCar();
+
+    int getImage( unsigned char *t_img ) override;
+    void setServo( float t_position ) override;
+    void setMotorPWM( float t_l_pwm, float t_r_pwm ) override;
+    void resetCar() override;
+    void beginCommands() override;
+    int commit() override;
+    double getSimTime() override;
+    int getFrameFd() override { return m_car.getFrameFd(); }
+    int getPose( CarPose &t_pose ) override { return m_car.getPose( t_pose ); }
+    int saveSnapshot( CarSnapshot &t_snapshot ) override { return m_car.saveSnapshot( t_snapshot ); }
+    int restoreSnapshot( const CarSnapshot &t_snapshot ) override { return m_car.restoreSnapshot( t_snapshot ); }
+    void getFaults( CarFaults &t_faults ) override { m_car.getFaults( t_faults ); }
+
+protected:
+
+    Car &m_car;                         ///< The recorded car
+    TelemetrySink &m_recorder;          ///< The recorder
+    TelemetryRecord m_record;           ///< The record of the current control cycle
+    bool m_pending;                     ///< The current record is not stored yet
+
+};
+
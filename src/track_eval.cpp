@@ -0,0 +1,256 @@
+/**
+ * @file track_eval.cpp
+ * @brief Module track_eval
+ *
+ * This program evaluates \ref LineController on a list of tracks in one command.
+ * Every track is driven by one or more cars in parallel (\ref CarRunner) for a number of laps
+ * or until a time limit. The cars are headless or they are connected to several CoppeliaSim instances,
+ * the instance on port_number + i must have the track i (modulo number of tracks) selected.
+ *
+ * The result is a table of lap times, crashes and maximal lateral distance from the track centre
+ * for every track, and the score: the sum of costs of all tracks, the cost of track is the mean \ref runnerCost
+ * of its cars (the same cost as in gain_opt). A track which is not covered, i.e. not all laps are finished
+ * without crash, is penalized by the time limit and the crashes, so the score of such controller is never better.
+ *
+ * For more information see header files or use doxygen.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include <string>
+#include <vector>
+
+#include "runner.h"
+
+#define HELP                                                                \
+    "Usage: %s [-h] [-laps N] [-time S] [-repeat N] [-threads N] [-sync]\n" \
+    "          [-file name] [-track string]... [-param name=value]... port_number|-headless\n" \
+    "  -h               this help\n"                                        \
+    "  -laps N          laps on every track (default 3)\n"                  \
+    "  -time S          limit of simulation time on every track, also the cost\n" \
+    "                   of unfinished laps (default 120 s)\n"               \
+    "  -repeat N        number of cars on every track (default 1)\n"        \
+    "  -threads N       number of worker threads (default CPU cores)\n"     \
+    "  -sync            synchronous (lockstep) simulation mode\n"           \
+    "  -file name       file with track definitions, one per line, # for comments\n" \
+    "  -track string    track definition, it can be repeated\n"             \
+    "  -param name=value parameter of controller, it can be repeated\n"     \
+    "  port_number      port of the first CoppeliaSim, next cars use next ports\n" \
+    "  -headless        use headless car models instead of CoppeliaSim\n\n" \
+    "Without -file and -track the predefined tracks are evaluated.\n\n"
+
+/// The default time limit of single track in seconds
+#define EVAL_DEFAULT_TIME_S     120
+
+/// The predefined closed tracks
+static const char *g_eval_tracks[] =
+{
+    "S R S L S R S R S S S O R S S O S R",
+    "S R R S R R",
+    "S S S R R S S S R R",
+    "S R S R S R S R",
+    "S C S R R S C S R R",
+    "S O S R R S O S R R",
+    "S R S R S L S L S L S L S R S R",
+    "S I R R R I S L L L",
+    "S H S R R S U D S R R",
+};
+
+/// Aggregated results of one track
+struct EvalTrackStats
+{
+    int cars;                           ///< Number of cars on track
+    int failed;                         ///< Number of cars which were not able to run
+    int laps;                           ///< Number of finished laps
+    double best_lap_s;                  ///< The best lap time
+    double total_lap_s;                 ///< Time of all finished laps
+    double distance_m;                  ///< Odometry distance of all finished laps
+    int crashes;                        ///< Number of crashes
+    double max_offset_m;                ///< Maximal lateral distance from the track centre
+    double cost;                        ///< Sum of \ref runnerCost of all cars
+    bool covered;                       ///< All cars finished all laps without crash
+};
+
+/// Every car gets its own controller with the evaluated parameters
+CarController *evalControllerFactory( int t_car, void *t_arg )
+{
+    return new LineController( *( const LineControllerParams * ) t_arg );
+}
+
+int main( int argc, char* argv[] )
+{
+    RunnerConfig l_config;
+    memset( &l_config, 0, sizeof( l_config ) );
+    l_config.port = -1;
+    l_config.laps = 3;
+    l_config.time_limit_s = EVAL_DEFAULT_TIME_S;
+
+    LineControllerParams l_params = g_line_controller_default;
+    std::vector< std::string > l_tracks;
+    int l_repeat = 1;
+    int l_help = 0;
+    int l_headless = 0;
+
+    for ( int i = 1; i < argc; i++ )
+    {
+        if ( !strcmp( argv[ i ], "-h" ) )
+        {
+            l_help = 1;
+        }
+        else if ( !strcmp( argv[ i ], "-sync" ) )
+        {
+            l_config.synchronous = true;
+        }
+        else if ( !strcmp( argv[ i ], "-headless" ) )
+        {
+            l_headless = 1;
+        }
+        else if ( i + 1 < argc && !strcmp( argv[ i ], "-laps" ) )
+        {
+            l_config.laps = atoi( argv[ ++i ] );
+        }
+        else if ( i + 1 < argc && !strcmp( argv[ i ], "-time" ) )
+        {
+            l_config.time_limit_s = atof( argv[ ++i ] );
+        }
+        else if ( i + 1 < argc && !strcmp( argv[ i ], "-repeat" ) )
+        {
+            l_repeat = atoi( argv[ ++i ] );
+        }
+        else if ( i + 1 < argc && !strcmp( argv[ i ], "-threads" ) )
+        {
+            l_config.threads = atoi( argv[ ++i ] );
+        }
+        else if ( i + 1 < argc && !strcmp( argv[ i ], "-file" ) )
+        {
+            if ( runnerReadTracks( argv[ ++i ], l_tracks ) < 0 ) exit( 1 );
+        }
+        else if ( i + 1 < argc && !strcmp( argv[ i ], "-track" ) )
+        {
+            l_tracks.push_back( argv[ ++i ] );
+        }
+        else if ( i + 1 < argc && !strcmp( argv[ i ], "-param" ) )
+        {
+            if ( lineControllerSetParam( l_params, argv[ ++i ] ) < 0 )
+            {
+                fprintf( stderr, "Unknown parameter %s!\n", argv[ i ] );
+                exit( 1 );
+            }
+        }
+        else if ( *argv[ i ] != '-' )
+        {
+            l_config.port = atoi( argv[ i ] );
+        }
+        else
+            l_help = 1;
+    }
+    if ( ( l_config.port < 0 && !l_headless ) || l_repeat < 1 || l_config.laps < 0 || l_help
+            || l_config.time_limit_s <= 0 )
+    {
+        printf( HELP, argv[ 0 ] );
+        exit( 0 );
+    }
+    if ( l_headless ) l_config.port = -1;
+
+    if ( l_tracks.empty() )
+        l_tracks.assign( g_eval_tracks, g_eval_tracks + sizeof( g_eval_tracks ) / sizeof( g_eval_tracks[ 0 ] ) );
+
+    // all tracks are compiled before the first car starts
+    int l_track_count = l_tracks.size();
+    std::vector< TrackMap > l_maps( l_track_count );
+    std::vector< const TrackMap * > l_map_ptrs( l_track_count );
+    for ( int i = 0; i < l_track_count; i++ )
+    {
+        if ( l_maps[ i ].compile( l_tracks[ i ].c_str() ) < 0 )
+        {
+            fprintf( stderr, "Unable to compile track %d \"%s\"!\n", i, l_tracks[ i ].c_str() );
+            exit( 1 );
+        }
+        if ( l_config.laps && !l_maps[ i ].isClosed() )
+        {
+            fprintf( stderr, "Track %d is not closed (%.2f m), laps will not be finished!\n", i, l_maps[ i ].getClosureError() );
+            exit( 1 );
+        }
+        l_map_ptrs[ i ] = &l_maps[ i ];
+    }
+
+    l_config.tracks = l_map_ptrs.data();
+    l_config.track_count = l_track_count;
+    l_config.cars = l_track_count * l_repeat;
+
+    printf( "Controller: " );
+    lineControllerPrintParams( stdout, l_params );
+    printf( "Tracks: %d, cars: %d, laps: %d, time limit: %.0f s\n\n",
+            l_track_count, l_config.cars, l_config.laps, l_config.time_limit_s );
+
+    CarRunner l_runner( l_config, evalControllerFactory, &l_params );
+    int l_ret = l_runner.run();
+
+    // results of all cars on the same track are merged
+    std::vector< EvalTrackStats > l_results( l_track_count );
+    memset( l_results.data(), 0, sizeof( EvalTrackStats ) * l_track_count );
+    for ( const RunnerCarStats &l_car : l_runner.getCarStats() )
+    {
+        EvalTrackStats &l_result = l_results[ l_car.track ];
+        l_result.cars++;
+        l_result.cost += runnerCost( l_car, l_config.laps, l_config.time_limit_s );
+        if ( l_car.error )
+        {
+            l_result.failed++;
+            continue;
+        }
+        if ( l_car.laps > 0 )
+        {
+            if ( !l_result.laps || l_car.best_lap_s < l_result.best_lap_s ) l_result.best_lap_s = l_car.best_lap_s;
+            l_result.laps += l_car.laps;
+            l_result.total_lap_s += l_car.total_lap_s;
+            l_result.distance_m += l_car.avg_speed_m_s * l_car.total_lap_s;
+        }
+        l_result.crashes += l_car.crashes;
+        l_result.max_offset_m = MAX( l_result.max_offset_m, l_car.max_offset_m );
+    }
+
+    printf( "%5s %5s %10s %10s %8s %8s %10s %10s  %s\n",
+            "track", "laps", "best [s]", "avg [s]", "v [m/s]", "crashes", "offset [m]", "cost [s]", "definition" );
+    int l_covered = 0;
+    int l_crashes = 0;
+    double l_score = 0;
+    for ( int i = 0; i < l_track_count; i++ )
+    {
+        EvalTrackStats &l_result = l_results[ i ];
+        int l_expected = l_config.laps ? l_config.laps * l_result.cars : 1;
+        l_result.covered = !l_result.failed && !l_result.crashes && l_result.laps >= l_expected;
+        l_crashes += l_result.crashes;
+
+        printf( "%5d", i );
+        if ( l_result.failed )
+            printf( " %5s %10s %10s %8s %8s %10s", "fail", "-", "-", "-", "-", "-" );
+        else if ( !l_result.laps )
+            printf( " %5d %10s %10s %8s %8d %10.3f", 0, "-", "-", "-", l_result.crashes, l_result.max_offset_m );
+        else
+        {
+            double l_avg = l_result.total_lap_s / l_result.laps;
+            printf( " %5d %10.2f %10.2f %8.2f %8d %10.3f", l_result.laps, l_result.best_lap_s, l_avg,
+                    l_result.distance_m / l_result.total_lap_s, l_result.crashes, l_result.max_offset_m );
+        }
+        double l_cost = l_result.cost / l_result.cars;
+        l_score += l_cost;
+        printf( " %10.2f%s %s\n", l_cost, l_result.covered ? " " : "*", l_tracks[ i ].c_str() );
+
+        if ( l_result.covered ) l_covered++;
+    }
+
+    const RunnerStats &l_stats = l_runner.getStats();
+    printf( "\nCoverage: %d/%d tracks (* not covered), crashes: %d\n", l_covered, l_track_count, l_crashes );
+    printf( "Score: %.2f s (sum of costs: average lap time, time limit for unfinished laps, %.0f s per crash)\n",
+            l_score, RUNNER_CRASH_PENALTY_S );
+    printf( "Cycles: %ld, wall time: %.3f s, throughput: %.0f cycles/s\n",
+            l_stats.cycles, l_stats.wall_time_s, l_stats.cycles_per_s );
+
+    if ( l_ret < 0 ) return 1;
+    return l_covered == l_track_count ? 0 : 2;
+}
+
@@ -0,0 +1,441 @@
+/**
+ * @file track_map.cpp
+ * @brief Module track_map
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <sys/param.h>
+
+#include "track_map.h"
+
+/// The maximal number of segments crossed by single camera line
+#define TRACK_MAX_CANDIDATES            64
+
+/// Half width of track including border lines
+#define TRACK_OUTER_HW                  ( HEADLESS_TRACK_WIDTH_M / 2 )
+/// Half width of white track surface
+#define TRACK_INNER_HW                  ( HEADLESS_TRACK_WIDTH_M / 2 - HEADLESS_TRACK_LINE_WIDTH_M )
+
+
+int TrackMap::compile( const char *t_track )
+{
+    m_segments.clear();
+    m_end_x = 0;
+    m_end_y = 0;
+    m_end_yaw = 0;
+    m_length = 0;
+
+    // offset: shift to the left and back to the original direction
+    static const float l_offset_angles[] = { 1, -2, 1 };
+    // chicane: swing to the left, right and left, the heading is antisymmetric along the part,
+    // so the lateral shifts cancel and the part ends on the line of its start
+    static const float l_chicane_angles[] = { 1, -2, 2, -2, 1 };
+
+    for ( const char *l_c = t_track; *l_c; l_c++ )
+    {
+        switch ( toupper( *l_c ) )
+        {
+            case 'S':
+            case 'I':
+            case 'U':
+            case 'D':
+                trackAddLine( toupper( *l_c ), TRACK_PART_LENGTH_M );
+                break;
+            case 'H':
+                trackAddLine( 'H', 2 * TRACK_PART_LENGTH_M );
+                break;
+            case 'L':
+                trackAddArc( 'L', TRACK_CURVE_RADIUS_M, M_PI / 2 );
+                break;
+            case 'R':
+                trackAddArc( 'R', TRACK_CURVE_RADIUS_M, -M_PI / 2 );
+                break;
+            case 'O':
+                if ( trackAddArcs( 'O', l_offset_angles, sizeof( l_offset_angles ) / sizeof( float ) ) < 0 )
+                {
+                    m_segments.clear();
+                    return -1;
+                }
+                break;
+            case 'C':
+                if ( trackAddArcs( 'C', l_chicane_angles, sizeof( l_chicane_angles ) / sizeof( float ) ) < 0 )
+                {
+                    m_segments.clear();
+                    return -1;
+                }
+                break;
+            case ' ':
+            case '\t':
+            case '\n':
+                break;
+            default:
+                fprintf( stderr, "Unknown track part '%c'!\n", *l_c );
+                m_segments.clear();
+                return -1;
+        }
+    }
+
+    if ( m_segments.empty() )
+    {
+        fprintf( stderr, "Empty track!\n" );
+        return -1;
+    }
+
+    m_closure_error = hypotf( m_end_x, m_end_y );
+
+    trackBuildIndex();
+
+    return 0;
+}
+
+
+void TrackMap::trackAddLine( char t_part, float t_length )
+{
+    TrackSegment l_seg;
+    memset( &l_seg, 0, sizeof( l_seg ) );
+
+    l_seg.type = TRACK_SEG_LINE;
+    l_seg.part = t_part;
+    l_seg.x0 = m_end_x;
+    l_seg.y0 = m_end_y;
+    l_seg.yaw0 = m_end_yaw;
+    l_seg.ux = cosf( m_end_yaw );
+    l_seg.uy = sinf( m_end_yaw );
+    l_seg.length = t_length;
+    l_seg.s0 = m_length;
+
+    m_end_x += t_length * cosf( m_end_yaw );
+    m_end_y += t_length * sinf( m_end_yaw );
+    m_length += t_length;
+
+    l_seg.min_x = MIN( l_seg.x0, m_end_x ) - TRACK_OUTER_HW;
+    l_seg.min_y = MIN( l_seg.y0, m_end_y ) - TRACK_OUTER_HW;
+    l_seg.max_x = MAX( l_seg.x0, m_end_x ) + TRACK_OUTER_HW;
+    l_seg.max_y = MAX( l_seg.y0, m_end_y ) + TRACK_OUTER_HW;
+
+    m_segments.push_back( l_seg );
+}
+
+
+void TrackMap::trackAddArc( char t_part, float t_radius, float t_angle )
+{
+    TrackSegment l_seg;
+    memset( &l_seg, 0, sizeof( l_seg ) );
+
+    l_seg.type = TRACK_SEG_ARC;
+    l_seg.part = t_part;
+    l_seg.x0 = m_end_x;
+    l_seg.y0 = m_end_y;
+    l_seg.yaw0 = m_end_yaw;
+    l_seg.length = t_radius * fabsf( t_angle );
+    l_seg.s0 = m_length;
+    l_seg.radius = t_radius;
+    l_seg.turn = t_angle > 0 ? 1 : -1;
+
+    // the directions are used by every rendered line, they are computed only once
+    float l_yaw1 = l_seg.yaw0 + l_seg.turn * l_seg.length / l_seg.radius;
+    l_seg.ux = cosf( l_seg.yaw0 );
+    l_seg.uy = sinf( l_seg.yaw0 );
+    l_seg.u1x = cosf( l_yaw1 );
+    l_seg.u1y = sinf( l_yaw1 );
+
+    // the centre is on the left side for left turn
+    l_seg.cx = m_end_x - l_seg.turn * t_radius * sinf( m_end_yaw );
+    l_seg.cy = m_end_y + l_seg.turn * t_radius * cosf( m_end_yaw );
+
+    m_end_yaw = remainderf( m_end_yaw + t_angle, 2 * M_PI );
+    m_end_x = l_seg.cx + l_seg.turn * t_radius * sinf( m_end_yaw );
+    m_end_y = l_seg.cy - l_seg.turn * t_radius * cosf( m_end_yaw );
+    m_length += l_seg.length;
+
+    // whole circle is conservative bounding box
+    l_seg.min_x = l_seg.cx - t_radius - TRACK_OUTER_HW;
+    l_seg.min_y = l_seg.cy - t_radius - TRACK_OUTER_HW;
+    l_seg.max_x = l_seg.cx + t_radius + TRACK_OUTER_HW;
+    l_seg.max_y = l_seg.cy + t_radius + TRACK_OUTER_HW;
+
+    m_segments.push_back( l_seg );
+}
+
+
+int TrackMap::trackAddArcs( char t_part, const float *t_angles, int t_count )
+{
+    float l_x0 = m_end_x, l_y0 = m_end_y, l_yaw0 = m_end_yaw;
+
+    float l_angle = TRACK_CHICANE_ANGLE_DEG * M_PI / 180;
+
+    // the advance of arcs with unit radius in the original direction
+    float l_yaw = 0, l_advance = 0;
+    for ( int i = 0; i < t_count; i++ )
+    {
+        float l_yaw1 = l_yaw + t_angles[ i ] * l_angle;
+        l_advance += fabsf( sinf( l_yaw1 ) - sinf( l_yaw ) );
+        l_yaw = l_yaw1;
+    }
+
+    // the radius is scaled to the length of part
+    float l_radius = TRACK_PART_LENGTH_M / l_advance;
+    if ( t_part == 'O' )
+    {
+        // the shift of offset is given, the angle is computed from the length
+        l_angle = 2 * atanf( 2 * TRACK_OFFSET_M / TRACK_PART_LENGTH_M );
+        l_radius = TRACK_PART_LENGTH_M / ( 4 * sinf( l_angle ) );
+    }
+
+    for ( int i = 0; i < t_count; i++ )
+        trackAddArc( t_part, l_radius, t_angles[ i ] * l_angle );
+
+    // the part replaces straight part, it has to end as the straight part
+    float l_dx = m_end_x - l_x0, l_dy = m_end_y - l_y0;
+    float l_advance_err = l_dx * cosf( l_yaw0 ) + l_dy * sinf( l_yaw0 ) - TRACK_PART_LENGTH_M;
+    float l_lateral_err = -l_dx * sinf( l_yaw0 ) + l_dy * cosf( l_yaw0 );
+    float l_yaw_err = remainderf( m_end_yaw - l_yaw0, 2 * M_PI );
+    if ( fabsf( l_advance_err ) > TRACK_PART_END_TOLERANCE_M || fabsf( l_lateral_err ) > TRACK_PART_END_TOLERANCE_M
+            || fabsf( l_yaw_err ) > TRACK_PART_END_TOLERANCE_M / TRACK_PART_LENGTH_M )
+    {
+        fprintf( stderr, "Track part '%c' does not end on the line of its start (%.4f m, %.4f m, %.4f rad)!\n",
+                t_part, l_advance_err, l_lateral_err, l_yaw_err );
+        return -1;
+    }
+
+    return 0;
+}
+
+
+void TrackMap::trackBuildIndex()
+{
+    float l_max_x = m_segments[ 0 ].max_x, l_max_y = m_segments[ 0 ].max_y;
+    m_grid_x = m_segments[ 0 ].min_x;
+    m_grid_y = m_segments[ 0 ].min_y;
+    for ( const TrackSegment &l_seg : m_segments )
+    {
+        m_grid_x = MIN( m_grid_x, l_seg.min_x );
+        m_grid_y = MIN( m_grid_y, l_seg.min_y );
+        l_max_x = MAX( l_max_x, l_seg.max_x );
+        l_max_y = MAX( l_max_y, l_seg.max_y );
+    }
+    m_grid_cols = ( int ) ( ( l_max_x - m_grid_x ) / TRACK_GRID_CELL_M ) + 1;
+    m_grid_rows = ( int ) ( ( l_max_y - m_grid_y ) / TRACK_GRID_CELL_M ) + 1;
+
+    // count items of every cell, then fill them
+    m_cell_start.assign( m_grid_cols * m_grid_rows + 1, 0 );
+    for ( int l_pass = 0; l_pass < 2; l_pass++ )
+    {
+        std::vector< int > l_fill( m_cell_start.begin(), m_cell_start.end() - 1 );
+        for ( int i = 0; i < ( int ) m_segments.size(); i++ )
+        {
+            const TrackSegment &l_seg = m_segments[ i ];
+            int l_c0 = ( int ) ( ( l_seg.min_x - m_grid_x ) / TRACK_GRID_CELL_M );
+            int l_c1 = ( int ) ( ( l_seg.max_x - m_grid_x ) / TRACK_GRID_CELL_M );
+            int l_r0 = ( int ) ( ( l_seg.min_y - m_grid_y ) / TRACK_GRID_CELL_M );
+            int l_r1 = ( int ) ( ( l_seg.max_y - m_grid_y ) / TRACK_GRID_CELL_M );
+            for ( int r = l_r0; r <= l_r1; r++ )
+                for ( int c = l_c0; c <= l_c1; c++ )
+                {
+                    if ( l_pass == 0 )
+                        m_cell_start[ r * m_grid_cols + c + 1 ]++;
+                    else
+                        m_cell_items[ l_fill[ r * m_grid_cols + c ]++ ] = i;
+                }
+        }
+        if ( l_pass == 0 )
+        {
+            for ( int i = 1; i < ( int ) m_cell_start.size(); i++ )
+                m_cell_start[ i ] += m_cell_start[ i - 1 ];
+            m_cell_items.resize( m_cell_start.back() );
+        }
+    }
+}
+
+
+int TrackMap::trackCandidates( float t_min_x, float t_min_y, float t_max_x, float t_max_y, int *t_segs, int t_max ) const
+{
+    int l_c0 = MAX( ( int ) floorf( ( t_min_x - m_grid_x ) / TRACK_GRID_CELL_M ), 0 );
+    int l_c1 = MIN( ( int ) floorf( ( t_max_x - m_grid_x ) / TRACK_GRID_CELL_M ), m_grid_cols - 1 );
+    int l_r0 = MAX( ( int ) floorf( ( t_min_y - m_grid_y ) / TRACK_GRID_CELL_M ), 0 );
+    int l_r1 = MIN( ( int ) floorf( ( t_max_y - m_grid_y ) / TRACK_GRID_CELL_M ), m_grid_rows - 1 );
+
+    int l_count = 0;
+    for ( int r = l_r0; r <= l_r1; r++ )
+        for ( int c = l_c0; c <= l_c1; c++ )
+            for ( int i = m_cell_start[ r * m_grid_cols + c ]; i < m_cell_start[ r * m_grid_cols + c + 1 ]; i++ )
+            {
+                int l_seg = m_cell_items[ i ];
+                int j = 0;
+                while ( j < l_count && t_segs[ j ] != l_seg ) j++;
+                if ( j == l_count && l_count < t_max ) t_segs[ l_count++ ] = l_seg;
+            }
+
+    return l_count;
+}
+
+
+/// Limit the interval <t_lo, t_hi> to values where t_a + t_b * t >= 0
+static bool trackHalfPlane( float t_a, float t_b, float &t_lo, float &t_hi )
+{
+    if ( t_b == 0 ) return t_a >= 0;
+
+    float l_t = -t_a / t_b;
+    if ( t_b > 0 )
+        t_lo = MAX( t_lo, l_t );
+    else
+        t_hi = MIN( t_hi, l_t );
+
+    return t_lo <= t_hi;
+}
+
+
+/// Interval of t where t_a * t^2 + t_b * t + t_c <= 0, t_a > 0
+static bool trackQuadratic( float t_a, float t_b, float t_c, float &t_lo, float &t_hi )
+{
+    float l_disc = t_b * t_b - 4 * t_a * t_c;
+    if ( l_disc < 0 ) return false;
+
+    l_disc = sqrtf( l_disc );
+    t_lo = ( -t_b - l_disc ) / ( 2 * t_a );
+    t_hi = ( -t_b + l_disc ) / ( 2 * t_a );
+
+    return true;
+}
+
+
+/// Fill pixels with centre inside of interval <t_lo, t_hi> of line
+static void trackFill( float t_lo, float t_hi, unsigned char t_value, unsigned char *t_img, int t_len )
+{
+    int l_i0 = MAX( ( int ) ceilf( t_lo * t_len - 0.5f ), 0 );
+    int l_i1 = MIN( ( int ) floorf( t_hi * t_len - 0.5f ), t_len - 1 );
+    if ( l_i1 >= l_i0 )
+        memset( t_img + l_i0, t_value, l_i1 - l_i0 + 1 );
+}
+
+
+/// Fill part of line crossing the band of segment with half width t_hw
+static void trackFillSegment( const TrackSegment &t_seg, float t_hw, float t_x0, float t_y0, float t_dx, float t_dy,
+                              unsigned char t_value, unsigned char *t_img, int t_len )
+{
+    if ( t_seg.type == TRACK_SEG_LINE )
+    {
+        float l_ux = t_seg.ux, l_uy = t_seg.uy;
+        float l_qx = t_x0 - t_seg.x0, l_qy = t_y0 - t_seg.y0;
+
+        // longitudinal and lateral position are linear along camera line
+        float l_u = l_qx * l_ux + l_qy * l_uy, l_du = t_dx * l_ux + t_dy * l_uy;
+        float l_v = l_ux * l_qy - l_uy * l_qx, l_dv = l_ux * t_dy - l_uy * t_dx;
+
+        float l_lo = 0, l_hi = 1;
+        if ( trackHalfPlane( l_u, l_du, l_lo, l_hi )
+                && trackHalfPlane( t_seg.length - l_u, -l_du, l_lo, l_hi )
+                && trackHalfPlane( t_hw - l_v, -l_dv, l_lo, l_hi )
+                && trackHalfPlane( t_hw + l_v, l_dv, l_lo, l_hi ) )
+            trackFill( l_lo, l_hi, t_value, t_img, t_len );
+
+        return;
+    }
+
+    // radius vectors of arc start and end
+    float l_r0x = t_seg.turn * t_seg.radius * t_seg.uy, l_r0y = -t_seg.turn * t_seg.radius * t_seg.ux;
+    float l_r1x = t_seg.turn * t_seg.radius * t_seg.u1y, l_r1y = -t_seg.turn * t_seg.radius * t_seg.u1x;
+    float l_qx = t_x0 - t_seg.cx, l_qy = t_y0 - t_seg.cy;
+
+    // the wedge of arc is intersection of two half planes
+    float l_lo = 0, l_hi = 1;
+    if ( !trackHalfPlane( t_seg.turn * ( l_r0x * l_qy - l_r0y * l_qx ), t_seg.turn * ( l_r0x * t_dy - l_r0y * t_dx ), l_lo, l_hi )
+            || !trackHalfPlane( t_seg.turn * ( l_qx * l_r1y - l_qy * l_r1x ), t_seg.turn * ( t_dx * l_r1y - t_dy * l_r1x ), l_lo, l_hi ) )
+        return;
+
+    // the squared distance from centre is quadratic along camera line
+    float l_a = t_dx * t_dx + t_dy * t_dy;
+    float l_b = 2 * ( l_qx * t_dx + l_qy * t_dy );
+    float l_c = l_qx * l_qx + l_qy * l_qy;
+
+    float l_out_lo, l_out_hi;
+    float l_r_out = t_seg.radius + t_hw;
+    if ( !trackQuadratic( l_a, l_b, l_c - l_r_out * l_r_out, l_out_lo, l_out_hi ) ) return;
+    l_out_lo = MAX( l_out_lo, l_lo );
+    l_out_hi = MIN( l_out_hi, l_hi );
+    if ( l_out_lo > l_out_hi ) return;
+
+    // the hole inside of inner edge splits the ring to two intervals
+    float l_in_lo, l_in_hi;
+    float l_r_in = t_seg.radius - t_hw;
+    if ( l_r_in <= 0 || !trackQuadratic( l_a, l_b, l_c - l_r_in * l_r_in, l_in_lo, l_in_hi ) )
+    {
+        trackFill( l_out_lo, l_out_hi, t_value, t_img, t_len );
+        return;
+    }
+
+    trackFill( l_out_lo, MIN( l_out_hi, l_in_lo ), t_value, t_img, t_len );
+    trackFill( MAX( l_out_lo, l_in_hi ), l_out_hi, t_value, t_img, t_len );
+}
+
+
+void TrackMap::renderLine( float t_x0, float t_y0, float t_x1, float t_y1, unsigned char *t_img, int t_len ) const
+{
+    memset( t_img, HEADLESS_PIXEL_FLOOR, t_len );
+
+    int l_segs[ TRACK_MAX_CANDIDATES ];
+    int l_count = trackCandidates( MIN( t_x0, t_x1 ), MIN( t_y0, t_y1 ), MAX( t_x0, t_x1 ), MAX( t_y0, t_y1 ),
+                                   l_segs, TRACK_MAX_CANDIDATES );
+
+    float l_dx = t_x1 - t_x0, l_dy = t_y1 - t_y0;
+
+    // border lines at first, the surface of track covers lines of crossing track in intersection
+    for ( int i = 0; i < l_count; i++ )
+        trackFillSegment( m_segments[ l_segs[ i ] ], TRACK_OUTER_HW, t_x0, t_y0, l_dx, l_dy, HEADLESS_PIXEL_LINE, t_img, t_len );
+    for ( int i = 0; i < l_count; i++ )
+        trackFillSegment( m_segments[ l_segs[ i ] ], TRACK_INNER_HW, t_x0, t_y0, l_dx, l_dy, HEADLESS_PIXEL_TRACK, t_img, t_len );
+}
+
+
+void TrackMap::startPose( float &t_x, float &t_y, float &t_yaw ) const
+{
+    t_x = 0;
+    t_y = 0;
+    t_yaw = 0;
+}
+
+
+int TrackMap::locate( float t_x, float t_y, TrackLocation &t_loc ) const
+{
+    int l_segs[ TRACK_MAX_CANDIDATES ];
+    int l_count = trackCandidates( t_x, t_y, t_x, t_y, l_segs, TRACK_MAX_CANDIDATES );
+
+    int l_found = -1;
+    for ( int i = 0; i < l_count; i++ )
+    {
+        const TrackSegment &l_seg = m_segments[ l_segs[ i ] ];
+        float l_along, l_offset;
+
+        if ( l_seg.type == TRACK_SEG_LINE )
+        {
+            float l_ux = l_seg.ux, l_uy = l_seg.uy;
+            float l_qx = t_x - l_seg.x0, l_qy = t_y - l_seg.y0;
+            l_along = l_qx * l_ux + l_qy * l_uy;
+            l_offset = l_ux * l_qy - l_uy * l_qx;
+            if ( l_along < 0 || l_along > l_seg.length ) continue;
+        }
+        else
+        {
+            float l_r0x = l_seg.turn * l_seg.uy, l_r0y = -l_seg.turn * l_seg.ux;
+            float l_qx = t_x - l_seg.cx, l_qy = t_y - l_seg.cy;
+            float l_angle = atan2f( l_seg.turn * ( l_r0x * l_qy - l_r0y * l_qx ), l_r0x * l_qx + l_r0y * l_qy );
+            l_along = l_angle * l_seg.radius;
+            if ( l_along < 0 || l_along > l_seg.length ) continue;
+            l_offset = l_seg.turn * ( l_seg.radius - hypotf( l_qx, l_qy ) );
+        }
+
+        if ( fabsf( l_offset ) > TRACK_OUTER_HW ) continue;
+        if ( l_found >= 0 && fabsf( l_offset ) >= fabsf( t_loc.offset ) ) continue;
+
+        l_found = l_segs[ i ];
+        t_loc.segment = l_found;
+        t_loc.s = l_seg.s0 + l_along;
+        t_loc.offset = l_offset;
+    }
+
+    return l_found >= 0 ? 0 : -1;
+}
+
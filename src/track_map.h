@@ -0,0 +1,160 @@
+#pragma once
+
+/**
+ * @file track_map.h
+ * @brief Module track_map
+ *
+ * This module track_map compiles the track definition string of object TrackGenerator
+ * (e.g. "S R S L S R S R S S S O R S S O S R") to the geometry of track for the headless model.
+ * The image of line camera is rendered by analytic intersection of camera line with track segments.
+ */
+
+#include <vector>
+
+#include "headless_car.h"
+
+/// The length of one track part (straight, intersection, offset, chicane)
+#define TRACK_PART_LENGTH_M             0.6
+/// The radius of left and right curve (centre of track)
+#define TRACK_CURVE_RADIUS_M            0.6
+/// The lateral shift of track in the offset part
+#define TRACK_OFFSET_M                  0.05
+/// The angle of single turn of chicane
+#define TRACK_CHICANE_ANGLE_DEG         20
+/// The largest error of the end of offset or chicane against the end of straight part
+#define TRACK_PART_END_TOLERANCE_M      0.001
+/// The cell size of spatial index
+#define TRACK_GRID_CELL_M               0.5
+/// The largest distance between the end and the start of a closed track (laps can be counted)
+#define TRACK_MAX_CLOSURE_M             ( HEADLESS_TRACK_WIDTH_M / 2 )
+
+/// The type of track segment
+enum TrackSegmentType
+{
+    TRACK_SEG_LINE,                     ///< Straight segment
+    TRACK_SEG_ARC                       ///< Circular arc
+};
+
+/// Single segment of track geometry (the track part is composed from one or more segments).
+struct TrackSegment
+{
+    TrackSegmentType type;              ///< The type of segment.
+    char part;                          ///< The track part letter of segment.
+    float x0;                           ///< Start point of centre line.
+    float y0;                           ///< Start point of centre line.
+    float yaw0;                         ///< Start direction of centre line.
+    float ux;                           ///< Start direction as unit vector, cos( yaw0 ).
+    float uy;                           ///< Start direction as unit vector, sin( yaw0 ).
+    float u1x;                          ///< End direction of arc as unit vector.
+    float u1y;                          ///< End direction of arc as unit vector.
+    float length;                       ///< Length of centre line.
+    float s0;                           ///< Distance of segment start from the track start.
+    float radius;                       ///< Radius of arc.
+    float turn;                         ///< Turn direction of arc: 1 left, -1 right.
+    float cx;                           ///< Centre of arc.
+    float cy;                           ///< Centre of arc.
+    float min_x;                        ///< Bounding box of segment including track width.
+    float min_y;                        ///< Bounding box of segment including track width.
+    float max_x;                        ///< Bounding box of segment including track width.
+    float max_y;                        ///< Bounding box of segment including track width.
+};
+
+/// The position of a point related to the track.
+struct TrackLocation
+{
+    int segment;                        ///< The nearest segment index.
+    float s;                            ///< Distance along the track centre line from the track start.
+    float offset;                       ///< Lateral offset from the track centre, positive to the left.
+};
+
+/**
+ * @brief The track compiled from the track definition string.
+ *
+ * The parts of track are:
+ *   - S - Straight,
+ *   - L - Left,
+ *   - R - Right,
+ *   - H - Hill (long straight in the plane projection),
+ *   - U - Hill Up (straight in the plane projection),
+ *   - D - Hill Down (straight in the plane projection),
+ *   - I - Intersection (straight, crossed by other intersection part),
+ *   - O - Offset,
+ *   - C - Chicane.
+ *
+ * The dimensions of parts are approximation of parts of the CoppeliaSim scene.
+ * The track starts in [0, 0] in direction of x axis.
+ */
+class TrackMap : public HeadlessTrack
+{
+public:
+
+    /** @brief Compile track from definition string.
+     *
+     * @param t_track The track definition, the parts are separated by spaces.
+     * @return When the track was compiled correctly, it returns 0. Otherwise -1.
+     */
+    int compile( const char *t_track );
+
+    void renderLine( float t_x0, float t_y0, float t_x1, float t_y1, unsigned char *t_img, int t_len ) const override;
+    void startPose( float &t_x, float &t_y, float &t_yaw ) const override;
+
+    /** @brief Find the position of point related to track.
+     *
+     * @return When the point is on the track (including border lines), it returns 0. Otherwise -1.
+     */
+    int locate( float t_x, float t_y, TrackLocation &t_loc ) const;
+
+    /** @brief The length of track centre line. */
+    float getLength() const { return m_length; }
+
+    /** @brief The distance between the end and the start of track, 0 for a closed track. */
+    float getClosureError() const { return m_closure_error; }
+
+    /** @brief The end of track meets its start within \ref TRACK_MAX_CLOSURE_M, so the laps can be counted. */
+    bool isClosed() const { return m_closure_error <= TRACK_MAX_CLOSURE_M; }
+
+    /** @brief The compiled segments. */
+    const std::vector< TrackSegment > &getSegments() const { return m_segments; }
+
+protected:
+
+    /** @brief Append straight segment at the end of track. */
+    void trackAddLine( char t_part, float t_length );
+
+    /** @brief Append arc segment at the end of track. */
+    void trackAddArc( char t_part, float t_radius, float t_angle );
+
+    /** @brief Append sequence of arcs scaled to the length of part.
+     *
+     * The part has to end as a straight part of the same length, with the same heading
+     * and on the line of its start, otherwise the closure of track would depend on it.
+     *
+     * @param t_angles Turn angles of arcs, positive to the left.
+     * @return When the end of part is checked within \ref TRACK_PART_END_TOLERANCE_M, it returns 0. Otherwise -1.
+     */
+    int trackAddArcs( char t_part, const float *t_angles, int t_count );
+
+    /** @brief Build the spatial index of segments. */
+    void trackBuildIndex();
+
+    /** @brief Collect segments from cells overlapped by the bounding box. */
+    int trackCandidates( float t_min_x, float t_min_y, float t_max_x, float t_max_y, int *t_segs, int t_max ) const;
+
+    std::vector< TrackSegment > m_segments;     ///< The track geometry
+    float m_end_x;                              ///< The end of track during compilation
+    float m_end_y;                              ///< The end of track during compilation
+    float m_end_yaw;                            ///< The end of track during compilation
+    float m_length;                             ///< The length of track
+    float m_closure_error;                      ///< The distance between the end and the start
+
+    /// @name The spatial index, list of segments for every grid cell
+    /// @{
+    float m_grid_x;                             ///< Origin of grid
+    float m_grid_y;                             ///< Origin of grid
+    int m_grid_cols;                            ///< Number of grid columns
+    int m_grid_rows;                            ///< Number of grid rows
+    std::vector< int > m_cell_start;            ///< Index of the first item of cell in m_cell_items
+    std::vector< int > m_cell_items;            ///< Segment indexes of all cells
+    /// @}
+};
+
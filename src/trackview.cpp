@@ -18,7 +18,11 @@
 
 
 #include <unistd.h>
+#include <string.h>
+#include <time.h>
 #include <pthread.h>
+#include <atomic>
+#include <sys/param.h>
 #include <opencv2/highgui.hpp>
 #include <opencv2/imgproc.hpp>
 #include <opencv2/core.hpp>
@@ -28,49 +32,139 @@
 
 #define TRACKVIEW_WINNAME       "Track View"
 #define TRACKVIEW_WINHEIGHT     256
+/// The ring of lines is longer than window, the producer can continue while the display thread copies lines
+#define TRACKVIEW_RING_ROWS     ( 2 * TRACKVIEW_WINHEIGHT )
 
 cv::Mat g_trackview_img;
+int g_trackview_period_ms;
+/// The size of image of the camera, which trackview was started for
+int g_trackview_pixels;
+
+TrackviewStats g_trackview_stats;
+pthread_mutex_t g_trackview_stats_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 int g_trackview_initialized = 0;
-int g_trackview_thread_stop = 0;
+std::atomic< int > g_trackview_thread_stop( 0 );
 pthread_t g_trackview_thread_id;
 
-pthread_mutex_t g_trackview_mutex = PTHREAD_MUTEX_INITIALIZER;
+/// The ring of images written by trackviewAddImageT (single producer) and read by display thread (single consumer),
+/// every row is the whole image of camera, the lines of multi-line camera are side by side
+template< class t_camera >
+struct TrackviewRing
+{
+    static unsigned char rows[ TRACKVIEW_RING_ROWS ][ t_camera::pixels ];
+};
+
+template< class t_camera >
+unsigned char TrackviewRing< t_camera >::rows[ TRACKVIEW_RING_ROWS ][ t_camera::pixels ];
+
+/// The number of rows written to ring, the newest row is at ( head - 1 ) % TRACKVIEW_RING_ROWS
+std::atomic< unsigned long > g_trackview_head( 0 );
+
+
+/// Copy the newest rows from ring to the displayed image, the newest row at the top
+template< class t_camera >
+static void trackviewSnapshot( unsigned long t_head )
+{
+    while ( true )
+    {
+        for ( int i = 0; i < TRACKVIEW_WINHEIGHT; i++ )
+        {
+            if ( t_head > ( unsigned long ) i )
+                memcpy( g_trackview_img.ptr( i ), TrackviewRing< t_camera >::rows[ ( t_head - 1 - i ) % TRACKVIEW_RING_ROWS ], t_camera::pixels );
+            else
+                memset( g_trackview_img.ptr( i ), 255, t_camera::pixels );
+        }
+
+        // the copy is consistent when the producer did not start to overwrite the oldest copied line,
+        // the producer writes the line head % TRACKVIEW_RING_ROWS before it increments head
+        std::atomic_thread_fence( std::memory_order_acquire );
+        unsigned long l_head = g_trackview_head.load( std::memory_order_relaxed );
+        if ( l_head - t_head < TRACKVIEW_RING_ROWS - TRACKVIEW_WINHEIGHT ) return;
+
+        t_head = g_trackview_head.load( std::memory_order_acquire );
+    }
+}
+
+
+/// Current monotonic time in ms
+static double trackviewTimeMs()
+{
+    timespec l_ts;
+    clock_gettime( CLOCK_MONOTONIC, &l_ts );
+    return l_ts.tv_sec * 1000.0 + l_ts.tv_nsec / 1000000.0;
+}
 
 
 /// Internal thread function
+template< class t_camera >
 void *trackviewThread( void *t_arg )
 {
     if ( !g_trackview_initialized ) return nullptr;
 
+    unsigned long l_last_head = 0;
+    double l_next_redraw = trackviewTimeMs();
+
     while ( !g_trackview_thread_stop )
     {
-        pthread_mutex_lock( &g_trackview_mutex );
-
+        // GUI events are processed until the next redraw
+        int l_wait = ( int ) ( l_next_redraw - trackviewTimeMs() );
+        cv::waitKey( MAX( l_wait, 1 ) );
+        if ( trackviewTimeMs() < l_next_redraw ) continue;
+        // after a stall the schedule is anchored again, the missed redraws are not made up in a burst
+        l_next_redraw = MAX( l_next_redraw + g_trackview_period_ms, trackviewTimeMs() );
+
+        unsigned long l_head = g_trackview_head.load( std::memory_order_acquire );
+        if ( l_head == l_last_head ) continue;
+
+        // closed or hidden window is not redrawn, minimized or occluded window is still visible for GTK backend
+        if ( cv::getWindowProperty( TRACKVIEW_WINNAME, cv::WND_PROP_VISIBLE ) < 1 )
+        {
+            pthread_mutex_lock( &g_trackview_stats_mutex );
+            g_trackview_stats.skipped++;
+            pthread_mutex_unlock( &g_trackview_stats_mutex );
+            continue;
+        }
+
+        double l_start = trackviewTimeMs();
+
+        trackviewSnapshot< t_camera >( l_head );
         cv::imshow( TRACKVIEW_WINNAME, g_trackview_img );
 
-        cv::waitKey( 1 );
+        double l_render = trackviewTimeMs() - l_start;
+        l_last_head = l_head;
+
+        pthread_mutex_lock( &g_trackview_stats_mutex );
+        g_trackview_stats.frames++;
+        g_trackview_stats.avg_render_ms += ( l_render - g_trackview_stats.avg_render_ms ) / g_trackview_stats.frames;
+        g_trackview_stats.max_render_ms = MAX( g_trackview_stats.max_render_ms, l_render );
+        pthread_mutex_unlock( &g_trackview_stats_mutex );
     }
     return nullptr;
 }
 
 
-int trackviewStart()
+template< class t_camera >
+int trackviewStartT( int t_fps )
 {
     if ( g_trackview_initialized ) return 0;
+    if ( t_fps <= 0 ) return -1;
+
+    g_trackview_period_ms = MAX( 1000 / t_fps, 1 );
+    memset( &g_trackview_stats, 0, sizeof( g_trackview_stats ) );
 
-    g_trackview_img = cv::Mat( TRACKVIEW_WINHEIGHT, CAR_CAM_RESOLUTION, CV_8UC1 );
+    g_trackview_pixels = t_camera::pixels;
+    g_trackview_img = cv::Mat( TRACKVIEW_WINHEIGHT, t_camera::pixels, CV_8UC1 );
     g_trackview_img.setTo( 255 );
     cv::namedWindow( TRACKVIEW_WINNAME, CV_WINDOW_NORMAL );
-    cv::resizeWindow( TRACKVIEW_WINNAME, CAR_CAM_RESOLUTION * 2, TRACKVIEW_WINHEIGHT * 2 );
+    cv::resizeWindow( TRACKVIEW_WINNAME, t_camera::pixels * 2, TRACKVIEW_WINHEIGHT * 2 );
     cv::imshow( TRACKVIEW_WINNAME, g_trackview_img );
 
+    g_trackview_head = 0;
     g_trackview_initialized = 1;
     g_trackview_thread_stop = 0;
 
-    pthread_mutex_trylock( &g_trackview_mutex );
-
-    pthread_create( &g_trackview_thread_id, nullptr, trackviewThread, nullptr );
+    pthread_create( &g_trackview_thread_id, nullptr, trackviewThread< t_camera >, nullptr );
 
     return 0;
 }
@@ -81,7 +175,6 @@ int trackviewStop()
     if ( !g_trackview_initialized ) return -1;
 
     g_trackview_thread_stop = 1;
-    pthread_mutex_unlock( &g_trackview_mutex );
     pthread_join( g_trackview_thread_id, nullptr );
 
     g_trackview_img.release();
@@ -93,12 +186,37 @@ int trackviewStop()
 }
 
 
-void trackviewAddImage( unsigned char *t_img )
+template< class t_camera >
+void trackviewAddImageT( const unsigned char *t_img )
+{
+    // the image of other camera does not fit to the window
+    if ( g_trackview_pixels != t_camera::pixels ) return;
+
+    // only this function writes head, the display thread reads it
+    unsigned long l_head = g_trackview_head.load( std::memory_order_relaxed );
+    memcpy( TrackviewRing< t_camera >::rows[ l_head % TRACKVIEW_RING_ROWS ], t_img, t_camera::pixels );
+    g_trackview_head.store( l_head + 1, std::memory_order_release );
+}
+
+
+int trackviewGetStats( TrackviewStats &t_stats )
 {
-    memmove( g_trackview_img.ptr( 1 ), g_trackview_img.ptr( 0 ), sizeof( uchar ) * ( g_trackview_img.total() - g_trackview_img.cols ) );
-    memcpy( g_trackview_img.ptr( 0 ), t_img, sizeof( uchar ) * g_trackview_img.cols );
+    if ( !g_trackview_initialized ) return -1;
 
-    pthread_mutex_unlock( &g_trackview_mutex );
+    pthread_mutex_lock( &g_trackview_stats_mutex );
+    t_stats = g_trackview_stats;
+    pthread_mutex_unlock( &g_trackview_stats_mutex );
+
+    t_stats.lines = g_trackview_head.load( std::memory_order_relaxed );
+
+    return 0;
 }
 
 
+// trackview is compiled for all supported cameras
+template int trackviewStartT< CarCameraLine128 >( int );
+template int trackviewStartT< CarCameraLine256 >( int );
+template int trackviewStartT< CarCameraDual128 >( int );
+template void trackviewAddImageT< CarCameraLine128 >( const unsigned char * );
+template void trackviewAddImageT< CarCameraLine256 >( const unsigned char * );
+template void trackviewAddImageT< CarCameraDual128 >( const unsigned char * );
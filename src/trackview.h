@@ -10,16 +10,43 @@
  * This project was developed as part of Bachelor thesis (2019) by michal.vasut.st@vsb.cz, see http://dspace.vsb.cz.
  *
  * The module trackview displays images captured by vision sensor using OpenCV library.
+ * The window width follows the camera (\ref CarCamera), the lines of multi-line camera are displayed side by side.
  */
 
+#include "car.h"
+
+/// The default refresh rate of trackview window
+#define TRACKVIEW_DEFAULT_FPS   30
+
+/// Statistics of trackview window refresh.
+struct TrackviewStats
+{
+    unsigned long lines;                ///< Number of lines added by \ref trackviewAddImage.
+    unsigned long frames;               ///< Number of window redraws.
+    unsigned long skipped;              ///< Number of redraws skipped, because window was closed or hidden (not minimized, see \ref trackviewStartT).
+    double avg_render_ms;               ///< Average time of single redraw.
+    double max_render_ms;               ///< Maximal time of single redraw.
+};
+
 /** 
  * @brief Function starts trackview.
  *
  * This function initializes all necessary data to display captured images. 
  * It creates standalone thread and open an associate window to continuously display captured data. 
+ * The window is redrawn with limited refresh rate independently on the rate of captured images, 
+ * all lines added between two redraws are displayed together. 
+ * When the window is not visible, the redraw is skipped. The visibility is reported by the HighGUI backend, 
+ * GTK reports minimized or occluded window as visible, so such window is still redrawn. 
+ *
+ * @tparam t_camera The camera of images, see \ref CarCamera.
+ * @param t_fps The refresh rate of window.
  * @return When trackview started without error, return 0. Otherwise return -1. 
  */
-int trackviewStart();
+template< class t_camera >
+int trackviewStartT( int t_fps = TRACKVIEW_DEFAULT_FPS );
+
+/** @brief Function starts trackview for the default camera, see \ref trackviewStartT. */
+inline int trackviewStart( int t_fps = TRACKVIEW_DEFAULT_FPS ) { return trackviewStartT< CarDefaultCamera >( t_fps ); }
 
 /**
  * @brief Function stops trackview.
@@ -36,8 +63,27 @@ int trackviewStop();
  * This function adds one single line image at the top of previous images. 
  * The oldest one line is automatically removed. 
  * The content of associated windows is refreshed automatically. 
+ *
+ * The line is only copied to a ring of lines without any locking, 
+ * the displayed image is assembled by the trackview thread. 
+ * The function must be called from a single thread. 
+ * The image of other camera than the one of \ref trackviewStartT is ignored.
+ *
+ * @tparam t_camera The camera of image, see \ref CarCamera.
+ * @param t_img The image of t_camera::pixels.
  */ 
-void trackviewAddImage( unsigned char *t_img );
+template< class t_camera >
+void trackviewAddImageT( const unsigned char *t_img );
+
+/** @brief Add image of the default camera, see \ref trackviewAddImageT. */
+inline void trackviewAddImage( unsigned char *t_img ) { trackviewAddImageT< CarDefaultCamera >( t_img ); }
+
+/**
+ * @brief Get statistics of trackview window refresh.
+ *
+ * @return When trackview is running, return 0. Otherwise return -1. 
+ */
+int trackviewGetStats( TrackviewStats &t_stats );
 
 
 